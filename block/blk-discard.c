@@ -0,0 +1,597 @@
+/*
+ * Background discard
+ *
+ * Discarding freed blocks right away, as ext4 and f2fs do when mounted with
+ * -o discard, puts a synchronous discard into every unlink and checkpoint,
+ * and on eMMC a discard can take tens of milliseconds. Instead filesystems
+ * can hand freed extents to blkdev_queue_discard(), which keeps them in a
+ * per-queue tree, merging adjacent and overlapping ones, and returns. A
+ * worker issues them once the device has been idle for discard_idle_ms, as
+ * large asynchronous discards and at most discard_rate_mb per second. When
+ * too many extents pile up or the device never goes idle, they are issued
+ * anyway.
+ *
+ * Freed blocks may be reallocated and written before their discard goes
+ * out. A write to a queued extent therefore cuts it out of the extent, and
+ * a write to one whose discard is in flight waits for it to complete. The
+ * filesystem calls blkdev_discard_flush() before it lets go of the device.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "blk.h"
+
+#define DISCARD_DEFAULT_IDLE_MS	50
+#define DISCARD_DEFAULT_RATE_MB	256
+/* issue without waiting for idle above this many queued extents */
+#define DISCARD_MAX_PENDING	4096
+/* or when the oldest has waited this long */
+#define DISCARD_MAX_DELAY	(10 * HZ)
+
+struct discard_extent {
+	struct rb_node		node;
+	struct list_head	list;	/* on the issue list */
+	struct block_device	*bdev;	/* queued for, possibly a partition */
+	sector_t		sector;	/* on the whole disk */
+	sector_t		nr_sects;
+	bool			issuing;
+	atomic_t		bios;
+	struct blk_discard	*d;
+};
+
+struct blk_discard {
+	struct request_queue	*queue;
+	spinlock_t		lock;	/* tree and counters */
+	struct rb_root		root;
+	unsigned int		nr_pending;	/* queued, not yet issued */
+	unsigned int		nr_issuing;
+	sector_t		pending_sects;
+	unsigned long		oldest;		/* jiffies */
+	unsigned long		last_io;	/* jiffies */
+	struct delayed_work	work;
+	wait_queue_head_t	wait;	/* for discards in flight */
+
+	bool			async;
+	unsigned int		idle_ms;
+	unsigned int		rate_mb;
+
+	unsigned long		queued;
+	unsigned long		merged;
+	unsigned long		issued;
+	unsigned long		cancelled;
+	u64			issued_sects;
+};
+
+static void blk_discard_work_fn(struct work_struct *work);
+
+static struct blk_discard *blk_discard_get(struct request_queue *q,
+					   gfp_t gfp_mask)
+{
+	struct blk_discard *d = ACCESS_ONCE(q->discard);
+
+	if (d)
+		return d;
+
+	d = kzalloc_node(sizeof(*d), gfp_mask, q->node);
+	if (!d)
+		return NULL;
+	d->queue = q;
+	spin_lock_init(&d->lock);
+	d->root = RB_ROOT;
+	INIT_DELAYED_WORK(&d->work, blk_discard_work_fn);
+	init_waitqueue_head(&d->wait);
+	d->async = true;
+	d->idle_ms = DISCARD_DEFAULT_IDLE_MS;
+	d->rate_mb = DISCARD_DEFAULT_RATE_MB;
+
+	if (cmpxchg(&q->discard, NULL, d)) {
+		kfree(d);
+		d = q->discard;
+	}
+	return d;
+}
+
+static inline sector_t extent_end(struct discard_extent *e)
+{
+	return e->sector + e->nr_sects;
+}
+
+/* first extent ending at or after @sector */
+static struct discard_extent *extent_first(struct blk_discard *d,
+					   sector_t sector)
+{
+	struct rb_node *n = d->root.rb_node;
+	struct discard_extent *e, *found = NULL;
+
+	while (n) {
+		e = rb_entry(n, struct discard_extent, node);
+		if (extent_end(e) >= sector) {
+			found = e;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	return found;
+}
+
+static inline struct discard_extent *extent_next(struct discard_extent *e)
+{
+	struct rb_node *n = rb_next(&e->node);
+
+	return n ? rb_entry(n, struct discard_extent, node) : NULL;
+}
+
+static void extent_insert(struct blk_discard *d, struct discard_extent *new)
+{
+	struct rb_node **p = &d->root.rb_node, *parent = NULL;
+	struct discard_extent *e;
+
+	while (*p) {
+		parent = *p;
+		e = rb_entry(parent, struct discard_extent, node);
+		if (new->sector < e->sector)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &d->root);
+}
+
+static void extent_drop(struct blk_discard *d, struct discard_extent *e)
+{
+	rb_erase(&e->node, &d->root);
+	d->nr_pending--;
+	d->pending_sects -= e->nr_sects;
+	kfree(e);
+}
+
+static void blk_discard_schedule(struct blk_discard *d)
+{
+	kblockd_schedule_delayed_work(d->queue, &d->work,
+				      msecs_to_jiffies(d->idle_ms));
+}
+
+/**
+ * blkdev_queue_discard - discard sectors in the background
+ * @bdev:	blockdev to discard
+ * @sector:	start sector
+ * @nr_sects:	number of sectors to discard
+ * @gfp_mask:	memory allocation flags
+ *
+ * Like blkdev_issue_discard(), but returns once the range is queued. A
+ * later write to the range cancels that part of the discard. Falls back to
+ * blkdev_issue_discard() if background discard is turned off.
+ */
+int blkdev_queue_discard(struct block_device *bdev, sector_t sector,
+			 sector_t nr_sects, gfp_t gfp_mask)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	struct discard_extent *new, *e, *next;
+	struct blk_discard *d;
+	sector_t end;
+
+	if (!q)
+		return -ENXIO;
+	if (!blk_queue_discard(q))
+		return -EOPNOTSUPP;
+	if (!nr_sects)
+		return 0;
+
+	d = blk_discard_get(q, gfp_mask);
+	if (!d || !d->async)
+		goto sync;
+	new = kmalloc(sizeof(*new), gfp_mask);
+	if (!new)
+		goto sync;
+
+	sector += get_start_sect(bdev);
+	end = sector + nr_sects;
+
+	spin_lock_irq(&d->lock);
+	/*
+	 * Merge with what this touches, unless part of it is already being
+	 * discarded or belongs to another partition: then do it now.
+	 */
+	for (e = extent_first(d, sector); e && e->sector <= end;
+	     e = extent_next(e)) {
+		if ((e->issuing || e->bdev != bdev) &&
+		    e->sector < end && extent_end(e) > sector) {
+			spin_unlock_irq(&d->lock);
+			kfree(new);
+			sector -= get_start_sect(bdev);
+			goto sync;
+		}
+	}
+	for (e = extent_first(d, sector); e && e->sector <= end; e = next) {
+		next = extent_next(e);
+		if (e->issuing || e->bdev != bdev)
+			continue;
+		sector = min(sector, e->sector);
+		end = max(end, extent_end(e));
+		extent_drop(d, e);
+		d->merged++;
+	}
+
+	new->bdev = bdev;
+	new->sector = sector;
+	new->nr_sects = end - sector;
+	new->issuing = false;
+	new->d = d;
+	extent_insert(d, new);
+	if (!d->nr_pending++)
+		d->oldest = jiffies;
+	d->pending_sects += new->nr_sects;
+	d->queued++;
+	d->last_io = jiffies;
+	spin_unlock_irq(&d->lock);
+
+	blk_discard_schedule(d);
+	return 0;
+
+sync:
+	return blkdev_issue_discard(bdev, sector, nr_sects, gfp_mask, 0);
+}
+EXPORT_SYMBOL(blkdev_queue_discard);
+
+static void blk_discard_put(struct discard_extent *e)
+{
+	struct blk_discard *d = e->d;
+	unsigned long flags;
+
+	if (!atomic_dec_and_test(&e->bios))
+		return;
+
+	spin_lock_irqsave(&d->lock, flags);
+	rb_erase(&e->node, &d->root);
+	d->nr_issuing--;
+	d->issued++;
+	d->issued_sects += e->nr_sects;
+	spin_unlock_irqrestore(&d->lock, flags);
+
+	wake_up_all(&d->wait);
+	kfree(e);
+}
+
+static void blk_discard_end_io(struct bio *bio, int err)
+{
+	struct discard_extent *e = bio->bi_private;
+
+	bio_put(bio);
+	blk_discard_put(e);
+}
+
+/*
+ * Send out extent @e, which the caller has marked issuing. The discard is
+ * advisory, so errors are not reported anywhere.
+ */
+static void blk_discard_issue(struct blk_discard *d, struct discard_extent *e)
+{
+	struct request_queue *q = d->queue;
+	sector_t sector = e->sector - get_start_sect(e->bdev);
+	sector_t nr_sects = e->nr_sects;
+	unsigned int max_sects;
+	struct bio *bio;
+
+	max_sects = min(q->limits.max_discard_sectors, UINT_MAX >> 9);
+	if (q->limits.discard_granularity)
+		max_sects &= ~((q->limits.discard_granularity >> 9) - 1);
+
+	atomic_set(&e->bios, 1);
+	while (nr_sects && max_sects) {
+		bio = bio_alloc(GFP_NOIO, 1);
+		if (!bio)
+			break;
+		bio->bi_sector = sector;
+		bio->bi_bdev = e->bdev;
+		bio->bi_end_io = blk_discard_end_io;
+		bio->bi_private = e;
+		bio->bi_size = min_t(sector_t, nr_sects, max_sects) << 9;
+		sector += bio->bi_size >> 9;
+		nr_sects -= bio->bi_size >> 9;
+
+		atomic_inc(&e->bios);
+		submit_bio(REQ_WRITE | REQ_DISCARD, bio);
+	}
+
+	/* finishes @e if no bio was sent */
+	blk_discard_put(e);
+}
+
+static void blk_discard_issue_list(struct blk_discard *d,
+				   struct list_head *list)
+{
+	struct discard_extent *e, *tmp;
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	list_for_each_entry_safe(e, tmp, list, list)
+		blk_discard_issue(d, e);
+	blk_finish_plug(&plug);
+}
+
+static void blk_discard_take(struct blk_discard *d, struct discard_extent *e,
+			     struct list_head *list)
+{
+	e->issuing = true;
+	d->nr_pending--;
+	d->pending_sects -= e->nr_sects;
+	d->nr_issuing++;
+	list_add_tail(&e->list, list);
+}
+
+static bool blk_discard_idle(struct blk_discard *d)
+{
+	struct request_queue *q = d->queue;
+
+	return !q->in_flight[0] && !q->in_flight[1] &&
+		time_after_eq(jiffies,
+			      d->last_io + msecs_to_jiffies(d->idle_ms));
+}
+
+static void blk_discard_work_fn(struct work_struct *work)
+{
+	struct blk_discard *d = container_of(to_delayed_work(work),
+					     struct blk_discard, work);
+	struct discard_extent *e, *next;
+	sector_t budget = ~(sector_t)0;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&d->lock);
+	if (!d->nr_pending)
+		goto out;
+
+	if (!blk_discard_idle(d) && d->nr_pending < DISCARD_MAX_PENDING &&
+	    time_before(jiffies, d->oldest + DISCARD_MAX_DELAY)) {
+		spin_unlock_irq(&d->lock);
+		blk_discard_schedule(d);
+		return;
+	}
+
+	/* what may go out until the next run, but at least one extent */
+	if (d->rate_mb)
+		budget = ((sector_t)d->rate_mb << 11) * d->idle_ms / 1000;
+	for (e = extent_first(d, 0); e && budget; e = next) {
+		next = extent_next(e);
+		if (e->issuing)
+			continue;
+		budget -= min(budget, e->nr_sects);
+		blk_discard_take(d, e, &list);
+	}
+	d->oldest = jiffies;
+out:
+	spin_unlock_irq(&d->lock);
+
+	blk_discard_issue_list(d, &list);
+	if (d->nr_pending)
+		blk_discard_schedule(d);
+}
+
+/*
+ * Called for every bio submitted to @q: note the activity, and keep
+ * queued discards from destroying what @bio is writing.
+ */
+void blk_discard_check_bio(struct request_queue *q, struct bio *bio)
+{
+	struct blk_discard *d = q->discard;
+	struct discard_extent *e, *next, *tail;
+	sector_t start, end;
+	DEFINE_WAIT(wait);
+
+	if (!d || (!d->nr_pending && !d->nr_issuing) ||
+	    (bio->bi_rw & REQ_DISCARD))
+		return;
+
+	d->last_io = jiffies;
+	if (!(bio->bi_rw & REQ_WRITE) || !bio_sectors(bio))
+		return;
+
+	start = bio->bi_sector;
+	end = start + bio_sectors(bio);
+again:
+	spin_lock_irq(&d->lock);
+	for (e = extent_first(d, start + 1); e && e->sector < end; e = next) {
+		next = extent_next(e);
+		if (e->issuing) {
+			prepare_to_wait(&d->wait, &wait, TASK_UNINTERRUPTIBLE);
+			spin_unlock_irq(&d->lock);
+			io_schedule();
+			finish_wait(&d->wait, &wait);
+			goto again;
+		}
+
+		d->cancelled++;
+		if (e->sector >= start && extent_end(e) <= end) {
+			extent_drop(d, e);
+			continue;
+		}
+
+		d->pending_sects -= e->nr_sects;
+		if (e->sector < start && extent_end(e) > end) {
+			/* split, or just keep the head if that fails */
+			tail = kmalloc(sizeof(*tail), GFP_ATOMIC);
+			if (tail) {
+				*tail = *e;
+				tail->sector = end;
+				tail->nr_sects = extent_end(e) - end;
+				extent_insert(d, tail);
+				d->nr_pending++;
+				d->pending_sects += tail->nr_sects;
+			}
+		}
+		if (e->sector < start) {
+			e->nr_sects = start - e->sector;
+		} else {
+			e->nr_sects = extent_end(e) - end;
+			e->sector = end;
+		}
+		d->pending_sects += e->nr_sects;
+	}
+	spin_unlock_irq(&d->lock);
+}
+
+static bool blk_discard_busy(struct blk_discard *d, struct block_device *bdev)
+{
+	struct discard_extent *e;
+	bool busy = false;
+
+	spin_lock_irq(&d->lock);
+	for (e = extent_first(d, 0); e; e = extent_next(e)) {
+		if (e->bdev == bdev) {
+			busy = true;
+			break;
+		}
+	}
+	spin_unlock_irq(&d->lock);
+	return busy;
+}
+
+/**
+ * blkdev_discard_flush - issue queued discards and wait for them
+ * @bdev:	blockdev whose discards to flush
+ *
+ * Must be called before the last user of @bdev that queued discards on it
+ * closes it.
+ */
+void blkdev_discard_flush(struct block_device *bdev)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	struct blk_discard *d = q ? q->discard : NULL;
+	struct discard_extent *e, *next;
+	LIST_HEAD(list);
+
+	if (!d)
+		return;
+
+	spin_lock_irq(&d->lock);
+	for (e = extent_first(d, 0); e; e = next) {
+		next = extent_next(e);
+		if (!e->issuing && e->bdev == bdev)
+			blk_discard_take(d, e, &list);
+	}
+	spin_unlock_irq(&d->lock);
+
+	blk_discard_issue_list(d, &list);
+	wait_event(d->wait, !blk_discard_busy(d, bdev));
+}
+EXPORT_SYMBOL(blkdev_discard_flush);
+
+void blk_discard_exit(struct request_queue *q)
+{
+	struct blk_discard *d = q->discard;
+	struct discard_extent *e, *next;
+
+	if (!d)
+		return;
+
+	cancel_delayed_work_sync(&d->work);
+	for (e = extent_first(d, 0); e; e = next) {
+		next = extent_next(e);
+		WARN_ON_ONCE(e->issuing);
+		extent_drop(d, e);
+	}
+	q->discard = NULL;
+	kfree(d);
+}
+
+/*
+ * sysfs: discard_async turns queueing on and off, discard_idle_ms and
+ * discard_rate_mb (0 for no limit) tune the worker, discard_stats shows
+ * extents queued, merged, cancelled by writes, issued and pending, then
+ * MB issued and pending.
+ */
+ssize_t blk_discard_async_show(struct request_queue *q, char *page)
+{
+	struct blk_discard *d = q->discard;
+
+	return sprintf(page, "%d\n", d ? d->async : 1);
+}
+
+ssize_t blk_discard_async_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	struct blk_discard *d = blk_discard_get(q, GFP_KERNEL);
+	unsigned long val;
+	int err;
+
+	if (!d)
+		return -ENOMEM;
+	err = kstrtoul(page, 10, &val);
+	if (err)
+		return err;
+	d->async = !!val;
+	return count;
+}
+
+ssize_t blk_discard_idle_show(struct request_queue *q, char *page)
+{
+	struct blk_discard *d = q->discard;
+
+	return sprintf(page, "%u\n", d ? d->idle_ms : DISCARD_DEFAULT_IDLE_MS);
+}
+
+ssize_t blk_discard_idle_store(struct request_queue *q, const char *page,
+			       size_t count)
+{
+	struct blk_discard *d = blk_discard_get(q, GFP_KERNEL);
+	unsigned long val;
+	int err;
+
+	if (!d)
+		return -ENOMEM;
+	err = kstrtoul(page, 10, &val);
+	if (err)
+		return err;
+	if (!val || val > 60000)
+		return -EINVAL;
+	d->idle_ms = val;
+	return count;
+}
+
+ssize_t blk_discard_rate_show(struct request_queue *q, char *page)
+{
+	struct blk_discard *d = q->discard;
+
+	return sprintf(page, "%u\n", d ? d->rate_mb : DISCARD_DEFAULT_RATE_MB);
+}
+
+ssize_t blk_discard_rate_store(struct request_queue *q, const char *page,
+			       size_t count)
+{
+	struct blk_discard *d = blk_discard_get(q, GFP_KERNEL);
+	unsigned long val;
+	int err;
+
+	if (!d)
+		return -ENOMEM;
+	err = kstrtoul(page, 10, &val);
+	if (err)
+		return err;
+	d->rate_mb = min(val, (unsigned long)UINT_MAX);
+	return count;
+}
+
+ssize_t blk_discard_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_discard *d = q->discard;
+	ssize_t ret;
+
+	if (!d)
+		return sprintf(page, "0 0 0 0 0 0 0\n");
+
+	spin_lock_irq(&d->lock);
+	ret = sprintf(page, "%lu %lu %lu %lu %u %llu %llu\n",
+		      d->queued, d->merged, d->cancelled, d->issued,
+		      d->nr_pending,
+		      (unsigned long long)(d->issued_sects >> 11),
+		      (unsigned long long)(d->pending_sects >> 11));
+	spin_unlock_irq(&d->lock);
+	return ret;
+}
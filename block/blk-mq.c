@@ -0,0 +1,618 @@
+/*
+ * Multi-queue block submission, see include/linux/blk-mq.h
+ *
+ * Requests are built on the submitting CPU, staged on its software queue
+ * and pushed to the hardware queue that CPU maps to. None of this takes
+ * queue_lock: the software queues have their own lock, which only the
+ * CPU that owns them and the runs of their hardware queue contend on.
+ * Completions go back to the submitting CPU through the block softirq.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Grab a free tag, starting at the last one this CPU got so that CPUs
+ * tend to stay on their own bitmap words.
+ */
+static int blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int *hint)
+{
+	unsigned int start = *hint < tags->nr_tags ? *hint : 0;
+	unsigned int tag = start;
+	bool wrapped = false;
+
+	for (;;) {
+		tag = find_next_zero_bit(tags->bitmap, tags->nr_tags, tag);
+		if (tag >= tags->nr_tags) {
+			if (wrapped || !start)
+				return -1;
+			wrapped = true;
+			tag = 0;
+			continue;
+		}
+		if (wrapped && tag >= start)
+			return -1;
+		if (!test_and_set_bit_lock(tag, tags->bitmap))
+			break;
+	}
+	atomic_inc(&tags->active);
+	*hint = tag + 1;
+	return tag;
+}
+
+static void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	atomic_dec(&tags->active);
+	clear_bit_unlock(tag, tags->bitmap);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+static bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_first_zero_bit(tags->bitmap, tags->nr_tags) <
+		tags->nr_tags;
+}
+
+/*
+ * Returns a request on the current CPU's software queue, with preemption
+ * disabled until blk_mq_put_ctx(). Sleeps while the hardware queue has no
+ * free tags.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  struct blk_mq_ctx **ctxp)
+{
+	struct blk_mq_ctx *ctx;
+	struct blk_mq_tags *tags;
+	struct request *rq;
+	DEFINE_WAIT(wait);
+	int tag;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		tags = ctx->hctx->tags;
+		tag = blk_mq_get_tag(tags, &ctx->tag_hint);
+		if (tag >= 0)
+			break;
+		blk_mq_put_ctx(ctx);
+
+		prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+		if (!blk_mq_has_free_tags(tags))
+			io_schedule();
+		finish_wait(&tags->wait, &wait);
+	}
+
+	rq = tags->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	*ctxp = ctx;
+	return rq;
+}
+
+static void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = rq->mq_ctx->hctx;
+
+	rq->mq_ctx = NULL;
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+
+/**
+ * blk_mq_end_io - end all I/O on a request
+ * @rq:		the request, as passed to ->queue_rq
+ * @error:	0 for success, < 0 for error
+ *
+ * Completes the bios of @rq and frees it, in the caller's context. See
+ * blk_mq_complete_request() for completing on the submitting CPU.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_softirq_done(struct request *rq)
+{
+	struct blk_mq_ops *ops = rq->q->mq_ops;
+
+	if (ops->complete)
+		ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+/**
+ * blk_mq_complete_request - end I/O on a request from interrupt context
+ * @rq:		the request being completed
+ *
+ * Finishes @rq through ->complete (or blk_mq_end_io()) in the block
+ * softirq of the CPU that submitted it, so that the completion runs where
+ * the submitter's data is cache hot. Set rq->errors before calling.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	trace_block_rq_issue(rq->q, rq);
+	rq->cmd_flags |= REQ_STARTED;
+}
+
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	unsigned int bit;
+	int ret;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/* whatever the driver could not take last time goes first */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		if (!test_and_clear_bit(bit, hctx->ctx_map))
+			continue;
+		ctx = hctx->ctxs[bit];
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			rq->cmd_flags &= ~REQ_STARTED;
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+		pr_err("blk-mq: bad return on queue: %d\n", ret);
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	/*
+	 * A busy driver stops the queue and restarts it once it has room
+	 * again, see blk_mq_start_stopped_hw_queues().
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch the requests staged for a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	run it from kblockd instead of the caller's context
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (async)
+		kblockd_schedule_work(hctx->queue, &hctx->run_work);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -EIO);
+		return;
+	}
+
+	blk_queue_bounce(q, &bio);
+
+	rq = blk_mq_get_request(q, &ctx);
+	hctx = ctx->hctx;
+	trace_block_getrq(q, bio, bio->bi_rw);
+
+	init_request_from_bio(rq, bio);
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+	rq->cpu = ctx->cpu;
+	drive_stat_acct(rq, 1);
+
+	spin_lock(&ctx->lock);
+	trace_block_rq_insert(q, rq);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	spin_unlock(&ctx->lock);
+	set_bit(ctx->index_hw, hctx->ctx_map);
+	hctx->queued++;
+	blk_mq_put_ctx(ctx);
+
+	blk_mq_run_hw_queue(hctx, false);
+}
+
+static void blk_mq_free_tags(struct blk_mq_tag_set *set,
+			     struct blk_mq_tags *tags)
+{
+	unsigned int i;
+
+	if (!tags)
+		return;
+	if (tags->rqs) {
+		for (i = 0; i < tags->nr_tags; i++)
+			kfree(tags->rqs[i]);
+		kfree(tags->rqs);
+	}
+	kfree(tags->bitmap);
+	kfree(tags);
+}
+
+static struct blk_mq_tags *blk_mq_init_tags(struct blk_mq_tag_set *set,
+					    unsigned int hctx_idx)
+{
+	struct blk_mq_tags *tags;
+	unsigned int i;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, set->numa_node);
+	if (!tags)
+		return NULL;
+	tags->nr_tags = set->queue_depth;
+	atomic_set(&tags->active, 0);
+	init_waitqueue_head(&tags->wait);
+
+	tags->bitmap = kzalloc_node(BITS_TO_LONGS(tags->nr_tags) *
+				    sizeof(long), GFP_KERNEL, set->numa_node);
+	tags->rqs = kzalloc_node(tags->nr_tags * sizeof(struct request *),
+				 GFP_KERNEL, set->numa_node);
+	if (!tags->bitmap || !tags->rqs)
+		goto fail;
+
+	for (i = 0; i < tags->nr_tags; i++) {
+		struct request *rq;
+
+		rq = kzalloc_node(sizeof(*rq) + set->cmd_size, GFP_KERNEL,
+				  set->numa_node);
+		if (!rq)
+			goto fail;
+		tags->rqs[i] = rq;
+		if (set->ops->init_request &&
+		    set->ops->init_request(set->driver_data, rq, hctx_idx, i))
+			goto fail;
+	}
+	return tags;
+
+fail:
+	pr_warn("blk-mq: failed to allocate %u requests\n", tags->nr_tags);
+	blk_mq_free_tags(set, tags);
+	return NULL;
+}
+
+/**
+ * blk_mq_alloc_tag_set - allocate the requests of a multi-queue device
+ * @set:	filled in with ->ops, ->nr_hw_queues, ->queue_depth,
+ *		->cmd_size, ->numa_node and ->driver_data
+ *
+ * Allocates ->queue_depth requests, each followed by ->cmd_size bytes of
+ * driver data, for every hardware queue. ->nr_hw_queues is capped at the
+ * number of CPUs.
+ */
+int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
+{
+	unsigned int i;
+
+	if (!set->ops || !set->ops->queue_rq || !set->nr_hw_queues ||
+	    !set->queue_depth || set->queue_depth > BLK_MQ_MAX_DEPTH)
+		return -EINVAL;
+
+	if (set->nr_hw_queues > nr_cpu_ids)
+		set->nr_hw_queues = nr_cpu_ids;
+
+	set->tags = kzalloc_node(set->nr_hw_queues * sizeof(*set->tags),
+				 GFP_KERNEL, set->numa_node);
+	if (!set->tags)
+		return -ENOMEM;
+
+	for (i = 0; i < set->nr_hw_queues; i++) {
+		set->tags[i] = blk_mq_init_tags(set, i);
+		if (!set->tags[i]) {
+			blk_mq_free_tag_set(set);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL(blk_mq_alloc_tag_set);
+
+void blk_mq_free_tag_set(struct blk_mq_tag_set *set)
+{
+	unsigned int i;
+
+	if (!set->tags)
+		return;
+	for (i = 0; i < set->nr_hw_queues; i++)
+		blk_mq_free_tags(set, set->tags[i]);
+	kfree(set->tags);
+	set->tags = NULL;
+}
+EXPORT_SYMBOL(blk_mq_free_tag_set);
+
+/*
+ * Let go of the tag set, which the driver may free as soon as
+ * blk_cleanup_queue() returns, while others can still hold @q.
+ */
+static void blk_mq_exit_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_tag_set *set = q->tag_set;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (!set || !q->queue_hw_ctx)
+		return;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+		if (set->ops->exit_hctx && hctx->queue)
+			set->ops->exit_hctx(hctx, i);
+		hctx->queue = NULL;
+		hctx->tags = NULL;
+	}
+	q->tag_set = NULL;
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+		kfree(hctx->ctxs);
+		kfree(hctx->ctx_map);
+		kfree(hctx);
+	}
+	kfree(q->queue_hw_ctx);
+	q->queue_hw_ctx = NULL;
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_tag_set *set)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	q->queue_hw_ctx = kzalloc_node(set->nr_hw_queues * sizeof(hctx),
+				       GFP_KERNEL, set->numa_node);
+	if (!q->queue_hw_ctx)
+		return -ENOMEM;
+	q->nr_hw_queues = set->nr_hw_queues;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, set->numa_node);
+		if (!hctx)
+			return -ENOMEM;
+		q->queue_hw_ctx[i] = hctx;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_WORK(&hctx->run_work, blk_mq_run_work_fn);
+		hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(*hctx->ctxs),
+					  GFP_KERNEL, set->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(long), GFP_KERNEL,
+					     set->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+		hctx->tags = set->tags[i];
+		hctx->queue_num = i;
+
+		if (set->ops->init_hctx &&
+		    set->ops->init_hctx(hctx, set->driver_data, i))
+			return -ENOMEM;
+		/* only now may exit_hctx be called for it */
+		hctx->queue = q;
+	}
+	return 0;
+}
+
+/* Spread the CPUs over the hardware queues */
+static void blk_mq_map_swqueues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->queue_hw_ctx[cpu % q->nr_hw_queues];
+		ctx->hctx = hctx;
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - create a multi-queue request queue
+ * @set:	tag set allocated with blk_mq_alloc_tag_set()
+ *
+ * The queue is freed with blk_cleanup_queue() like any other, which waits
+ * for the requests in flight first. @set must be kept until
+ * blk_cleanup_queue() returns, the queue doesn't use it after that.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_tag_set *set)
+{
+	struct request_queue *q;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, set->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->tag_set = set;
+	q->mq_ops = set->ops;
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!q->queue_ctx)
+		goto fail;
+	if (blk_mq_init_hw_queues(q, set))
+		goto fail;
+	blk_mq_map_swqueues(q);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_softirq_done(q, blk_mq_softirq_done);
+	q->nr_requests = set->queue_depth;
+	queue_flag_set_unlocked(QUEUE_FLAG_SAME_COMP, q);
+	return q;
+
+fail:
+	/* half set up, keep blk_cleanup_queue() from draining and exiting it */
+	blk_mq_free_queue(q);
+	blk_mq_release(q);
+	q->mq_ops = NULL;
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/* Called from blk_cleanup_queue(), once @q is drained */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	blk_mq_exit_hw_queues(q);
+}
+
+/* Called when the last reference to @q goes away */
+void blk_mq_release(struct request_queue *q)
+{
+	if (q->queue_hw_ctx)
+		blk_mq_free_hw_queues(q);
+	free_percpu(q->queue_ctx);
+	q->queue_ctx = NULL;
+}
+
+/*
+ * Wait for the requests in flight, with @q already marked dead. A queue
+ * the driver stopped would never dispatch what is left on it, so stopped
+ * queues are restarted on every pass; a driver that is still busy just
+ * stops them again.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+	bool busy;
+
+	do {
+		busy = false;
+		queue_for_each_hw_ctx(q, hctx, i) {
+			if (atomic_read(&hctx->tags->active)) {
+				clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+				blk_mq_run_hw_queue(hctx, false);
+				busy = true;
+			}
+		}
+		if (busy)
+			msleep(10);
+	} while (busy);
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_work_sync(&hctx->run_work);
+}
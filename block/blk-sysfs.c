@@ -6,6 +6,7 @@
 #include <linux/module.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
@@ -387,6 +388,49 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wbt_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_wbt_lat_show,
+	.store = blk_wbt_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wbt_window_entry = {
+	.attr = {.name = "wbt_window", .mode = S_IRUGO },
+	.show = blk_wbt_window_show,
+};
+
+static struct queue_sysfs_entry queue_wbt_observed_entry = {
+	.attr = {.name = "wbt_lat_observed_usec", .mode = S_IRUGO },
+	.show = blk_wbt_observed_show,
+};
+#endif
+
+#ifdef CONFIG_BLK_BG_DISCARD
+static struct queue_sysfs_entry queue_discard_async_entry = {
+	.attr = {.name = "discard_async", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_discard_async_show,
+	.store = blk_discard_async_store,
+};
+
+static struct queue_sysfs_entry queue_discard_idle_entry = {
+	.attr = {.name = "discard_idle_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_discard_idle_show,
+	.store = blk_discard_idle_store,
+};
+
+static struct queue_sysfs_entry queue_discard_rate_entry = {
+	.attr = {.name = "discard_rate_mb", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_discard_rate_show,
+	.store = blk_discard_rate_store,
+};
+
+static struct queue_sysfs_entry queue_discard_stats_entry = {
+	.attr = {.name = "discard_stats", .mode = S_IRUGO },
+	.show = blk_discard_stats_show,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -409,6 +453,17 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wbt_lat_entry.attr,
+	&queue_wbt_window_entry.attr,
+	&queue_wbt_observed_entry.attr,
+#endif
+#ifdef CONFIG_BLK_BG_DISCARD
+	&queue_discard_async_entry.attr,
+	&queue_discard_idle_entry.attr,
+	&queue_discard_rate_entry.attr,
+	&queue_discard_stats_entry.attr,
+#endif
 	NULL,
 };
 
@@ -487,6 +542,11 @@ static void blk_release_queue(struct kobject *kobj)
 	}
 
 	blk_throtl_exit(q);
+	blk_wbt_exit(q);
+	blk_discard_exit(q);
+
+	if (q->mq_ops)
+		blk_mq_release(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
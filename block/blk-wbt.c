@@ -0,0 +1,289 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback can fill the whole request pool of a queue, and on
+ * eMMC a read queued behind that many writes waits hundreds of
+ * milliseconds. Here the number of background write requests a queue may
+ * have allocated is limited to a window, which is resized every
+ * WBT_WINDOW_MSEC from the read latency seen in that period: if even the
+ * fastest read missed the target the window is halved, otherwise it grows
+ * by one, and without reads it opens up quickly. Writers over the window
+ * sleep in blk_queue_bio() until a tracked write completes.
+ *
+ * Background writes are writes without REQ_SYNC, which is what
+ * WB_SYNC_NONE writeback from the flusher threads and balance_dirty_pages()
+ * issues. O_DIRECT, fsync and WB_SYNC_ALL writes are not throttled, and
+ * neither is memory reclaim.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/blktrace_api.h>
+
+#include "blk.h"
+
+/* default read latency target, usecs */
+#define WBT_DEFAULT_LAT_USEC	20000
+#define WBT_WINDOW_MSEC		100
+
+struct rq_wb {
+	struct request_queue	*queue;
+
+	u64			min_lat_nsec;	/* target, 0 = off */
+	unsigned int		wb_normal;	/* current window */
+	unsigned int		inflight;	/* tracked writes allocated */
+	wait_queue_head_t	wait;
+	struct timer_list	window_timer;
+
+	/* reads completed in the current period */
+	unsigned int		nr_reads;
+	u64			win_min_nsec;
+	/* fastest read of the last period that had reads */
+	u64			observed_nsec;
+};
+
+#define wbt_log(rwb, fmt, args...)	\
+	blk_add_trace_msg((rwb)->queue, "wbt " fmt, ##args)
+
+static unsigned int wbt_max_depth(struct request_queue *q)
+{
+	return max(1UL, q->nr_requests * 3 / 4);
+}
+
+static inline bool wbt_should_track(struct bio *bio)
+{
+	const unsigned long mask = REQ_WRITE | REQ_SYNC | REQ_FLUSH |
+		REQ_FUA | REQ_DISCARD;
+
+	return (bio->bi_rw & mask) == REQ_WRITE &&
+		!(current->flags & PF_MEMALLOC);
+}
+
+static void wbt_wake(struct rq_wb *rwb)
+{
+	if (waitqueue_active(&rwb->wait) && rwb->inflight < rwb->wb_normal)
+		wake_up_nr(&rwb->wait, rwb->wb_normal - rwb->inflight);
+}
+
+/*
+ * Resize the window from the period that just ended. Keeps running as
+ * long as there is anything to watch.
+ */
+static void wbt_window_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	struct request_queue *q = rwb->queue;
+	unsigned long flags;
+	unsigned int max;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	max = wbt_max_depth(q);
+	if (rwb->nr_reads) {
+		rwb->observed_nsec = rwb->win_min_nsec;
+		if (rwb->win_min_nsec > rwb->min_lat_nsec)
+			rwb->wb_normal = max(1U, rwb->wb_normal / 2);
+		else
+			rwb->wb_normal++;
+	} else {
+		/* nothing to protect */
+		rwb->wb_normal *= 2;
+	}
+	rwb->wb_normal = min(rwb->wb_normal, max);
+
+	wbt_log(rwb, "reads %u min_lat %llu window %u inflight %u",
+		rwb->nr_reads, (unsigned long long)rwb->win_min_nsec,
+		rwb->wb_normal, rwb->inflight);
+
+	if (rwb->nr_reads || rwb->inflight)
+		mod_timer(&rwb->window_timer,
+			  jiffies + msecs_to_jiffies(WBT_WINDOW_MSEC));
+	rwb->nr_reads = 0;
+	rwb->win_min_nsec = 0;
+
+	wbt_wake(rwb);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static void wbt_arm_window(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		mod_timer(&rwb->window_timer,
+			  jiffies + msecs_to_jiffies(WBT_WINDOW_MSEC));
+}
+
+/**
+ * blk_wbt_wait - wait for room for a background write
+ * @q: the queue @bio is going to
+ * @bio: the bio about to get a request
+ *
+ * Called with queue_lock held, which is dropped while sleeping. Returns
+ * true if the request allocated for @bio is to be tracked, in which case
+ * the caller marks it REQ_WBT.
+ */
+bool blk_wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb || !rwb->min_lat_nsec || !wbt_should_track(bio))
+		return false;
+
+	wbt_arm_window(rwb);
+	while (rwb->min_lat_nsec && rwb->inflight >= rwb->wb_normal &&
+	       !blk_queue_dead(q)) {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (!rwb->min_lat_nsec || rwb->inflight < rwb->wb_normal)
+			break;
+		spin_unlock_irq(q->queue_lock);
+		io_schedule();
+		spin_lock_irq(q->queue_lock);
+	}
+	finish_wait(&rwb->wait, &wait);
+
+	rwb->inflight++;
+	return true;
+}
+
+/**
+ * blk_wbt_release - give back a slot taken by blk_wbt_wait()
+ * @q: the queue
+ *
+ * For callers that got no request after all. queue_lock must be held.
+ */
+void blk_wbt_release(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	rwb->inflight--;
+	wbt_wake(rwb);
+}
+
+/*
+ * Request @rq is going to the driver: start timing it if it is a read.
+ */
+void blk_wbt_issue(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	rq->wbt_issue_ns = 0;
+	if (!rwb || !rwb->min_lat_nsec || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ)
+		return;
+
+	rq->wbt_issue_ns = ktime_to_ns(ktime_get());
+	wbt_arm_window(rwb);
+}
+
+/*
+ * Request @rq completed or is being freed, with queue_lock held: account
+ * a read's latency and release a tracked write's slot.
+ */
+void blk_wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	u64 lat;
+
+	if (!rwb)
+		return;
+
+	if (rq->wbt_issue_ns) {
+		lat = ktime_to_ns(ktime_get()) - rq->wbt_issue_ns;
+		rq->wbt_issue_ns = 0;
+		if (!rwb->nr_reads++ || lat < rwb->win_min_nsec)
+			rwb->win_min_nsec = lat;
+	}
+
+	if (rq->cmd_flags & REQ_WBT) {
+		rq->cmd_flags &= ~REQ_WBT;
+		blk_wbt_release(q);
+	}
+}
+
+int blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->queue = q;
+	rwb->min_lat_nsec = WBT_DEFAULT_LAT_USEC * NSEC_PER_USEC;
+	rwb->wb_normal = wbt_max_depth(q);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wbt_window_fn, (unsigned long)rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
+
+/*
+ * sysfs: wbt_lat_usec sets the target, 0 turns throttling off;
+ * wbt_window and wbt_lat_observed_usec show its current state.
+ */
+ssize_t blk_wbt_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+	return sprintf(page, "%llu\n",
+		       div_u64(q->rq_wb->min_lat_nsec, NSEC_PER_USEC));
+}
+
+ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long val;
+	int err;
+
+	if (!rwb)
+		return -EINVAL;
+
+	err = kstrtoul(page, 10, &val);
+	if (err)
+		return err;
+
+	spin_lock_irq(q->queue_lock);
+	rwb->min_lat_nsec = (u64)val * NSEC_PER_USEC;
+	rwb->wb_normal = wbt_max_depth(q);
+	rwb->nr_reads = 0;
+	rwb->observed_nsec = 0;
+	/* with throttling off, nobody may be left waiting */
+	wake_up_all(&rwb->wait);
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+
+ssize_t blk_wbt_window_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+	return sprintf(page, "%u\n", q->rq_wb->wb_normal);
+}
+
+ssize_t blk_wbt_observed_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+	return sprintf(page, "%llu\n",
+		       div_u64(q->rq_wb->observed_nsec, NSEC_PER_USEC));
+}
@@ -25,6 +25,8 @@ int blk_rq_append_bio(struct request_queue *q, struct request *rq,
 		      struct bio *bio);
 void blk_drain_queue(struct request_queue *q, bool drain_all);
 void blk_dequeue_request(struct request *rq);
+void drive_stat_acct(struct request *rq, int new_io);
+void blk_account_io_done(struct request *req);
 void __blk_queue_free_tags(struct request_queue *q);
 bool __blk_end_bidi_request(struct request *rq, int error,
 			    unsigned int nr_bytes, unsigned int bidi_bytes);
@@ -261,4 +263,55 @@ static inline void blk_throtl_exit(struct request_queue *q) { }
 static inline void blk_throtl_release(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+/*
+ * Writeback throttling
+ */
+#ifdef CONFIG_BLK_WBT
+extern bool blk_wbt_wait(struct request_queue *q, struct bio *bio);
+extern void blk_wbt_release(struct request_queue *q);
+extern void blk_wbt_issue(struct request_queue *q, struct request *rq);
+extern void blk_wbt_done(struct request_queue *q, struct request *rq);
+extern int blk_wbt_init(struct request_queue *q);
+extern void blk_wbt_exit(struct request_queue *q);
+extern ssize_t blk_wbt_lat_show(struct request_queue *q, char *page);
+extern ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+				 size_t count);
+extern ssize_t blk_wbt_window_show(struct request_queue *q, char *page);
+extern ssize_t blk_wbt_observed_show(struct request_queue *q, char *page);
+#else /* CONFIG_BLK_WBT */
+static inline bool blk_wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	return false;
+}
+static inline void blk_wbt_release(struct request_queue *q) { }
+static inline void blk_wbt_issue(struct request_queue *q,
+				 struct request *rq) { }
+static inline void blk_wbt_done(struct request_queue *q,
+				struct request *rq) { }
+static inline int blk_wbt_init(struct request_queue *q) { return 0; }
+static inline void blk_wbt_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_WBT */
+
+/*
+ * Background discard
+ */
+#ifdef CONFIG_BLK_BG_DISCARD
+extern void blk_discard_check_bio(struct request_queue *q, struct bio *bio);
+extern void blk_discard_exit(struct request_queue *q);
+extern ssize_t blk_discard_async_show(struct request_queue *q, char *page);
+extern ssize_t blk_discard_async_store(struct request_queue *q,
+				       const char *page, size_t count);
+extern ssize_t blk_discard_idle_show(struct request_queue *q, char *page);
+extern ssize_t blk_discard_idle_store(struct request_queue *q,
+				      const char *page, size_t count);
+extern ssize_t blk_discard_rate_show(struct request_queue *q, char *page);
+extern ssize_t blk_discard_rate_store(struct request_queue *q,
+				      const char *page, size_t count);
+extern ssize_t blk_discard_stats_show(struct request_queue *q, char *page);
+#else /* CONFIG_BLK_BG_DISCARD */
+static inline void blk_discard_check_bio(struct request_queue *q,
+					 struct bio *bio) { }
+static inline void blk_discard_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_BG_DISCARD */
+
 #endif /* BLK_INTERNAL_H */
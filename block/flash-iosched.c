@@ -0,0 +1,933 @@
+/*
+ * Flash I/O scheduler.
+ *
+ * Every process gets three queues: reads, sync writes and async writes.
+ * A queue is charged virtual I/O time ("vios") for each request it
+ * dispatches, scaled by direction, sync-ness, ioprio and the blkio cgroup
+ * weight of the submitter, and queues of one kind are served from a service
+ * tree in vios order, as in fiops. Reads go ahead of writes and can ask the
+ * driver to preempt a long write, as in ROW; writes get one dispatch every
+ * writes_starved reads. The number of async writes allowed in flight while
+ * reads are pending is adapted so that read latency stays under
+ * target_latency.
+ *
+ * Based on the fiops and ROW schedulers.
+ *  Copyright (C) 2003 Jens Axboe <axboe@kernel.dk>
+ *  Shaohua Li <shli@kernel.org>
+ *  Copyright (c) 2012-2013, The Linux Foundation. All rights reserved.
+ *
+ * See Documentation/block/flash-iosched.txt
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/blktrace_api.h>
+#include "blk.h"
+#include "blk-cgroup.h"
+
+#define VIOS_SCALE_SHIFT 10
+#define VIOS_SCALE (1 << VIOS_SCALE_SHIFT)
+
+#define VIOS_READ_SCALE (1)
+#define VIOS_WRITE_SCALE (2)
+#define VIOS_SYNC_SCALE (2)
+#define VIOS_ASYNC_SCALE (5)
+
+#define VIOS_PRIO_SCALE (5)
+
+/* reads dispatched before a waiting write gets its turn */
+#define FLASH_WRITES_STARVED	16
+/* read latency target, in usecs */
+#define FLASH_TARGET_LATENCY	(10 * USEC_PER_MSEC)
+/* async writes in flight while reads are pending */
+#define FLASH_MAX_ASYNC_DEPTH	16
+/* how often a process' blkio cgroup weight is looked up again */
+#define FLASH_WEIGHT_REFRESH	HZ
+
+enum flash_queue_type {
+	FLASH_READ = 0,
+	FLASH_SYNC_WRITE,
+	FLASH_ASYNC_WRITE,
+	FLASH_NR_QUEUES,
+};
+
+enum wl_prio_t {
+	IDLE_WORKLOAD = 0,
+	BE_WORKLOAD = 1,
+	RT_WORKLOAD = 2,
+	FLASH_PRIO_NR,
+};
+
+struct flash_rb_root {
+	struct rb_root rb;
+	struct rb_node *left;
+	unsigned count;
+
+	u64 min_vios;
+};
+#define FLASH_RB_ROOT	(struct flash_rb_root) { .rb = RB_ROOT}
+
+struct flash_data {
+	struct request_queue *queue;
+
+	struct flash_rb_root service_tree[FLASH_PRIO_NR][FLASH_NR_QUEUES];
+
+	unsigned int queued[FLASH_NR_QUEUES];
+	unsigned int in_flight[FLASH_NR_QUEUES];
+
+	/* reads dispatched while writes were waiting */
+	unsigned int starved;
+	/* async writes allowed in flight while reads are pending */
+	unsigned int async_depth;
+	/* moving average of read latency, in usecs */
+	unsigned int read_latency;
+	unsigned long last_throttle;
+
+	dev_t dev;
+
+	struct work_struct unplug_work;
+
+	unsigned int read_scale;
+	unsigned int write_scale;
+	unsigned int sync_scale;
+	unsigned int async_scale;
+	unsigned int writes_starved;
+	unsigned int target_latency;
+	unsigned int max_async_depth;
+	unsigned int urgent_reads;
+};
+
+struct flash_ioc;
+
+struct flash_queue {
+	struct flash_ioc *ioc;
+	enum flash_queue_type type;
+
+	struct rb_node rb_node;
+	u64 vios; /* key in service_tree */
+	struct flash_rb_root *service_tree;
+
+	unsigned int in_flight;
+
+	struct rb_root sort_list;
+	struct list_head fifo;
+};
+
+struct flash_ioc {
+	struct io_cq icq;
+
+	struct flash_data *fd;
+	struct flash_queue queues[FLASH_NR_QUEUES];
+
+	pid_t pid;
+	unsigned short ioprio;
+	enum wl_prio_t wl_type;
+	bool prio_changed;
+
+	unsigned int weight;
+	unsigned long weight_stamp;
+};
+
+#define RQ_CIC(rq)		icq_to_cic((rq)->elv.icq)
+#define RQ_FQ(rq)		((struct flash_queue *)((rq)->elv.priv[0]))
+
+#define flash_log_fq(fd, fq, fmt, args...)	\
+	blk_add_trace_msg((fd)->queue, "flash%d%c " fmt, (fq)->ioc->pid, \
+			  "rsa"[(fq)->type], ##args)
+#define flash_log(fd, fmt, args...)	\
+	blk_add_trace_msg((fd)->queue, "flash " fmt, ##args)
+
+static enum wl_prio_t flash_wl_type(short prio_class)
+{
+	if (prio_class == IOPRIO_CLASS_RT)
+		return RT_WORKLOAD;
+	if (prio_class == IOPRIO_CLASS_BE)
+		return BE_WORKLOAD;
+	return IDLE_WORKLOAD;
+}
+
+static inline enum flash_queue_type flash_rq_type(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return FLASH_READ;
+	return rq_is_sync(rq) ? FLASH_SYNC_WRITE : FLASH_ASYNC_WRITE;
+}
+
+static inline enum flash_queue_type flash_bio_type(struct bio *bio)
+{
+	if (bio_data_dir(bio) == READ)
+		return FLASH_READ;
+	return (bio->bi_rw & REQ_SYNC) ? FLASH_SYNC_WRITE : FLASH_ASYNC_WRITE;
+}
+
+static inline unsigned int flash_busy_queues(struct flash_data *fd)
+{
+	return fd->queued[FLASH_READ] + fd->queued[FLASH_SYNC_WRITE] +
+		fd->queued[FLASH_ASYNC_WRITE];
+}
+
+/* a cheap usec clock; only differences of it are used */
+static inline unsigned long flash_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static inline struct flash_ioc *icq_to_cic(struct io_cq *icq)
+{
+	/* cic->icq is the first member, %NULL will convert to %NULL */
+	return container_of(icq, struct flash_ioc, icq);
+}
+
+static inline struct flash_ioc *flash_cic_lookup(struct flash_data *fd,
+						 struct io_context *ioc)
+{
+	if (ioc)
+		return icq_to_cic(ioc_lookup_icq(ioc, fd->queue));
+	return NULL;
+}
+
+/*
+ * The below is leftmost cache rbtree addon
+ */
+static struct flash_queue *flash_rb_first(struct flash_rb_root *root)
+{
+	/* Service tree is empty */
+	if (!root->count)
+		return NULL;
+
+	if (!root->left)
+		root->left = rb_first(&root->rb);
+
+	if (root->left)
+		return rb_entry(root->left, struct flash_queue, rb_node);
+
+	return NULL;
+}
+
+static void flash_rb_erase(struct rb_node *n, struct flash_rb_root *root)
+{
+	if (root->left == n)
+		root->left = NULL;
+	rb_erase(n, &root->rb);
+	RB_CLEAR_NODE(n);
+	--root->count;
+}
+
+static inline u64 max_vios(u64 min_vios, u64 vios)
+{
+	s64 delta = (s64)(vios - min_vios);
+	if (delta > 0)
+		min_vios = vios;
+
+	return min_vios;
+}
+
+static void flash_update_min_vios(struct flash_rb_root *service_tree)
+{
+	struct flash_queue *fq;
+
+	fq = flash_rb_first(service_tree);
+	if (!fq)
+		return;
+	service_tree->min_vios = max_vios(service_tree->min_vios, fq->vios);
+}
+
+/*
+ * Add fq to, or move it within, the service tree of its kind and class.
+ * A queue that went idle restarts at the tree's min_vios so that it can't
+ * claim the service it missed while it had nothing to do.
+ */
+static void flash_service_tree_add(struct flash_data *fd,
+				   struct flash_queue *fq)
+{
+	struct flash_rb_root *service_tree =
+		&fd->service_tree[fq->ioc->wl_type][fq->type];
+	struct rb_node **p, *parent;
+	struct flash_queue *__fq;
+	u64 vios;
+	int left;
+
+	if (RB_EMPTY_NODE(&fq->rb_node)) {
+		if (fq->in_flight > 0)
+			vios = fq->vios;
+		else
+			vios = max_vios(service_tree->min_vios, fq->vios);
+	} else {
+		vios = fq->vios;
+		/* fq->service_tree might not equal to service_tree */
+		flash_rb_erase(&fq->rb_node, fq->service_tree);
+	}
+
+	left = 1;
+	parent = NULL;
+	fq->service_tree = service_tree;
+	p = &service_tree->rb.rb_node;
+	while (*p) {
+		parent = *p;
+		__fq = rb_entry(parent, struct flash_queue, rb_node);
+
+		if (vios < __fq->vios)
+			p = &parent->rb_left;
+		else {
+			p = &parent->rb_right;
+			left = 0;
+		}
+	}
+
+	if (left)
+		service_tree->left = &fq->rb_node;
+
+	fq->vios = vios;
+	rb_link_node(&fq->rb_node, parent, p);
+	rb_insert_color(&fq->rb_node, &service_tree->rb);
+	service_tree->count++;
+
+	flash_update_min_vios(service_tree);
+}
+
+static void flash_service_tree_del(struct flash_queue *fq)
+{
+	if (!RB_EMPTY_NODE(&fq->rb_node))
+		flash_rb_erase(&fq->rb_node, fq->service_tree);
+}
+
+static void flash_add_rq(struct flash_data *fd, struct flash_queue *fq,
+			 struct request *rq, bool front)
+{
+	if (front)
+		list_add(&rq->queuelist, &fq->fifo);
+	else
+		list_add_tail(&rq->queuelist, &fq->fifo);
+	fd->queued[fq->type]++;
+
+	if (RB_EMPTY_NODE(&fq->rb_node))
+		flash_service_tree_add(fd, fq);
+}
+
+static void flash_remove_rq(struct flash_data *fd, struct request *rq)
+{
+	struct flash_queue *fq = RQ_FQ(rq);
+
+	list_del_init(&rq->queuelist);
+	/* a reinserted request is not on the sort list */
+	if (!RB_EMPTY_NODE(&rq->rb_node))
+		elv_rb_del(&fq->sort_list, rq);
+	fd->queued[fq->type]--;
+}
+
+static u64 flash_scaled_vios(struct flash_data *fd, struct flash_queue *fq)
+{
+	struct flash_ioc *ioc = fq->ioc;
+	int vios = VIOS_SCALE;
+
+	if (fq->type != FLASH_READ)
+		vios = vios * fd->write_scale / fd->read_scale;
+
+	if (fq->type == FLASH_ASYNC_WRITE)
+		vios = vios * fd->async_scale / fd->sync_scale;
+
+	vios += vios * (ioc->ioprio - IOPRIO_NORM) / VIOS_PRIO_SCALE;
+
+	return div_u64((u64)vios * BLKIO_WEIGHT_DEFAULT, ioc->weight);
+}
+
+static void flash_dispatch_request(struct flash_data *fd,
+				   struct flash_queue *fq)
+{
+	struct request *rq = rq_entry_fifo(fq->fifo.next);
+
+	flash_remove_rq(fd, rq);
+	rq->elv.priv[1] = (void *)flash_now_us();
+	elv_dispatch_add_tail(fd->queue, rq);
+
+	fd->in_flight[fq->type]++;
+	fq->in_flight++;
+}
+
+static int flash_forced_dispatch(struct flash_data *fd)
+{
+	struct flash_queue *fq;
+	int dispatched = 0;
+	int i, t;
+
+	for (i = RT_WORKLOAD; i >= IDLE_WORKLOAD; i--) {
+		for (t = 0; t < FLASH_NR_QUEUES; t++) {
+			while ((fq = flash_rb_first(&fd->service_tree[i][t]))) {
+				while (!list_empty(&fq->fifo)) {
+					flash_dispatch_request(fd, fq);
+					dispatched++;
+				}
+				flash_service_tree_del(fq);
+			}
+		}
+	}
+	fd->starved = 0;
+	return dispatched;
+}
+
+/*
+ * Async writes are held back once async_depth of them are in flight and
+ * reads are waiting or in flight; without reads they can go freely.
+ */
+static bool flash_async_may_dispatch(struct flash_data *fd)
+{
+	if (!fd->queued[FLASH_READ] && !fd->in_flight[FLASH_READ])
+		return true;
+	return fd->in_flight[FLASH_ASYNC_WRITE] < fd->async_depth;
+}
+
+static struct flash_queue *flash_select_queue(struct flash_data *fd)
+{
+	struct flash_rb_root *st = NULL;
+	bool writes;
+	int i;
+
+	for (i = RT_WORKLOAD; i >= IDLE_WORKLOAD; i--) {
+		st = fd->service_tree[i];
+		if (st[FLASH_READ].count || st[FLASH_SYNC_WRITE].count ||
+		    st[FLASH_ASYNC_WRITE].count)
+			break;
+	}
+	if (i < IDLE_WORKLOAD)
+		return NULL;
+
+	writes = st[FLASH_SYNC_WRITE].count ||
+		(st[FLASH_ASYNC_WRITE].count && flash_async_may_dispatch(fd));
+
+	if (st[FLASH_READ].count &&
+	    (!writes || fd->starved < fd->writes_starved)) {
+		if (writes)
+			fd->starved++;
+		return flash_rb_first(&st[FLASH_READ]);
+	}
+
+	if (!writes) {
+		flash_log(fd, "postpone async, in_flight async %u read %u",
+			  fd->in_flight[FLASH_ASYNC_WRITE],
+			  fd->in_flight[FLASH_READ]);
+		return NULL;
+	}
+
+	fd->starved = 0;
+	if (st[FLASH_SYNC_WRITE].count)
+		return flash_rb_first(&st[FLASH_SYNC_WRITE]);
+	return flash_rb_first(&st[FLASH_ASYNC_WRITE]);
+}
+
+static void flash_charge_vios(struct flash_data *fd, struct flash_queue *fq)
+{
+	struct flash_rb_root *service_tree = fq->service_tree;
+	u64 vios = flash_scaled_vios(fd, fq);
+
+	fq->vios += vios;
+
+	flash_log_fq(fd, fq, "charge vios %llu, new vios %llu",
+		     (unsigned long long)vios, (unsigned long long)fq->vios);
+
+	if (list_empty(&fq->fifo))
+		flash_service_tree_del(fq);
+	else
+		flash_service_tree_add(fd, fq);
+
+	flash_update_min_vios(service_tree);
+}
+
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_queue *fq;
+
+	if (unlikely(force))
+		return flash_forced_dispatch(fd);
+
+	fq = flash_select_queue(fd);
+	if (!fq)
+		return 0;
+
+	flash_dispatch_request(fd, fq);
+	flash_charge_vios(fd, fq);
+	return 1;
+}
+
+static void flash_init_prio_data(struct flash_ioc *cic)
+{
+	struct task_struct *tsk = current;
+	struct io_context *ioc = cic->icq.ioc;
+	int ioprio_class;
+
+	if (test_and_clear_bit(ICQ_IOPRIO_CHANGED, &cic->icq.changed))
+		cic->prio_changed = true;
+	if (!cic->prio_changed)
+		return;
+
+	ioprio_class = IOPRIO_PRIO_CLASS(ioc->ioprio);
+	switch (ioprio_class) {
+	default:
+		printk(KERN_ERR "flash: bad prio %x\n", ioprio_class);
+	case IOPRIO_CLASS_NONE:
+		/*
+		 * no prio set, inherit CPU scheduling settings
+		 */
+		cic->ioprio = task_nice_ioprio(tsk);
+		cic->wl_type = flash_wl_type(task_nice_ioclass(tsk));
+		break;
+	case IOPRIO_CLASS_RT:
+		cic->ioprio = task_ioprio(ioc);
+		cic->wl_type = flash_wl_type(IOPRIO_CLASS_RT);
+		break;
+	case IOPRIO_CLASS_BE:
+		cic->ioprio = task_ioprio(ioc);
+		cic->wl_type = flash_wl_type(IOPRIO_CLASS_BE);
+		break;
+	case IOPRIO_CLASS_IDLE:
+		cic->wl_type = flash_wl_type(IOPRIO_CLASS_IDLE);
+		cic->ioprio = 7;
+		break;
+	}
+
+	cic->prio_changed = false;
+}
+
+static void flash_insert_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_ioc *cic = RQ_CIC(rq);
+	struct flash_queue *fq;
+	int i;
+
+	flash_init_prio_data(cic);
+
+	/* the class changed, requeue everything still waiting */
+	for (i = 0; i < FLASH_NR_QUEUES; i++) {
+		fq = &cic->queues[i];
+		if (!RB_EMPTY_NODE(&fq->rb_node) &&
+		    fq->service_tree != &fd->service_tree[cic->wl_type][i])
+			flash_service_tree_add(fd, fq);
+	}
+
+	fq = &cic->queues[flash_rq_type(rq)];
+	rq->elv.priv[0] = fq;
+	elv_rb_add(&fq->sort_list, rq);
+	flash_add_rq(fd, fq, rq, false);
+}
+
+/*
+ * Put a request the driver gave up on (to serve an urgent read) back at
+ * the head of its queue, as if it had never been dispatched.
+ */
+static int flash_reinsert_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_queue *fq = RQ_FQ(rq);
+
+	fd->in_flight[fq->type]--;
+	fq->in_flight--;
+
+	RB_CLEAR_NODE(&rq->rb_node);
+	flash_add_rq(fd, fq, rq, true);
+
+	flash_log_fq(fd, fq, "request reinserted");
+	return 0;
+}
+
+/*
+ * Reads are urgent when writes are keeping the device busy: the driver
+ * may then stop the write in progress and fetch the read first.
+ */
+static bool flash_urgent_pending(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return fd->urgent_reads && fd->queued[FLASH_READ] &&
+		!fd->in_flight[FLASH_READ] &&
+		(fd->in_flight[FLASH_SYNC_WRITE] ||
+		 fd->in_flight[FLASH_ASYNC_WRITE]);
+}
+
+/*
+ * scheduler run of queue, if there are requests pending and no one in the
+ * driver that will restart queueing
+ */
+static inline void flash_schedule_dispatch(struct flash_data *fd)
+{
+	if (flash_busy_queues(fd))
+		kblockd_schedule_work(fd->queue, &fd->unplug_work);
+}
+
+/*
+ * Fold a read completion into the latency average and move async_depth
+ * toward target_latency: halve it at most once per target_latency while
+ * reads are too slow, open it up by one while they are fast enough and
+ * async writes are actually being held back.
+ */
+static void flash_update_latency(struct flash_data *fd, struct request *rq)
+{
+	unsigned long now = flash_now_us();
+	unsigned long lat = now - (unsigned long)rq->elv.priv[1];
+
+	if (lat > 100 * fd->target_latency)
+		lat = 100 * fd->target_latency;
+	fd->read_latency = (fd->read_latency * 7 + lat) / 8;
+
+	if (fd->read_latency > fd->target_latency) {
+		if (fd->async_depth > 1 &&
+		    now - fd->last_throttle > fd->target_latency) {
+			fd->async_depth /= 2;
+			fd->last_throttle = now;
+			flash_log(fd, "read latency %u, async depth %u",
+				  fd->read_latency, fd->async_depth);
+		}
+	} else if (fd->async_depth < fd->max_async_depth &&
+		   fd->queued[FLASH_ASYNC_WRITE] &&
+		   fd->in_flight[FLASH_ASYNC_WRITE] >= fd->async_depth) {
+		fd->async_depth++;
+	}
+}
+
+static void flash_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_queue *fq = RQ_FQ(rq);
+
+	fd->in_flight[fq->type]--;
+	fq->in_flight--;
+
+	if (fq->type == FLASH_READ)
+		flash_update_latency(fd, rq);
+
+	flash_log_fq(fd, fq, "in_flight %u, busy queues %u",
+		     fq->in_flight, flash_busy_queues(fd));
+
+	/* a held back async write may go now */
+	if (fq->type == FLASH_ASYNC_WRITE ||
+	    !(fd->in_flight[FLASH_READ] + fd->in_flight[FLASH_SYNC_WRITE] +
+	      fd->in_flight[FLASH_ASYNC_WRITE]))
+		flash_schedule_dispatch(fd);
+}
+
+static struct request *
+flash_find_rq_fmerge(struct flash_data *fd, struct bio *bio)
+{
+	struct flash_ioc *cic;
+
+	cic = flash_cic_lookup(fd, current->io_context);
+
+	if (cic) {
+		struct flash_queue *fq = &cic->queues[flash_bio_type(bio)];
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		return elv_rb_find(&fq->sort_list, sector);
+	}
+
+	return NULL;
+}
+
+static int flash_merge(struct request_queue *q, struct request **req,
+		       struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	__rq = flash_find_rq_fmerge(fd, bio);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q, struct request *req,
+				 int type)
+{
+	if (type == ELEVATOR_FRONT_MERGE) {
+		struct flash_queue *fq = RQ_FQ(req);
+
+		elv_rb_del(&fq->sort_list, req);
+		elv_rb_add(&fq->sort_list, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *rq,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_queue *fq = RQ_FQ(next);
+
+	flash_remove_rq(fd, next);
+
+	/*
+	 * all requests of this queue are merged to other queues, delete it
+	 * from the service tree.
+	 */
+	if (list_empty(&fq->fifo))
+		flash_service_tree_del(fq);
+}
+
+static int flash_allow_merge(struct request_queue *q, struct request *rq,
+			     struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_ioc *cic;
+
+	/*
+	 * Lookup the ioc that this bio will be queued with. Allow
+	 * merge only if rq is queued there, on the queue of its kind.
+	 */
+	cic = flash_cic_lookup(fd, current->io_context);
+
+	return cic == RQ_CIC(rq) && RQ_FQ(rq)->type == flash_bio_type(bio);
+}
+
+#ifdef CONFIG_BLK_CGROUP
+static void flash_update_weight(struct flash_data *fd, struct flash_ioc *cic)
+{
+	struct backing_dev_info *bdi = &fd->queue->backing_dev_info;
+	struct blkio_cgroup *blkcg;
+	unsigned int major, minor;
+
+	if (time_before(jiffies, cic->weight_stamp))
+		return;
+	cic->weight_stamp = jiffies + FLASH_WEIGHT_REFRESH;
+
+	if (!fd->dev && bdi->dev) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		fd->dev = MKDEV(major, minor);
+	}
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	cic->weight = blkcg_get_weight(blkcg, fd->dev);
+	rcu_read_unlock();
+}
+#else
+static inline void flash_update_weight(struct flash_data *fd,
+				       struct flash_ioc *cic)
+{
+}
+#endif
+
+/*
+ * Called for every new request, without queue_lock: the blkio cgroup
+ * lookup takes its own lock, so it is done here rather than on insert.
+ */
+static int flash_set_request(struct request_queue *q, struct request *rq,
+			     gfp_t gfp_mask)
+{
+	flash_update_weight(q->elevator->elevator_data, RQ_CIC(rq));
+	return 0;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	cancel_work_sync(&fd->unplug_work);
+
+	kfree(fd);
+}
+
+static void flash_kick_queue(struct work_struct *work)
+{
+	struct flash_data *fd =
+		container_of(work, struct flash_data, unplug_work);
+	struct request_queue *q = fd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+static int flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i, t;
+
+	fd = kzalloc_node(sizeof(*fd), GFP_KERNEL, q->node);
+	if (!fd)
+		return -ENOMEM;
+
+	fd->queue = q;
+
+	for (i = IDLE_WORKLOAD; i <= RT_WORKLOAD; i++)
+		for (t = 0; t < FLASH_NR_QUEUES; t++)
+			fd->service_tree[i][t] = FLASH_RB_ROOT;
+
+	INIT_WORK(&fd->unplug_work, flash_kick_queue);
+
+	fd->read_scale = VIOS_READ_SCALE;
+	fd->write_scale = VIOS_WRITE_SCALE;
+	fd->sync_scale = VIOS_SYNC_SCALE;
+	fd->async_scale = VIOS_ASYNC_SCALE;
+	fd->writes_starved = FLASH_WRITES_STARVED;
+	fd->target_latency = FLASH_TARGET_LATENCY;
+	fd->max_async_depth = FLASH_MAX_ASYNC_DEPTH;
+	fd->async_depth = FLASH_MAX_ASYNC_DEPTH;
+	fd->urgent_reads = 1;
+
+	q->elevator->elevator_data = fd;
+
+	return 0;
+}
+
+static void flash_init_icq(struct io_cq *icq)
+{
+	struct flash_data *fd = icq->q->elevator->elevator_data;
+	struct flash_ioc *cic = icq_to_cic(icq);
+	int t;
+
+	for (t = 0; t < FLASH_NR_QUEUES; t++) {
+		struct flash_queue *fq = &cic->queues[t];
+
+		fq->ioc = cic;
+		fq->type = t;
+		RB_CLEAR_NODE(&fq->rb_node);
+		INIT_LIST_HEAD(&fq->fifo);
+		fq->sort_list = RB_ROOT;
+	}
+
+	cic->fd = fd;
+	cic->pid = current->pid;
+	cic->prio_changed = true;
+	cic->weight = BLKIO_WEIGHT_DEFAULT;
+	cic->weight_stamp = jiffies;
+}
+
+/*
+ * sysfs parts below -->
+ */
+static ssize_t
+flash_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%u\n", var);
+}
+
+static ssize_t
+flash_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	return flash_var_show(__VAR, (page));				\
+}
+SHOW_FUNCTION(flash_read_scale_show, fd->read_scale);
+SHOW_FUNCTION(flash_write_scale_show, fd->write_scale);
+SHOW_FUNCTION(flash_sync_scale_show, fd->sync_scale);
+SHOW_FUNCTION(flash_async_scale_show, fd->async_scale);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved);
+SHOW_FUNCTION(flash_target_latency_show, fd->target_latency);
+SHOW_FUNCTION(flash_max_async_depth_show, fd->max_async_depth);
+SHOW_FUNCTION(flash_urgent_reads_show, fd->urgent_reads);
+SHOW_FUNCTION(flash_async_depth_show, fd->async_depth);
+SHOW_FUNCTION(flash_read_latency_show, fd->read_latency);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)				\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	*(__PTR) = __data;						\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_scale_store, &fd->read_scale, 1, 100);
+STORE_FUNCTION(flash_write_scale_store, &fd->write_scale, 1, 100);
+STORE_FUNCTION(flash_sync_scale_store, &fd->sync_scale, 1, 100);
+STORE_FUNCTION(flash_async_scale_store, &fd->async_scale, 1, 100);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX);
+STORE_FUNCTION(flash_target_latency_store, &fd->target_latency,
+	       100, 10 * USEC_PER_SEC);
+STORE_FUNCTION(flash_urgent_reads_store, &fd->urgent_reads, 0, 1);
+#undef STORE_FUNCTION
+
+static ssize_t flash_max_async_depth_store(struct elevator_queue *e,
+					   const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+	unsigned int __data;
+	int ret = flash_var_store(&__data, page, count);
+
+	fd->max_async_depth = clamp_t(unsigned int, __data, 1, BLKDEV_MAX_RQ);
+	fd->async_depth = fd->max_async_depth;
+	return ret;
+}
+
+#define FLASH_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, flash_##name##_store)
+#define FLASH_ATTR_RO(name) \
+	__ATTR(name, S_IRUGO, flash_##name##_show, NULL)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FLASH_ATTR(read_scale),
+	FLASH_ATTR(write_scale),
+	FLASH_ATTR(sync_scale),
+	FLASH_ATTR(async_scale),
+	FLASH_ATTR(writes_starved),
+	FLASH_ATTR(target_latency),
+	FLASH_ATTR(max_async_depth),
+	FLASH_ATTR(urgent_reads),
+	FLASH_ATTR_RO(async_depth),
+	FLASH_ATTR_RO(read_latency),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn =		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_insert_request,
+		.elevator_reinsert_req_fn =	flash_reinsert_request,
+		.elevator_is_urgent_fn =	flash_urgent_pending,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_init_icq_fn =		flash_init_icq,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+	.icq_size	=	sizeof(struct flash_ioc),
+	.icq_align	=	__alignof__(struct flash_ioc),
+	.elevator_attrs =	flash_attrs,
+	.elevator_name =	"flash",
+	.elevator_owner =	THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	return elv_register(&iosched_flash);
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_AUTHOR("Jens Axboe, Shaohua Li <shli@kernel.org>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Flash storage IO scheduler");
@@ -48,8 +48,7 @@ static int snp_compress(struct crypto_tfm *tfm, const u8 *src,
 	size_t olen = *dlen;
 	int err;
 
-	/* XXXX very pessimistic. check in snappy? */
-	if (*dlen < snappy_max_compressed_length(*dlen))
+	if (*dlen < snappy_max_compressed_length(slen))
 		return -EINVAL;
 	err = snappy_compress(&ctx->env, src, slen, dst, &olen);
 
@@ -64,7 +64,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", "lz4hc", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -719,6 +719,173 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+/*
+ * Used by test_comp_speed(): every compressor is fed the same data, about
+ * half of which repeats a recent run of bytes.
+ */
+static void test_comp_fill(u8 *buf, unsigned int len)
+{
+	u32 seed = 0x2545f491;
+	unsigned int i = 0, run, off;
+
+	while (i < len) {
+		seed = seed * 1103515245 + 12345;
+		run = 4 + ((seed >> 8) & 15);
+		off = 1 + ((seed >> 12) & 255);
+		if ((seed >> 24) & 1 && off <= i) {
+			for (; run && i < len; run--, i++)
+				buf[i] = buf[i - off];
+		} else {
+			buf[i++] = 'a' + ((seed >> 16) & 31);
+		}
+	}
+}
+
+static int test_comp_jiffies(struct crypto_comp *tfm, int comp,
+			     const u8 *src, unsigned int slen, u8 *dst,
+			     int sec)
+{
+	unsigned long start, end;
+	unsigned int dlen;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + sec * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		dlen = PAGE_SIZE;
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst, &dlen);
+
+		if (ret)
+			return ret;
+	}
+
+	printk("%d operations in %d seconds (%ld bytes)\n",
+	       bcount, sec, (long)bcount * (comp ? slen : dlen));
+	return 0;
+}
+
+static int test_comp_cycles(struct crypto_comp *tfm, int comp,
+			    const u8 *src, unsigned int slen, u8 *dst)
+{
+	unsigned long cycles = 0;
+	unsigned int dlen = 0;
+	int ret = 0;
+	int i;
+
+	local_bh_disable();
+	local_irq_disable();
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		dlen = PAGE_SIZE;
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst, &dlen);
+
+		if (ret)
+			goto out;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		dlen = PAGE_SIZE;
+		start = get_cycles();
+		if (comp)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst, &dlen);
+		end = get_cycles();
+
+		if (ret)
+			goto out;
+
+		cycles += end - start;
+	}
+
+out:
+	local_irq_enable();
+	local_bh_enable();
+
+	if (ret == 0)
+		printk("1 operation in %lu cycles (%u bytes)\n",
+		       (cycles + 4) / 8, comp ? slen : dlen);
+
+	return ret;
+}
+
+static u32 comp_block_sizes[] = { 512, 1024, 2048, 4096, 0 };
+
+static void test_comp_speed(const char *algo, unsigned int sec)
+{
+	struct crypto_comp *tfm;
+	u8 *src = tvmem[0], *comp = tvmem[1], *decomp = tvmem[2];
+	unsigned int clen, dlen;
+	u32 *b_size;
+	int ret;
+
+	printk(KERN_INFO "\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk(KERN_ERR "failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	test_comp_fill(src, PAGE_SIZE);
+
+	for (b_size = comp_block_sizes; *b_size; b_size++) {
+		if (*b_size > PAGE_SIZE)
+			break;
+
+		clen = PAGE_SIZE;
+		ret = crypto_comp_compress(tfm, src, *b_size, comp, &clen);
+		if (ret) {
+			printk(KERN_ERR "%s: compression failed ret=%d\n",
+			       algo, ret);
+			break;
+		}
+
+		dlen = PAGE_SIZE;
+		ret = crypto_comp_decompress(tfm, comp, clen, decomp, &dlen);
+		if (ret || dlen != *b_size || memcmp(src, decomp, dlen)) {
+			printk(KERN_ERR "%s: decompression mismatch ret=%d\n",
+			       algo, ret);
+			break;
+		}
+
+		printk(KERN_INFO "test %u (%u byte blocks, %u compressed): ",
+		       (unsigned int)(b_size - comp_block_sizes), *b_size, clen);
+
+		printk("compress ");
+		if (sec)
+			ret = test_comp_jiffies(tfm, 1, src, *b_size, comp, sec);
+		else
+			ret = test_comp_cycles(tfm, 1, src, *b_size, comp);
+		if (ret)
+			break;
+
+		printk("decompress ");
+		if (sec)
+			ret = test_comp_jiffies(tfm, 0, comp, clen, decomp, sec);
+		else
+			ret = test_comp_cycles(tfm, 0, comp, clen, decomp);
+		if (ret) {
+			printk(KERN_ERR "%s: decompression failed ret=%d\n",
+			       algo, ret);
+			break;
+		}
+	}
+
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -948,6 +1115,14 @@ static int do_test(int m)
 		ret += tcrypt_test("ofb(aes)");
 		break;
 
+	case 47:
+		ret += tcrypt_test("lz4");
+		break;
+
+	case 48:
+		ret += tcrypt_test("lz4hc");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1239,6 +1414,32 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 600:
+		/* fall through */
+
+	case 601:
+		test_comp_speed("lzo", sec);
+		if (mode > 600 && mode < 700) break;
+
+	case 602:
+		test_comp_speed("snappy", sec);
+		if (mode > 600 && mode < 700) break;
+
+	case 603:
+		test_comp_speed("deflate", sec);
+		if (mode > 600 && mode < 700) break;
+
+	case 604:
+		test_comp_speed("lz4", sec);
+		if (mode > 600 && mode < 700) break;
+
+	case 605:
+		test_comp_speed("lz4hc", sec);
+		if (mode > 600 && mode < 700) break;
+
+	case 699:
+		break;
+
 	case 1000:
 		test_available();
 		break;
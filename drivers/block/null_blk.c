@@ -0,0 +1,215 @@
+/*
+ * Null block device driver.
+ *
+ * Completes every I/O without touching any data, so that the cost of the
+ * block layer itself can be measured. The disks can either take bios
+ * directly or go through the multi-queue submission path, to compare the
+ * two.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	struct blk_mq_tag_set tag_set;
+};
+
+static LIST_HEAD(nullb_list);
+static int null_major;
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_MQ		= 1,
+
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+};
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Submission path: 0=bio, 1=multi-queue");
+
+static int submit_queues;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Hardware queues in multi-queue mode (default: one per CPU)");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Requests per hardware queue");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "Completion: 0=inline, 1=block softirq on the submitting CPU");
+
+static int nr_devices = 1;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size of each device in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Logical block size in bytes");
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	if (irqmode == NULL_IRQ_SOFTIRQ) {
+		rq->errors = 0;
+		blk_mq_complete_request(rq);
+	} else {
+		blk_mq_end_io(rq, 0);
+	}
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+};
+
+static void null_make_request(struct request_queue *q, struct bio *bio)
+{
+	bio_endio(bio, 0);
+}
+
+static const struct block_device_operations null_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del(&nullb->list);
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	if (queue_mode == NULL_Q_MQ)
+		blk_mq_free_tag_set(&nullb->tag_set);
+	kfree(nullb);
+}
+
+static int null_add_dev(unsigned int index)
+{
+	struct nullb *nullb;
+	struct gendisk *disk;
+	sector_t size;
+	int ret = -ENOMEM;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+	nullb->index = index;
+
+	if (queue_mode == NULL_Q_MQ) {
+		nullb->tag_set.ops = &null_mq_ops;
+		nullb->tag_set.nr_hw_queues = submit_queues;
+		nullb->tag_set.queue_depth = hw_queue_depth;
+		nullb->tag_set.numa_node = NUMA_NO_NODE;
+		nullb->tag_set.driver_data = nullb;
+
+		ret = blk_mq_alloc_tag_set(&nullb->tag_set);
+		if (ret)
+			goto out_free;
+		nullb->q = blk_mq_init_queue(&nullb->tag_set);
+		if (IS_ERR(nullb->q)) {
+			ret = PTR_ERR(nullb->q);
+			goto out_free_tags;
+		}
+	} else {
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (!nullb->q)
+			goto out_free;
+		blk_queue_make_request(nullb->q, null_make_request);
+	}
+
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup_queue;
+
+	size = (sector_t)gb * 1024 * 1024 * 1024;
+	set_capacity(disk, size >> 9);
+
+	disk->major = null_major;
+	disk->first_minor = index;
+	disk->fops = &null_fops;
+	disk->private_data = nullb;
+	disk->queue = nullb->q;
+	sprintf(disk->disk_name, "nullb%d", index);
+	add_disk(disk);
+
+	list_add_tail(&nullb->list, &nullb_list);
+	return 0;
+
+out_cleanup_queue:
+	blk_cleanup_queue(nullb->q);
+out_free_tags:
+	if (queue_mode == NULL_Q_MQ)
+		blk_mq_free_tag_set(&nullb->tag_set);
+out_free:
+	kfree(nullb);
+	return ret;
+}
+
+static int __init null_init(void)
+{
+	struct nullb *nullb, *next;
+	unsigned int i;
+
+	if (queue_mode != NULL_Q_BIO && queue_mode != NULL_Q_MQ) {
+		pr_warn("null_blk: invalid queue_mode %d, using multi-queue\n",
+			queue_mode);
+		queue_mode = NULL_Q_MQ;
+	}
+	if (bs < 512 || bs > PAGE_SIZE || !is_power_of_2(bs))
+		bs = 512;
+	if (submit_queues <= 0 || submit_queues > nr_cpu_ids)
+		submit_queues = nr_cpu_ids;
+	if (hw_queue_depth <= 0 || hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = 64;
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev(i)) {
+			list_for_each_entry_safe(nullb, next, &nullb_list, list)
+				null_del_dev(nullb);
+			unregister_blkdev(null_major, "nullb");
+			return -ENOMEM;
+		}
+	}
+
+	pr_info("null_blk: %d devices, %s submission\n", nr_devices,
+		queue_mode == NULL_Q_MQ ? "multi-queue" : "bio");
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb, *next;
+
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	unregister_blkdev(null_major, "nullb");
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Null block device for block layer benchmarking");
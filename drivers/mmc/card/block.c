@@ -89,6 +89,7 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_CMD	(1 << 2)	/* MMC packed command support */
 
 	unsigned int	usage;
 	unsigned int	read_only;
@@ -791,6 +792,11 @@ static int mmc_blk_issue_flush(struct mmc_queue *mq, struct request *req)
 	return 1;
 }
 
+static inline bool mmc_req_rel_wr(struct request *req)
+{
+	return (req->cmd_flags & REQ_FUA) || (req->cmd_flags & REQ_META);
+}
+
 /*
  * Reformat current write as a reliable write, supporting
  * both legacy and the enhanced reliable write MMC cards.
@@ -906,13 +912,77 @@ static int mmc_blk_err_check(struct mmc_card *card,
 		}
 	}
 
-	if (ret == MMC_BLK_SUCCESS &&
-	    blk_rq_bytes(req) != brq->data.bytes_xfered)
+	if (mmc_packed_cmd(mq_mrq->cmd_type)) {
+		if (brq->data.bytes_xfered !=
+		    brq->data.blocks * brq->data.blksz)
+			ret = MMC_BLK_PARTIAL;
+	} else if (blk_rq_bytes(req) != brq->data.bytes_xfered) {
 		ret = MMC_BLK_PARTIAL;
+	}
 
 	return ret;
 }
 
+static int mmc_blk_packed_err_check(struct mmc_card *card,
+				    struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_rq = container_of(areq, struct mmc_queue_req,
+						   mmc_active);
+	struct request *req = mq_rq->req;
+	struct mmc_packed *packed = mq_rq->packed;
+	int err, check;
+	u32 status;
+	u8 *ext_csd;
+
+	packed->retries--;
+	check = mmc_blk_err_check(card, areq);
+	err = get_card_status(card, &status, 0);
+	if (err) {
+		pr_err("%s: error %d sending status command\n",
+		       req->rq_disk->disk_name, err);
+		return MMC_BLK_ABORT;
+	}
+
+	if (!(status & R1_EXCEPTION_EVENT))
+		return check;
+
+	ext_csd = kzalloc(512, GFP_KERNEL);
+	if (!ext_csd) {
+		pr_err("%s: unable to allocate buffer for ext_csd\n",
+		       req->rq_disk->disk_name);
+		return MMC_BLK_ABORT;
+	}
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (err) {
+		pr_err("%s: error %d sending ext_csd\n",
+		       req->rq_disk->disk_name, err);
+		check = MMC_BLK_ABORT;
+		goto out;
+	}
+
+	if ((ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_PACKED_FAILURE) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_GENERIC_ERROR)) {
+		/* the card counts the entries from 1 */
+		if ((ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+		     EXT_CSD_PACKED_INDEXED_ERROR) &&
+		    ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] > 0 &&
+		    ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] <=
+		    packed->nr_entries) {
+			packed->idx_failure =
+				ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] - 1;
+			check = MMC_BLK_PARTIAL;
+		}
+		pr_err("%s: packed cmd failed, nr %u, sectors %u, failure index: %d\n",
+		       req->rq_disk->disk_name, packed->nr_entries,
+		       packed->blocks, packed->idx_failure);
+	}
+out:
+	kfree(ext_csd);
+	return check;
+}
+
 static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 			       struct mmc_card *card,
 			       int disable_multi,
@@ -930,8 +1000,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	 * XXX: this really needs a good explanation of why REQ_META
 	 * is treated special.
 	 */
-	bool do_rel_wr = ((req->cmd_flags & REQ_FUA) ||
-			  (req->cmd_flags & REQ_META)) &&
+	bool do_rel_wr = mmc_req_rel_wr(req) &&
 		(rq_data_dir(req) == WRITE) &&
 		(md->flags & MMC_BLK_REL_WR);
 
@@ -1049,6 +1118,291 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	mmc_queue_bounce_pre(mqrq);
 }
 
+static void mmc_blk_packed_stats(struct mmc_card *card, u8 entries,
+				 enum mmc_packed_stop_reason reason)
+{
+	struct mmc_packed_stats *stats = &card->packed_stats;
+
+	spin_lock(&stats->lock);
+	if (entries > MMC_PACKED_NR_SINGLE)
+		stats->packed[entries]++;
+	else
+		stats->unpacked++;
+	stats->stop[reason]++;
+	spin_unlock(&stats->lock);
+}
+
+static void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
+{
+	struct mmc_packed *packed = mqrq->packed;
+
+	mqrq->cmd_type = MMC_PACKED_NONE;
+	packed->nr_entries = 0;
+	packed->blocks = 0;
+	packed->retries = 0;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+}
+
+/*
+ * Check whether a write can be packed with the writes queued behind it.
+ * Pulls the ones that fit off the queue and returns the total number of
+ * requests in the packed command, or 0 if @req goes out on its own.
+ */
+static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	struct mmc_packed *packed = mqrq->packed;
+	struct request *next;
+	bool en_rel_wr = card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN;
+	bool large_sec = mmc_large_sector(card);
+	unsigned int req_sectors, phys_segments, hdr_blocks;
+	unsigned int max_blk_count, max_phys_segs;
+	enum mmc_packed_stop_reason reason;
+	u8 max_packed_rw, reqs = 1;
+
+	mqrq->cmd_type = MMC_PACKED_NONE;
+
+	if (!(md->flags & MMC_BLK_PACKED_CMD) || rq_data_dir(req) != WRITE)
+		return 0;
+
+	if (mmc_req_rel_wr(req) && (md->flags & MMC_BLK_REL_WR) &&
+	    !en_rel_wr) {
+		reason = MMC_PACKED_STOP_REL_WRITE;
+		goto no_packed;
+	}
+
+	if (large_sec && !IS_ALIGNED(blk_rq_sectors(req), 8)) {
+		reason = MMC_PACKED_STOP_LARGE_SEC_ALIGN;
+		goto no_packed;
+	}
+
+	max_packed_rw = min_t(unsigned int, card->ext_csd.max_packed_writes,
+			      MMC_PACKED_MAX_ENTRIES);
+	/* CMD23 carries a 16 bit block count */
+	max_blk_count = min(card->host->max_blk_count,
+			    card->host->max_req_size >> 9);
+	max_blk_count = min(max_blk_count, 0xffffU);
+	max_phys_segs = queue_max_segments(q);
+
+	hdr_blocks = large_sec ? 8 : 1;
+	req_sectors = blk_rq_sectors(req) + hdr_blocks;
+	phys_segments = req->nr_phys_segments +
+		DIV_ROUND_UP(hdr_blocks << 9, queue_max_segment_size(q));
+
+	if (req_sectors > max_blk_count) {
+		reason = MMC_PACKED_STOP_EXCEEDS_SECTORS;
+		goto no_packed;
+	}
+	if (phys_segments > max_phys_segs) {
+		reason = MMC_PACKED_STOP_EXCEEDS_SEGMENTS;
+		goto no_packed;
+	}
+
+	/*
+	 * Look at and take the next request under the queue lock, so that
+	 * nothing gets merged into it in between.
+	 */
+	spin_lock_irq(q->queue_lock);
+	for (;;) {
+		if (reqs >= max_packed_rw) {
+			reason = MMC_PACKED_STOP_MAX_ENTRIES;
+			break;
+		}
+
+		next = blk_peek_request(q);
+		if (!next) {
+			reason = MMC_PACKED_STOP_EMPTY_QUEUE;
+			break;
+		}
+		if (next->cmd_flags & (REQ_DISCARD | REQ_FLUSH)) {
+			reason = MMC_PACKED_STOP_FLUSH_OR_DISCARD;
+			break;
+		}
+		if (rq_data_dir(next) != WRITE) {
+			reason = MMC_PACKED_STOP_WRONG_DATA_DIR;
+			break;
+		}
+		if (mmc_req_rel_wr(next) && (md->flags & MMC_BLK_REL_WR) &&
+		    !en_rel_wr) {
+			reason = MMC_PACKED_STOP_REL_WRITE;
+			break;
+		}
+		if (large_sec && !IS_ALIGNED(blk_rq_sectors(next), 8)) {
+			reason = MMC_PACKED_STOP_LARGE_SEC_ALIGN;
+			break;
+		}
+		if (req_sectors + blk_rq_sectors(next) > max_blk_count) {
+			reason = MMC_PACKED_STOP_EXCEEDS_SECTORS;
+			break;
+		}
+		if (phys_segments + next->nr_phys_segments > max_phys_segs) {
+			reason = MMC_PACKED_STOP_EXCEEDS_SEGMENTS;
+			break;
+		}
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &packed->list);
+		req_sectors += blk_rq_sectors(next);
+		phys_segments += next->nr_phys_segments;
+		reqs++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (reqs > MMC_PACKED_NR_SINGLE) {
+		list_add(&req->queuelist, &packed->list);
+		packed->nr_entries = reqs;
+		packed->retries = MMC_PACKED_RETRIES;
+		mqrq->cmd_type = MMC_PACKED_WRITE;
+		mmc_blk_packed_stats(card, reqs, reason);
+		return reqs;
+	}
+
+no_packed:
+	mmc_blk_packed_stats(card, MMC_PACKED_NR_SINGLE, reason);
+	return 0;
+}
+
+static void mmc_blk_packed_hdr_wrq_prep(struct mmc_queue_req *mqrq,
+					struct mmc_card *card,
+					struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_packed *packed = mqrq->packed;
+	u32 *hdr = packed->cmd_hdr;
+	struct request *prq;
+	unsigned int hdr_blocks = mmc_large_sector(card) ? 8 : 1;
+	bool do_rel_wr;
+	int i = 1;
+
+	mqrq->cmd_type = MMC_PACKED_WRITE;
+	packed->blocks = 0;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+
+	memset(hdr, 0, hdr_blocks << 9);
+	hdr[0] = MMC_PACKED_HDR(packed->nr_entries, MMC_PACKED_CMD_WR);
+	list_for_each_entry(prq, &packed->list, queuelist) {
+		do_rel_wr = mmc_req_rel_wr(prq) && (md->flags & MMC_BLK_REL_WR);
+		/* argument of the CMD23 this entry stands for */
+		hdr[i * 2] = (do_rel_wr ? MMC_CMD23_ARG_REL_WR : 0) |
+			blk_rq_sectors(prq);
+		/* and of its CMD25 */
+		hdr[i * 2 + 1] = mmc_card_blockaddr(card) ?
+			blk_rq_pos(prq) : blk_rq_pos(prq) << 9;
+		packed->blocks += blk_rq_sectors(prq);
+		i++;
+	}
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	brq->mrq.sbc = &brq->sbc;
+	brq->mrq.stop = &brq->stop;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (packed->blocks + hdr_blocks);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = packed->blocks + hdr_blocks;
+	brq->data.flags |= MMC_DATA_WRITE;
+
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_packed_map_sg(mq, mqrq);
+
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_packed_err_check;
+}
+
+static void mmc_blk_prep_any(struct mmc_queue_req *mqrq,
+			     struct mmc_card *card, int disable_multi,
+			     struct mmc_queue *mq)
+{
+	if (mmc_packed_cmd(mqrq->cmd_type))
+		mmc_blk_packed_hdr_wrq_prep(mqrq, card, mq);
+	else
+		mmc_blk_rw_rq_prep(mqrq, card, disable_multi, mq);
+}
+
+/*
+ * Complete the requests of a packed command up to the entry the card
+ * failed at, if any. Returns 1 if requests are left, in which case @mq_rq
+ * now describes them and is to be sent again.
+ */
+static int mmc_blk_end_packed_req(struct mmc_queue *mq,
+				  struct mmc_queue_req *mq_rq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_packed *packed = mq_rq->packed;
+	int idx = packed->idx_failure, i = 0;
+	struct request *prq;
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		if (i == idx) {
+			spin_unlock_irq(&md->lock);
+
+			packed->nr_entries -= idx;
+			mq_rq->req = prq;
+			if (packed->nr_entries == MMC_PACKED_NR_SINGLE) {
+				list_del_init(&prq->queuelist);
+				mmc_blk_clear_packed(mq_rq);
+			}
+
+			spin_lock(&mq->card->packed_stats.lock);
+			mq->card->packed_stats.retries++;
+			spin_unlock(&mq->card->packed_stats.lock);
+			return 1;
+		}
+		list_del_init(&prq->queuelist);
+		__blk_end_request(prq, 0, blk_rq_bytes(prq));
+		i++;
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mq_rq);
+	return 0;
+}
+
+static void mmc_blk_abort_packed_req(struct mmc_queue *mq,
+				     struct mmc_queue_req *mq_rq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_packed *packed = mq_rq->packed;
+	struct request *prq;
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		list_del_init(&prq->queuelist);
+		__blk_end_request(prq, -EIO, blk_rq_bytes(prq));
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mq_rq);
+
+	spin_lock(&mq->card->packed_stats.lock);
+	mq->card->packed_stats.failures++;
+	spin_unlock(&mq->card->packed_stats.lock);
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 {
 	struct mmc_blk_data *md = mq->data;
@@ -1063,9 +1417,12 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	if (!rqc && !mq->mqrq_prev->req)
 		return 0;
 
+	if (rqc)
+		mmc_blk_prep_packed_list(mq, rqc);
+
 	do {
 		if (rqc) {
-			mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+			mmc_blk_prep_any(mq->mqrq_cur, card, 0, mq);
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -1081,6 +1438,19 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 		switch (status) {
 		case MMC_BLK_SUCCESS:
 		case MMC_BLK_PARTIAL:
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				/*
+				 * Without a failure index it is not known
+				 * which entries made it, so resend them all.
+				 */
+				if (status == MMC_BLK_PARTIAL &&
+				    mq_rq->packed->idx_failure ==
+				    MMC_PACKED_NR_IDX)
+					ret = 1;
+				else
+					ret = mmc_blk_end_packed_req(mq, mq_rq);
+				break;
+			}
 			/*
 			 * A block was successfully transferred.
 			 */
@@ -1132,7 +1502,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			 * In case of a none complete request
 			 * prepare it again and resend.
 			 */
-			mmc_blk_rw_rq_prep(mq_rq, card, disable_multi, mq);
+			if (mmc_packed_cmd(mq_rq->cmd_type) &&
+			    !mq_rq->packed->retries)
+				goto cmd_abort;
+			mmc_blk_prep_any(mq_rq, card, disable_multi, mq);
 			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
 		}
 	} while (ret);
@@ -1143,6 +1516,9 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	return 1;
 
  cmd_err:
+	if (mmc_packed_cmd(mq_rq->cmd_type))
+		goto cmd_abort;
+
  	/*
  	 * If this is an SD card and we're writing, we can first
  	 * mark the known good sectors as ok.
@@ -1167,14 +1543,19 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	}
 
  cmd_abort:
-	spin_lock_irq(&md->lock);
-	while (ret)
-		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
-	spin_unlock_irq(&md->lock);
+	if (mmc_packed_cmd(mq_rq->cmd_type)) {
+		mmc_blk_abort_packed_req(mq, mq_rq);
+	} else {
+		spin_lock_irq(&md->lock);
+		while (ret)
+			ret = __blk_end_request(req, -EIO,
+						blk_rq_cur_bytes(req));
+		spin_unlock_irq(&md->lock);
+	}
 
  start_new_req:
 	if (rqc) {
-		mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+		mmc_blk_prep_any(mq->mqrq_cur, card, 0, mq);
 		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
 	}
 
@@ -1340,6 +1721,12 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	if (mmc_card_mmc(card) && (md->flags & MMC_BLK_CMD23) &&
+	    card->ext_csd.packed_event_en) {
+		if (!mmc_packed_init(&md->queue, card))
+			md->flags |= MMC_BLK_PACKED_CMD;
+	}
+
 	return md;
 
  err_putdisk:
@@ -1453,6 +1840,8 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 
 		/* Then flush out any already in there */
 		mmc_cleanup_queue(&md->queue);
+		if (md->flags & MMC_BLK_PACKED_CMD)
+			mmc_packed_clean(&md->queue);
 		mmc_blk_put(md);
 	}
 }
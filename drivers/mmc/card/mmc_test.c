@@ -787,6 +787,8 @@ static int mmc_test_check_result(struct mmc_test_card *test,
 
 	ret = 0;
 
+	if (!ret && mrq->sbc && mrq->sbc->error)
+		ret = mrq->sbc->error;
 	if (!ret && mrq->cmd->error)
 		ret = mrq->cmd->error;
 	if (!ret && mrq->data->error)
@@ -2419,6 +2421,234 @@ static int mmc_test_profile_sglen_r_nonblock_perf(struct mmc_test_card *test)
 	return mmc_test_rw_multiple_sg_len(test, &test_data);
 }
 
+/*
+ * Packed writes need an eMMC 4.5 card and a host that sends CMD23.
+ */
+static int mmc_test_packed_supported(struct mmc_test_card *test)
+{
+	struct mmc_card *card = test->card;
+
+	if (!mmc_card_mmc(card) || !card->ext_csd.max_packed_writes)
+		return RESULT_UNSUP_CARD;
+	if (!mmc_host_cmd23(card->host))
+		return RESULT_UNSUP_HOST;
+	return 0;
+}
+
+/*
+ * Fill in a packed write of @nr entries of @blocks blocks each, at @addrs.
+ * @sg maps the header @hdr first, then the data of all entries.
+ */
+static void mmc_test_prepare_packed_mrq(struct mmc_test_card *test,
+	struct mmc_request *mrq, u32 *hdr, struct scatterlist *sg,
+	unsigned sg_len, unsigned *addrs, unsigned nr, unsigned blocks)
+{
+	struct mmc_card *card = test->card;
+	unsigned hdr_blocks = mmc_large_sector(card) ? 8 : 1;
+	unsigned i;
+
+	memset(hdr, 0, hdr_blocks * 512);
+	hdr[0] = MMC_PACKED_HDR(nr, MMC_PACKED_CMD_WR);
+	for (i = 1; i <= nr; i++) {
+		hdr[i * 2] = blocks;
+		hdr[i * 2 + 1] = addrs[i - 1];
+		if (!mmc_card_blockaddr(card))
+			hdr[i * 2 + 1] <<= 9;
+	}
+
+	mrq->sbc->opcode = MMC_SET_BLOCK_COUNT;
+	mrq->sbc->arg = MMC_CMD23_ARG_PACKED | (nr * blocks + hdr_blocks);
+	mrq->sbc->flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	mmc_test_prepare_mrq(test, mrq, sg, sg_len, addrs[0],
+			     nr * blocks + hdr_blocks, 512, 1);
+}
+
+static int mmc_test_packed_transfer(struct mmc_test_card *test, u32 *hdr,
+	struct scatterlist *sg, unsigned sg_len, unsigned *addrs,
+	unsigned nr, unsigned blocks)
+{
+	struct mmc_request mrq = {0};
+	struct mmc_command sbc = {0};
+	struct mmc_command cmd = {0};
+	struct mmc_command stop = {0};
+	struct mmc_data data = {0};
+
+	mrq.sbc = &sbc;
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+
+	mmc_test_prepare_packed_mrq(test, &mrq, hdr, sg, sg_len, addrs, nr,
+				    blocks);
+
+	mmc_wait_for_req(test->card->host, &mrq);
+
+	mmc_test_wait_busy(test);
+
+	return mmc_test_check_result(test, &mrq);
+}
+
+/*
+ * Write every other sector of the test buffer area in one packed command
+ * and check that the written sectors read back and the others did not
+ * change.
+ */
+static int mmc_test_packed_write_verify(struct mmc_test_card *test)
+{
+	unsigned addrs[4], nr = ARRAY_SIZE(addrs);
+	struct scatterlist sg[2];
+	unsigned i, j;
+	u32 *hdr;
+	int ret;
+
+	ret = mmc_test_packed_supported(test);
+	if (ret)
+		return ret;
+	if (mmc_large_sector(test->card))
+		return RESULT_UNSUP_CARD;
+
+	hdr = kzalloc(512, GFP_KERNEL);
+	if (!hdr)
+		return -ENOMEM;
+
+	for (i = 0; i < nr * 512; i++)
+		test->scratch[i] = (u8)(i + (i >> 9));
+	for (i = 0; i < nr; i++)
+		addrs[i] = 2 * i + 1;
+
+	sg_init_table(sg, 2);
+	sg_set_buf(&sg[0], hdr, 512);
+	sg_set_buf(&sg[1], test->scratch, nr * 512);
+
+	ret = mmc_test_packed_transfer(test, hdr, sg, 2, addrs, nr, 1);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < 2 * nr; i++) {
+		ret = mmc_test_buffer_transfer(test, test->buffer, i, 512, 0);
+		if (ret)
+			goto out;
+
+		for (j = 0; j < 512; j++) {
+			if (i & 1) {
+				if (test->buffer[j] !=
+				    test->scratch[(i / 2) * 512 + j])
+					break;
+			} else if (test->buffer[j] != 0xDF) {
+				break;
+			}
+		}
+		if (j < 512) {
+			ret = RESULT_FAIL;
+			goto out;
+		}
+	}
+out:
+	kfree(hdr);
+	return ret;
+}
+
+#define MMC_TEST_PACKED_COUNT	64
+
+/*
+ * Write 2, 4, 8... chunks of @sz bytes, each two chunks apart so that
+ * the card sees separate random writes, either as one packed command or
+ * one by one, and print the rate per chunk.
+ */
+static int mmc_test_packed_perf(struct mmc_test_card *test, unsigned long sz,
+				int packed)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	unsigned hdr_sz = mmc_large_sector(card) ? 4096 : 512;
+	unsigned addrs[MMC_PACKED_MAX_ENTRIES];
+	unsigned blocks = sz >> 9, max_nr, nr, cnt, i;
+	struct scatterlist *sg = NULL;
+	struct timespec ts1, ts2;
+	u32 *hdr;
+	int ret;
+
+	ret = mmc_test_packed_supported(test);
+	if (ret)
+		return ret;
+
+	max_nr = min_t(unsigned, card->ext_csd.max_packed_writes,
+		       MMC_PACKED_MAX_ENTRIES);
+
+	hdr = kzalloc(hdr_sz, GFP_KERNEL);
+	if (packed)
+		sg = kmalloc(sizeof(struct scatterlist) * (t->max_segs + 1),
+			     GFP_KERNEL);
+	if (!hdr || (packed && !sg)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (nr = 2; nr <= max_nr; nr <<= 1) {
+		if (nr * sz + hdr_sz > t->max_tfr || 2 * nr * sz > t->max_sz)
+			break;
+
+		for (i = 0; i < nr; i++)
+			addrs[i] = t->dev_addr + 2 * i * blocks;
+
+		if (packed) {
+			ret = mmc_test_area_map(test, nr * sz, 0, 0);
+			if (ret)
+				goto out;
+			if (t->sg_len + 1 > t->max_segs)
+				break;
+
+			sg_init_table(sg, t->sg_len + 1);
+			sg_set_buf(&sg[0], hdr, hdr_sz);
+			for (i = 0; i < t->sg_len; i++)
+				sg_set_page(&sg[i + 1], sg_page(&t->sg[i]),
+					    t->sg[i].length, t->sg[i].offset);
+		}
+
+		getnstimeofday(&ts1);
+		for (cnt = 0; cnt < MMC_TEST_PACKED_COUNT; cnt++) {
+			if (packed) {
+				ret = mmc_test_packed_transfer(test, hdr, sg,
+						t->sg_len + 1, addrs, nr,
+						blocks);
+				if (ret)
+					goto out;
+				continue;
+			}
+			for (i = 0; i < nr; i++) {
+				ret = mmc_test_area_io(test, sz, addrs[i], 1,
+						       0, 0);
+				if (ret)
+					goto out;
+			}
+		}
+		getnstimeofday(&ts2);
+
+		mmc_test_print_avg_rate(test, sz, cnt * nr, &ts1, &ts2);
+	}
+out:
+	kfree(sg);
+	kfree(hdr);
+	return ret;
+}
+
+/*
+ * Packed write performance, 4KiB chunks.
+ */
+static int mmc_test_packed_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_packed_perf(test, 4096, 1);
+}
+
+/*
+ * The same 4KiB writes, one command each.
+ */
+static int mmc_test_unpacked_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_packed_perf(test, 4096, 0);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2741,6 +2971,27 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.run = mmc_test_profile_sglen_r_nonblock_perf,
 		.cleanup = mmc_test_area_cleanup,
 	},
+
+	{
+		.name = "Packed write of scattered sectors",
+		.prepare = mmc_test_prepare_write,
+		.run = mmc_test_packed_write_verify,
+		.cleanup = mmc_test_cleanup,
+	},
+
+	{
+		.name = "Packed write performance 4KiB x 2 to max entries",
+		.prepare = mmc_test_area_prepare_erase,
+		.run = mmc_test_packed_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Unpacked write performance 4KiB x 2 to max entries",
+		.prepare = mmc_test_area_prepare_erase,
+		.run = mmc_test_unpacked_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -406,6 +406,78 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 	return 1;
 }
 
+/**
+ * mmc_packed_init - set up a queue for packed commands
+ * @mq: MMC queue
+ * @card: card that supports them
+ *
+ * Packed commands reuse the scatterlists of the queue, and are therefore
+ * only set up when the queue does not bounce.
+ */
+int mmc_packed_init(struct mmc_queue *mq, struct mmc_card *card)
+{
+	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
+	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
+
+	if (mqrq_cur->bounce_buf || mqrq_prev->bounce_buf)
+		return -EINVAL;
+
+	mqrq_cur->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+	mqrq_prev->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+	if (!mqrq_cur->packed || !mqrq_prev->packed) {
+		pr_warning("%s: unable to allocate packed cmd header\n",
+			   mmc_card_name(card));
+		mmc_packed_clean(mq);
+		return -ENOMEM;
+	}
+
+	INIT_LIST_HEAD(&mqrq_cur->packed->list);
+	INIT_LIST_HEAD(&mqrq_prev->packed->list);
+	return 0;
+}
+
+void mmc_packed_clean(struct mmc_queue *mq)
+{
+	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
+	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
+
+	kfree(mqrq_cur->packed);
+	mqrq_cur->packed = NULL;
+	kfree(mqrq_prev->packed);
+	mqrq_prev->packed = NULL;
+}
+
+/*
+ * Map the header and all requests of a packed command into one sg list
+ */
+unsigned int mmc_queue_packed_map_sg(struct mmc_queue *mq,
+				     struct mmc_queue_req *mqrq)
+{
+	struct mmc_packed *packed = mqrq->packed;
+	struct scatterlist *sg = mqrq->sg;
+	unsigned int max_seg_sz = queue_max_segment_size(mq->queue);
+	unsigned int hdr_sz = mmc_large_sector(mq->card) ? 4096 : 512;
+	unsigned int len, offset = 0, sg_len = 0;
+	struct request *req;
+
+	sg_init_table(sg, mq->card->host->max_segs);
+
+	while (offset < hdr_sz) {
+		len = min(hdr_sz - offset, max_seg_sz);
+		sg_set_buf(&sg[sg_len++], (u8 *)packed->cmd_hdr + offset, len);
+		offset += len;
+	}
+
+	list_for_each_entry(req, &packed->list, queuelist) {
+		sg_len += blk_rq_map_sg(mq->queue, req, &sg[sg_len]);
+		/* blk_rq_map_sg() ends the list after each request */
+		sg[sg_len - 1].page_link &= ~0x02;
+	}
+	sg_mark_end(&sg[sg_len - 1]);
+
+	return sg_len;
+}
+
 /*
  * If writing, bounce the data to the buffer before the request
  * is sent to the host driver
@@ -254,6 +254,7 @@ struct mmc_card *mmc_alloc_card(struct mmc_host *host, struct device_type *type)
 		return ERR_PTR(-ENOMEM);
 
 	card->host = host;
+	spin_lock_init(&card->packed_stats.lock);
 
 	device_initialize(&card->dev);
 
@@ -286,6 +286,91 @@ static const struct file_operations mmc_dbg_ext_csd_fops = {
 	.llseek		= default_llseek,
 };
 
+static const char * const mmc_packed_stop_names[] = {
+	[MMC_PACKED_STOP_EMPTY_QUEUE]		= "empty queue",
+	[MMC_PACKED_STOP_WRONG_DATA_DIR]	= "read",
+	[MMC_PACKED_STOP_FLUSH_OR_DISCARD]	= "flush or discard",
+	[MMC_PACKED_STOP_REL_WRITE]		= "reliable write",
+	[MMC_PACKED_STOP_LARGE_SEC_ALIGN]	= "4KB sector alignment",
+	[MMC_PACKED_STOP_EXCEEDS_SEGMENTS]	= "max segments",
+	[MMC_PACKED_STOP_EXCEEDS_SECTORS]	= "max sectors",
+	[MMC_PACKED_STOP_MAX_ENTRIES]		= "max entries",
+};
+
+static int mmc_packed_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_packed_stats *stats;
+	unsigned int reqs = 0, cmds = 0;
+	int i;
+
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	spin_lock(&card->packed_stats.lock);
+	*stats = card->packed_stats;
+	spin_unlock(&card->packed_stats.lock);
+
+	for (i = 2; i <= MMC_PACKED_MAX_ENTRIES; i++) {
+		cmds += stats->packed[i];
+		reqs += stats->packed[i] * i;
+	}
+
+	seq_printf(s, "max packed writes: %u\n",
+		   card->ext_csd.max_packed_writes);
+	seq_printf(s, "packed commands: %u\n", cmds);
+	seq_printf(s, "packed requests: %u\n", reqs);
+	seq_printf(s, "unpacked writes: %u\n", stats->unpacked);
+	seq_printf(s, "retries: %u\n", stats->retries);
+	seq_printf(s, "failures: %u\n", stats->failures);
+
+	seq_puts(s, "\nrequests per packed command:\n");
+	for (i = 2; i <= MMC_PACKED_MAX_ENTRIES; i++)
+		if (stats->packed[i])
+			seq_printf(s, "%4d: %u\n", i, stats->packed[i]);
+
+	seq_puts(s, "\npacking stopped at:\n");
+	for (i = 0; i < MMC_PACKED_NR_STOP_REASONS; i++)
+		seq_printf(s, "%s: %u\n", mmc_packed_stop_names[i],
+			   stats->stop[i]);
+
+	kfree(stats);
+	return 0;
+}
+
+static int mmc_packed_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_packed_stats_show, inode->i_private);
+}
+
+/* Any write resets the counters */
+static ssize_t mmc_packed_stats_write(struct file *file,
+				      const char __user *ubuf, size_t cnt,
+				      loff_t *ppos)
+{
+	struct mmc_card *card = file->f_path.dentry->d_inode->i_private;
+	struct mmc_packed_stats *stats = &card->packed_stats;
+
+	spin_lock(&stats->lock);
+	memset(stats->packed, 0, sizeof(stats->packed));
+	memset(stats->stop, 0, sizeof(stats->stop));
+	stats->unpacked = 0;
+	stats->retries = 0;
+	stats->failures = 0;
+	spin_unlock(&stats->lock);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_packed_stats_fops = {
+	.open		= mmc_packed_stats_open,
+	.read		= seq_read,
+	.write		= mmc_packed_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_card_debugfs(struct mmc_card *card)
 {
 	struct mmc_host	*host = card->host;
@@ -318,6 +403,12 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					&mmc_dbg_ext_csd_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) && card->ext_csd.max_packed_writes)
+		if (!debugfs_create_file("packed_stats", S_IRUSR | S_IWUSR,
+					 root, card,
+					 &mmc_dbg_packed_stats_fops))
+			goto err;
+
 	return;
 
 err:
@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_PTR		= B_PACK_CHARS('p', 't', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,37 @@ struct flat_binder_object {
 	void __user		*cookie;
 };
 
+/*
+ * A user buffer that is gathered into the target's buffer, sent with
+ * BC_TRANSACTION_SG or BC_REPLY_SG. The driver copies the memory at
+ * 'buffer' into the extra buffers area of the transaction and rewrites
+ * 'buffer' to point at the copy in the target.
+ *
+ * With BINDER_BUFFER_FLAG_HAS_PARENT, the new address is also written into
+ * the buffer object at index 'parent' of the offsets array, at
+ * 'parent_offset' bytes into its data. The parent must come first.
+ *
+ * With BINDER_BUFFER_FLAG_REMAP, a page aligned buffer of whole pages in a
+ * shared file mapping (such as ashmem) is handed over by mapping its pages
+ * into the target instead of copying them, if buffers_size has a page of
+ * slack for the alignment. The target then sees later changes made through
+ * the sender's mapping. The flag is cleared in the delivered object when
+ * the driver had to copy after all.
+ */
+enum {
+	BINDER_BUFFER_FLAG_HAS_PARENT = 0x01,
+	BINDER_BUFFER_FLAG_REMAP = 0x02,
+};
+
+struct binder_buffer_object {
+	unsigned long		type;	/* BINDER_TYPE_PTR */
+	unsigned long		flags;
+	void __user		*buffer;
+	size_t			length;
+	size_t			parent;
+	size_t			parent_offset;
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
@@ -147,6 +179,15 @@ struct binder_transaction_data {
 	} data;
 };
 
+/*
+ * buffers_size is the room needed in the target for all BINDER_TYPE_PTR
+ * buffers, each rounded up to 8 bytes.
+ */
+struct binder_transaction_data_sg {
+	struct binder_transaction_data	transaction_data;
+	size_t				buffers_size;
+};
+
 struct binder_ptr_cookie {
 	void *ptr;
 	void *cookie;
@@ -324,6 +365,13 @@ enum BinderDriverCommandProtocol {
 	/*
 	 * void *: cookie
 	 */
+
+	BC_TRANSACTION_SG = _IOW('c', 17, struct binder_transaction_data_sg),
+	BC_REPLY_SG = _IOW('c', 18, struct binder_transaction_data_sg),
+	/*
+	 * binder_transaction_data_sg: the sent command, with room for the
+	 * BINDER_TYPE_PTR buffers it carries.
+	 */
 };
 
 #endif /* _LINUX_BINDER_H */
@@ -192,9 +192,10 @@ TRACE_EVENT(binder_transaction_ref_to_node,
 );
 
 TRACE_EVENT(binder_transaction_ref_to_ref,
-	TP_PROTO(struct binder_transaction *t, struct binder_ref *src_ref,
+	TP_PROTO(struct binder_transaction *t, struct binder_node *node,
+		 int src_ref_debug_id, uint32_t src_ref_desc,
 		 struct binder_ref *dest_ref),
-	TP_ARGS(t, src_ref, dest_ref),
+	TP_ARGS(t, node, src_ref_debug_id, src_ref_desc, dest_ref),
 
 	TP_STRUCT__entry(
 		__field(int, debug_id)
@@ -206,9 +207,9 @@ TRACE_EVENT(binder_transaction_ref_to_ref,
 	),
 	TP_fast_assign(
 		__entry->debug_id = t->debug_id;
-		__entry->node_debug_id = src_ref->node->debug_id;
-		__entry->src_ref_debug_id = src_ref->debug_id;
-		__entry->src_ref_desc = src_ref->desc;
+		__entry->node_debug_id = node->debug_id;
+		__entry->src_ref_debug_id = src_ref_debug_id;
+		__entry->src_ref_desc = src_ref_desc;
 		__entry->dest_ref_debug_id = dest_ref->debug_id;
 		__entry->dest_ref_desc = dest_ref->desc;
 	),
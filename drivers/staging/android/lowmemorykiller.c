@@ -17,6 +17,16 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With the vmpressure parameter set, the reclaim efficiency based pressure
+ * level of mm/vmpressure.c can trigger kills before free memory drops below
+ * any minfree threshold: medium pressure lets the last (highest) adj level
+ * be killed, critical pressure the one before it.
+ *
+ * Processes are kept in a tree sorted by oom_score_adj, so picking a victim
+ * only looks at the processes with the highest oom_score_adj instead of
+ * walking every task. The lowmemorykiller:lowmem_scan and lowmem_kill trace
+ * events report the cost of each scan and the latency of each kill.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -42,6 +52,12 @@
 #include <linux/notifier.h>
 #include <linux/mutex.h>
 #include <linux/delay.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/vmpressure.h>
+
+#define CREATE_TRACE_POINTS
+#include "trace/lowmemorykiller.h"
 
 static uint32_t lowmem_debug_level = 1;
 static short lowmem_adj[6] = {
@@ -61,6 +77,10 @@ static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
 
+static bool lowmem_vmpressure;
+static int lowmem_pressure_level;
+static unsigned long lowmem_pressure_expires;
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -83,12 +103,122 @@ static int test_task_flag(struct task_struct *p, int flag)
 	return 0;
 }
 
+/*
+ * Thread group leaders sorted by oom_score_adj. The tree is protected by
+ * tasklist_lock, which fork and exit already hold for writing when they
+ * add and remove processes. Each node is keyed by a copy of the
+ * oom_score_adj it was inserted with, the value itself may change under
+ * siglock at any time.
+ */
+static struct rb_root lowmem_adj_tree = RB_ROOT;
+static int lowmem_adj_tree_size;
+
+static void __lowmem_adj_tree_insert(struct task_struct *p)
+{
+	struct rb_node **link = &lowmem_adj_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct task_struct *t;
+
+	p->lowmem_adj = p->signal->oom_score_adj;
+	while (*link) {
+		parent = *link;
+		t = rb_entry(parent, struct task_struct, lowmem_node);
+		if (p->lowmem_adj < t->lowmem_adj)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&p->lowmem_node, parent, link);
+	rb_insert_color(&p->lowmem_node, &lowmem_adj_tree);
+	lowmem_adj_tree_size++;
+}
+
+static void __lowmem_adj_tree_erase(struct task_struct *p)
+{
+	rb_erase(&p->lowmem_node, &lowmem_adj_tree);
+	RB_CLEAR_NODE(&p->lowmem_node);
+	lowmem_adj_tree_size--;
+}
+
+/*
+ * Called for every new task, with tasklist_lock held for writing. Kernel
+ * threads are indexed too: a task forked from one inherits PF_KTHREAD and
+ * only loses it when it execs into user space, as init and usermode
+ * helpers do. The scan skips whatever is still a kernel thread.
+ */
+void lowmem_adj_tree_add(struct task_struct *p)
+{
+	RB_CLEAR_NODE(&p->lowmem_node);
+	if (!thread_group_leader(p))
+		return;
+	__lowmem_adj_tree_insert(p);
+}
+
+/* Called with tasklist_lock held for writing */
+void lowmem_adj_tree_del(struct task_struct *p)
+{
+	if (!RB_EMPTY_NODE(&p->lowmem_node))
+		__lowmem_adj_tree_erase(p);
+}
+
+/*
+ * Move the process of @p to its new place after its oom_score_adj was
+ * changed. Takes tasklist_lock, so the caller must not hold task_lock()
+ * or siglock. @p may have been released meanwhile, its group_leader is
+ * then stale and the process already out of the tree.
+ */
+void lowmem_adj_tree_update(struct task_struct *p)
+{
+	write_lock_irq(&tasklist_lock);
+	if (!pid_alive(p)) {
+		write_unlock_irq(&tasklist_lock);
+		return;
+	}
+	p = p->group_leader;
+	if (!RB_EMPTY_NODE(&p->lowmem_node) &&
+	    p->lowmem_adj != p->signal->oom_score_adj) {
+		__lowmem_adj_tree_erase(p);
+		__lowmem_adj_tree_insert(p);
+	}
+	write_unlock_irq(&tasklist_lock);
+}
+
+static int lowmem_vmpressure_notify(struct notifier_block *nb,
+				    unsigned long level, void *data)
+{
+	lowmem_pressure_level = level;
+	/* a level is only trusted until the next reclaim window or so */
+	lowmem_pressure_expires = jiffies + HZ;
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call = lowmem_vmpressure_notify,
+};
+
+/* The adj level the current memory pressure allows to kill, or -1 */
+static int lowmem_pressure_adj_index(int array_size)
+{
+	int level = lowmem_pressure_level;
+
+	if (!lowmem_vmpressure ||
+	    time_after(jiffies, lowmem_pressure_expires))
+		return -1;
+
+	if (level == VMPRESSURE_CRITICAL)
+		return array_size - 2;
+	if (level == VMPRESSURE_MEDIUM)
+		return array_size - 1;
+	return -1;
+}
+
 static DEFINE_MUTEX(scan_mutex);
 
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *tsk;
 	struct task_struct *selected = NULL;
+	struct rb_node *n;
 	int rem = 0;
 	int tasksize;
 	int i;
@@ -100,7 +230,10 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int other_free;
 	int other_file;
 	unsigned long nr_to_scan = sc->nr_to_scan;
+	int nr_visited = 0;
+	ktime_t start;
 
+	start = ktime_get();
 	if (nr_to_scan > 0) {
 		if (mutex_lock_interruptible(&scan_mutex) < 0)
 			return 0;
@@ -121,6 +254,14 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			break;
 		}
 	}
+	i = lowmem_pressure_adj_index(array_size);
+	if (i >= 0 && lowmem_adj[i] < min_score_adj) {
+		min_score_adj = lowmem_adj[i];
+		minfree = lowmem_minfree[i];
+		if (nr_to_scan > 0)
+			lowmem_print(3, "lowmem_shrink pressure level %d, ma %hd\n",
+				     lowmem_pressure_level, min_score_adj);
+	}
 	if (nr_to_scan > 0)
 		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %hd\n",
 				nr_to_scan, sc->gfp_mask, other_free,
@@ -139,11 +280,21 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_score_adj = min_score_adj;
 
-	rcu_read_lock();
-	for_each_process(tsk) {
+	/*
+	 * Walk down from the highest oom_score_adj. Once a victim is found
+	 * only processes with the same oom_score_adj, which might be bigger,
+	 * are left to look at.
+	 */
+	read_lock(&tasklist_lock);
+	for (n = rb_last(&lowmem_adj_tree); n; n = rb_prev(n)) {
 		struct task_struct *p;
 		short oom_score_adj;
 
+		tsk = rb_entry(n, struct task_struct, lowmem_node);
+		if (tsk->lowmem_adj < selected_oom_score_adj)
+			break;
+		nr_visited++;
+
 		if (tsk->flags & PF_KTHREAD)
 			continue;
 
@@ -153,7 +304,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 
 		if (time_before_eq(jiffies, lowmem_deathpending_timeout)) {
 			if (test_task_flag(tsk, TIF_MEMDIE)) {
-				rcu_read_unlock();
+				read_unlock(&tasklist_lock);
 				/* give the system time to free up the memory */
 				msleep_interruptible(20);
 				mutex_unlock(&scan_mutex);
@@ -187,6 +338,8 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_print(2, "select '%s' (%d), adj %hd, size %d, to kill\n",
 			     p->comm, p->pid, oom_score_adj, tasksize);
 	}
+	trace_lowmem_scan(min_score_adj, nr_visited, lowmem_adj_tree_size,
+			  ktime_to_ns(ktime_sub(ktime_get(), start)));
 	if (selected) {
 		lowmem_print(1, "Killing '%s' (%d), adj %hd,\n" \
 				"   to free %ldkB on behalf of '%s' (%d) because\n" \
@@ -203,12 +356,15 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending_timeout = jiffies + HZ;
 		send_sig(SIGKILL, selected, 0);
 		set_tsk_thread_flag(selected, TIF_MEMDIE);
+		trace_lowmem_kill(selected, selected_oom_score_adj,
+				  selected_tasksize, min_score_adj,
+				  ktime_to_ns(ktime_sub(ktime_get(), start)));
 		rem -= selected_tasksize;
-		rcu_read_unlock();
+		read_unlock(&tasklist_lock);
 		/* give the system time to free up the memory */
 		msleep_interruptible(20);
 	} else
-		rcu_read_unlock();
+		read_unlock(&tasklist_lock);
 
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     nr_to_scan, sc->gfp_mask, rem);
@@ -224,11 +380,13 @@ static struct shrinker lowmem_shrinker = {
 static int __init lowmem_init(void)
 {
 	register_shrinker(&lowmem_shrinker);
+	vmpressure_register_notifier(&lowmem_vmpressure_nb);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	vmpressure_unregister_notifier(&lowmem_vmpressure_nb);
 	unregister_shrinker(&lowmem_shrinker);
 }
 
@@ -323,6 +481,7 @@ module_param_array_named(adj, lowmem_adj, short, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(vmpressure, lowmem_vmpressure, bool, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
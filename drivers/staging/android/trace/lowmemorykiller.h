@@ -0,0 +1,70 @@
+#undef TRACE_SYSTEM
+#define TRACE_INCLUDE_PATH ../../drivers/staging/android/trace
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_scan,
+	TP_PROTO(short min_score_adj, int nr_visited, int nr_indexed,
+		 s64 duration_ns),
+
+	TP_ARGS(min_score_adj, nr_visited, nr_indexed, duration_ns),
+
+	TP_STRUCT__entry(
+			__field(short, min_score_adj)
+			__field(int, nr_visited)
+			__field(int, nr_indexed)
+			__field(s64, duration_ns)
+	),
+
+	TP_fast_assign(
+			__entry->min_score_adj = min_score_adj;
+			__entry->nr_visited = nr_visited;
+			__entry->nr_indexed = nr_indexed;
+			__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("min_score_adj=%hd visited=%d indexed=%d duration_ns=%lld",
+		  __entry->min_score_adj, __entry->nr_visited,
+		  __entry->nr_indexed, __entry->duration_ns)
+);
+
+TRACE_EVENT(lowmem_kill,
+	TP_PROTO(struct task_struct *killed_task, short oom_score_adj,
+		 int tasksize, short min_score_adj, s64 latency_ns),
+
+	TP_ARGS(killed_task, oom_score_adj, tasksize, min_score_adj,
+		latency_ns),
+
+	TP_STRUCT__entry(
+			__array(char, comm, TASK_COMM_LEN)
+			__field(pid_t, pid)
+			__field(short, oom_score_adj)
+			__field(int, tasksize)
+			__field(short, min_score_adj)
+			__field(s64, latency_ns)
+	),
+
+	TP_fast_assign(
+			memcpy(__entry->comm, killed_task->comm, TASK_COMM_LEN);
+			__entry->pid = killed_task->pid;
+			__entry->oom_score_adj = oom_score_adj;
+			__entry->tasksize = tasksize;
+			__entry->min_score_adj = min_score_adj;
+			__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("comm=%s pid=%d oom_score_adj=%hd tasksize=%d min_score_adj=%hd latency_ns=%lld",
+		  __entry->comm, __entry->pid, __entry->oom_score_adj,
+		  __entry->tasksize, __entry->min_score_adj,
+		  __entry->latency_ns)
+);
+
+#endif /* if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ) */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
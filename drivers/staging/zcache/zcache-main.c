@@ -91,8 +91,10 @@ static inline bool is_local_client(struct zcache_client *cli)
 }
 
 /* crypto API for zcache  */
-#ifdef CONFIG_ZCACHE_CRYPTO_SNAPPY
+#if defined(CONFIG_ZCACHE_CRYPTO_SNAPPY)
 static char *zcache_comp_name = "snappy";
+#elif defined(CONFIG_ZCACHE_CRYPTO_LZ4)
+static char *zcache_comp_name = "lz4";
 #else
 static char *zcache_comp_name = "lzo";
 #endif
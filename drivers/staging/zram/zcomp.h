@@ -0,0 +1,58 @@
+/*
+ * Compression stream management for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/mutex.h>
+#include <linux/list.h>
+
+struct crypto_comp;
+
+struct zcomp_strm {
+	/* compression/decompression buffer */
+	void *buffer;
+	/* crypto API transform, owns the compressor working memory */
+	struct crypto_comp *tfm;
+	/* used in multi stream backend, protected by zcomp_strm_multi.lock */
+	struct list_head list;
+};
+
+/* dynamic per-device compression frontend */
+struct zcomp {
+	void *stream;
+	/* name of the crypto API compression algorithm */
+	const char *name;
+	/* per-cpu transforms used for decompression */
+	struct crypto_comp * __percpu *dtfm;
+
+	struct zcomp_strm *(*strm_find)(struct zcomp *comp);
+	void (*strm_release)(struct zcomp *comp, struct zcomp_strm *zstrm);
+	bool (*set_max_streams)(struct zcomp *comp, int num_strm);
+	void (*destroy)(struct zcomp *comp);
+};
+
+ssize_t zcomp_available_show(const char *comp, char *buf);
+const char *zcomp_find_backend(const char *comp);
+
+struct zcomp *zcomp_create(const char *comp, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst);
+
+bool zcomp_set_max_streams(struct zcomp *comp, int num_strm);
+
+#endif /* _ZCOMP_H_ */
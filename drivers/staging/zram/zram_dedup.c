@@ -0,0 +1,123 @@
+/*
+ * Compressed RAM block device - content based deduplication
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+
+#include "zram_drv.h"
+
+/*
+ * Identical pages compress to identical objects, so the index is keyed by
+ * a checksum of the compressed (or stored uncompressed) object and every
+ * hit is verified with a memcmp() against the stored copy.
+ */
+
+/* One bucket for every four table entries keeps the chains short */
+#define ZRAM_DEDUP_PAGES_PER_BUCKET	4
+#define ZRAM_DEDUP_MIN_BITS		4
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t buckets;
+
+	buckets = max_t(size_t, num_pages / ZRAM_DEDUP_PAGES_PER_BUCKET,
+			1 << ZRAM_DEDUP_MIN_BITS);
+	meta->dedup_bits = ilog2(roundup_pow_of_two(buckets));
+	meta->dedup_table = vzalloc(sizeof(struct hlist_head) <<
+				    meta->dedup_bits);
+	if (!meta->dedup_table)
+		return -ENOMEM;
+
+	spin_lock_init(&meta->dedup_lock);
+	return 0;
+}
+
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	vfree(meta->dedup_table);
+	meta->dedup_table = NULL;
+}
+
+u32 zram_dedup_checksum(const unsigned char *mem, size_t len)
+{
+	return jhash(mem, len, 0);
+}
+
+static struct hlist_head *zram_dedup_bucket(struct zram_meta *meta,
+					    u32 checksum)
+{
+	return &meta->dedup_table[hash_32(checksum, meta->dedup_bits)];
+}
+
+/*
+ * Look up an object with the same content as @mem and take a reference
+ * on it. Returns NULL if there is none.
+ */
+struct zram_entry *zram_dedup_get(struct zram *zram, const unsigned char *mem,
+				  size_t len, u32 checksum)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_entry *entry;
+	struct hlist_node *pos;
+	unsigned char *cmem;
+	bool match;
+
+	spin_lock(&meta->dedup_lock);
+	hlist_for_each_entry(entry, pos, zram_dedup_bucket(meta, checksum),
+			     node) {
+		if (entry->checksum != checksum || entry->len != len)
+			continue;
+
+		cmem = zs_map_object(meta->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(cmem, mem, len);
+		zs_unmap_object(meta->mem_pool, entry->handle);
+		if (match) {
+			entry->refcount++;
+			spin_unlock(&meta->dedup_lock);
+			return entry;
+		}
+	}
+	spin_unlock(&meta->dedup_lock);
+
+	return NULL;
+}
+
+/* Make a freshly stored object (refcount 1) visible to zram_dedup_get() */
+void zram_dedup_insert(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_meta *meta = zram->meta;
+
+	spin_lock(&meta->dedup_lock);
+	hlist_add_head(&entry->node, zram_dedup_bucket(meta, entry->checksum));
+	spin_unlock(&meta->dedup_lock);
+}
+
+/*
+ * Drop a reference. Returns true when this was the last one; the entry has
+ * then been unhashed and the caller must free the object and the entry.
+ */
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_meta *meta = zram->meta;
+	bool last;
+
+	spin_lock(&meta->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		hlist_del(&entry->node);
+	spin_unlock(&meta->dedup_lock);
+
+	return last;
+}
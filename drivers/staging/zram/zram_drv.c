@@ -32,53 +32,14 @@
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 #include <linux/ratelimit.h>
+#include <linux/bit_spinlock.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 
 #include "zram_drv.h"
 
-#if defined(CONFIG_ZRAM_LZO)
-#include <linux/lzo.h>
-#define WMSIZE		LZO1X_MEM_COMPRESS
-#define COMPRESS(s, sl, d, dl, wm)	\
-	lzo1x_1_compress(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	lzo1x_decompress_safe(s, sl, d, dl)
-#elif defined(CONFIG_ZRAM_SNAPPY)
-#include "../snappy/csnappy.h" /* if built in drivers/staging */
-#define WMSIZE_ORDER	((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
-#define WMSIZE		(1 << WMSIZE_ORDER)
-static int
-snappy_compress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len,
-	void *workmem)
-{
-	const unsigned char *end = csnappy_compress_fragment(
-		src, (uint32_t)src_len, dst, workmem, WMSIZE_ORDER);
-	*dst_len = end - dst;
-	return 0;
-}
-static int
-snappy_decompress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len)
-{
-	uint32_t dst_len_ = (uint32_t)*dst_len;
-	int ret = csnappy_decompress_noheader(src, src_len, dst, &dst_len_);
-	*dst_len = (size_t)dst_len_;
-	return ret;
-}
-#define COMPRESS(s, sl, d, dl, wm)	\
-	snappy_compress_(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	snappy_decompress_(s, sl, d, dl)
-#else
-#error either CONFIG_ZRAM_LZO or CONFIG_ZRAM_SNAPPY must be defined
-#endif
-
 /* Globals */
 static int zram_major;
 struct zram *zram_devices;
@@ -89,38 +50,6 @@ struct zram *zram_devices;
  */
 #define ALLOC_ERROR_LOG_RATE_MS 2000
 
-#ifdef CONFIG_ZRAM_SNAPPY
-#define WMSIZE_ORDER  ((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
-#define WMSIZE    (1 << WMSIZE_ORDER)
-
-static int
-snappy_compress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len,
-	void *workmem)
-{
-const unsigned char *end = csnappy_compress_fragment(
-	src, (uint32_t)src_len, dst, workmem, WMSIZE_ORDER);
-	*dst_len = end - dst;
-	return 0;
-}
-static int
-snappy_decompress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len)
-{
-uint32_t dst_len_ = (uint32_t)*dst_len;
-	int ret = csnappy_decompress_noheader(src, src_len, dst, &dst_len_);
-	*dst_len = (size_t)dst_len_;
-	return ret;
-}
-#endif
-
-
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
 
@@ -143,80 +72,345 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	zram_stat64_add(zram, v, 1);
 }
 
+static void zram_lat_account(atomic_t *hist, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	while (bucket < ZRAM_LAT_BUCKETS - 1 && us >= (1LL << bucket))
+		bucket++;
+	atomic_inc(&hist[bucket]);
+}
+
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	return meta->table[index].flags & BIT(flag);
+	return meta->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags |= BIT(flag);
+	meta->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
-	meta->table[index].flags &= ~BIT(flag);
+	meta->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram_meta *meta, u32 index)
+{
+	return meta->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram_meta *meta,
+					u32 index, size_t size)
+{
+	unsigned long flags = meta->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
+}
+
+/*
+ * Table entries are protected by a bit spinlock in the entry itself, so
+ * that I/O to different pages of the device does not serialize.
+ */
+static inline void zram_lock_table(struct zram_meta *meta, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 }
 
-static int page_zero_filled(void *ptr)
+static inline void zram_unlock_table(struct zram_meta *meta, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long len,
+			   unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned long pos;
+
+	if (likely(value == 0)) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (pos = 0; pos < len / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
+/* zsmalloc handle of a stored (not same filled) page, 0 if none */
+static unsigned long zram_get_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram->meta->table[index].handle;
+
+	if (zram->use_dedup && handle)
+		handle = ((struct zram_entry *)handle)->handle;
+	return handle;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Max number of pages moved to backing_dev per batch of bios */
+#define ZRAM_WB_BATCH	32
+
+static const fmode_t zram_bdev_mode = FMODE_READ | FMODE_WRITE | FMODE_EXCL;
+
+/*
+ * Allocate a free PAGE_SIZE block on backing_dev, searching from @hint so
+ * that the blocks of one batch tend to be contiguous. Returns 0 if the
+ * device is full.
+ */
+static unsigned long zram_alloc_block(struct zram *zram, unsigned long hint)
+{
+	unsigned long blk;
+
+	if (hint < 1 || hint >= zram->nr_pages)
+		hint = 1;
+retry:
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_pages, hint);
+	if (blk >= zram->nr_pages) {
+		if (hint == 1)
+			return 0;
+		/* wrap around, block 0 is never handed out */
+		hint = 1;
+		goto retry;
+	}
+	if (test_and_set_bit(blk, zram->bitmap))
+		goto retry;
+
+	atomic_inc(&zram->stats.bd_count);
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+	atomic_dec(&zram->stats.bd_count);
+}
+
+/* A set of bios to backing_dev that is waited for as a whole */
+struct zram_bio_batch {
+	atomic_t pending;
+	int error;
+	struct completion done;
+};
+
+static void zram_batch_init(struct zram_bio_batch *batch)
+{
+	/* the submitter holds one reference until zram_batch_wait() */
+	atomic_set(&batch->pending, 1);
+	batch->error = 0;
+	init_completion(&batch->done);
+}
+
+static void zram_batch_end_io(struct bio *bio, int err)
+{
+	struct zram_bio_batch *batch = bio->bi_private;
+
+	if (err || !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		batch->error = -EIO;
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+	bio_put(bio);
+}
+
+static void zram_batch_submit(struct zram_bio_batch *batch, struct bio *bio,
+			      int rw)
+{
+	atomic_inc(&batch->pending);
+	bio->bi_private = batch;
+	bio->bi_end_io = zram_batch_end_io;
+	submit_bio(rw, bio);
+}
+
+static int zram_batch_wait(struct zram_bio_batch *batch)
+{
+	if (!atomic_dec_and_test(&batch->pending))
+		wait_for_completion(&batch->done);
+	return batch->error;
+}
+
+static struct bio *zram_bdev_bio(struct zram *zram, unsigned long blk,
+				 int nr_vecs)
+{
+	struct bio *bio = bio_alloc(GFP_NOIO, nr_vecs);
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	return bio;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *zw = container_of(work, struct zram_bdev_work,
+						 work);
+	struct zram_bio_batch batch;
+	struct bio *bio;
+
+	zram_batch_init(&batch);
+	bio = zram_bdev_bio(zw->zram, zw->blk, 1);
+	bio_add_page(bio, zw->page, PAGE_SIZE, 0);
+	zram_batch_submit(&batch, bio, READ);
+	zw->ret = zram_batch_wait(&batch);
+}
+
+/*
+ * Read one block of backing_dev into @page. Bios submitted from within
+ * zram_make_request() are only dispatched once it returns, so the read
+ * is issued and waited for from a worker instead.
+ */
+static int zram_bdev_read(struct zram *zram, unsigned long blk,
+			  struct page *page)
+{
+	struct zram_bdev_work zw;
+
+	zw.zram = zram;
+	zw.page = page;
+	zw.blk = blk;
+	INIT_WORK_ONSTACK(&zw.work, zram_bdev_read_work);
+	queue_work(system_unbound_wq, &zw.work);
+	flush_work(&zw.work);
+	destroy_work_on_stack(&zw.work);
+
+	atomic_inc(&zram->stats.bd_reads);
+	return zw.ret;
+}
+
+static int zram_bdev_read_mem(struct zram *zram, unsigned long blk,
+			      char *mem)
+{
+	struct page *page = alloc_page(GFP_NOIO);
+	int ret;
+
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_bdev_read(zram, blk, page);
+	if (!ret)
+		memcpy(mem, page_address(page), PAGE_SIZE);
+	__free_page(page);
+	return ret;
+}
+#else
+static inline int zram_bdev_read(struct zram *zram, unsigned long blk,
+				 struct page *page)
+{
+	return -EIO;
+}
+
+static inline int zram_bdev_read_mem(struct zram *zram, unsigned long blk,
+				     char *mem)
+{
+	return -EIO;
+}
+#endif
+
+/*
+ * To protect concurrent access to the same index entry,
+ * caller should hold this table index entry's bit_spinlock to
+ * indicate this index entry is accessing.
+ */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
-	u16 size = meta->table[index].size;
+	size_t size = zram_get_obj_size(meta, index);
+	struct zram_entry *entry;
+
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+	if (zram_test_flag(meta, index, ZRAM_HUGE)) {
+		zram_clear_flag(meta, index, ZRAM_HUGE);
+		atomic_dec(&zram->stats.pages_huge);
+	}
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
-			zram->stats.pages_zero--;
-		}
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		zram_free_block(zram, handle);
+		meta->table[index].handle = 0;
+		zram_set_obj_size(meta, index, 0);
 		return;
 	}
+#endif
+
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		atomic_dec(&zram->stats.pages_same);
+		if (!handle)
+			atomic_dec(&zram->stats.pages_zero);
+		meta->table[index].handle = 0;
+		return;
+	}
+
+	if (!handle)
+		return;
 
 	if (unlikely(size > max_zpage_size))
-		zram->stats.bad_compress--;
+		atomic_dec(&zram->stats.bad_compress);
 
-	zs_free(meta->mem_pool, handle);
+	if (!zram->use_dedup) {
+		zs_free(meta->mem_pool, handle);
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	} else {
+		entry = (struct zram_entry *)handle;
+		if (zram_dedup_put(zram, entry)) {
+			zs_free(meta->mem_pool, entry->handle);
+			kfree(entry);
+			zram_stat64_sub(zram, &zram->stats.compr_size, size);
+		} else {
+			atomic_dec(&zram->stats.pages_dedup);
+			zram_stat64_sub(zram, &zram->stats.dedup_saved, size);
+		}
+	}
 
 	if (size <= PAGE_SIZE / 2)
-		zram->stats.good_compress--;
+		atomic_dec(&zram->stats.good_compress);
 
-	zram_stat64_sub(zram, &zram->stats.compr_size,
-			meta->table[index].size);
-	zram->stats.pages_stored--;
+	atomic_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
-	meta->table[index].size = 0;
+	zram_set_obj_size(meta, index, 0);
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -227,26 +421,52 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
-static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
+/*
+ * Returns -EAGAIN, with the block in @blk, if the page has been moved to
+ * backing_dev and must be read with zram_bdev_read() instead.
+ */
+static int zram_decompress_page(struct zram *zram, char *mem, u32 index,
+				unsigned long *blk)
 {
 	int ret = 0;
-	size_t clen = PAGE_SIZE;
 	unsigned char *cmem;
 	struct zram_meta *meta = zram->meta;
-	unsigned long handle = meta->table[index].handle;
+	unsigned long handle;
+	size_t size;
+	ktime_t start;
+
+	zram_lock_table(meta, index);
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		handle = meta->table[index].handle;
+		zram_unlock_table(meta, index);
+		zram_fill_page(mem, PAGE_SIZE, handle);
+		return 0;
+	}
+
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		*blk = meta->table[index].handle;
+		zram_unlock_table(meta, index);
+		return -EAGAIN;
+	}
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
+	handle = zram_get_handle(zram, index);
+	size = zram_get_obj_size(meta, index);
+	if (!handle) {
+		zram_unlock_table(meta, index);
 		memset(mem, 0, PAGE_SIZE);
 		return 0;
 	}
 
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
-	if (meta->table[index].size == PAGE_SIZE)
+	if (size == PAGE_SIZE)
 		memcpy(mem, cmem, PAGE_SIZE);
-	else
-		ret = DECOMPRESS(cmem, meta->table[index].size,
-						mem, &clen);
+	else {
+		start = ktime_get();
+		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		zram_lat_account(zram->stats.decompr_lat, start);
+	}
 	zs_unmap_object(meta->mem_pool, handle);
+	zram_unlock_table(meta, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret)) {
@@ -265,13 +485,20 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	struct page *page;
 	unsigned char *user_mem, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
+	unsigned long blk;
 	page = bvec->bv_page;
 
-	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
+	zram_lock_table(meta, index);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	if (zram_test_flag(meta, index, ZRAM_SAME) ||
+	    unlikely(!meta->table[index].handle)) {
+		unsigned long element = meta->table[index].handle;
+
+		zram_unlock_table(meta, index);
+		handle_same_page(bvec, element);
 		return 0;
 	}
+	zram_unlock_table(meta, index);
 
 	if (is_partial_io(bvec))
 		/* Use  a temporary buffer to decompress the page */
@@ -287,7 +514,18 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		goto out_cleanup;
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
+	ret = zram_decompress_page(zram, uncmem, index, &blk);
+	if (ret == -EAGAIN) {
+		/* The page lives on backing_dev, reading it may sleep */
+		kunmap_atomic(user_mem);
+		if (is_partial_io(bvec))
+			ret = zram_bdev_read_mem(zram, blk, uncmem);
+		else
+			ret = zram_bdev_read(zram, blk, page);
+		user_mem = kmap_atomic(page);
+		if (!is_partial_io(bvec))
+			uncmem = user_mem;
+	}
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
 		goto out_cleanup;
@@ -314,11 +552,15 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	struct zram_entry *entry = NULL;
+	unsigned long element, blk;
+	u32 checksum;
+	bool locked = false;
+	ktime_t start;
 	static unsigned long zram_rs_time;
 
 	page = bvec->bv_page;
-	src = meta->compress_buffer;
-
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
@@ -330,19 +572,15 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_decompress_page(zram, uncmem, index);
+		ret = zram_decompress_page(zram, uncmem, index, &blk);
+		if (ret == -EAGAIN)
+			ret = zram_bdev_read_mem(zram, blk, uncmem);
 		if (ret)
 			goto out;
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (meta->table[index].handle ||
-	    zram_test_flag(meta, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
-
+	zstrm = zcomp_strm_find(zram->comp);
+	locked = true;
 	user_mem = kmap_atomic(page);
 
 	if (is_partial_io(bvec)) {
@@ -354,66 +592,139 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
-		kunmap_atomic(user_mem);
-		zram->stats.pages_zero++;
-		zram_set_flag(meta, index, ZRAM_ZERO);
+	if (page_same_filled(uncmem, &element)) {
+		if (user_mem)
+			kunmap_atomic(user_mem);
+		/* Free memory associated with this sector now. */
+		zram_lock_table(meta, index);
+		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].handle = element;
+		zram_unlock_table(meta, index);
+
+		atomic_inc(&zram->stats.pages_same);
+		if (!element)
+			atomic_inc(&zram->stats.pages_zero);
 		ret = 0;
 		goto out;
 	}
 
-	/*
-	 * zram_slot_free_notify could miss free so that let's
-	 * double check.
-	 */
-	if (unlikely(meta->table[index].handle ||
-			zram_test_flag(meta, index, ZRAM_ZERO)))
-		zram_free_page(zram, index);
-	COMPRESS(uncmem, PAGE_SIZE, src, &clen, meta->compress_workmem);
-
+	start = ktime_get();
+	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
+	zram_lat_account(zram->stats.compr_lat, start);
 	if (!is_partial_io(bvec)) {
 		kunmap_atomic(user_mem);
 		user_mem = NULL;
 		uncmem = NULL;
 	}
 
+	if (unlikely(ret)) {
+		pr_err("Compression failed! err=%d\n", ret);
+		goto out;
+	}
+	src = zstrm->buffer;
 	if (unlikely(clen > max_zpage_size)) {
-		zram->stats.bad_compress++;
 		clen = PAGE_SIZE;
-		src = NULL;
 		if (is_partial_io(bvec))
 			src = uncmem;
 	}
 
+	if (zram->use_dedup) {
+		bool mapped = (clen == PAGE_SIZE) && !is_partial_io(bvec);
+
+		if (mapped)
+			src = kmap_atomic(page);
+		checksum = zram_dedup_checksum(src, clen);
+		entry = zram_dedup_get(zram, src, clen, checksum);
+		if (mapped)
+			kunmap_atomic(src);
+		if (entry) {
+			zcomp_strm_release(zram->comp, zstrm);
+			locked = false;
+			handle = (unsigned long)entry;
+			atomic_inc(&zram->stats.pages_dedup);
+			zram_stat64_add(zram, &zram->stats.dedup_saved, clen);
+			goto install;
+		}
+
+		entry = kmalloc(sizeof(*entry), GFP_NOIO);
+		if (!entry) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		src = zstrm->buffer;
+		if (clen == PAGE_SIZE && is_partial_io(bvec))
+			src = uncmem;
+	}
+
 	handle = zs_malloc(meta->mem_pool, clen);
 	if (!handle) {
 		if (printk_timed_ratelimit(&zram_rs_time,
 					   ALLOC_ERROR_LOG_RATE_MS))
 			pr_info("Error allocating memory for compressed page: %u, size=%zu\n",
 				index, clen);
+		kfree(entry);
 		ret = -ENOMEM;
 		goto out;
 	}
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
 
-	if ((clen == PAGE_SIZE) && !is_partial_io(bvec))
+	if ((clen == PAGE_SIZE) && !is_partial_io(bvec)) {
 		src = kmap_atomic(page);
-	memcpy(cmem, src, clen);
-	if ((clen == PAGE_SIZE) && !is_partial_io(bvec))
+		memcpy(cmem, src, PAGE_SIZE);
 		kunmap_atomic(src);
+	} else {
+		memcpy(cmem, src, clen);
+	}
 
+	zcomp_strm_release(zram->comp, zstrm);
+	locked = false;
 	zs_unmap_object(meta->mem_pool, handle);
 
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	if (entry) {
+		entry->handle = handle;
+		entry->checksum = checksum;
+		entry->len = clen;
+		entry->refcount = 1;
+		zram_dedup_insert(zram, entry);
+		handle = (unsigned long)entry;
+	}
+
+install:
+	/*
+	 * Free memory associated with this sector
+	 * before overwriting unused sectors.
+	 */
+	zram_lock_table(meta, index);
+	zram_free_page(zram, index);
+
 	meta->table[index].handle = handle;
-	meta->table[index].size = clen;
+	zram_set_obj_size(meta, index, clen);
+	if (clen == PAGE_SIZE)
+		zram_set_flag(meta, index, ZRAM_HUGE);
+	zram_unlock_table(meta, index);
 
 	/* Update stats */
-	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram->stats.pages_stored++;
+	atomic_inc(&zram->stats.pages_stored);
+	if (unlikely(clen > max_zpage_size))
+		atomic_inc(&zram->stats.bad_compress);
+	if (clen == PAGE_SIZE) {
+		atomic_inc(&zram->stats.pages_huge);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* leave a full backing_dev alone */
+		if (zram->bdev &&
+		    atomic_read(&zram->stats.pages_huge) >= ZRAM_WB_BATCH &&
+		    atomic_read(&zram->stats.bd_count) < zram->nr_pages - 1)
+			schedule_work(&zram->wb_work);
+#endif
+	}
 	if (clen <= PAGE_SIZE / 2)
-		zram->stats.good_compress++;
+		atomic_inc(&zram->stats.good_compress);
 
 out:
+	if (locked)
+		zcomp_strm_release(zram->comp, zstrm);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 
@@ -422,36 +733,15 @@ out:
 	return ret;
 }
 
-static void handle_pending_slot_free(struct zram *zram)
-{
-	struct zram_slot_free *free_rq;
-
-	spin_lock(&zram->slot_free_lock);
-	while (zram->slot_free_rq) {
-		free_rq = zram->slot_free_rq;
-		zram->slot_free_rq = free_rq->next;
-		zram_free_page(zram, free_rq->index);
-		kfree(free_rq);
-	}
-	spin_unlock(&zram->slot_free_lock);
-}
-
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
 	int ret;
 
-	if (rw == READ) {
-		down_read(&zram->lock);
-		handle_pending_slot_free(zram);
+	if (rw == READ)
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		handle_pending_slot_free(zram);
+	else
 		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
 
 	return ret;
 }
@@ -568,25 +858,278 @@ error:
 	bio_io_error(bio);
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Claim a page for writeback if it matches @mode. The ZRAM_UNDER_WB flag
+ * is cleared by zram_free_page(), so a page that is overwritten or freed
+ * meanwhile is detected by zram_wb_finish().
+ */
+static bool zram_wb_pick(struct zram *zram, u32 index,
+			 enum zram_wb_mode mode, unsigned long *handle)
+{
+	struct zram_meta *meta = zram->meta;
+	bool picked = false;
+
+	zram_lock_table(meta, index);
+	if (!meta->table[index].handle ||
+	    zram_test_flag(meta, index, ZRAM_SAME) ||
+	    zram_test_flag(meta, index, ZRAM_WB) ||
+	    zram_test_flag(meta, index, ZRAM_UNDER_WB))
+		goto out;
+	if (mode == ZRAM_WB_HUGE && !zram_test_flag(meta, index, ZRAM_HUGE))
+		goto out;
+	if (mode == ZRAM_WB_IDLE && !zram_test_flag(meta, index, ZRAM_IDLE))
+		goto out;
+
+	zram_set_flag(meta, index, ZRAM_UNDER_WB);
+	*handle = meta->table[index].handle;
+	picked = true;
+out:
+	zram_unlock_table(meta, index);
+	return picked;
+}
+
+/* Replace the in-memory copy with the block once it is on backing_dev */
+static void zram_wb_finish(struct zram *zram, u32 index, unsigned long handle,
+			   unsigned long blk, int err)
+{
+	struct zram_meta *meta = zram->meta;
+	bool done = false;
+
+	zram_lock_table(meta, index);
+	if (zram_test_flag(meta, index, ZRAM_UNDER_WB) &&
+	    meta->table[index].handle == handle) {
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		if (!err) {
+			zram_free_page(zram, index);
+			zram_set_flag(meta, index, ZRAM_WB);
+			meta->table[index].handle = blk;
+			done = true;
+		}
+	}
+	zram_unlock_table(meta, index);
+
+	if (done)
+		atomic_inc(&zram->stats.bd_writes);
+	else if (blk)
+		zram_free_block(zram, blk);
+}
+
+/* Write a batch of pages, merging contiguous blocks into one bio */
+static int zram_wb_write(struct zram *zram, struct page **pages,
+			 unsigned long *blks, int nr)
+{
+	struct zram_bio_batch batch;
+	struct bio *bio = NULL;
+	int i;
+
+	zram_batch_init(&batch);
+	for (i = 0; i < nr; i++) {
+		if (bio && (blks[i] != blks[i - 1] + 1 ||
+			    !bio_add_page(bio, pages[i], PAGE_SIZE, 0))) {
+			zram_batch_submit(&batch, bio, WRITE);
+			bio = NULL;
+		}
+		if (!bio) {
+			bio = zram_bdev_bio(zram, blks[i], nr - i);
+			bio_add_page(bio, pages[i], PAGE_SIZE, 0);
+		}
+	}
+	if (bio)
+		zram_batch_submit(&batch, bio, WRITE);
+
+	return zram_batch_wait(&batch);
+}
+
+/*
+ * Move pages matching @mode to backing_dev. Pages are decompressed and
+ * written in batches of ZRAM_WB_BATCH; the memory they used is released
+ * once their batch has completed. Caller must hold init_lock.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	struct page *pages[ZRAM_WB_BATCH];
+	unsigned long handles[ZRAM_WB_BATCH];
+	unsigned long blks[ZRAM_WB_BATCH];
+	u32 indices[ZRAM_WB_BATCH];
+	unsigned long index = 0, blk = 0, unused;
+	int i, nr, err, ret = 0;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	memset(pages, 0, sizeof(pages));
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	mutex_lock(&zram->wb_lock);
+	while (index < nr_pages) {
+		for (nr = 0; index < nr_pages && nr < ZRAM_WB_BATCH; index++) {
+			if (!zram_wb_pick(zram, index, mode, &handles[nr]))
+				continue;
+
+			blk = zram_alloc_block(zram, blk + 1);
+			if (!blk) {
+				zram_wb_finish(zram, index, handles[nr], 0,
+					       -ENOSPC);
+				ret = -ENOSPC;
+				index = nr_pages;
+				break;
+			}
+			if (zram_decompress_page(zram,
+					page_address(pages[nr]), index,
+					&unused)) {
+				zram_wb_finish(zram, index, handles[nr], blk,
+					       -EIO);
+				continue;
+			}
+			indices[nr] = index;
+			blks[nr] = blk;
+			nr++;
+		}
+		if (!nr)
+			break;
+
+		err = zram_wb_write(zram, pages, blks, nr);
+		if (err)
+			ret = err;
+		for (i = 0; i < nr; i++)
+			zram_wb_finish(zram, indices[i], handles[i], blks[i],
+				       err);
+	}
+	mutex_unlock(&zram->wb_lock);
+out:
+	for (i = 0; i < ZRAM_WB_BATCH && pages[i]; i++)
+		__free_page(pages[i]);
+	return ret;
+}
+
+static void zram_wb_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, wb_work);
+
+	down_read(&zram->init_lock);
+	if (zram->init_done && zram->bdev)
+		zram_writeback(zram, ZRAM_WB_HUGE);
+	up_read(&zram->init_lock);
+}
+
+/* Mark every page currently stored in memory as idle */
+void zram_mark_idle(struct zram *zram)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	u32 index;
+
+	for (index = 0; index < nr_pages; index++) {
+		zram_lock_table(meta, index);
+		if (meta->table[index].handle &&
+		    !zram_test_flag(meta, index, ZRAM_SAME) &&
+		    !zram_test_flag(meta, index, ZRAM_WB))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		zram_unlock_table(meta, index);
+	}
+}
+
+static void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, zram_bdev_mode);
+	vfree(zram->bitmap);
+	kfree(zram->backing_dev);
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->backing_dev = NULL;
+	zram->nr_pages = 0;
+}
+
+/*
+ * Attach the block device at @path ("none" detaches). Caller must hold
+ * init_lock for writing on an uninitialized device.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_pages;
+	unsigned long *bitmap;
+	char *name;
+	int err;
+
+	zram_reset_bdev(zram);
+	if (sysfs_streq(path, "none"))
+		return 0;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+	strim(name);
+
+	bdev = blkdev_get_by_path(name, zram_bdev_mode, zram);
+	if (IS_ERR(bdev)) {
+		err = PTR_ERR(bdev);
+		goto out_free_name;
+	}
+
+	err = -EINVAL;
+	if (bdev->bd_disk == zram->disk)
+		goto out_put;
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2)
+		goto out_put;
+
+	err = -ENOMEM;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap)
+		goto out_put;
+
+	zram->bdev = bdev;
+	zram->backing_dev = name;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	pr_info("setup backing device %s (%lu pages)\n", name, nr_pages);
+	return 0;
+
+out_put:
+	blkdev_put(bdev, zram_bdev_mode);
+out_free_name:
+	kfree(name);
+	return err;
+}
+#else
+static inline void zram_reset_bdev(struct zram *zram) {}
+#endif
+
 static void __zram_reset_device(struct zram *zram)
 {
 	size_t index;
-	struct zram_meta *meta;
 
-	if (!zram->init_done)
+	/* a backing device can be attached before the disksize is set */
+	if (!zram->init_done) {
+		zram_reset_bdev(zram);
 		return;
+	}
 
-	meta = zram->meta;
 	zram->init_done = 0;
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		unsigned long handle = meta->table[index].handle;
-		if (!handle)
-			continue;
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
 
-		zs_free(meta->mem_pool, handle);
-	}
+	zcomp_destroy(zram->comp);
+	zram->comp = NULL;
+	zram->max_comp_streams = 1;
+	zram->compressor = default_compressor;
+	zram->use_dedup = false;
+	zram_reset_bdev(zram);
 
 	zram_meta_free(zram->meta);
 	zram->meta = NULL;
@@ -602,58 +1145,57 @@ void zram_reset_device(struct zram *zram)
 	down_write(&zram->init_lock);
 	__zram_reset_device(zram);
 	up_write(&zram->init_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/*
+	 * The work takes init_lock, so it can't be waited for under it.
+	 * Only writes queue it, and none get past the reset device, so
+	 * nothing queues it again after this.
+	 */
+	cancel_work_sync(&zram->wb_work);
+#endif
 }
 
 void zram_meta_free(struct zram_meta *meta)
 {
 	zs_destroy_pool(meta->mem_pool);
-	kfree(meta->compress_workmem);
-	free_pages((unsigned long)meta->compress_buffer, 1);
+	zram_dedup_fini(meta);
 	vfree(meta->table);
 	kfree(meta);
 }
 
-struct zram_meta *zram_meta_alloc(u64 disksize)
+struct zram_meta *zram_meta_alloc(const char *name, u64 disksize,
+				   bool use_dedup)
 {
 	size_t num_pages;
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 	if (!meta)
 		goto out;
-	meta->compress_workmem = kzalloc(WMSIZE, GFP_KERNEL);
-	if (!meta->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		goto free_meta;
-	}
-
-	meta->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!meta->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		goto free_workmem;
-	}
 
 	num_pages = disksize >> PAGE_SHIFT;
 	meta->table = vzalloc(num_pages * sizeof(*meta->table));
 	if (!meta->table) {
 		pr_err("Error allocating zram address table\n");
-		goto free_buffer;
+		goto free_meta;
+	}
+
+	if (use_dedup && zram_dedup_init(meta, num_pages)) {
+		pr_err("Error allocating zram dedup table\n");
+		goto free_table;
 	}
 
-	meta->mem_pool = zs_create_pool(GFP_NOIO | __GFP_HIGHMEM |
+	meta->mem_pool = zs_create_pool(name, GFP_NOIO | __GFP_HIGHMEM |
 					__GFP_NOWARN);
 	if (!meta->mem_pool) {
 		pr_err("Error creating memory pool\n");
-		goto free_table;
+		goto free_dedup;
 	}
 
 	return meta;
 
+free_dedup:
+	zram_dedup_fini(meta);
 free_table:
 	vfree(meta->table);
-free_buffer:
-	free_pages((unsigned long)meta->compress_buffer, 1);
-free_workmem:
-	kfree(meta->compress_workmem);
 free_meta:
 	kfree(meta);
 	meta = NULL;
@@ -661,7 +1203,8 @@ out:
 	return meta;
 }
 
-void zram_init_device(struct zram *zram, struct zram_meta *meta)
+void zram_init_device(struct zram *zram, struct zram_meta *meta,
+		      struct zcomp *comp)
 {
 	if (zram->disksize > 2 * (totalram_pages << PAGE_SHIFT)) {
 		pr_info(
@@ -681,45 +1224,25 @@ void zram_init_device(struct zram *zram, struct zram_meta *meta)
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
 	zram->meta = meta;
+	zram->comp = comp;
 	zram->init_done = 1;
 
 	pr_debug("Initialization done!\n");
 }
 
-static void zram_slot_free(struct work_struct *work)
-{
-	struct zram *zram;
-
-	zram = container_of(work, struct zram, free_work);
-	down_write(&zram->lock);
-	handle_pending_slot_free(zram);
-	up_write(&zram->lock);
-}
-
-static void add_slot_free(struct zram *zram, struct zram_slot_free *free_rq)
-{
-	spin_lock(&zram->slot_free_lock);
-	free_rq->next = zram->slot_free_rq;
-	zram->slot_free_rq = free_rq;
-	spin_unlock(&zram->slot_free_lock);
-}
-
 static void zram_slot_free_notify(struct block_device *bdev,
 				unsigned long index)
 {
 	struct zram *zram;
-	struct zram_slot_free *free_rq;
+	struct zram_meta *meta;
 
 	zram = bdev->bd_disk->private_data;
-	zram_stat64_inc(zram, &zram->stats.notify_free);
-
-	free_rq = kmalloc(sizeof(struct zram_slot_free), GFP_ATOMIC);
-	if (!free_rq)
-		return;
+	meta = zram->meta;
 
-	free_rq->index = index;
-	add_slot_free(zram, free_rq);
-	schedule_work(&zram->free_work);
+	zram_lock_table(meta, index);
+	zram_free_page(zram, index);
+	zram_unlock_table(meta, index);
+	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
 static const struct block_device_operations zram_devops = {
@@ -731,13 +1254,12 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = -ENOMEM;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
-
-	INIT_WORK(&zram->free_work, zram_slot_free);
-	spin_lock_init(&zram->slot_free_lock);
-	zram->slot_free_rq = NULL;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	mutex_init(&zram->wb_lock);
+	INIT_WORK(&zram->wb_work, zram_wb_work);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -787,6 +1309,8 @@ static int create_device(struct zram *zram, int device_id)
 	}
 
 	zram->init_done = 0;
+	zram->max_comp_streams = 1;
+	zram->compressor = default_compressor;
 	return 0;
 
 out_free_disk:
@@ -19,6 +19,7 @@
 #include <linux/mutex.h>
 
 #include "../zsmalloc/zsmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -40,6 +41,9 @@ static const size_t max_zpage_size = PAGE_SIZE / 10 * 9;
  * always return failure.
  */
 
+/* Compressor used unless comp_algorithm is written before disksize */
+static const char * const default_compressor = "lzo";
+
 /*-- End of configurable params */
 
 #define SECTOR_SHIFT		9
@@ -51,23 +55,54 @@ static const size_t max_zpage_size = PAGE_SIZE / 10 * 9;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table.value is for
+ * object size (excluding header), the higher bits is for
+ * zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT 24
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, which is kept
+	 * in table[page_no].handle instead of a zsmalloc handle
+	 */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT + 1,
+	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_WB,	/* page is stored on backing_dev, handle is the block */
+	ZRAM_UNDER_WB,	/* page is being written to backing_dev */
+	ZRAM_HUGE,	/* incompressible page */
+	ZRAM_IDLE,	/* not accessed since the last idle marking */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+/*
+ * Compression and decompression latency histogram buckets, log2 in
+ * microseconds: <1us, <2us, ... <2048us, >=2048us
+ */
+#define ZRAM_LAT_BUCKETS	13
+
 /*-- Data structures */
 
-/* Allocated for each disk page */
+/*
+ * Allocated for each disk page. With use_dedup, handle points to the
+ * zram_entry that owns the zsmalloc object.
+ */
 struct table {
 	unsigned long handle;
-	u16 size;	/* object size (excluding header) */
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __aligned(4);
+	unsigned long value;
+};
+
+/* A stored object shared by all pages with identical content */
+struct zram_entry {
+	struct hlist_node node;
+	unsigned long handle;	/* zsmalloc handle */
+	u32 checksum;
+	unsigned int len;	/* object size */
+	int refcount;		/* protected by zram_meta.dedup_lock */
+};
 
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
@@ -77,45 +112,65 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 bad_compress;	/* % of pages with compression ratio>=75% */
+	u64 dedup_saved;	/* bytes not stored thanks to dedup */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same element filled pages */
+	atomic_t pages_dedup;	/* no. of pages sharing another's object */
+	atomic_t pages_huge;	/* no. of incompressible pages in memory */
+	atomic_t bd_count;	/* no. of pages stored on backing_dev */
+	atomic_t bd_reads;	/* no. of reads from backing_dev */
+	atomic_t bd_writes;	/* no. of writes to backing_dev */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t bad_compress;	/* % of pages with compression ratio>=75% */
+	/* latency of the current comp_algorithm, see ZRAM_LAT_BUCKETS */
+	atomic_t compr_lat[ZRAM_LAT_BUCKETS];
+	atomic_t decompr_lat[ZRAM_LAT_BUCKETS];
 };
 
 struct zram_meta {
-	void *compress_workmem;
-	void *compress_buffer;
 	struct table *table;
 	struct zs_pool *mem_pool;
-};
-
-struct zram_slot_free {
-	unsigned long index;
-	struct zram_slot_free *next;
+	/* content index of stored objects, only used with use_dedup */
+	struct hlist_head *dedup_table;
+	unsigned int dedup_bits;
+	spinlock_t dedup_lock;
 };
 
 struct zram {
 	struct zram_meta *meta;
+	struct zcomp *comp;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers, table,
-				   * 32bit stat counters against concurrent
-				   * notifications, reads and writes */
-
-	struct work_struct free_work;  /* handle pending free request */
-	struct zram_slot_free *slot_free_rq; /* list head of free request */
 
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
-	/* Prevent concurrent execution of device init, reset and R/W request */
+	/*
+	 * Prevent concurrent execution of device init, reset and R/W request.
+	 * Individual table entries are protected by the ZRAM_ACCESS bit
+	 * spinlock, so reads and writes to different slots run in parallel.
+	 */
 	struct rw_semaphore init_lock;
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	spinlock_t slot_free_lock;
+	int max_comp_streams;
+	const char *compressor;
+	bool use_dedup;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Optional block device incompressible and idle pages move to */
+	struct block_device *bdev;
+	char *backing_dev;
+	/* One bit per PAGE_SIZE block of bdev, block 0 is never used */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+	/* Serializes writeback passes */
+	struct mutex wb_lock;
+	/* Writes back incompressible pages once enough have piled up */
+	struct work_struct wb_work;
+#endif
 
 	struct zram_stats stats;
 };
@@ -127,8 +182,29 @@ extern struct attribute_group zram_disk_attr_group;
 #endif
 
 extern void zram_reset_device(struct zram *zram);
-extern struct zram_meta *zram_meta_alloc(u64 disksize);
+extern struct zram_meta *zram_meta_alloc(const char *name, u64 disksize,
+					  bool use_dedup);
 extern void zram_meta_free(struct zram_meta *meta);
-extern void zram_init_device(struct zram *zram, struct zram_meta *meta);
+extern void zram_init_device(struct zram *zram, struct zram_meta *meta,
+			     struct zcomp *comp);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,	/* incompressible pages */
+	ZRAM_WB_IDLE,	/* pages not accessed since zram_mark_idle() */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
+
+extern int zram_dedup_init(struct zram_meta *meta, size_t num_pages);
+extern void zram_dedup_fini(struct zram_meta *meta);
+extern u32 zram_dedup_checksum(const unsigned char *mem, size_t len);
+extern struct zram_entry *zram_dedup_get(struct zram *zram,
+		const unsigned char *mem, size_t len, u32 checksum);
+extern void zram_dedup_insert(struct zram *zram, struct zram_entry *entry);
+extern bool zram_dedup_put(struct zram *zram, struct zram_entry *entry);
 
 #endif
@@ -56,6 +56,23 @@
  *	PG_private: identifies the first component page
  *	PG_private2: identifies the last component page
  *
+ * Handles returned by zs_malloc() do not encode the object location
+ * directly. A handle is the address of a word, allocated from
+ * zs_handle_cachep, which holds the current location of the object.
+ * Except in huge classes, every allocated object starts with a header
+ * pointing back to its handle, tagged with OBJ_ALLOCATED_TAG. This lets
+ * compaction walk a sparse zspage, move its objects into fuller zspages
+ * of the same class and update their handles, after which the sparse
+ * zspage can be freed. Bit HANDLE_PIN_BIT of the handle word is a lock
+ * that keeps the object in place while it is mapped or being freed;
+ * compaction skips pinned objects.
+ *
+ * Freed objects are first kept, together with their handle, in a small
+ * per-cpu cache of their class, so that zs_malloc()/zs_free() usually
+ * do not touch the shared class lock. Cached objects still look
+ * allocated to the rest of the allocator and are returned to their
+ * zspages in batches, or all at once before compaction.
+ *
  */
 
 #ifdef CONFIG_ZSMALLOC_DEBUG
@@ -77,6 +94,12 @@
 #include <linux/vmalloc.h>
 #include <linux/hardirq.h>
 #include <linux/spinlock.h>
+#include <linux/bit_spinlock.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/types.h>
 
 #include "zsmalloc.h"
@@ -119,7 +142,20 @@
 #endif
 #endif
 #define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
-#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS)
+
+/*
+ * The low bit of an object location is left clear so that it can serve
+ * as HANDLE_PIN_BIT in the handle word, and so that a free object (whose
+ * first word links to the next free location) can be told apart from an
+ * allocated one (whose first word is its handle | OBJ_ALLOCATED_TAG).
+ * Handles come from a kmem_cache and are at least word aligned.
+ */
+#define OBJ_TAG_BITS	1
+#define OBJ_ALLOCATED_TAG	1
+#define HANDLE_PIN_BIT	0
+#define ZS_HANDLE_SIZE	(sizeof(unsigned long))
+
+#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
 #define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
 
 #define MAX(a, b) ((a) >= (b) ? (a) : (b))
@@ -145,6 +181,13 @@
 #define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
 					ZS_SIZE_CLASS_DELTA + 1)
 
+/*
+ * Number of freed objects each cpu keeps per size class, and how many of
+ * them are given back to the class at once when the cache overflows.
+ */
+#define ZS_CACHE_SIZE	8
+#define ZS_CACHE_BATCH	(ZS_CACHE_SIZE / 2)
+
 /*
  * We do not maintain any list for completely empty or full pages
  */
@@ -173,6 +216,13 @@ enum fullness_group {
  */
 static const int fullness_threshold_frac = 4;
 
+/* per-cpu cache of freed objects of one size class, see zs_free() */
+struct zs_cache {
+	spinlock_t lock;
+	int count;
+	unsigned long handles[ZS_CACHE_SIZE];
+};
+
 struct size_class {
 	/*
 	 * Size of objects stored in this class. Must be multiple
@@ -183,13 +233,23 @@ struct size_class {
 
 	/* Number of PAGE_SIZE sized pages to combine to form a 'zspage' */
 	int pages_per_zspage;
+	int objs_per_zspage;
+	/*
+	 * A zspage of a huge class holds a single object, which has no
+	 * header and is never moved by compaction.
+	 */
+	bool huge;
 
 	spinlock_t lock;
 
 	/* stats */
 	u64 pages_allocated;
+	/* allocated objects, including the ones in per-cpu caches */
+	unsigned long objs_inuse;
 
 	struct page *fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	struct zs_cache __percpu *cache;
 };
 
 /*
@@ -199,14 +259,27 @@ struct size_class {
  * This must be power of 2 and less than or equal to ZS_ALIGN
  */
 struct link_free {
-	/* Handle of next free chunk (encodes <PFN, obj_idx>) */
-	void *next;
+	union {
+		/* Location of next free chunk (encodes <PFN, obj_idx>) */
+		void *next;
+		/* Handle of an allocated object, with OBJ_ALLOCATED_TAG */
+		unsigned long handle;
+	};
 };
 
 struct zs_pool {
 	struct size_class size_class[ZS_SIZE_CLASSES];
 
 	gfp_t flags;	/* allocation flags used when growing pool */
+	const char *name;
+
+	/* compacts the pool under memory pressure */
+	struct shrinker shrinker;
+	atomic_long_t pages_compacted;
+
+#ifdef CONFIG_ZSMALLOC_STAT
+	struct dentry *stat_dentry;
+#endif
 };
 
 /*
@@ -232,6 +305,46 @@ struct mapping_area {
 /* per-cpu VM mapping areas for zspage accesses that cross page boundaries */
 static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
 
+static struct kmem_cache *zs_handle_cachep;
+
+static unsigned long alloc_handle(struct zs_pool *pool)
+{
+	return (unsigned long)kmem_cache_alloc(zs_handle_cachep,
+			pool->flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+}
+
+static void free_handle(unsigned long handle)
+{
+	kmem_cache_free(zs_handle_cachep, (void *)handle);
+}
+
+/* Only valid while the object cannot move, see pin_tag() */
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle & ~(1UL << HANDLE_PIN_BIT);
+}
+
+/* Point a handle, pinned by the caller, to a new location */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	*(unsigned long *)handle = obj | (1UL << HANDLE_PIN_BIT);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
 static int is_first_page(struct page *page)
 {
 	return PagePrivate(page);
@@ -272,7 +385,8 @@ static int get_size_class_index(int size)
 		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
 				ZS_SIZE_CLASS_DELTA);
 
-	return idx;
+	/* objects of the last class are huge and carry no header */
+	return min_t(int, idx, ZS_SIZE_CLASSES - 1);
 }
 
 static enum fullness_group get_fullness_group(struct page *page)
@@ -334,11 +448,10 @@ static void remove_zspage(struct page *page, struct size_class *class,
 	list_del_init(&page->lru);
 }
 
-static enum fullness_group fix_fullness_group(struct zs_pool *pool,
+static enum fullness_group fix_fullness_group(struct size_class *class,
 						struct page *page)
 {
 	int class_idx;
-	struct size_class *class;
 	enum fullness_group currfg, newfg;
 
 	BUG_ON(!is_first_page(page));
@@ -348,7 +461,6 @@ static enum fullness_group fix_fullness_group(struct zs_pool *pool,
 	if (newfg == currfg)
 		goto out;
 
-	class = &pool->size_class[class_idx];
 	remove_zspage(page, class, currfg);
 	insert_zspage(page, class, newfg);
 	set_zspage_mapping(page, class_idx, newfg);
@@ -420,36 +532,38 @@ static struct page *get_next_page(struct page *page)
 }
 
 /*
- * Encode <page, obj_idx> as a single handle value.
+ * Encode <page, obj_idx> as a single object location value.
  * On hardware platforms with physical memory starting at 0x0 the pfn
- * could be 0 so we ensure that the handle will never be 0 by adjusting the
- * encoded obj_idx value before encoding.
+ * could be 0 so we ensure that the location will never be 0 by adjusting
+ * the encoded obj_idx value before encoding.
  */
-static void *obj_location_to_handle(struct page *page, unsigned long obj_idx)
+static void *location_to_obj(struct page *page, unsigned long obj_idx)
 {
-	unsigned long handle;
+	unsigned long obj;
 
 	if (!page) {
 		BUG_ON(obj_idx);
 		return NULL;
 	}
 
-	handle = page_to_pfn(page) << OBJ_INDEX_BITS;
-	handle |= ((obj_idx + 1) & OBJ_INDEX_MASK);
+	obj = page_to_pfn(page) << OBJ_INDEX_BITS;
+	obj |= ((obj_idx + 1) & OBJ_INDEX_MASK);
+	obj <<= OBJ_TAG_BITS;
 
-	return (void *)handle;
+	return (void *)obj;
 }
 
 /*
- * Decode <page, obj_idx> pair from the given object handle. We adjust the
- * decoded obj_idx back to its original value since it was adjusted in
- * obj_location_to_handle().
+ * Decode <page, obj_idx> pair from the given object location. We adjust
+ * the decoded obj_idx back to its original value since it was adjusted in
+ * location_to_obj().
  */
-static void obj_handle_to_location(unsigned long handle, struct page **page,
+static void obj_to_location(unsigned long obj, struct page **page,
 				unsigned long *obj_idx)
 {
-	*page = pfn_to_page(handle >> OBJ_INDEX_BITS);
-	*obj_idx = (handle & OBJ_INDEX_MASK) - 1;
+	obj >>= OBJ_TAG_BITS;
+	*page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+	*obj_idx = (obj & OBJ_INDEX_MASK) - 1;
 }
 
 static unsigned long obj_idx_to_offset(struct page *page,
@@ -526,7 +640,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		for (i = 1; i <= objs_on_page; i++) {
 			off += class->size;
 			if (off < PAGE_SIZE) {
-				link->next = obj_location_to_handle(page, i);
+				link->next = location_to_obj(page, i);
 				link += class->size / sizeof(*link);
 			}
 		}
@@ -537,7 +651,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		 * page (if present)
 		 */
 		next_page = get_next_page(page);
-		link->next = obj_location_to_handle(next_page, 0);
+		link->next = location_to_obj(next_page, 0);
 		kunmap_atomic(link);
 		page = next_page;
 		off = (off + class->size) % PAGE_SIZE;
@@ -591,9 +705,9 @@ static struct page *alloc_zspage(struct size_class *class, gfp_t flags)
 
 	init_zspage(first_page, class);
 
-	first_page->freelist = obj_location_to_handle(first_page, 0);
+	first_page->freelist = location_to_obj(first_page, 0);
 	/* Maximum number of objects we can store in this zspage */
-	first_page->objects = class->pages_per_zspage * PAGE_SIZE / class->size;
+	first_page->objects = class->objs_per_zspage;
 
 	error = 0; /* Success */
 
@@ -620,6 +734,416 @@ static struct page *find_get_zspage(struct size_class *class)
 	return page;
 }
 
+/*
+ * Take a free object from @first_page for @handle. Caller must hold the
+ * class lock and fix the fullness group of the zspage.
+ */
+static unsigned long obj_malloc(struct page *first_page,
+				struct size_class *class, unsigned long handle)
+{
+	unsigned long obj;
+	struct link_free *link;
+	struct page *m_page;
+	unsigned long m_objidx, m_offset;
+
+	obj = (unsigned long)first_page->freelist;
+	obj_to_location(obj, &m_page, &m_objidx);
+	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
+
+	link = (struct link_free *)kmap_atomic(m_page) +
+					m_offset / sizeof(*link);
+	first_page->freelist = link->next;
+	if (!class->huge)
+		link->handle = handle | OBJ_ALLOCATED_TAG;
+	else
+		memset(link, POISON_INUSE, sizeof(*link));
+	kunmap_atomic(link);
+
+	first_page->inuse++;
+	class->objs_inuse++;
+
+	return obj;
+}
+
+/*
+ * Put an object back on its zspage freelist. Returns the first page of
+ * the zspage, whose fullness group the caller (holding the class lock)
+ * must fix.
+ */
+static struct page *obj_free(struct size_class *class, unsigned long obj)
+{
+	struct link_free *link;
+	struct page *first_page, *f_page;
+	unsigned long f_objidx, f_offset;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
+
+	/* Insert this object in containing zspage's freelist */
+	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
+							+ f_offset);
+	link->next = first_page->freelist;
+	kunmap_atomic(link);
+	first_page->freelist = (void *)obj;
+
+	first_page->inuse--;
+	class->objs_inuse--;
+
+	return first_page;
+}
+
+/* Copy a whole object, header included; either side may span two pages */
+static void zs_object_copy(unsigned long dst, unsigned long src,
+				struct size_class *class)
+{
+	struct page *s_page, *d_page;
+	unsigned long s_objidx, d_objidx;
+	unsigned long s_off, d_off;
+	void *s_addr, *d_addr;
+	int s_size, d_size, size;
+	int written = 0;
+
+	s_size = d_size = class->size;
+
+	obj_to_location(src, &s_page, &s_objidx);
+	obj_to_location(dst, &d_page, &d_objidx);
+
+	s_off = obj_idx_to_offset(s_page, s_objidx, class->size);
+	d_off = obj_idx_to_offset(d_page, d_objidx, class->size);
+
+	if (s_off + class->size > PAGE_SIZE)
+		s_size = PAGE_SIZE - s_off;
+	if (d_off + class->size > PAGE_SIZE)
+		d_size = PAGE_SIZE - d_off;
+
+	s_addr = kmap_atomic(s_page);
+	d_addr = kmap_atomic(d_page);
+
+	while (1) {
+		size = min(s_size, d_size);
+		memcpy(d_addr + d_off, s_addr + s_off, size);
+		written += size;
+
+		if (written == class->size)
+			break;
+
+		s_off += size;
+		s_size -= size;
+		d_off += size;
+		d_size -= size;
+
+		/* kmap_atomic() mappings must be released in reverse order */
+		if (s_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			kunmap_atomic(s_addr);
+			s_page = get_next_page(s_page);
+			BUG_ON(!s_page);
+			s_addr = kmap_atomic(s_page);
+			d_addr = kmap_atomic(d_page);
+			s_size = class->size - written;
+			s_off = 0;
+		}
+
+		if (d_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			d_page = get_next_page(d_page);
+			BUG_ON(!d_page);
+			d_addr = kmap_atomic(d_page);
+			d_size = class->size - written;
+			d_off = 0;
+		}
+	}
+
+	kunmap_atomic(d_addr);
+	kunmap_atomic(s_addr);
+}
+
+/*
+ * Find the next allocated object starting in @page at or after object
+ * @*index and pin its handle. Returns 0 if there is none left in @page.
+ */
+static unsigned long find_alloced_obj(struct page *page, int *index,
+					struct size_class *class)
+{
+	unsigned long head, handle = 0;
+	unsigned long offset = 0;
+	void *addr;
+
+	if (!is_first_page(page))
+		offset = page->index;
+	offset += class->size * *index;
+
+	addr = kmap_atomic(page);
+	while (offset < PAGE_SIZE) {
+		head = *(unsigned long *)(addr + offset);
+		if (head & OBJ_ALLOCATED_TAG) {
+			handle = head & ~OBJ_ALLOCATED_TAG;
+			if (trypin_tag(handle))
+				break;
+			/* mapped or being freed, leave it where it is */
+			handle = 0;
+		}
+		offset += class->size;
+		(*index)++;
+	}
+	kunmap_atomic(addr);
+
+	return handle;
+}
+
+struct zs_compact_control {
+	/* component page of the source zspage being scanned */
+	struct page *s_page;
+	/* object index within s_page to scan from */
+	int index;
+	/* first page of the destination zspage */
+	struct page *d_page;
+};
+
+/*
+ * Move objects from cc->s_page onwards into cc->d_page. Returns -ENOMEM
+ * when the destination is full before the source has been scanned to the
+ * end. Caller must hold the class lock with both zspages isolated.
+ */
+static int migrate_zspage(struct size_class *class,
+				struct zs_compact_control *cc)
+{
+	unsigned long handle, used_obj, free_obj;
+	struct page *s_page = cc->s_page;
+	struct page *d_page = cc->d_page;
+	int index = cc->index;
+	int ret = 0;
+
+	while (1) {
+		handle = find_alloced_obj(s_page, &index, class);
+		if (!handle) {
+			s_page = get_next_page(s_page);
+			if (!s_page)
+				break;
+			index = 0;
+			continue;
+		}
+
+		if (d_page->inuse == d_page->objects) {
+			unpin_tag(handle);
+			ret = -ENOMEM;
+			break;
+		}
+
+		used_obj = handle_to_obj(handle);
+		free_obj = obj_malloc(d_page, class, handle);
+		zs_object_copy(free_obj, used_obj, class);
+		index++;
+		record_obj(handle, free_obj);
+		unpin_tag(handle);
+		obj_free(class, used_obj);
+	}
+
+	cc->s_page = s_page;
+	cc->index = index;
+
+	return ret;
+}
+
+static struct page *isolate_source_page(struct size_class *class)
+{
+	struct page *page = class->fullness_list[ZS_ALMOST_EMPTY];
+
+	if (page)
+		remove_zspage(page, class, ZS_ALMOST_EMPTY);
+
+	return page;
+}
+
+static struct page *isolate_target_page(struct size_class *class)
+{
+	int i;
+	struct page *page;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		page = class->fullness_list[i];
+		if (page) {
+			remove_zspage(page, class, i);
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+/* Return an isolated zspage to the fullness list it now belongs to */
+static enum fullness_group putback_zspage(struct size_class *class,
+					struct page *first_page)
+{
+	enum fullness_group fullness;
+
+	fullness = get_fullness_group(first_page);
+	insert_zspage(first_page, class, fullness);
+	set_zspage_mapping(first_page, class->index, fullness);
+
+	if (fullness == ZS_EMPTY)
+		class->pages_allocated -= class->pages_per_zspage;
+
+	return fullness;
+}
+
+/*
+ * Free the objects held in a per-cpu cache: give the objects back to
+ * their zspages under a single acquisition of the class lock.
+ */
+static void zs_cache_flush(struct size_class *class, unsigned long *handles,
+				int nr)
+{
+	LIST_HEAD(free_pages);
+	struct page *first_page, *tmp;
+	int i;
+
+	spin_lock(&class->lock);
+	for (i = 0; i < nr; i++) {
+		first_page = obj_free(class, handle_to_obj(handles[i]));
+		if (fix_fullness_group(class, first_page) == ZS_EMPTY) {
+			class->pages_allocated -= class->pages_per_zspage;
+			list_add(&first_page->lru, &free_pages);
+		}
+	}
+	spin_unlock(&class->lock);
+
+	for (i = 0; i < nr; i++)
+		free_handle(handles[i]);
+
+	list_for_each_entry_safe(first_page, tmp, &free_pages, lru) {
+		list_del_init(&first_page->lru);
+		free_zspage(first_page);
+	}
+}
+
+/* Flush the per-cpu caches of @class on all cpus */
+static void zs_cache_drain(struct size_class *class)
+{
+	unsigned long handles[ZS_CACHE_SIZE];
+	struct zs_cache *cache;
+	int cpu, nr;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(class->cache, cpu);
+
+		spin_lock(&cache->lock);
+		nr = cache->count;
+		memcpy(handles, cache->handles, nr * sizeof(handles[0]));
+		cache->count = 0;
+		spin_unlock(&cache->lock);
+
+		if (nr)
+			zs_cache_flush(class, handles, nr);
+	}
+}
+
+static unsigned long zs_cache_get(struct size_class *class)
+{
+	struct zs_cache *cache;
+	unsigned long handle = 0;
+
+	cache = get_cpu_ptr(class->cache);
+	spin_lock(&cache->lock);
+	if (cache->count)
+		handle = cache->handles[--cache->count];
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(class->cache);
+
+	return handle;
+}
+
+static void zs_cache_put(struct size_class *class, unsigned long handle)
+{
+	unsigned long handles[ZS_CACHE_BATCH];
+	struct zs_cache *cache;
+	int nr = 0;
+
+	cache = get_cpu_ptr(class->cache);
+	spin_lock(&cache->lock);
+	if (cache->count == ZS_CACHE_SIZE) {
+		/* give back the oldest objects, keep the cache-hot ones */
+		nr = ZS_CACHE_BATCH;
+		memcpy(handles, cache->handles, sizeof(handles));
+		cache->count -= nr;
+		memmove(cache->handles, cache->handles + nr,
+			cache->count * sizeof(handles[0]));
+	}
+	cache->handles[cache->count++] = handle;
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(class->cache);
+
+	if (nr)
+		zs_cache_flush(class, handles, nr);
+}
+
+/* Number of pages compaction of @class could free at best */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_allocated, obj_wasted;
+
+	if (class->huge)
+		return 0;
+
+	obj_allocated = (unsigned long)class->pages_allocated /
+			class->pages_per_zspage * class->objs_per_zspage;
+	obj_wasted = obj_allocated - class->objs_inuse;
+	if ((long)obj_wasted <= 0)
+		return 0;
+
+	return obj_wasted / class->objs_per_zspage * class->pages_per_zspage;
+}
+
+static unsigned long __zs_compact(struct size_class *class)
+{
+	struct zs_compact_control cc;
+	struct page *src_page, *dst_page, *tmp;
+	unsigned long nr_src = 0, freed = 0;
+	int ret;
+
+	spin_lock(&class->lock);
+	src_page = class->fullness_list[ZS_ALMOST_EMPTY];
+	if (src_page) {
+		nr_src = 1;
+		list_for_each_entry(tmp, &src_page->lru, lru)
+			nr_src++;
+	}
+
+	/*
+	 * Sources that cannot be emptied (pinned objects) are put back
+	 * at the head of the list, so bound the number of attempts.
+	 */
+	while (nr_src-- && (src_page = isolate_source_page(class))) {
+		cc.s_page = src_page;
+		cc.index = 0;
+
+		dst_page = NULL;
+		while ((dst_page = isolate_target_page(class))) {
+			cc.d_page = dst_page;
+			ret = migrate_zspage(class, &cc);
+			putback_zspage(class, dst_page);
+			if (!ret)
+				break;
+		}
+
+		if (putback_zspage(class, src_page) == ZS_EMPTY) {
+			spin_unlock(&class->lock);
+			free_zspage(src_page);
+			freed += class->pages_per_zspage;
+			cond_resched();
+			spin_lock(&class->lock);
+		}
+
+		/* nothing left to move objects into */
+		if (!dst_page)
+			break;
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
 #ifdef CONFIG_PGTABLE_MAPPING
 static inline int __zs_cpu_up(struct mapping_area *area)
 {
@@ -765,6 +1289,129 @@ static struct notifier_block zs_cpu_nb = {
 	.notifier_call = zs_cpu_notifier
 };
 
+#ifdef CONFIG_ZSMALLOC_STAT
+static struct dentry *zs_stat_root;
+
+static int zs_stats_classes_show(struct seq_file *s, void *v)
+{
+	int i, cpu;
+	struct zs_pool *pool = s->private;
+	struct size_class *class;
+	struct page *page, *tmp;
+	unsigned long nr_fg[_ZS_NR_FULLNESS_GROUPS];
+	unsigned long obj_allocated, obj_used, pages_used, cached;
+	unsigned long total_objs = 0, total_used = 0, total_pages = 0;
+	unsigned long total_cached = 0, total_freeable = 0;
+	int fg;
+
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %6s %8s\n",
+			"class", "size", "almost_full", "almost_empty",
+			"obj_allocated", "obj_used", "pages_used",
+			"pages_per_zspage", "cached", "freeable");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			nr_fg[fg] = 0;
+			page = class->fullness_list[fg];
+			if (!page)
+				continue;
+			nr_fg[fg]++;
+			list_for_each_entry(tmp, &page->lru, lru)
+				nr_fg[fg]++;
+		}
+		pages_used = class->pages_allocated;
+		obj_allocated = pages_used / class->pages_per_zspage *
+				class->objs_per_zspage;
+		obj_used = class->objs_inuse;
+		spin_unlock(&class->lock);
+
+		cached = 0;
+		for_each_possible_cpu(cpu)
+			cached += per_cpu_ptr(class->cache, cpu)->count;
+
+		if (!obj_allocated)
+			continue;
+
+		seq_printf(s, " %5d %5d %11lu %12lu %13lu %10lu %10lu %16d %6lu %8lu\n",
+			i, class->size, nr_fg[ZS_ALMOST_FULL],
+			nr_fg[ZS_ALMOST_EMPTY], obj_allocated, obj_used,
+			pages_used, class->pages_per_zspage, cached,
+			zs_can_compact(class));
+
+		total_objs += obj_allocated;
+		total_used += obj_used;
+		total_pages += pages_used;
+		total_cached += cached;
+		total_freeable += zs_can_compact(class);
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %5s %5s %11s %12s %13lu %10lu %10lu %16s %6lu %8lu\n",
+			"Total", "", "", "", total_objs, total_used,
+			total_pages, "", total_cached, total_freeable);
+	seq_printf(s, "pages_compacted: %lu\n",
+			atomic_long_read(&pool->pages_compacted));
+
+	return 0;
+}
+
+static int zs_stats_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_classes_show, inode->i_private);
+}
+
+static const struct file_operations zs_stats_classes_fops = {
+	.open		= zs_stats_classes_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_stat_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	if (!zs_stat_root)
+		pr_warn("debugfs 'zsmalloc' stat dir creation failed\n");
+}
+
+static void zs_stat_exit(void)
+{
+	debugfs_remove_recursive(zs_stat_root);
+}
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	struct dentry *entry;
+
+	if (!zs_stat_root)
+		return;
+
+	/* pools sharing a name only get stats for the first one */
+	entry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (IS_ERR_OR_NULL(entry))
+		return;
+
+	debugfs_create_file("classes", S_IRUGO, entry, pool,
+			&zs_stats_classes_fops);
+	pool->stat_dentry = entry;
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+#else /* CONFIG_ZSMALLOC_STAT */
+
+static inline void zs_stat_init(void) {}
+static inline void zs_stat_exit(void) {}
+static inline void zs_pool_stat_create(struct zs_pool *pool) {}
+static inline void zs_pool_stat_destroy(struct zs_pool *pool) {}
+
+#endif /* CONFIG_ZSMALLOC_STAT */
+
 static void zs_exit(void)
 {
 	int cpu;
@@ -772,26 +1419,56 @@ static void zs_exit(void)
 	for_each_online_cpu(cpu)
 		zs_cpu_notifier(NULL, CPU_DEAD, (void *)(long)cpu);
 	unregister_cpu_notifier(&zs_cpu_nb);
+
+	zs_stat_exit();
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+	zs_handle_cachep = NULL;
 }
 
 static int zs_init(void)
 {
 	int cpu, ret;
 
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
 	register_cpu_notifier(&zs_cpu_nb);
 	for_each_online_cpu(cpu) {
 		ret = zs_cpu_notifier(NULL, CPU_UP_PREPARE, (void *)(long)cpu);
 		if (notifier_to_errno(ret))
 			goto fail;
 	}
+
+	zs_stat_init();
 	return 0;
 fail:
 	zs_exit();
 	return notifier_to_errno(ret);
 }
 
+static int zs_shrinker_shrink(struct shrinker *shrinker,
+				struct shrink_control *sc)
+{
+	int i;
+	unsigned long freeable = 0;
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					shrinker);
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		freeable += zs_can_compact(&pool->size_class[i]);
+
+	return min_t(unsigned long, freeable, INT_MAX);
+}
+
 /**
  * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool, used for its debugfs statistics
  * @flags: allocation flags used to allocate pool metadata
  *
  * This function must be called before anything when using
@@ -800,9 +1477,9 @@ fail:
  * On success, a pointer to the newly created pool is returned,
  * otherwise NULL.
  */
-struct zs_pool *zs_create_pool(gfp_t flags)
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
 {
-	int i, ovhd_size;
+	int i, cpu, ovhd_size;
 	struct zs_pool *pool;
 
 	ovhd_size = roundup(sizeof(*pool), PAGE_SIZE);
@@ -810,6 +1487,10 @@ struct zs_pool *zs_create_pool(gfp_t flags)
 	if (!pool)
 		return NULL;
 
+	pool->name = kstrdup(name, GFP_KERNEL);
+	if (!pool->name)
+		goto err;
+
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		int size;
 		struct size_class *class;
@@ -823,12 +1504,34 @@ struct zs_pool *zs_create_pool(gfp_t flags)
 		class->index = i;
 		spin_lock_init(&class->lock);
 		class->pages_per_zspage = get_pages_per_zspage(size);
-
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / size;
+		class->huge = class->objs_per_zspage == 1;
+
+		class->cache = alloc_percpu(struct zs_cache);
+		if (!class->cache)
+			goto err;
+		for_each_possible_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(class->cache, cpu)->lock);
 	}
 
 	pool->flags = flags;
+	atomic_long_set(&pool->pages_compacted, 0);
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
 
 	return pool;
+
+err:
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		free_percpu(pool->size_class[i].cache);
+	kfree(pool->name);
+	kfree(pool);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(zs_create_pool);
 
@@ -836,10 +1539,16 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	zs_pool_stat_destroy(pool);
+	unregister_shrinker(&pool->shrinker);
+
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		int fg;
 		struct size_class *class = &pool->size_class[i];
 
+		zs_cache_drain(class);
+		free_percpu(class->cache);
+
 		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
 			if (class->fullness_list[fg]) {
 				pr_info("Freeing non-empty class with size "
@@ -848,6 +1557,7 @@ void zs_destroy_pool(struct zs_pool *pool)
 			}
 		}
 	}
+	kfree(pool->name);
 	kfree(pool);
 }
 EXPORT_SYMBOL_GPL(zs_destroy_pool);
@@ -863,95 +1573,106 @@ EXPORT_SYMBOL_GPL(zs_destroy_pool);
  */
 unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 {
-	unsigned long obj;
-	struct link_free *link;
+	unsigned long handle, obj;
 	int class_idx;
 	struct size_class *class;
-
-	struct page *first_page, *m_page;
-	unsigned long m_objidx, m_offset;
+	struct page *first_page;
 
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
-	class_idx = get_size_class_index(size);
+	class_idx = get_size_class_index(size + ZS_HANDLE_SIZE);
 	class = &pool->size_class[class_idx];
 	BUG_ON(class_idx != class->index);
 
+	/* fast path: reuse an object freed on this cpu */
+	handle = zs_cache_get(class);
+	if (handle)
+		return handle;
+
+	handle = alloc_handle(pool);
+	if (!handle)
+		return 0;
+
 	spin_lock(&class->lock);
 	first_page = find_get_zspage(class);
 
 	if (!first_page) {
 		spin_unlock(&class->lock);
 		first_page = alloc_zspage(class, pool->flags);
-		if (unlikely(!first_page))
+		if (unlikely(!first_page)) {
+			free_handle(handle);
 			return 0;
+		}
 
 		set_zspage_mapping(first_page, class->index, ZS_EMPTY);
 		spin_lock(&class->lock);
 		class->pages_allocated += class->pages_per_zspage;
 	}
 
-	obj = (unsigned long)first_page->freelist;
-	obj_handle_to_location(obj, &m_page, &m_objidx);
-	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
-
-	link = (struct link_free *)kmap_atomic(m_page) +
-					m_offset / sizeof(*link);
-	first_page->freelist = link->next;
-	memset(link, POISON_INUSE, sizeof(*link));
-	kunmap_atomic(link);
-
-	first_page->inuse++;
+	obj = obj_malloc(first_page, class, handle);
 	/* Now move the zspage to another fullness group, if required */
-	fix_fullness_group(pool, first_page);
+	fix_fullness_group(class, first_page);
+	/* the handle is not visible to anyone else yet */
+	*(unsigned long *)handle = obj;
 	spin_unlock(&class->lock);
 
-	return obj;
+	return handle;
 }
 EXPORT_SYMBOL_GPL(zs_malloc);
 
-void zs_free(struct zs_pool *pool, unsigned long obj)
+void zs_free(struct zs_pool *pool, unsigned long handle)
 {
-	struct link_free *link;
-	struct page *first_page, *f_page;
-	unsigned long f_objidx, f_offset;
-
-	int class_idx;
-	struct size_class *class;
+	struct page *f_page;
+	unsigned long obj, f_objidx;
+	unsigned int class_idx;
 	enum fullness_group fullness;
 
-	if (unlikely(!obj))
+	if (unlikely(!handle))
 		return;
 
-	obj_handle_to_location(obj, &f_page, &f_objidx);
-	first_page = get_first_page(f_page);
-
-	get_zspage_mapping(first_page, &class_idx, &fullness);
-	class = &pool->size_class[class_idx];
-	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
-
-	spin_lock(&class->lock);
-
-	/* Insert this object in containing zspage's freelist */
-	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
-							+ f_offset);
-	link->next = first_page->freelist;
-	kunmap_atomic(link);
-	first_page->freelist = (void *)obj;
+	/* keep compaction from moving the object while we look it up */
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &f_page, &f_objidx);
+	get_zspage_mapping(get_first_page(f_page), &class_idx, &fullness);
+	unpin_tag(handle);
 
-	first_page->inuse--;
-	fullness = fix_fullness_group(pool, first_page);
+	zs_cache_put(&pool->size_class[class_idx], handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
 
-	if (fullness == ZS_EMPTY)
-		class->pages_allocated -= class->pages_per_zspage;
+/*
+ * Locate the part of an object that belongs to the user, i.e. without the
+ * handle header. The handle must be pinned.
+ */
+static struct size_class *get_payload_location(struct zs_pool *pool,
+				unsigned long handle, struct page **page,
+				unsigned long *off, int *size)
+{
+	unsigned long obj_idx;
+	unsigned int class_idx;
+	enum fullness_group fg;
+	struct size_class *class;
 
-	spin_unlock(&class->lock);
+	obj_to_location(handle_to_obj(handle), page, &obj_idx);
+	get_zspage_mapping(get_first_page(*page), &class_idx, &fg);
+	class = &pool->size_class[class_idx];
+	*off = obj_idx_to_offset(*page, obj_idx, class->size);
+	*size = class->size;
+
+	if (!class->huge) {
+		/* the header never spans pages, the payload may start after */
+		*off += ZS_HANDLE_SIZE;
+		*size -= ZS_HANDLE_SIZE;
+		if (*off >= PAGE_SIZE) {
+			*page = get_next_page(*page);
+			*off -= PAGE_SIZE;
+		}
+	}
 
-	if (fullness == ZS_EMPTY)
-		free_zspage(first_page);
+	return class;
 }
-EXPORT_SYMBOL_GPL(zs_free);
 
 /**
  * zs_map_object - get address of allocated object from handle.
@@ -963,7 +1684,8 @@ EXPORT_SYMBOL_GPL(zs_free);
  * zs_unmap_object.
  *
  * Only one object can be mapped per cpu at a time. There is no protection
- * against nested mappings.
+ * against nested mappings. The object is pinned, i.e. not moved by
+ * compaction, until it is unmapped.
  *
  * This function returns with preemption and page faults disabled.
 */
@@ -971,11 +1693,9 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 			enum zs_mapmode mm)
 {
 	struct page *page;
-	unsigned long obj_idx, off;
+	unsigned long off;
+	int size;
 
-	unsigned int class_idx;
-	enum fullness_group fg;
-	struct size_class *class;
 	struct mapping_area *area;
 	struct page *pages[2];
 
@@ -988,14 +1708,12 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	 */
 	BUG_ON(in_interrupt());
 
-	obj_handle_to_location(handle, &page, &obj_idx);
-	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
-	class = &pool->size_class[class_idx];
-	off = obj_idx_to_offset(page, obj_idx, class->size);
+	pin_tag(handle);
+	get_payload_location(pool, handle, &page, &off, &size);
 
 	area = &get_cpu_var(zs_map_area);
 	area->vm_mm = mm;
-	if (off + class->size <= PAGE_SIZE) {
+	if (off + size <= PAGE_SIZE) {
 		/* this object is contained entirely within a page */
 		area->vm_addr = kmap_atomic(page);
 		return area->vm_addr + off;
@@ -1006,29 +1724,24 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	pages[1] = get_next_page(page);
 	BUG_ON(!pages[1]);
 
-	return __zs_map_object(area, pages, off, class->size);
+	return __zs_map_object(area, pages, off, size);
 }
 EXPORT_SYMBOL_GPL(zs_map_object);
 
 void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
 {
 	struct page *page;
-	unsigned long obj_idx, off;
+	unsigned long off;
+	int size;
 
-	unsigned int class_idx;
-	enum fullness_group fg;
-	struct size_class *class;
 	struct mapping_area *area;
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
-	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
-	class = &pool->size_class[class_idx];
-	off = obj_idx_to_offset(page, obj_idx, class->size);
+	get_payload_location(pool, handle, &page, &off, &size);
 
 	area = &__get_cpu_var(zs_map_area);
-	if (off + class->size <= PAGE_SIZE)
+	if (off + size <= PAGE_SIZE)
 		kunmap_atomic(area->vm_addr);
 	else {
 		struct page *pages[2];
@@ -1037,9 +1750,10 @@ void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
 		pages[1] = get_next_page(page);
 		BUG_ON(!pages[1]);
 
-		__zs_unmap_object(area, pages, off, class->size);
+		__zs_unmap_object(area, pages, off, size);
 	}
 	put_cpu_var(zs_map_area);
+	unpin_tag(handle);
 }
 EXPORT_SYMBOL_GPL(zs_unmap_object);
 
@@ -1055,6 +1769,42 @@ u64 zs_get_total_size_bytes(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
 
+/**
+ * zs_compact - release sparsely used zspages of a pool
+ * @pool: pool to compact
+ *
+ * Objects cached per cpu are given back first. Then, in every size
+ * class, objects are moved out of almost empty zspages into fuller ones
+ * and the zspages that end up empty are freed. Mapped objects are left
+ * in place.
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long freed = 0;
+	struct size_class *class;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		class = &pool->size_class[i];
+		zs_cache_drain(class);
+		if (!zs_can_compact(class))
+			continue;
+		freed += __zs_compact(class);
+	}
+	atomic_long_add(freed, &pool->pages_compacted);
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_pool_stats);
+
 module_init(zs_init);
 module_exit(zs_exit);
 
@@ -427,6 +427,28 @@ void exit_aio(struct mm_struct *mm)
 	}
 }
 
+/*
+ * Wake function of kiocb->ki_wait: the page bit the iocb waits for got
+ * cleared, retry the iocb. Called with the wait queue's lock held, often
+ * from I/O completion.
+ */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode, int sync,
+			     void *arg)
+{
+	struct wait_bit_key *key = arg;
+	struct wait_bit_queue *wait_bit =
+		container_of(wait, struct wait_bit_queue, wait);
+
+	if (wait_bit->key.flags != key->flags ||
+	    wait_bit->key.bit_nr != key->bit_nr ||
+	    test_bit(key->bit_nr, key->flags))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(container_of(wait_bit, struct kiocb, ki_wait));
+	return 1;
+}
+
 /* aio_get_req
  *	Allocate a slot for an aio request.  Increments the users count
  * of the kioctx so that the kioctx stays around until all requests are
@@ -458,6 +480,8 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
 
 	/* Check if the completion queue has enough free space to
 	 * accept an event from this io.
@@ -794,7 +818,7 @@ static void aio_queue_work(struct kioctx * ctx)
 	 */
 	smp_mb();
 	if (waitqueue_active(&ctx->wait))
-		timeout = 1;
+		timeout = 0;
 	else
 		timeout = HZ/10;
 	queue_delayed_work(aio_wq, &ctx->wq, timeout);
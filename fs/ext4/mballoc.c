@@ -2620,8 +2620,13 @@ int ext4_mb_release(struct super_block *sb)
 	return 0;
 }
 
+/*
+ * Freed blocks are discarded in the background, where the block layer
+ * supports that; FITRIM waits for its discards.
+ */
 static inline int ext4_issue_discard(struct super_block *sb,
-		ext4_group_t block_group, ext4_grpblk_t cluster, int count)
+		ext4_group_t block_group, ext4_grpblk_t cluster, int count,
+		bool wait)
 {
 	ext4_fsblk_t discard_block;
 
@@ -2630,6 +2635,8 @@ static inline int ext4_issue_discard(struct super_block *sb,
 	count = EXT4_C2B(EXT4_SB(sb), count);
 	trace_ext4_discard_blocks(sb,
 			(unsigned long long) discard_block, count);
+	if (!wait)
+		return sb_queue_discard(sb, discard_block, count, GFP_NOFS);
 	return sb_issue_discard(sb, discard_block, count, GFP_NOFS, 0);
 }
 
@@ -2654,7 +2661,8 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 
 		if (test_opt(sb, DISCARD))
 			ext4_issue_discard(sb, entry->group,
-					   entry->start_cluster, entry->count);
+					   entry->start_cluster, entry->count,
+					   false);
 
 		err = ext4_mb_load_buddy(sb, entry->group, &e4b);
 		/* we expect to find existing buddy because it's pinned */
@@ -4920,7 +4928,7 @@ static void ext4_trim_extent(struct super_block *sb, int start, int count,
 	 */
 	mb_mark_used(e4b, &ex);
 	ext4_unlock_group(sb, group);
-	ext4_issue_discard(sb, group, start, count);
+	ext4_issue_discard(sb, group, start, count, true);
 	ext4_lock_group(sb, group);
 	mb_free_blocks(NULL, e4b, start, ex.fe_len);
 }
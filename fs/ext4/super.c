@@ -4302,8 +4302,11 @@ static int ext4_sync_fs(struct super_block *sb, int wait)
 	flush_workqueue(sbi->dio_unwritten_wq);
 	if (jbd2_journal_start_commit(sbi->s_journal, &target)) {
 		if (wait)
-			jbd2_log_wait_commit(sbi->s_journal, target);
+			ret = jbd2_log_wait_commit(sbi->s_journal, target);
 	}
+	/* fsync_batch() hands this to every fsync in the batch */
+	if (!ret && wait && is_journal_aborted(sbi->s_journal))
+		ret = -EROFS;
 	return ret;
 }
 
@@ -5011,7 +5014,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_GROUP_FSYNC,
 };
 
 static int __init ext4_init_feat_adverts(void)
@@ -463,6 +463,14 @@ static int get_data_block_ro(struct inode *inode, sector_t iblock,
 
 static int f2fs_read_data_page(struct file *file, struct page *page)
 {
+	struct inode *inode = page->mapping->host;
+	int ret;
+
+	if (f2fs_has_inline_data(inode)) {
+		ret = f2fs_read_inline_data(inode, page);
+		unlock_page(page);
+		return ret;
+	}
 	return mpage_readpage(page, get_data_block_ro);
 }
 
@@ -470,6 +478,10 @@ static int f2fs_read_data_pages(struct file *file,
 			struct address_space *mapping,
 			struct list_head *pages, unsigned nr_pages)
 {
+	/* the inline data is read by f2fs_read_data_page() */
+	if (f2fs_has_inline_data(mapping->host))
+		return 0;
+
 	return mpage_readpages(mapping, pages, nr_pages, get_data_block_ro);
 }
 
@@ -554,7 +566,10 @@ write:
 		err = do_write_data_page(page);
 	} else {
 		int ilock = mutex_lock_op(sbi);
-		err = do_write_data_page(page);
+		if (f2fs_has_inline_data(inode))
+			err = f2fs_write_inline_data(inode, page);
+		else
+			err = do_write_data_page(page);
 		mutex_unlock_op(sbi, ilock);
 		need_balance_fs = true;
 	}
@@ -640,12 +655,28 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 	*fsdata = NULL;
 
 	f2fs_balance_fs(sbi);
+
+	err = f2fs_convert_inline_data(inode, pos + len);
+	if (err)
+		return err;
 repeat:
 	page = grab_cache_page_write_begin(mapping, index, flags);
 	if (!page)
 		return -ENOMEM;
 	*pagep = page;
 
+	/* the write fits in the inode, there is no block to reserve */
+	if (f2fs_has_inline_data(inode)) {
+		if (!PageUptodate(page) && len != PAGE_CACHE_SIZE) {
+			err = f2fs_read_inline_data(inode, page);
+			if (err) {
+				f2fs_put_page(page, 1);
+				return err;
+			}
+		}
+		return 0;
+	}
+
 	ilock = mutex_lock_op(sbi);
 
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
@@ -731,6 +762,10 @@ static ssize_t f2fs_direct_IO(int rw, struct kiocb *iocb,
 	if (rw == WRITE)
 		return 0;
 
+	/* let the buffered read handle the inline data */
+	if (f2fs_has_inline_data(inode))
+		return 0;
+
 	/* Needs synchronization with the cleaner */
 	return blockdev_direct_IO(rw, iocb, inode, iov, offset, nr_segs,
 						  get_data_block_ro);
@@ -769,6 +804,9 @@ static int f2fs_set_data_page_dirty(struct page *page)
 
 static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 {
+	if (f2fs_has_inline_data(mapping->host))
+		return 0;
+
 	return generic_block_bmap(mapping, block, get_data_block_ro);
 }
 
@@ -27,6 +27,80 @@ static LIST_HEAD(f2fs_stat_list);
 static struct dentry *debugfs_root;
 static DEFINE_MUTEX(f2fs_stat_mutex);
 
+static const char *gc_state_name[] = {
+	[GC_THREAD_OFF]		= "off",
+	[GC_THREAD_NORMAL]	= "normal",
+	[GC_THREAD_IDLE]	= "idle",
+	[GC_THREAD_URGENT]	= "urgent",
+};
+
+/*
+ * Account the time a writer waited for foreground GC, to the task as well
+ * when it is one of the NR_GC_STALL_TASKS most stalled. A new task takes
+ * the slot of the least stalled one if it has waited longer.
+ */
+void stat_add_gc_stall(struct f2fs_sb_info *sbi, ktime_t time)
+{
+	struct f2fs_stat_info *si = sbi->stat_info;
+	struct f2fs_gc_stall *st, *min = NULL;
+	unsigned long long us = ktime_to_us(time);
+	int i;
+
+	spin_lock(&si->gc_stall_lock);
+	si->gc_stall_count++;
+	si->gc_stall_time += us;
+	if (us > si->gc_stall_max)
+		si->gc_stall_max = us;
+
+	for (i = 0; i < NR_GC_STALL_TASKS; i++) {
+		st = &si->gc_stall[i];
+		if (st->pid == current->pid &&
+				!strncmp(st->comm, current->comm, TASK_COMM_LEN))
+			goto found;
+		if (!min || st->time < min->time)
+			min = st;
+	}
+	if (min->count && min->time >= us)
+		goto out;
+	st = min;
+	memset(st, 0, sizeof(*st));
+	st->pid = current->pid;
+	get_task_comm(st->comm, current);
+found:
+	st->count++;
+	st->time += us;
+	if (us > st->max)
+		st->max = us;
+out:
+	spin_unlock(&si->gc_stall_lock);
+}
+
+static void gc_stall_show(struct seq_file *s, struct f2fs_stat_info *si)
+{
+	struct f2fs_gc_stall stall[NR_GC_STALL_TASKS];
+	unsigned long long time, max;
+	unsigned int count;
+	int i;
+
+	spin_lock(&si->gc_stall_lock);
+	count = si->gc_stall_count;
+	time = si->gc_stall_time;
+	max = si->gc_stall_max;
+	memcpy(stall, si->gc_stall, sizeof(stall));
+	spin_unlock(&si->gc_stall_lock);
+
+	seq_printf(s, "GC stalls: %u, %llu ms (max: %llu ms)\n",
+		   count, div_u64(time, 1000), div_u64(max, 1000));
+	for (i = 0; i < NR_GC_STALL_TASKS; i++) {
+		if (!stall[i].count)
+			continue;
+		seq_printf(s, "  - %s[%d]: %u, %llu ms (max: %llu ms)\n",
+			   stall[i].comm, stall[i].pid, stall[i].count,
+			   div_u64(stall[i].time, 1000),
+			   div_u64(stall[i].max, 1000));
+	}
+}
+
 static void update_general_status(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_stat_info *si = sbi->stat_info;
@@ -57,6 +131,7 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->sits = SIT_I(sbi)->dirty_sentries;
 	si->fnids = NM_I(sbi)->fcnt;
 	si->bg_gc = sbi->bg_gc;
+	si->urgent_gc = sbi->urgent_gc;
 	si->util_free = (int)(free_user_blocks(sbi) >> sbi->log_blocks_per_seg)
 		* 100 / (int)(sbi->user_block_count >> sbi->log_blocks_per_seg)
 		/ 2;
@@ -240,6 +315,12 @@ static int stat_show(struct seq_file *s, void *v)
 		seq_printf(s, "Try to move %d blocks\n", si->tot_blks);
 		seq_printf(s, "  - data blocks : %d\n", si->data_blks);
 		seq_printf(s, "  - node blocks : %d\n", si->node_blks);
+		seq_printf(s, "\nGC thread: %s, sleep %ld ms, urgent calls: %d\n",
+			   gc_state_name[si->gc_state], si->gc_wait_ms,
+			   si->urgent_gc);
+		seq_printf(s, "  - free sections used: %u per minute\n",
+			   si->gc_use_rate);
+		gc_stall_show(s, si);
 		seq_printf(s, "\nExtent Hit Ratio: %d / %d\n",
 			   si->hit_ext, si->total_ext);
 		seq_printf(s, "\nBalancing F2FS Async:\n");
@@ -319,6 +400,7 @@ int f2fs_build_stats(struct f2fs_sb_info *sbi)
 	si->main_area_zones = si->main_area_sections /
 				le32_to_cpu(raw_super->secs_per_zone);
 	si->sbi = sbi;
+	spin_lock_init(&si->gc_stall_lock);
 
 	mutex_lock(&f2fs_stat_mutex);
 	list_add_tail(&si->stat_list, &f2fs_stat_list);
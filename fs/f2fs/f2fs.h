@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/crc32.h>
 #include <linux/magic.h>
+#include <linux/sched.h>
 
 /*
  * For mount options
@@ -28,6 +29,8 @@
 #define F2FS_MOUNT_XATTR_USER		0x00000010
 #define F2FS_MOUNT_POSIX_ACL		0x00000020
 #define F2FS_MOUNT_DISABLE_EXT_IDENTIFY	0x00000040
+#define F2FS_MOUNT_INLINE_DATA		0x00000080
+#define F2FS_MOUNT_INLINE_DENTRY	0x00000100
 
 #define clear_opt(sbi, option)	(sbi->mount_opt.opt &= ~F2FS_MOUNT_##option)
 #define set_opt(sbi, option)	(sbi->mount_opt.opt |= F2FS_MOUNT_##option)
@@ -249,6 +252,35 @@ static inline void set_new_dnode(struct dnode_of_data *dn, struct inode *inode,
 	dn->nid = nid;
 }
 
+/*
+ * this structure is used to walk the dentries of a dentry block and of an
+ * inline directory with the same code.
+ */
+struct f2fs_dentry_ptr {
+	void *bitmap;				/* dentry bitmap */
+	struct f2fs_dir_entry *dentry;		/* dentry slots */
+	__u8 (*filename)[F2FS_SLOT_LEN];	/* file name slots */
+	int max;				/* the number of slots */
+};
+
+static inline void make_dentry_ptr(struct f2fs_dentry_ptr *d,
+					void *src, bool in_inode)
+{
+	if (in_inode) {
+		struct f2fs_inline_dentry *t = (struct f2fs_inline_dentry *)src;
+		d->max = NR_INLINE_DENTRY;
+		d->bitmap = &t->dentry_bitmap;
+		d->dentry = t->dentry;
+		d->filename = t->filename;
+	} else {
+		struct f2fs_dentry_block *t = (struct f2fs_dentry_block *)src;
+		d->max = NR_DENTRY_IN_BLOCK;
+		d->bitmap = &t->dentry_bitmap;
+		d->dentry = t->dentry;
+		d->filename = t->filename;
+	}
+}
+
 /*
  * For SIT manager
  *
@@ -425,6 +457,7 @@ struct f2fs_sb_info {
 	unsigned int block_count[2];		/* # of allocated blocks */
 	int total_hit_ext, read_hit_ext;	/* extent cache hit ratio */
 	int bg_gc;				/* background gc calls */
+	int urgent_gc;				/* urgent background gc calls */
 	unsigned int n_dirty_dirs;		/* # of dir inodes */
 #endif
 	unsigned int last_victim[2];		/* last victim segment # */
@@ -873,6 +906,8 @@ enum {
 	FI_NO_ALLOC,		/* should not allocate any blocks */
 	FI_UPDATE_DIR,		/* should update inode block for consistency */
 	FI_DELAY_IPUT,		/* used for the recovery */
+	FI_INLINE_DATA,		/* file data is stored in the inode */
+	FI_INLINE_DENTRY,	/* dentries are stored in the inode */
 };
 
 static inline void set_inode_flag(struct f2fs_inode_info *fi, int flag)
@@ -905,6 +940,42 @@ static inline int cond_clear_inode_flag(struct f2fs_inode_info *fi, int flag)
 	return 0;
 }
 
+static inline void get_inline_info(struct f2fs_inode_info *fi,
+					struct f2fs_inode *ri)
+{
+	if (ri->i_inline & F2FS_INLINE_DATA)
+		set_inode_flag(fi, FI_INLINE_DATA);
+	if (ri->i_inline & F2FS_INLINE_DENTRY)
+		set_inode_flag(fi, FI_INLINE_DENTRY);
+}
+
+static inline void set_raw_inline(struct f2fs_inode_info *fi,
+					struct f2fs_inode *ri)
+{
+	ri->i_inline = 0;
+
+	if (is_inode_flag_set(fi, FI_INLINE_DATA))
+		ri->i_inline |= F2FS_INLINE_DATA;
+	if (is_inode_flag_set(fi, FI_INLINE_DENTRY))
+		ri->i_inline |= F2FS_INLINE_DENTRY;
+}
+
+static inline int f2fs_has_inline_data(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_INLINE_DATA);
+}
+
+static inline int f2fs_has_inline_dentry(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_INLINE_DENTRY);
+}
+
+static inline void *inline_data_addr(struct page *page)
+{
+	struct f2fs_node *rn = (struct f2fs_node *)page_address(page);
+	return (void *)&(rn->i.i_addr[1]);
+}
+
 static inline int f2fs_readonly(struct super_block *sb)
 {
 	return sb->s_flags & MS_RDONLY;
@@ -941,6 +1012,20 @@ struct dentry *f2fs_get_parent(struct dentry *child);
 /*
  * dir.c
  */
+void do_make_empty_dir(struct inode *, struct inode *,
+			struct f2fs_dentry_ptr *);
+struct page *init_inode_metadata(struct inode *, struct inode *,
+			const struct qstr *);
+void update_parent_metadata(struct inode *, struct inode *,
+			struct page *, unsigned int);
+int room_for_filename(const void *, int, int);
+void f2fs_update_dentry(struct inode *, struct f2fs_dentry_ptr *,
+			const struct qstr *, f2fs_hash_t, unsigned int);
+struct f2fs_dir_entry *find_target_dentry(const char *, size_t, f2fs_hash_t,
+			int *, struct f2fs_dentry_ptr *);
+bool f2fs_fill_dentries(struct file *, void *, filldir_t,
+			struct f2fs_dentry_ptr *, unsigned int, unsigned int);
+void f2fs_drop_nlink(struct inode *, struct inode *);
 struct f2fs_dir_entry *f2fs_find_entry(struct inode *, struct qstr *,
 							struct page **);
 struct f2fs_dir_entry *f2fs_parent_dir(struct inode *, struct page **);
@@ -948,7 +1033,8 @@ ino_t f2fs_inode_by_name(struct inode *, struct qstr *);
 void f2fs_set_link(struct inode *, struct f2fs_dir_entry *,
 				struct page *, struct inode *);
 int __f2fs_add_link(struct inode *, const struct qstr *, struct inode *);
-void f2fs_delete_entry(struct f2fs_dir_entry *, struct page *, struct inode *);
+void f2fs_delete_entry(struct f2fs_dir_entry *, struct page *,
+				struct inode *, struct inode *);
 int f2fs_make_empty(struct inode *, struct inode *);
 bool f2fs_empty_dir(struct inode *);
 
@@ -1069,7 +1155,8 @@ int do_write_data_page(struct page *);
 int start_gc_thread(struct f2fs_sb_info *);
 void stop_gc_thread(struct f2fs_sb_info *);
 block_t start_bidx_of_node(unsigned int);
-int f2fs_gc(struct f2fs_sb_info *);
+int f2fs_gc(struct f2fs_sb_info *, bool);
+void wake_up_urgent_gc(struct f2fs_sb_info *);
 void build_gc_manager(struct f2fs_sb_info *);
 int __init create_gc_caches(void);
 void destroy_gc_caches(void);
@@ -1080,10 +1167,39 @@ void destroy_gc_caches(void);
 int recover_fsync_data(struct f2fs_sb_info *);
 bool space_for_roll_forward(struct f2fs_sb_info *);
 
+/*
+ * inline.c
+ */
+int f2fs_read_inline_data(struct inode *, struct page *);
+int f2fs_write_inline_data(struct inode *, struct page *);
+int f2fs_convert_inline_data(struct inode *, loff_t);
+void truncate_inline_data(struct page *, u64);
+bool recover_inline_data(struct inode *, struct page *);
+struct f2fs_dir_entry *find_in_inline_dir(struct inode *, struct qstr *,
+							struct page **);
+struct f2fs_dir_entry *f2fs_parent_inline_dir(struct inode *, struct page **);
+int make_empty_inline_dir(struct inode *, struct inode *, struct page *);
+int f2fs_add_inline_entry(struct inode *, const struct qstr *, struct inode *);
+void f2fs_delete_inline_entry(struct f2fs_dir_entry *, struct page *,
+						struct inode *, struct inode *);
+bool f2fs_empty_inline_dir(struct inode *);
+int f2fs_read_inline_dir(struct file *, void *, filldir_t);
+
 /*
  * debug.c
  */
 #ifdef CONFIG_F2FS_STAT_FS
+#define NR_GC_STALL_TASKS	8	/* tasks shown stalled by GC */
+
+/* time a task spent waiting for foreground GC */
+struct f2fs_gc_stall {
+	pid_t pid;
+	char comm[TASK_COMM_LEN];
+	unsigned int count;			/* # of stalls */
+	unsigned long long time;		/* total stall time in us */
+	unsigned long long max;			/* longest stall in us */
+};
+
 struct f2fs_stat_info {
 	struct list_head stat_list;
 	struct f2fs_sb_info *sbi;
@@ -1094,7 +1210,7 @@ struct f2fs_stat_info {
 	int ndirty_node, ndirty_dent, ndirty_dirs, ndirty_meta;
 	int nats, sits, fnids;
 	int total_count, utilization;
-	int bg_gc;
+	int bg_gc, urgent_gc;
 	unsigned int valid_count, valid_node_count, valid_inode_count;
 	unsigned int bimodal, avg_vblocks;
 	int util_free, util_valid, util_invalid;
@@ -1110,6 +1226,17 @@ struct f2fs_stat_info {
 	unsigned int segment_count[2];
 	unsigned int block_count[2];
 	unsigned base_mem, cache_mem;
+
+	/* set by the GC thread */
+	int gc_state;
+	long gc_wait_ms;
+	unsigned int gc_use_rate;
+
+	/* foreground GC stalls, in total and of the most stalled tasks */
+	spinlock_t gc_stall_lock;
+	unsigned int gc_stall_count;
+	unsigned long long gc_stall_time, gc_stall_max;
+	struct f2fs_gc_stall gc_stall[NR_GC_STALL_TASKS];
 };
 
 #define stat_inc_call_count(si)	((si)->call_count++)
@@ -1141,6 +1268,7 @@ struct f2fs_stat_info {
 		si->node_blks += (blks);				\
 	} while (0)
 
+void stat_add_gc_stall(struct f2fs_sb_info *, ktime_t);
 int f2fs_build_stats(struct f2fs_sb_info *);
 void f2fs_destroy_stats(struct f2fs_sb_info *);
 void __init f2fs_create_root_stats(void);
@@ -1151,6 +1279,7 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_tot_blk_count(si, blks)
 #define stat_inc_data_blk_count(si, blks)
 #define stat_inc_node_blk_count(sbi, blks)
+#define stat_add_gc_stall(sbi, time)
 
 static inline int f2fs_build_stats(struct f2fs_sb_info *sbi) { return 0; }
 static inline void f2fs_destroy_stats(struct f2fs_sb_info *sbi) { }
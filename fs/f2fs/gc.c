@@ -26,31 +26,99 @@
 
 static struct kmem_cache *winode_slab;
 
+/*
+ * The device counts as idle when no requests are queued or in flight, f2fs
+ * has nothing under writeback and no read completed since the last check.
+ */
+static bool device_idle(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+	return is_idle(sbi) &&
+		!part_in_flight(&sbi->sb->s_bdev->bd_disk->part0) &&
+		!get_pages(sbi, F2FS_WRITEBACK) &&
+		bdev_read_ios(sbi) == gc_th->last_ios;
+}
+
+/* keep a moving average of how fast free sections are used up */
+static void update_free_trend(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+	unsigned int free_secs = free_sections(sbi);
+	unsigned int elapsed = jiffies_to_msecs(jiffies - gc_th->last_check);
+	unsigned int rate = 0;
+
+	if (!elapsed)
+		return;
+	if (free_secs < gc_th->last_free_secs)
+		rate = (gc_th->last_free_secs - free_secs) * 60000ULL / elapsed;
+
+	gc_th->use_rate = (gc_th->use_rate * 3 + rate) / 4;
+	gc_th->last_free_secs = free_secs;
+	gc_th->last_check = jiffies;
+}
+
+static bool need_urgent_gc(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+	unsigned int free_secs = free_sections(sbi);
+	unsigned int limit = urgent_free_secs(sbi);
+
+	if (free_secs <= limit)
+		return true;
+	if (!gc_th->use_rate)
+		return false;
+	return (free_secs - limit) * 60 / gc_th->use_rate < GC_URGENT_HORIZON;
+}
+
+static void update_gc_thread_stat(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+#ifdef CONFIG_F2FS_STAT_FS
+	struct f2fs_stat_info *si = sbi->stat_info;
+
+	si->gc_state = gc_th->gc_state;
+	si->gc_wait_ms = gc_th->wait_ms;
+	si->gc_use_rate = gc_th->use_rate;
+#endif
+}
+
 static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
-	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
-	long wait_ms;
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	wait_queue_head_t *wq = &gc_th->gc_wait_queue_head;
+	bool urgent;
 
-	wait_ms = GC_THREAD_MIN_SLEEP_TIME;
+	gc_th->gc_state = GC_THREAD_NORMAL;
+	gc_th->wait_ms = GC_THREAD_MIN_SLEEP_TIME;
+	gc_th->last_check = jiffies;
+	gc_th->last_ios = bdev_read_ios(sbi);
+	gc_th->last_free_secs = free_sections(sbi);
 
 	do {
 		if (try_to_freeze())
 			continue;
 		else
 			wait_event_interruptible_timeout(*wq,
-						kthread_should_stop(),
-						msecs_to_jiffies(wait_ms));
+					kthread_should_stop() || gc_th->gc_wake,
+					msecs_to_jiffies(gc_th->wait_ms));
 		if (kthread_should_stop())
 			break;
+		gc_th->gc_wake = false;
+
+		update_free_trend(sbi, gc_th);
+		urgent = need_urgent_gc(sbi, gc_th);
 
 		/*
 		 * [GC triggering condition]
 		 * 0. GC is not conducted currently.
-		 * 1. There are enough dirty segments.
-		 * 2. IO subsystem is idle by checking the # of writeback pages.
-		 * 3. IO subsystem is idle by checking the # of requests in
-		 *    bdev's request list.
+		 * 1. Free sections will run out soon: GC right away, in the
+		 *    foreground manner, so that writers need not stall for it.
+		 * 2. Otherwise, the device has been idle since the last check:
+		 *    no requests, no writeback pages and no completed reads.
+		 *    While it stays idle and there are enough invalid blocks,
+		 *    keep cleaning at short intervals.
+		 * 3. Otherwise, back off.
 		 *
 		 * Note) We have to avoid triggering GCs too much frequently.
 		 * Because it is possible that some segments can be
@@ -60,25 +128,38 @@ static int gc_thread_func(void *data)
 		if (!mutex_trylock(&sbi->gc_mutex))
 			continue;
 
-		if (!is_idle(sbi)) {
-			wait_ms = increase_sleep_time(wait_ms);
+		if (urgent) {
+			gc_th->gc_state = GC_THREAD_URGENT;
+			gc_th->wait_ms = GC_THREAD_URGENT_SLEEP_TIME;
+		} else if (!device_idle(sbi, gc_th)) {
+			gc_th->gc_state = GC_THREAD_NORMAL;
+			gc_th->wait_ms = increase_sleep_time(gc_th->wait_ms);
 			mutex_unlock(&sbi->gc_mutex);
-			continue;
+			goto next;
+		} else if (has_enough_invalid_blocks(sbi)) {
+			gc_th->gc_state = GC_THREAD_IDLE;
+			gc_th->wait_ms = GC_THREAD_IDLE_SLEEP_TIME;
+		} else {
+			gc_th->gc_state = GC_THREAD_NORMAL;
+			gc_th->wait_ms = increase_sleep_time(gc_th->wait_ms);
 		}
 
-		if (has_enough_invalid_blocks(sbi))
-			wait_ms = decrease_sleep_time(wait_ms);
-		else
-			wait_ms = increase_sleep_time(wait_ms);
-
 #ifdef CONFIG_F2FS_STAT_FS
 		sbi->bg_gc++;
+		if (urgent)
+			sbi->urgent_gc++;
 #endif
 
 		/* if return value is not zero, no victim was selected */
-		if (f2fs_gc(sbi))
-			wait_ms = GC_THREAD_NOGC_SLEEP_TIME;
+		if (f2fs_gc(sbi, urgent))
+			gc_th->wait_ms = GC_THREAD_NOGC_SLEEP_TIME;
+next:
+		gc_th->last_ios = bdev_read_ios(sbi);
+		update_gc_thread_stat(sbi, gc_th);
 	} while (!kthread_should_stop());
+
+	gc_th->gc_state = GC_THREAD_OFF;
+	update_gc_thread_stat(sbi, gc_th);
 	return 0;
 }
 
@@ -90,7 +171,7 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 
 	if (!test_opt(sbi, BG_GC))
 		goto out;
-	gc_th = kmalloc(sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
+	gc_th = kzalloc(sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
 	if (!gc_th) {
 		err = -ENOMEM;
 		goto out;
@@ -116,8 +197,35 @@ void stop_gc_thread(struct f2fs_sb_info *sbi)
 	if (!gc_th)
 		return;
 	kthread_stop(gc_th->f2fs_gc_task);
-	kfree(gc_th);
+
+	/* wake_up_urgent_gc() looks at gc_thread under gc_mutex */
+	mutex_lock(&sbi->gc_mutex);
 	sbi->gc_thread = NULL;
+	mutex_unlock(&sbi->gc_mutex);
+
+	kfree(gc_th);
+}
+
+/*
+ * Called by writers with free sections getting low, but not yet low enough
+ * for foreground GC: have the GC thread clean urgently instead of waiting
+ * out its sleep time.
+ */
+void wake_up_urgent_gc(struct f2fs_sb_info *sbi)
+{
+	struct f2fs_gc_kthread *gc_th;
+
+	if (free_sections(sbi) > urgent_free_secs(sbi))
+		return;
+	/* someone is cleaning already */
+	if (!mutex_trylock(&sbi->gc_mutex))
+		return;
+	gc_th = sbi->gc_thread;
+	if (gc_th && gc_th->gc_state != GC_THREAD_URGENT && !gc_th->gc_wake) {
+		gc_th->gc_wake = true;
+		wake_up_interruptible(&gc_th->gc_wait_queue_head);
+	}
+	mutex_unlock(&sbi->gc_mutex);
 }
 
 static int select_gc_type(int gc_type)
@@ -181,19 +289,13 @@ next:
 static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
-	unsigned int secno = GET_SECNO(sbi, segno);
-	unsigned int start = secno * sbi->segs_per_sec;
-	unsigned long long mtime = 0;
+	unsigned long long mtime;
 	unsigned int vblocks;
 	unsigned char age = 0;
 	unsigned char u;
-	unsigned int i;
 
-	for (i = 0; i < sbi->segs_per_sec; i++)
-		mtime += get_seg_entry(sbi, start + i)->mtime;
+	mtime = get_sec_mtime(sbi, GET_SECNO(sbi, segno));
 	vblocks = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
-
-	mtime = div_u64(mtime, sbi->segs_per_sec);
 	vblocks = div_u64(vblocks, sbi->segs_per_sec);
 
 	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
@@ -224,50 +326,31 @@ static unsigned int get_gc_cost(struct f2fs_sb_info *sbi, unsigned int segno,
 }
 
 /*
- * This function is called from two paths.
- * One is garbage collection and the other is SSR segment selection.
- * When it is called during GC, it just gets a victim segment
- * and it does not remove it from dirty seglist.
- * When it is called from SSR segment selection, it finds a segment
- * which has minimum valid blocks and removes it from dirty seglist.
+ * SSR looks for a segment of the given type in the dirty seglist, trying
+ * at most MAX_VICTIM_SEARCH of them from where the last search stopped.
  */
-static int get_victim_by_default(struct f2fs_sb_info *sbi,
-		unsigned int *result, int gc_type, int type, char alloc_mode)
+static void get_victim_by_scan(struct f2fs_sb_info *sbi, int gc_type,
+					struct victim_sel_policy *p)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
-	struct victim_sel_policy p;
-	unsigned int secno, max_cost;
+	unsigned int secno, max_cost = p->min_cost;
 	int nsearched = 0;
 
-	p.alloc_mode = alloc_mode;
-	select_policy(sbi, gc_type, type, &p);
-
-	p.min_segno = NULL_SEGNO;
-	p.min_cost = max_cost = get_max_cost(sbi, &p);
-
-	mutex_lock(&dirty_i->seglist_lock);
-
-	if (p.alloc_mode == LFS && gc_type == FG_GC) {
-		p.min_segno = check_bg_victims(sbi);
-		if (p.min_segno != NULL_SEGNO)
-			goto got_it;
-	}
-
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
 
-		segno = find_next_bit(p.dirty_segmap,
-						TOTAL_SEGS(sbi), p.offset);
+		segno = find_next_bit(p->dirty_segmap,
+						TOTAL_SEGS(sbi), p->offset);
 		if (segno >= TOTAL_SEGS(sbi)) {
-			if (sbi->last_victim[p.gc_mode]) {
-				sbi->last_victim[p.gc_mode] = 0;
-				p.offset = 0;
+			if (sbi->last_victim[p->gc_mode]) {
+				sbi->last_victim[p->gc_mode] = 0;
+				p->offset = 0;
 				continue;
 			}
 			break;
 		}
-		p.offset = ((segno / p.ofs_unit) * p.ofs_unit) + p.ofs_unit;
+		p->offset = ((segno / p->ofs_unit) * p->ofs_unit) + p->ofs_unit;
 		secno = GET_SECNO(sbi, segno);
 
 		if (sec_usage_check(sbi, secno))
@@ -275,21 +358,96 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 		if (gc_type == BG_GC && test_bit(secno, dirty_i->victim_secmap))
 			continue;
 
-		cost = get_gc_cost(sbi, segno, &p);
+		cost = get_gc_cost(sbi, segno, p);
 
-		if (p.min_cost > cost) {
-			p.min_segno = segno;
-			p.min_cost = cost;
+		if (p->min_cost > cost) {
+			p->min_segno = segno;
+			p->min_cost = cost;
 		}
 
 		if (cost == max_cost)
 			continue;
 
 		if (nsearched++ >= MAX_VICTIM_SEARCH) {
-			sbi->last_victim[p.gc_mode] = segno;
+			sbi->last_victim[p->gc_mode] = segno;
+			break;
+		}
+	}
+}
+
+/*
+ * Cleaning looks at whole sections through the victim index, which holds
+ * every dirty section in the bucket of its valid blocks, oldest first.
+ * Greedy takes the first usable section of the lowest bucket. Cost-benefit
+ * only needs the oldest usable section of each bucket, since no younger
+ * section of the same bucket can cost less.
+ */
+static void get_victim_from_index(struct f2fs_sb_info *sbi, int gc_type,
+					struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_entry *ve;
+	unsigned int bucket;
+
+	for_each_set_bit(bucket, dirty_i->victim_bucketmap,
+						NR_VICTIM_BUCKETS(sbi)) {
+		list_for_each_entry(ve, &dirty_i->victim_buckets[bucket], list) {
+			unsigned int secno = ve - dirty_i->victim_entries;
+			unsigned int segno = secno * sbi->segs_per_sec;
+			unsigned int cost;
+
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
 			break;
 		}
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			break;
 	}
+}
+
+/*
+ * This function is called from two paths.
+ * One is garbage collection and the other is SSR segment selection.
+ * When it is called during GC, it just gets a victim segment
+ * and it does not remove it from dirty seglist.
+ * When it is called from SSR segment selection, it finds a segment
+ * which has minimum valid blocks and removes it from dirty seglist.
+ */
+static int get_victim_by_default(struct f2fs_sb_info *sbi,
+		unsigned int *result, int gc_type, int type, char alloc_mode)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_sel_policy p;
+	unsigned int secno;
+
+	p.alloc_mode = alloc_mode;
+	select_policy(sbi, gc_type, type, &p);
+
+	p.min_segno = NULL_SEGNO;
+	p.min_cost = get_max_cost(sbi, &p);
+
+	mutex_lock(&dirty_i->seglist_lock);
+
+	if (p.alloc_mode == LFS && gc_type == FG_GC) {
+		p.min_segno = check_bg_victims(sbi);
+		if (p.min_segno != NULL_SEGNO)
+			goto got_it;
+	}
+
+	if (p.alloc_mode == LFS)
+		get_victim_from_index(sbi, gc_type, &p);
+	else
+		get_victim_by_scan(sbi, gc_type, &p);
+
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -371,12 +529,12 @@ static int check_valid_map(struct f2fs_sb_info *sbi,
  * On validity, copy that node with cold status, otherwise (invalid node)
  * ignore that.
  */
-static void gc_node_segment(struct f2fs_sb_info *sbi,
+static int gc_node_segment(struct f2fs_sb_info *sbi,
 		struct f2fs_summary *sum, unsigned int segno, int gc_type)
 {
 	bool initial = true;
 	struct f2fs_summary *entry;
-	int off;
+	int off, moved = 0;
 
 next_step:
 	entry = sum;
@@ -387,7 +545,7 @@ next_step:
 
 		/* stop BG_GC if there is not enough free sections. */
 		if (gc_type == BG_GC && has_not_enough_free_secs(sbi, 0))
-			return;
+			return moved;
 
 		if (check_valid_map(sbi, segno, off) == 0)
 			continue;
@@ -411,6 +569,7 @@ next_step:
 		}
 		f2fs_put_page(node_page, 1);
 		stat_inc_node_blk_count(sbi, 1);
+		moved++;
 	}
 
 	if (initial) {
@@ -433,6 +592,7 @@ next_step:
 		if (get_valid_blocks(sbi, segno, 1) != 0)
 			goto next_step;
 	}
+	return moved;
 }
 
 /*
@@ -528,13 +688,13 @@ out:
  * If the parent node is not valid or the data block address is different,
  * the victim data block is ignored.
  */
-static void gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
+static int gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 		struct list_head *ilist, unsigned int segno, int gc_type)
 {
 	struct super_block *sb = sbi->sb;
 	struct f2fs_summary *entry;
 	block_t start_addr;
-	int off;
+	int off, moved = 0;
 	int phase = 0;
 
 	start_addr = START_BLOCK(sbi, segno);
@@ -551,7 +711,7 @@ next_step:
 
 		/* stop BG_GC if there is not enough free sections. */
 		if (gc_type == BG_GC && has_not_enough_free_secs(sbi, 0))
-			return;
+			return moved;
 
 		if (check_valid_map(sbi, segno, off) == 0)
 			continue;
@@ -594,6 +754,7 @@ next_step:
 					continue;
 				move_data_page(inode, data_page, gc_type);
 				stat_inc_data_blk_count(sbi, 1);
+				moved++;
 			}
 		}
 		continue;
@@ -616,6 +777,7 @@ next_iput:
 			goto next_step;
 		}
 	}
+	return moved;
 }
 
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
@@ -629,17 +791,22 @@ static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
 	return ret;
 }
 
-static void do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
+/*
+ * Returns the number of blocks moved, or only dirtied to be moved by the
+ * next writeback in the case of BG_GC.
+ */
+static int do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
 				struct list_head *ilist, int gc_type)
 {
 	struct page *sum_page;
 	struct f2fs_summary_block *sum;
 	struct blk_plug plug;
+	int moved = 0;
 
 	/* read segment summary of victim */
 	sum_page = get_sum_page(sbi, segno);
 	if (IS_ERR(sum_page))
-		return;
+		return 0;
 
 	blk_start_plug(&plug);
 
@@ -647,10 +814,11 @@ static void do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
 
 	switch (GET_SUM_TYPE((&sum->footer))) {
 	case SUM_TYPE_NODE:
-		gc_node_segment(sbi, sum->entries, segno, gc_type);
+		moved = gc_node_segment(sbi, sum->entries, segno, gc_type);
 		break;
 	case SUM_TYPE_DATA:
-		gc_data_segment(sbi, sum->entries, ilist, segno, gc_type);
+		moved = gc_data_segment(sbi, sum->entries, ilist,
+							segno, gc_type);
 		break;
 	}
 	blk_finish_plug(&plug);
@@ -659,22 +827,30 @@ static void do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
 	stat_inc_call_count(sbi->stat_info);
 
 	f2fs_put_page(sum_page, 1);
+	return moved;
 }
 
-int f2fs_gc(struct f2fs_sb_info *sbi)
+/*
+ * Called with gc_mutex held, which is released here. Background GC turns
+ * into foreground GC once free sections are short, or from the start if
+ * urgent.
+ */
+int f2fs_gc(struct f2fs_sb_info *sbi, bool urgent)
 {
 	struct list_head ilist;
-	unsigned int segno, i;
+	unsigned int segno, valid, moved, i;
 	int gc_type = BG_GC;
 	int nfree = 0;
 	int ret = -1;
+	ktime_t start;
 
 	INIT_LIST_HEAD(&ilist);
 gc_more:
 	if (!(sbi->sb->s_flags & MS_ACTIVE))
 		goto stop;
 
-	if (gc_type == BG_GC && has_not_enough_free_secs(sbi, nfree)) {
+	if (gc_type == BG_GC &&
+			(urgent || has_not_enough_free_secs(sbi, nfree))) {
 		gc_type = FG_GC;
 		write_checkpoint(sbi, false);
 	}
@@ -683,8 +859,14 @@ gc_more:
 		goto stop;
 	ret = 0;
 
+	start = ktime_get();
+	valid = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
+	moved = 0;
 	for (i = 0; i < sbi->segs_per_sec; i++)
-		do_garbage_collect(sbi, segno + i, &ilist, gc_type);
+		moved += do_garbage_collect(sbi, segno + i, &ilist, gc_type);
+
+	trace_f2fs_gc_section(sbi->sb, gc_type, GET_SECNO(sbi, segno), valid,
+			moved, ktime_to_ns(ktime_sub(ktime_get(), start)));
 
 	if (gc_type == FG_GC) {
 		sbi->cur_victim_sec = NULL_SEGNO;
@@ -16,15 +16,42 @@
 #define GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define GC_THREAD_MAX_SLEEP_TIME	60000
 #define GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define GC_THREAD_IDLE_SLEEP_TIME	200	/* while the device is idle */
+#define GC_THREAD_URGENT_SLEEP_TIME	500	/* while free space runs low */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
-/* Search max. number of dirty segments to select a victim segment */
+/*
+ * Background GC gets urgent this many sections before writers would have to
+ * do foreground GC, or when free sections are being used up fast enough to
+ * get there within GC_URGENT_HORIZON seconds.
+ */
+#define GC_URGENT_MARGIN_SECS	8
+#define GC_URGENT_HORIZON	60
+
+/* Search max. number of dirty segments to select a SSR victim segment */
 #define MAX_VICTIM_SEARCH	20
 
+/* the state of the GC thread, as shown in the stats */
+enum {
+	GC_THREAD_OFF,
+	GC_THREAD_NORMAL,	/* sleeps longer while the device is in use */
+	GC_THREAD_IDLE,		/* cleans at short intervals while idle */
+	GC_THREAD_URGENT,	/* cleans like foreground GC, even if busy */
+};
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
+
+	/* for scheduling GC by device idleness and free space */
+	bool gc_wake;			/* woken up for urgent GC */
+	int gc_state;			/* GC_THREAD_XXX */
+	long wait_ms;			/* time to sleep */
+	unsigned long last_check;	/* jiffies at the last wakeup */
+	unsigned long last_ios;		/* reads done by the device then */
+	unsigned int last_free_secs;	/* free sections then */
+	unsigned int use_rate;		/* free sections used per minute */
 };
 
 struct inode_entry {
@@ -67,17 +94,6 @@ static inline long increase_sleep_time(long wait)
 	return wait;
 }
 
-static inline long decrease_sleep_time(long wait)
-{
-	if (wait == GC_THREAD_NOGC_SLEEP_TIME)
-		wait = GC_THREAD_MAX_SLEEP_TIME;
-
-	wait -= GC_THREAD_MIN_SLEEP_TIME;
-	if (wait <= GC_THREAD_MIN_SLEEP_TIME)
-		wait = GC_THREAD_MIN_SLEEP_TIME;
-	return wait;
-}
-
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
@@ -100,3 +116,21 @@ static inline int is_idle(struct f2fs_sb_info *sbi)
 	struct request_list *rl = &q->rq;
 	return !(rl->count[BLK_RW_SYNC]) && !(rl->count[BLK_RW_ASYNC]);
 }
+
+/*
+ * Read from the whole disk, which counts the I/O of every partition on it:
+ * GC should only run when the device is quiet, not just our partition.
+ */
+static inline unsigned long bdev_read_ios(struct f2fs_sb_info *sbi)
+{
+	return part_stat_read(&sbi->sb->s_bdev->bd_disk->part0, ios[READ]);
+}
+
+static inline unsigned int urgent_free_secs(struct f2fs_sb_info *sbi)
+{
+	int node_secs = get_blocktype_secs(sbi, F2FS_DIRTY_NODES);
+	int dent_secs = get_blocktype_secs(sbi, F2FS_DIRTY_DENTS);
+
+	return node_secs + 2 * dent_secs + reserved_sections(sbi) +
+						GC_URGENT_MARGIN_SECS;
+}
@@ -0,0 +1,434 @@
+/*
+ * fs/f2fs/inline.c
+ *
+ * Copyright (c) 2013 Samsung Electronics Co., Ltd.
+ *             http://www.samsung.com/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+
+#include "f2fs.h"
+#include "node.h"
+
+/*
+ * Small regular files keep their data and small directories their dentries
+ * in i_addr[1..] of the inode block, so that they cost one block and one
+ * read instead of two. i_addr[0] stays free for the block the data moves
+ * to when it no longer fits.
+ *
+ * Lock ordering, as for block mapped data:
+ * ->data_page (or dentry page)
+ *  ->mutex_lock_op
+ *    ->inode page
+ */
+
+int f2fs_read_inline_data(struct inode *inode, struct page *page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *ipage;
+	void *src_addr, *dst_addr;
+
+	if (page->index) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		goto out;
+	}
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	zero_user_segment(page, MAX_INLINE_DATA, PAGE_CACHE_SIZE);
+
+	src_addr = inline_data_addr(ipage);
+	dst_addr = kmap(page);
+	memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+	kunmap(page);
+	f2fs_put_page(ipage, 1);
+out:
+	SetPageUptodate(page);
+	return 0;
+}
+
+/*
+ * Caller should grab and release a mutex by calling mutex_lock_op() and
+ * mutex_unlock_op().
+ */
+int f2fs_write_inline_data(struct inode *inode, struct page *page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *ipage;
+	void *src_addr, *dst_addr;
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	wait_on_page_writeback(ipage);
+	src_addr = kmap(page);
+	dst_addr = inline_data_addr(ipage);
+	memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+	kunmap(page);
+	set_page_dirty(ipage);
+	f2fs_put_page(ipage, 1);
+	return 0;
+}
+
+/* ipage should be locked */
+void truncate_inline_data(struct page *ipage, u64 from)
+{
+	void *addr;
+
+	if (from >= MAX_INLINE_DATA)
+		return;
+
+	wait_on_page_writeback(ipage);
+	addr = inline_data_addr(ipage);
+	memset(addr + from, 0, MAX_INLINE_DATA - from);
+	set_page_dirty(ipage);
+}
+
+/*
+ * Move the data of an inline file to a data block before it grows past
+ * MAX_INLINE_DATA. The block is written before the inline copy is dropped,
+ * so a checkpoint taken at any point finds the data in one of the two.
+ */
+int f2fs_convert_inline_data(struct inode *inode, loff_t to_size)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *page, *ipage;
+	struct dnode_of_data dn;
+	block_t new_blk_addr;
+	void *src_addr, *dst_addr;
+	int err = 0, ilock;
+
+	if (!f2fs_has_inline_data(inode) || to_size <= MAX_INLINE_DATA)
+		return 0;
+
+	page = grab_cache_page(inode->i_mapping, 0);
+	if (!page)
+		return -ENOMEM;
+
+	ilock = mutex_lock_op(sbi);
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage)) {
+		err = PTR_ERR(ipage);
+		goto out;
+	}
+
+	/* converted by someone else while we waited for the page */
+	if (!f2fs_has_inline_data(inode)) {
+		f2fs_put_page(ipage, 1);
+		goto out;
+	}
+
+	set_new_dnode(&dn, inode, ipage, ipage, 0);
+	err = get_dnode_of_data(&dn, 0, ALLOC_NODE);
+	if (err) {
+		f2fs_put_page(ipage, 1);
+		goto out;
+	}
+
+	if (dn.data_blkaddr == NULL_ADDR) {
+		err = reserve_new_block(&dn);
+		if (err) {
+			f2fs_put_dnode(&dn);
+			goto out;
+		}
+	}
+
+	/* a cached page holds the newest data, it may not be written yet */
+	if (!PageUptodate(page)) {
+		zero_user_segment(page, MAX_INLINE_DATA, PAGE_CACHE_SIZE);
+		src_addr = inline_data_addr(ipage);
+		dst_addr = kmap(page);
+		memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+		kunmap(page);
+		SetPageUptodate(page);
+	}
+
+	clear_page_dirty_for_io(page);
+	set_page_writeback(page);
+	write_data_page(inode, page, &dn, dn.data_blkaddr, &new_blk_addr);
+	update_extent_cache(new_blk_addr, &dn);
+
+	truncate_inline_data(ipage, 0);
+	clear_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+	sync_inode_page(&dn);
+	f2fs_put_dnode(&dn);
+out:
+	mutex_unlock_op(sbi, ilock);
+	if (!err)
+		f2fs_submit_bio(sbi, DATA, true);
+	f2fs_put_page(page, 1);
+	return err;
+}
+
+/*
+ * Roll forward the inline data of a fsynced inode page. It returns true if
+ * there is nothing left for do_recover_data() to do with npage.
+ */
+bool recover_inline_data(struct inode *inode, struct page *npage)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode *ri = NULL;
+	struct page *ipage;
+
+	if (!f2fs_has_inline_data(inode))
+		return false;
+
+	if (IS_INODE(npage))
+		ri = &((struct f2fs_node *)page_address(npage))->i;
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	BUG_ON(IS_ERR(ipage));
+	wait_on_page_writeback(ipage);
+
+	if (ri && (ri->i_inline & F2FS_INLINE_DATA)) {
+		memcpy(inline_data_addr(ipage), inline_data_addr(npage),
+							MAX_INLINE_DATA);
+		update_inode(inode, ipage);
+		f2fs_put_page(ipage, 1);
+		return true;
+	}
+
+	/* converted after the checkpoint, the data block is in npage */
+	truncate_inline_data(ipage, 0);
+	clear_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+	update_inode(inode, ipage);
+	f2fs_put_page(ipage, 1);
+	return false;
+}
+
+struct f2fs_dir_entry *find_in_inline_dir(struct inode *dir,
+				struct qstr *name, struct page **res_page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct f2fs_dir_entry *de;
+	struct f2fs_dentry_ptr d;
+	struct page *ipage;
+	f2fs_hash_t namehash;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return NULL;
+
+	namehash = f2fs_dentry_hash(name->name, name->len);
+
+	make_dentry_ptr(&d, inline_data_addr(ipage), true);
+	de = find_target_dentry(name->name, name->len, namehash, NULL, &d);
+	unlock_page(ipage);
+	if (de) {
+		/* kunmap - pair of f2fs_find_entry */
+		kmap(ipage);
+		*res_page = ipage;
+	} else {
+		f2fs_put_page(ipage, 0);
+	}
+	return de;
+}
+
+struct f2fs_dir_entry *f2fs_parent_inline_dir(struct inode *dir,
+							struct page **p)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct f2fs_inline_dentry *dentry_blk;
+	struct page *ipage;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return NULL;
+
+	dentry_blk = inline_data_addr(ipage);
+	kmap(ipage);
+	unlock_page(ipage);
+	*p = ipage;
+	return &dentry_blk->dentry[1];
+}
+
+/* ipage is the locked inode page of the new directory */
+int make_empty_inline_dir(struct inode *inode, struct inode *parent,
+							struct page *ipage)
+{
+	struct f2fs_dentry_ptr d;
+
+	make_dentry_ptr(&d, inline_data_addr(ipage), true);
+	do_make_empty_dir(inode, parent, &d);
+	set_page_dirty(ipage);
+
+	/* update i_size to MAX_INLINE_DATA */
+	if (i_size_read(inode) < MAX_INLINE_DATA) {
+		i_size_write(inode, MAX_INLINE_DATA);
+		set_inode_flag(F2FS_I(inode), FI_UPDATE_DIR);
+	}
+	return 0;
+}
+
+/*
+ * Move the inline dentries of a full directory to its first dentry block.
+ * Level 0 of the hash tables is a single bucket starting at that block, so
+ * every name stays where f2fs_find_entry() looks for it first.
+ */
+static int f2fs_convert_inline_dir(struct inode *dir, struct page *ipage,
+				struct f2fs_inline_dentry *inline_dentry)
+{
+	struct page *page;
+	struct f2fs_dentry_block *dentry_blk;
+
+	page = get_new_data_page(dir, ipage, 0, false);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	wait_on_page_writeback(page);
+	dentry_blk = kmap_atomic(page);
+	memset(dentry_blk, 0, sizeof(struct f2fs_dentry_block));
+
+	/* copy data from inline dentry block to new dentry block */
+	memcpy(dentry_blk->dentry_bitmap, inline_dentry->dentry_bitmap,
+					INLINE_DENTRY_BITMAP_SIZE);
+	memcpy(dentry_blk->dentry, inline_dentry->dentry,
+			sizeof(struct f2fs_dir_entry) * NR_INLINE_DENTRY);
+	memcpy(dentry_blk->filename, inline_dentry->filename,
+					NR_INLINE_DENTRY * F2FS_SLOT_LEN);
+	kunmap_atomic(dentry_blk);
+
+	SetPageUptodate(page);
+	set_page_dirty(page);
+	f2fs_put_page(page, 1);
+
+	/* clear inline dir and flag after the dentry block is in place */
+	truncate_inline_data(ipage, 0);
+	clear_inode_flag(F2FS_I(dir), FI_INLINE_DENTRY);
+
+	if (i_size_read(dir) < PAGE_CACHE_SIZE)
+		i_size_write(dir, PAGE_CACHE_SIZE);
+	update_inode(dir, ipage);
+	return 0;
+}
+
+/*
+ * Caller should grab and release a mutex by calling mutex_lock_op() and
+ * mutex_unlock_op(). It returns -EAGAIN if the directory was moved to a
+ * dentry block to make room, and the caller should add the name there.
+ */
+int f2fs_add_inline_entry(struct inode *dir, const struct qstr *name,
+						struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct page *ipage, *page;
+	unsigned int bit_pos;
+	f2fs_hash_t name_hash;
+	struct f2fs_inline_dentry *dentry_blk;
+	struct f2fs_dentry_ptr d;
+	int slots = GET_DENTRY_SLOTS(name->len);
+	int err = 0;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	dentry_blk = inline_data_addr(ipage);
+	bit_pos = room_for_filename(&dentry_blk->dentry_bitmap,
+						slots, NR_INLINE_DENTRY);
+	if (bit_pos >= NR_INLINE_DENTRY) {
+		err = f2fs_convert_inline_dir(dir, ipage, dentry_blk);
+		if (!err)
+			err = -EAGAIN;
+		goto out;
+	}
+
+	wait_on_page_writeback(ipage);
+
+	page = init_inode_metadata(inode, dir, name);
+	if (IS_ERR(page)) {
+		err = PTR_ERR(page);
+		goto fail;
+	}
+
+	name_hash = f2fs_dentry_hash(name->name, name->len);
+	make_dentry_ptr(&d, (void *)dentry_blk, true);
+	f2fs_update_dentry(inode, &d, name, name_hash, bit_pos);
+	set_page_dirty(ipage);
+
+	/* we don't need to mark_inode_dirty now */
+	F2FS_I(inode)->i_pino = dir->i_ino;
+	update_inode(inode, page);
+	f2fs_put_page(page, 1);
+
+	update_parent_metadata(dir, inode, ipage,
+				F2FS_I(dir)->i_current_depth);
+fail:
+	clear_inode_flag(F2FS_I(dir), FI_UPDATE_DIR);
+out:
+	f2fs_put_page(ipage, 1);
+	return err;
+}
+
+void f2fs_delete_inline_entry(struct f2fs_dir_entry *dentry, struct page *page,
+					struct inode *dir, struct inode *inode)
+{
+	struct f2fs_inline_dentry *inline_dentry;
+	int slots = GET_DENTRY_SLOTS(le16_to_cpu(dentry->name_len));
+	unsigned int bit_pos;
+	int i;
+
+	lock_page(page);
+	wait_on_page_writeback(page);
+
+	inline_dentry = inline_data_addr(page);
+	bit_pos = dentry - inline_dentry->dentry;
+	for (i = 0; i < slots; i++)
+		test_and_clear_bit_le(bit_pos + i,
+				&inline_dentry->dentry_bitmap);
+
+	kunmap(page); /* kunmap - pair of f2fs_find_entry */
+	set_page_dirty(page);
+	f2fs_put_page(page, 1);
+
+	f2fs_drop_nlink(dir, inode);
+}
+
+bool f2fs_empty_inline_dir(struct inode *dir)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct page *ipage;
+	unsigned int bit_pos = 2;
+	struct f2fs_inline_dentry *dentry_blk;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return false;
+
+	dentry_blk = inline_data_addr(ipage);
+	bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
+					NR_INLINE_DENTRY, bit_pos);
+
+	f2fs_put_page(ipage, 1);
+
+	return bit_pos >= NR_INLINE_DENTRY;
+}
+
+int f2fs_read_inline_dir(struct file *file, void *dirent, filldir_t filldir)
+{
+	struct inode *inode = file_inode(file);
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *ipage;
+	struct f2fs_dentry_ptr d;
+
+	if (file->f_pos >= NR_INLINE_DENTRY)
+		return 0;
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	make_dentry_ptr(&d, inline_data_addr(ipage), true);
+	if (!f2fs_fill_dentries(file, dirent, filldir, &d, 0, file->f_pos))
+		file->f_pos = NR_INLINE_DENTRY;
+
+	f2fs_put_page(ipage, 1);
+	return 0;
+}
@@ -57,6 +57,11 @@ static struct inode *f2fs_new_inode(struct inode *dir, umode_t mode)
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	inode->i_generation = sbi->s_next_generation++;
 
+	if (test_opt(sbi, INLINE_DATA) && S_ISREG(inode->i_mode))
+		set_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+	if (test_opt(sbi, INLINE_DENTRY) && S_ISDIR(inode->i_mode))
+		set_inode_flag(F2FS_I(inode), FI_INLINE_DENTRY);
+
 	err = insert_inode_locked(inode);
 	if (err) {
 		err = -EINVAL;
@@ -253,7 +258,7 @@ static int f2fs_unlink(struct inode *dir, struct dentry *dentry)
 	}
 
 	ilock = mutex_lock_op(sbi);
-	f2fs_delete_entry(de, page, inode);
+	f2fs_delete_entry(de, page, dir, inode);
 	mutex_unlock_op(sbi, ilock);
 
 	/* In order to evict this inode,  we set it dirty */
@@ -407,6 +412,7 @@ static int f2fs_rename(struct inode *old_dir, struct dentry *old_dentry,
 	struct f2fs_dir_entry *old_dir_entry = NULL;
 	struct f2fs_dir_entry *old_entry;
 	struct f2fs_dir_entry *new_entry;
+	bool old_dir_inline = f2fs_has_inline_dentry(old_dir);
 	int err = -ENOENT, ilock = -1;
 
 	f2fs_balance_fs(sbi);
@@ -457,6 +463,23 @@ static int f2fs_rename(struct inode *old_dir, struct dentry *old_dentry,
 		if (err)
 			goto out_dir;
 
+		/* adding the new name moved old_entry out of the inode */
+		if (old_dir_inline && !f2fs_has_inline_dentry(old_dir)) {
+			kunmap(old_page);
+			f2fs_put_page(old_page, 0);
+			old_entry = f2fs_find_entry(old_dir,
+					&old_dentry->d_name, &old_page);
+			if (!old_entry) {
+				err = -EIO;
+				if (old_dir_entry) {
+					kunmap(old_dir_page);
+					f2fs_put_page(old_dir_page, 0);
+				}
+				mutex_unlock_op(sbi, ilock);
+				goto out;
+			}
+		}
+
 		if (old_dir_entry) {
 			inc_nlink(new_dir);
 			update_inode_page(new_dir);
@@ -466,7 +489,7 @@ static int f2fs_rename(struct inode *old_dir, struct dentry *old_dentry,
 	old_inode->i_ctime = CURRENT_TIME;
 	mark_inode_dirty(old_inode);
 
-	f2fs_delete_entry(old_entry, old_page, NULL);
+	f2fs_delete_entry(old_entry, old_page, old_dir, NULL);
 
 	if (old_dir_entry) {
 		if (old_dir != new_dir) {
@@ -835,6 +835,8 @@ struct page *new_node_page(struct dnode_of_data *dn,
 
 	get_node_info(sbi, dn->nid, &old_ni);
 
+	/* a freed node page may still be cached; inline data must start clean */
+	zero_user_segment(page, 0, PAGE_CACHE_SIZE);
 	SetPageUptodate(page);
 	fill_node_footer(page, dn->nid, dn->inode->i_ino, ofs, true);
 
@@ -1480,6 +1482,7 @@ int recover_inode_page(struct f2fs_sb_info *sbi, struct page *page)
 	remove_free_nid(NM_I(sbi), ino);
 
 	get_node_info(sbi, ino, &old_ni);
+	zero_user_segment(ipage, 0, PAGE_CACHE_SIZE);
 	SetPageUptodate(ipage);
 	fill_node_footer(ipage, ino, ino, 0, true);
 
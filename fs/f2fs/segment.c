@@ -14,6 +14,7 @@
 #include <linux/blkdev.h>
 #include <linux/prefetch.h>
 #include <linux/vmalloc.h>
+#include <linux/list_sort.h>
 
 #include "f2fs.h"
 #include "segment.h"
@@ -31,11 +32,63 @@ void f2fs_balance_fs(struct f2fs_sb_info *sbi)
 	 * dir/node pages without enough free segments.
 	 */
 	if (has_not_enough_free_secs(sbi, 0)) {
+		ktime_t start = ktime_get();
+
 		mutex_lock(&sbi->gc_mutex);
-		f2fs_gc(sbi);
+		f2fs_gc(sbi, false);
+		stat_add_gc_stall(sbi, ktime_sub(ktime_get(), start));
+	} else {
+		/* let the GC thread make room before we have to stall */
+		wake_up_urgent_gc(sbi);
 	}
 }
 
+/*
+ * The victim index keeps every section having a segment in the DIRTY list
+ * in the bucket of its valid blocks, see get_victim_by_default().
+ * These should be called under seglist_lock.
+ */
+static void __unlink_victim_entry(struct dirty_seglist_info *dirty_i,
+					struct victim_entry *ve)
+{
+	list_del_init(&ve->list);
+	if (list_empty(&dirty_i->victim_buckets[ve->bucket]))
+		__clear_bit(ve->bucket, dirty_i->victim_bucketmap);
+}
+
+static void __link_victim_entry(struct f2fs_sb_info *sbi, unsigned int secno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_entry *ve = &dirty_i->victim_entries[secno];
+	unsigned int segno = secno * sbi->segs_per_sec;
+
+	if (!list_empty(&ve->list))
+		__unlink_victim_entry(dirty_i, ve);
+
+	ve->bucket = get_valid_blocks(sbi, segno, sbi->segs_per_sec) /
+							sbi->segs_per_sec;
+	list_add_tail(&ve->list, &dirty_i->victim_buckets[ve->bucket]);
+	__set_bit(ve->bucket, dirty_i->victim_bucketmap);
+}
+
+static void __inc_victim_entry(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	unsigned int secno = GET_SECNO(sbi, segno);
+
+	if (DIRTY_I(sbi)->victim_entries[secno].dirty_segs++ == 0)
+		__link_victim_entry(sbi, secno);
+}
+
+static void __dec_victim_entry(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_entry *ve;
+
+	ve = &dirty_i->victim_entries[GET_SECNO(sbi, segno)];
+	if (--ve->dirty_segs == 0)
+		__unlink_victim_entry(dirty_i, ve);
+}
+
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		enum dirty_type dirty_type)
 {
@@ -45,8 +98,11 @@ static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 	if (IS_CURSEG(sbi, segno))
 		return;
 
-	if (!test_and_set_bit(segno, dirty_i->dirty_segmap[dirty_type]))
+	if (!test_and_set_bit(segno, dirty_i->dirty_segmap[dirty_type])) {
 		dirty_i->nr_dirty[dirty_type]++;
+		if (dirty_type == DIRTY)
+			__inc_victim_entry(sbi, segno);
+	}
 
 	if (dirty_type == DIRTY) {
 		struct seg_entry *sentry = get_seg_entry(sbi, segno);
@@ -72,8 +128,11 @@ static void __remove_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 
-	if (test_and_clear_bit(segno, dirty_i->dirty_segmap[dirty_type]))
+	if (test_and_clear_bit(segno, dirty_i->dirty_segmap[dirty_type])) {
 		dirty_i->nr_dirty[dirty_type]--;
+		if (dirty_type == DIRTY)
+			__dec_victim_entry(sbi, segno);
+	}
 
 	if (dirty_type == DIRTY) {
 		enum dirty_type t = DIRTY_HOT_DATA;
@@ -156,14 +215,14 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi)
 		if (test_and_clear_bit(segno, dirty_i->dirty_segmap[PRE]))
 			dirty_i->nr_dirty[PRE]--;
 
-		/* Let's use trim */
+		/* Let's use trim, in the background where possible */
 		if (test_opt(sbi, DISCARD))
-			blkdev_issue_discard(sbi->sb->s_bdev,
+			blkdev_queue_discard(sbi->sb->s_bdev,
 					START_BLOCK(sbi, segno) <<
 					sbi->log_sectors_per_block,
 					1 << (sbi->log_sectors_per_block +
 						sbi->log_blocks_per_seg),
-					GFP_NOFS, 0);
+					GFP_NOFS);
 	}
 	mutex_unlock(&dirty_i->seglist_lock);
 }
@@ -184,6 +243,21 @@ static void __set_sit_entry_type(struct f2fs_sb_info *sbi, int type,
 		__mark_sit_entry_dirty(sbi, segno);
 }
 
+/*
+ * Move a dirty section to the bucket of its new valid blocks, and to the
+ * young end of it.
+ */
+static void update_victim_entry(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SECNO(sbi, segno);
+
+	mutex_lock(&dirty_i->seglist_lock);
+	if (dirty_i->victim_entries[secno].dirty_segs)
+		__link_victim_entry(sbi, secno);
+	mutex_unlock(&dirty_i->seglist_lock);
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -221,6 +295,8 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	if (sbi->segs_per_sec > 1)
 		get_sec_entry(sbi, segno)->valid_blocks += del;
+
+	update_victim_entry(sbi, segno);
 }
 
 static void refresh_sit_entry(struct f2fs_sb_info *sbi,
@@ -1557,10 +1633,69 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+static int build_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nr_buckets = NR_VICTIM_BUCKETS(sbi);
+	unsigned int i;
+
+	dirty_i->victim_entries = vzalloc(TOTAL_SECS(sbi) *
+					sizeof(struct victim_entry));
+	if (!dirty_i->victim_entries)
+		return -ENOMEM;
+	for (i = 0; i < TOTAL_SECS(sbi); i++)
+		INIT_LIST_HEAD(&dirty_i->victim_entries[i].list);
+
+	dirty_i->victim_buckets = kmalloc(nr_buckets *
+					sizeof(struct list_head), GFP_KERNEL);
+	if (!dirty_i->victim_buckets)
+		return -ENOMEM;
+	for (i = 0; i < nr_buckets; i++)
+		INIT_LIST_HEAD(&dirty_i->victim_buckets[i]);
+
+	dirty_i->victim_bucketmap = kzalloc(f2fs_bitmap_size(nr_buckets),
+								GFP_KERNEL);
+	if (!dirty_i->victim_bucketmap)
+		return -ENOMEM;
+	return 0;
+}
+
+static int victim_entry_cmp(void *priv, struct list_head *a,
+						struct list_head *b)
+{
+	struct f2fs_sb_info *sbi = priv;
+	struct victim_entry *entries = DIRTY_I(sbi)->victim_entries;
+	unsigned long long mtime_a, mtime_b;
+
+	mtime_a = get_sec_mtime(sbi,
+			list_entry(a, struct victim_entry, list) - entries);
+	mtime_b = get_sec_mtime(sbi,
+			list_entry(b, struct victim_entry, list) - entries);
+	return mtime_a > mtime_b;
+}
+
+/*
+ * The sections found dirty at mount time were added in the order of their
+ * numbers; put every bucket in the order of age.
+ */
+static void sort_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int bucket;
+
+	mutex_lock(&dirty_i->seglist_lock);
+	for_each_set_bit(bucket, dirty_i->victim_bucketmap,
+						NR_VICTIM_BUCKETS(sbi))
+		list_sort(sbi, &dirty_i->victim_buckets[bucket],
+							victim_entry_cmp);
+	mutex_unlock(&dirty_i->seglist_lock);
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -1578,7 +1713,12 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 			return -ENOMEM;
 	}
 
+	err = build_victim_index(sbi);
+	if (err)
+		return err;
+
 	init_dirty_segmap(sbi);
+	sort_victim_index(sbi);
 	return init_victim_secmap(sbi);
 }
 
@@ -1588,20 +1728,14 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 static void init_min_max_mtime(struct f2fs_sb_info *sbi)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
-	unsigned int segno;
+	unsigned int secno;
 
 	mutex_lock(&sit_i->sentry_lock);
 
 	sit_i->min_mtime = LLONG_MAX;
 
-	for (segno = 0; segno < TOTAL_SEGS(sbi); segno += sbi->segs_per_sec) {
-		unsigned int i;
-		unsigned long long mtime = 0;
-
-		for (i = 0; i < sbi->segs_per_sec; i++)
-			mtime += get_seg_entry(sbi, segno + i)->mtime;
-
-		mtime = div_u64(mtime, sbi->segs_per_sec);
+	for (secno = 0; secno < TOTAL_SECS(sbi); secno++) {
+		unsigned long long mtime = get_sec_mtime(sbi, secno);
 
 		if (sit_i->min_mtime > mtime)
 			sit_i->min_mtime = mtime;
@@ -1672,6 +1806,15 @@ static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 	kfree(dirty_i->victim_secmap);
 }
 
+static void destroy_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+
+	vfree(dirty_i->victim_entries);
+	kfree(dirty_i->victim_buckets);
+	kfree(dirty_i->victim_bucketmap);
+}
+
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
@@ -1685,6 +1828,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	destroy_victim_index(sbi);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
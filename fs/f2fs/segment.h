@@ -214,12 +214,29 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Sections having dirty segments are indexed for victim selection, in one
+ * list per bucket of valid blocks. A section goes to the tail of its
+ * bucket whenever it is modified, so every list runs from the oldest
+ * section to the youngest.
+ */
+#define NR_VICTIM_BUCKETS(sbi)	((sbi)->blocks_per_seg + 1)
+
+struct victim_entry {
+	struct list_head list;		/* in its victim bucket */
+	unsigned int bucket;		/* valid blocks / segs_per_sec */
+	unsigned int dirty_segs;	/* # of segments in the DIRTY list */
+};
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	struct victim_entry *victim_entries;	/* index entry per section */
+	struct list_head *victim_buckets;	/* dirty sections by valid blocks */
+	unsigned long *victim_bucketmap;	/* non-empty victim buckets */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -274,6 +291,18 @@ static inline unsigned int get_valid_blocks(struct f2fs_sb_info *sbi,
 		return get_seg_entry(sbi, segno)->valid_blocks;
 }
 
+static inline unsigned long long get_sec_mtime(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	unsigned int start = secno * sbi->segs_per_sec;
+	unsigned long long mtime = 0;
+	unsigned int i;
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		mtime += get_seg_entry(sbi, start + i)->mtime;
+	return div_u64(mtime, sbi->segs_per_sec);
+}
+
 static inline void seg_info_from_raw_sit(struct seg_entry *se,
 					struct f2fs_sit_entry *rs)
 {
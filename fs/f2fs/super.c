@@ -42,6 +42,8 @@ enum {
 	Opt_noacl,
 	Opt_active_logs,
 	Opt_disable_ext_identify,
+	Opt_inline_data,
+	Opt_inline_dentry,
 	Opt_err,
 };
 
@@ -54,6 +56,8 @@ static match_table_t f2fs_tokens = {
 	{Opt_noacl, "noacl"},
 	{Opt_active_logs, "active_logs=%u"},
 	{Opt_disable_ext_identify, "disable_ext_identify"},
+	{Opt_inline_data, "inline_data"},
+	{Opt_inline_dentry, "inline_dentry"},
 	{Opt_err, NULL},
 };
 
@@ -151,6 +155,12 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_disable_ext_identify:
 			set_opt(sbi, DISABLE_EXT_IDENTIFY);
 			break;
+		case Opt_inline_data:
+			set_opt(sbi, INLINE_DATA);
+			break;
+		case Opt_inline_dentry:
+			set_opt(sbi, INLINE_DENTRY);
+			break;
 		default:
 			f2fs_msg(sb, KERN_ERR,
 				"Unrecognized mount option \"%s\" or missing value",
@@ -223,8 +233,8 @@ static void f2fs_put_super(struct super_block *sb)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(sb);
 
-	f2fs_destroy_stats(sbi);
 	stop_gc_thread(sbi);
+	f2fs_destroy_stats(sbi);
 
 	write_checkpoint(sbi, true);
 
@@ -318,6 +328,10 @@ static int f2fs_show_options(struct seq_file *seq, struct vfsmount *vfs)
 #endif
 	if (test_opt(sbi, DISABLE_EXT_IDENTIFY))
 		seq_puts(seq, ",disable_ext_identify");
+	if (test_opt(sbi, INLINE_DATA))
+		seq_puts(seq, ",inline_data");
+	if (test_opt(sbi, INLINE_DENTRY))
+		seq_puts(seq, ",inline_dentry");
 
 	seq_printf(seq, ",active_logs=%u", sbi->active_logs);
 
@@ -732,6 +746,11 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 				"Cannot recover all fsync data errno=%ld", err);
 	}
 
+	/* the GC thread reports its state in the stats */
+	err = f2fs_build_stats(sbi);
+	if (err)
+		goto free_root_inode;
+
 	/*
 	 * If filesystem is not mounted as read-only then
 	 * do start the gc_thread.
@@ -740,13 +759,9 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 		/* After POR, we can run background GC thread.*/
 		err = start_gc_thread(sbi);
 		if (err)
-			goto fail;
+			goto free_stats;
 	}
 
-	err = f2fs_build_stats(sbi);
-	if (err)
-		goto fail;
-
 	if (test_opt(sbi, DISCARD)) {
 		struct request_queue *q = bdev_get_queue(sb->s_bdev);
 		if (!blk_queue_discard(q))
@@ -756,8 +771,8 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 
 	return 0;
-fail:
-	stop_gc_thread(sbi);
+free_stats:
+	f2fs_destroy_stats(sbi);
 free_root_inode:
 	iput(root);
 free_node_inode:
@@ -0,0 +1,359 @@
+/*
+ * Group commit for fsync
+ *
+ * An fsync on ext4 or f2fs ends in a journal commit or checkpoint and a
+ * cache flush, and when several apps write their databases at once most of
+ * the time goes into doing these one after another. Here the fsyncs on a
+ * superblock share them instead: every caller writes back its own data and
+ * inode, then joins the batch that is open on the superblock, or opens one.
+ * The caller that opened it waits up to window_us for the others that are
+ * still writing their data, closes the batch and does one ->sync_fs(sb, 1)
+ * and one cache flush for all members, which are then woken with its
+ * result. If nobody joined, it takes its file's own ->fsync instead, which
+ * is no slower than the commit and reports errors the way the filesystem
+ * does for a single file. Nothing is skipped: no fsync returns before its
+ * file is on stable storage, only the commit is shared.
+ *
+ * Filesystems opt in with FS_GROUP_FSYNC, which says that once the data is
+ * written and ->write_inode() has run, ->sync_fs(sb, 1) makes a file
+ * durable and returns the error if it could not. Everything else, and
+ * inodes the flusher is busy with, go to the filesystem's own ->fsync.
+ *
+ * The window and the counters are in /sys/kernel/fsync_batch. The latency
+ * counters are kept with the window at 0 as well, for comparison.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/delay.h>
+#include <linux/kobject.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/wait.h>
+#include <linux/writeback.h>
+
+#include "internal.h"
+
+#define FSYNC_DEFAULT_WINDOW_US	1000
+#define FSYNC_MAX_WINDOW_US	100000
+
+/* latency buckets: <100us <1ms <10ms <100ms <1s and the rest */
+#define FSYNC_LAT_BUCKETS	6
+
+struct fsync_batch {
+	struct kref		ref;
+	wait_queue_head_t	wait;
+	int			nr_joined;	/* under fsync_batch_lock */
+	bool			done;
+	int			err;
+};
+
+static unsigned int fsync_window_us __read_mostly = FSYNC_DEFAULT_WINDOW_US;
+
+/* protects sb->s_fsync_batch */
+static DEFINE_SPINLOCK(fsync_batch_lock);
+
+static struct {
+	atomic_long_t	fsyncs;
+	atomic_long_t	commits;
+	atomic_long_t	coalesced;
+	atomic_long_t	fallbacks;
+	atomic64_t	lat_us;
+	unsigned long	max_lat_us;
+	atomic_long_t	lat_hist[FSYNC_LAT_BUCKETS];
+} fsync_stats;
+
+static void fsync_account(ktime_t start)
+{
+	unsigned long us = ktime_us_delta(ktime_get(), start);
+	unsigned long limit = 100;
+	int i;
+
+	atomic_long_inc(&fsync_stats.fsyncs);
+	atomic64_add(us, &fsync_stats.lat_us);
+	/* racy, but only ever off by a concurrent caller */
+	if (us > fsync_stats.max_lat_us)
+		fsync_stats.max_lat_us = us;
+	for (i = 0; i < FSYNC_LAT_BUCKETS - 1 && us >= limit; i++)
+		limit *= 10;
+	atomic_long_inc(&fsync_stats.lat_hist[i]);
+}
+
+static bool fsync_can_batch(struct super_block *sb)
+{
+	return (sb->s_type->fs_flags & FS_GROUP_FSYNC) &&
+		sb->s_op->sync_fs && !(sb->s_flags & MS_RDONLY);
+}
+
+/*
+ * Write back what the commit needs from this file. Returns 1 if the inode
+ * is still dirty, or is being written by the flusher whose ->write_inode()
+ * the commit might miss; the caller then takes the plain ->fsync.
+ */
+static int fsync_write_file(struct file *file, loff_t start, loff_t end,
+			    int datasync)
+{
+	struct inode *inode = file->f_mapping->host;
+	unsigned int dirty = datasync ? I_DIRTY_DATASYNC :
+		I_DIRTY_SYNC | I_DIRTY_DATASYNC;
+	int ret;
+
+	ret = filemap_write_and_wait_range(file->f_mapping, start, end);
+	if (ret)
+		return ret;
+
+	if (inode->i_state & dirty) {
+		ret = sync_inode_metadata(inode, 0);
+		if (ret)
+			return ret;
+	}
+
+	spin_lock(&inode->i_lock);
+	ret = !!(inode->i_state & (dirty | I_SYNC));
+	spin_unlock(&inode->i_lock);
+	return ret;
+}
+
+static int fsync_commit(struct super_block *sb)
+{
+	int ret, err;
+
+	atomic_long_inc(&fsync_stats.commits);
+	ret = sb->s_op->sync_fs(sb, 1);
+	err = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+	if (!ret && err != -EOPNOTSUPP)
+		ret = err;
+	return ret;
+}
+
+static struct fsync_batch *fsync_batch_alloc(void)
+{
+	struct fsync_batch *b;
+
+	b = kmalloc(sizeof(*b), GFP_NOFS);
+	if (!b)
+		return NULL;
+	kref_init(&b->ref);
+	init_waitqueue_head(&b->wait);
+	b->nr_joined = 0;
+	b->done = false;
+	b->err = 0;
+	return b;
+}
+
+static void fsync_batch_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct fsync_batch, ref));
+}
+
+/*
+ * Commit batch @b, which this caller opened on @sb for @file, for all its
+ * members.
+ */
+static int fsync_lead(struct super_block *sb, struct fsync_batch *b,
+		      unsigned int window, struct file *file, loff_t start,
+		      loff_t end, int datasync)
+{
+	int joined, ret;
+
+	/* a lone fsync doesn't wait for company that isn't coming */
+	if (atomic_read(&sb->s_fsync_writing))
+		usleep_range(window, window + window / 4);
+
+	spin_lock(&fsync_batch_lock);
+	sb->s_fsync_batch = NULL;
+	joined = b->nr_joined;
+	spin_unlock(&fsync_batch_lock);
+
+	if (joined)
+		ret = fsync_commit(sb);
+	else
+		ret = file->f_op->fsync(file, start, end, datasync);
+
+	b->err = ret;
+	smp_wmb();
+	b->done = true;
+	wake_up_all(&b->wait);
+	kref_put(&b->ref, fsync_batch_free);
+	return ret;
+}
+
+/**
+ * fsync_batch - fsync a file, sharing the commit with concurrent callers
+ * @file:	file to sync
+ * @start:	offset in bytes of the beginning of data range to sync
+ * @end:	offset in bytes of the end of data range (inclusive)
+ * @datasync:	perform only datasync
+ *
+ * Same guarantees as @file's ->fsync, which it calls unless the
+ * filesystem has FS_GROUP_FSYNC.
+ */
+int fsync_batch(struct file *file, loff_t start, loff_t end, int datasync)
+{
+	struct super_block *sb = file->f_mapping->host->i_sb;
+	struct fsync_batch *b, *new = NULL;
+	unsigned int window = ACCESS_ONCE(fsync_window_us);
+	ktime_t t;
+	int ret;
+
+	if (!fsync_can_batch(sb))
+		return file->f_op->fsync(file, start, end, datasync);
+
+	t = ktime_get();
+	if (!window)
+		goto plain;
+
+	atomic_inc(&sb->s_fsync_writing);
+	ret = fsync_write_file(file, start, end, datasync);
+	if (ret) {
+		atomic_dec(&sb->s_fsync_writing);
+		if (ret < 0)
+			goto out;
+		atomic_long_inc(&fsync_stats.fallbacks);
+		goto plain;
+	}
+
+	if (!ACCESS_ONCE(sb->s_fsync_batch))
+		new = fsync_batch_alloc();
+
+	spin_lock(&fsync_batch_lock);
+	b = sb->s_fsync_batch;
+	if (b) {
+		kref_get(&b->ref);
+		b->nr_joined++;
+	} else if (new) {
+		sb->s_fsync_batch = new;
+	}
+	atomic_dec(&sb->s_fsync_writing);
+	spin_unlock(&fsync_batch_lock);
+
+	if (b) {
+		kfree(new);
+		wait_event(b->wait, b->done);
+		smp_rmb();
+		ret = b->err;
+		kref_put(&b->ref, fsync_batch_free);
+		atomic_long_inc(&fsync_stats.coalesced);
+		goto out;
+	}
+	if (new) {
+		ret = fsync_lead(sb, new, window, file, start, end, datasync);
+		goto out;
+	}
+	/* no memory, or the batch we saw just closed: go alone */
+
+plain:
+	ret = file->f_op->fsync(file, start, end, datasync);
+out:
+	fsync_account(t);
+	return ret;
+}
+
+/*
+ * sysfs: window_us, 0 turns batching off; stats and latency_hist show the
+ * counters, writing to stats clears them.
+ */
+static ssize_t window_us_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", fsync_window_us);
+}
+
+static ssize_t window_us_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val > FSYNC_MAX_WINDOW_US)
+		return -EINVAL;
+	fsync_window_us = val;
+	return count;
+}
+
+static ssize_t stats_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	unsigned long fsyncs = atomic_long_read(&fsync_stats.fsyncs);
+	u64 lat = atomic64_read(&fsync_stats.lat_us);
+
+	return sprintf(buf,
+		       "fsyncs %lu\ncommits %lu\ncoalesced %lu\nfallbacks %lu\n"
+		       "avg_lat_us %llu\nmax_lat_us %lu\n",
+		       fsyncs, atomic_long_read(&fsync_stats.commits),
+		       atomic_long_read(&fsync_stats.coalesced),
+		       atomic_long_read(&fsync_stats.fallbacks),
+		       fsyncs ? div_u64(lat, fsyncs) : 0,
+		       fsync_stats.max_lat_us);
+}
+
+static ssize_t stats_store(struct kobject *kobj, struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	int i;
+
+	atomic_long_set(&fsync_stats.fsyncs, 0);
+	atomic_long_set(&fsync_stats.commits, 0);
+	atomic_long_set(&fsync_stats.coalesced, 0);
+	atomic_long_set(&fsync_stats.fallbacks, 0);
+	atomic64_set(&fsync_stats.lat_us, 0);
+	fsync_stats.max_lat_us = 0;
+	for (i = 0; i < FSYNC_LAT_BUCKETS; i++)
+		atomic_long_set(&fsync_stats.lat_hist[i], 0);
+	return count;
+}
+
+static ssize_t latency_hist_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	static const char * const names[FSYNC_LAT_BUCKETS] = {
+		"<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s",
+	};
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < FSYNC_LAT_BUCKETS; i++)
+		len += sprintf(buf + len, "%-7s %lu\n", names[i],
+			       atomic_long_read(&fsync_stats.lat_hist[i]));
+	return len;
+}
+
+static struct kobj_attribute window_us_attr =
+	__ATTR(window_us, 0644, window_us_show, window_us_store);
+static struct kobj_attribute stats_attr =
+	__ATTR(stats, 0644, stats_show, stats_store);
+static struct kobj_attribute latency_hist_attr = __ATTR_RO(latency_hist);
+
+static struct attribute *fsync_batch_attrs[] = {
+	&window_us_attr.attr,
+	&stats_attr.attr,
+	&latency_hist_attr.attr,
+	NULL,
+};
+
+static struct attribute_group fsync_batch_attr_group = {
+	.attrs = fsync_batch_attrs,
+};
+
+static int __init fsync_batch_init(void)
+{
+	struct kobject *kobj;
+	int ret;
+
+	kobj = kobject_create_and_add("fsync_batch", kernel_kobj);
+	if (!kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(kobj, &fsync_batch_attr_group);
+	if (ret)
+		kobject_put(kobj);
+	return ret;
+}
+module_init(fsync_batch_init);
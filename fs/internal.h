@@ -113,6 +113,19 @@ extern int get_nr_dirty_inodes(void);
 extern void evict_inodes(struct super_block *);
 extern int invalidate_inodes(struct super_block *, bool);
 
+/*
+ * fsync_batch.c
+ */
+#ifdef CONFIG_FSYNC_BATCH
+extern int fsync_batch(struct file *, loff_t, loff_t, int);
+#else
+static inline int fsync_batch(struct file *file, loff_t start, loff_t end,
+			      int datasync)
+{
+	return file->f_op->fsync(file, start, end, datasync);
+}
+#endif
+
 /*
  * dcache.c
  */
@@ -0,0 +1,756 @@
+/*
+ *	Submission and completion rings for file I/O
+ *
+ *	An application maps a submission queue (SQ) and a completion queue
+ *	(CQ) shared with the kernel, fills SQEs and reaps CQEs without a
+ *	system call per operation. Rings are created by IORING_IOC_SETUP
+ *	on /dev/io_ring; IORING_IOC_ENTER on a ring runs everything queued
+ *	since the last call and can wait for completions in the same call;
+ *	with IORING_SETUP_SQPOLL a kernel thread watches the SQ instead and
+ *	no system call is needed at all while it keeps polling.
+ *
+ *	Reads, writes and fsyncs are run to completion by whoever consumes
+ *	the SQ, like the synchronous system calls would; poll requests stay
+ *	queued on the file's wait queue and complete when it becomes ready.
+ *
+ *	See ../COPYING for licensing terms.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/mm.h>
+#include <linux/mmu_context.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/poll.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/anon_inodes.h>
+#include <linux/miscdevice.h>
+#include <linux/log2.h>
+#include <linux/cred.h>
+#include <linux/io_ring.h>
+
+#include <asm/uaccess.h>
+
+#define IORING_MAX_ENTRIES	4096
+#define IORING_SQ_IDLE_MS	1000
+
+struct io_ring_ctx {
+	/* the mapped region, starting with the header */
+	struct io_ring_hdr	*hdr;
+	struct io_ring_sqe	*sqes;
+	struct io_ring_cqe	*cqes;
+	size_t			map_size;
+
+	/*
+	 * Private copies of what the application must not be able to
+	 * change under us, the shared ones are only written to.
+	 */
+	unsigned int		sq_entries;
+	unsigned int		sq_mask;
+	unsigned int		sq_head;
+	unsigned int		cq_entries;
+	unsigned int		cq_mask;
+	unsigned int		cq_tail;
+
+	struct mutex		submit_lock;	/* one SQ consumer at a time */
+	spinlock_t		completion_lock;
+	wait_queue_head_t	cq_wait;
+
+	/* IORING_SETUP_SQPOLL */
+	struct task_struct	*sq_thread;
+	struct task_struct	*owner;		/* its mm and files are used */
+	const struct cred	*creds;
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_idle;	/* jiffies */
+
+	/* pending IORING_OP_POLL_ADD */
+	spinlock_t		poll_lock;
+	struct list_head	poll_list;
+
+	/* one for the file, one per poll until its work is done with ctx */
+	atomic_t		refs;
+	struct work_struct	free_work;
+};
+
+struct io_ring_poll {
+	struct io_ring_ctx	*ctx;
+	struct file		*file;
+	u64			user_data;
+	unsigned int		events;
+	wait_queue_head_t	*head;
+	wait_queue_t		wait;
+	poll_table		pt;
+	struct work_struct	work;
+	struct list_head	list;		/* empty once completed */
+};
+
+static const struct file_operations io_ring_fops;
+
+static void io_ring_put(struct io_ring_ctx *ctx)
+{
+	if (atomic_dec_and_test(&ctx->refs)) {
+		vfree(ctx->hdr);
+		kfree(ctx);
+	}
+}
+
+static unsigned int io_ring_cq_ready(struct io_ring_ctx *ctx)
+{
+	return ctx->cq_tail - ACCESS_ONCE(ctx->hdr->cq_head);
+}
+
+static void io_ring_complete(struct io_ring_ctx *ctx, u64 user_data, long res)
+{
+	struct io_ring_hdr *hdr = ctx->hdr;
+	struct io_ring_cqe *cqe;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	if (io_ring_cq_ready(ctx) >= ctx->cq_entries) {
+		/* the application didn't keep up */
+		hdr->cq_overflow++;
+	} else {
+		cqe = &ctx->cqes[ctx->cq_tail & ctx->cq_mask];
+		cqe->user_data = user_data;
+		cqe->res = res;
+		cqe->flags = 0;
+		ctx->cq_tail++;
+		/* the CQE before the tail that makes it visible */
+		smp_wmb();
+		hdr->cq_tail = ctx->cq_tail;
+	}
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	smp_mb();
+	if (waitqueue_active(&ctx->cq_wait))
+		wake_up_interruptible(&ctx->cq_wait);
+}
+
+/*
+ * fget() for the SQ thread, which runs with the owner's files but is not
+ * the owner. Ring file descriptors are refused, their last reference must
+ * not be dropped by the SQ thread that releasing them stops.
+ */
+static struct file *io_ring_fget(struct files_struct *files, unsigned int fd)
+{
+	struct file *file;
+
+	if (!files)
+		return NULL;
+
+	rcu_read_lock();
+	file = fcheck_files(files, fd);
+	if (file && ((file->f_mode & FMODE_PATH) ||
+		     !atomic_long_inc_not_zero(&file->f_count)))
+		file = NULL;
+	rcu_read_unlock();
+
+	if (file && file->f_op == &io_ring_fops) {
+		fput(file);
+		file = NULL;
+	}
+	return file;
+}
+
+static long io_ring_rw(struct file *file, const struct io_ring_sqe *sqe,
+		       int rw)
+{
+	const struct iovec __user *vec =
+		(const struct iovec __user *)(unsigned long)sqe->addr;
+	loff_t pos = sqe->off;
+
+	if ((loff_t)sqe->off < 0)
+		return -EINVAL;
+
+	if (rw == READ) {
+		if (!(file->f_mode & FMODE_PREAD))
+			return -ESPIPE;
+		return vfs_readv(file, vec, sqe->len, &pos);
+	}
+	if (!(file->f_mode & FMODE_PWRITE))
+		return -ESPIPE;
+	return vfs_writev(file, vec, sqe->len, &pos);
+}
+
+static long io_ring_fsync(struct file *file, const struct io_ring_sqe *sqe)
+{
+	loff_t end = sqe->len ? sqe->off + sqe->len - 1 : LLONG_MAX;
+
+	if ((loff_t)sqe->off < 0 || end < (loff_t)sqe->off)
+		return -EINVAL;
+
+	return vfs_fsync_range(file, sqe->off, end,
+			       sqe->op_flags & IORING_FSYNC_DATASYNC);
+}
+
+/*
+ * Take the poll off the file's wait queue. Returns false if it was not
+ * on it: a wakeup took it off and queued the work.
+ */
+static bool io_ring_poll_disarm(struct io_ring_poll *p)
+{
+	unsigned long flags;
+	bool armed;
+
+	if (!p->head)
+		return false;
+
+	spin_lock_irqsave(&p->head->lock, flags);
+	armed = !list_empty(&p->wait.task_list);
+	list_del_init(&p->wait.task_list);
+	spin_unlock_irqrestore(&p->head->lock, flags);
+	return armed;
+}
+
+/*
+ * Complete a poll request once, whoever gets here first: the submitter
+ * when the file is ready right away, the work item after a wakeup, or
+ * ring release cancelling it.
+ */
+static void io_ring_poll_finish(struct io_ring_poll *p, long res,
+				bool from_work)
+{
+	struct io_ring_ctx *ctx = p->ctx;
+
+	spin_lock(&ctx->poll_lock);
+	if (list_empty(&p->list)) {
+		spin_unlock(&ctx->poll_lock);
+		return;
+	}
+	list_del_init(&p->list);
+	spin_unlock(&ctx->poll_lock);
+
+	/*
+	 * The work only gets here with the poll off the wait queue and
+	 * nothing left to requeue it. Anyone else waits for a running work,
+	 * which does not rearm a poll that is off poll_list.
+	 */
+	io_ring_poll_disarm(p);
+	if (!from_work)
+		cancel_work_sync(&p->work);
+
+	io_ring_complete(ctx, p->user_data, res);
+	fput(p->file);
+	kfree(p);
+	io_ring_put(ctx);
+}
+
+static void io_ring_poll_work(struct work_struct *work)
+{
+	struct io_ring_poll *p = container_of(work, struct io_ring_poll, work);
+	struct io_ring_ctx *ctx = p->ctx;
+	unsigned int mask;
+
+	mask = p->file->f_op->poll(p->file, NULL);
+	if (!(mask & p->events)) {
+		/* woken for something else, wait for the next wakeup */
+		spin_lock(&ctx->poll_lock);
+		if (!list_empty(&p->list))
+			add_wait_queue(p->head, &p->wait);
+		spin_unlock(&ctx->poll_lock);
+
+		mask = p->file->f_op->poll(p->file, NULL);
+		if (!(mask & p->events) || !io_ring_poll_disarm(p))
+			return;
+	}
+	io_ring_poll_finish(p, mask & p->events, true);
+}
+
+/* one-shot: the entry leaves the wait queue with the first wakeup */
+static int io_ring_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			     void *key)
+{
+	struct io_ring_poll *p = container_of(wait, struct io_ring_poll, wait);
+
+	if (key && !((unsigned long)key & p->events))
+		return 0;
+
+	/* called with the wait queue lock held */
+	list_del_init(&wait->task_list);
+
+	/* may be in interrupt context, ->poll() is called from the work */
+	schedule_work(&p->work);
+	return 1;
+}
+
+static void io_ring_poll_queue(struct file *file, wait_queue_head_t *head,
+			       poll_table *pt)
+{
+	struct io_ring_poll *p = container_of(pt, struct io_ring_poll, pt);
+
+	/* one wait queue is enough for a one-shot poll */
+	if (p->head)
+		return;
+	p->head = head;
+	add_wait_queue(head, &p->wait);
+}
+
+/* returns -EIOCBQUEUED once the request is the poll's to complete */
+static long io_ring_poll_add(struct io_ring_ctx *ctx, struct file *file,
+			     const struct io_ring_sqe *sqe)
+{
+	unsigned int events = sqe->op_flags | POLLERR | POLLHUP;
+	struct io_ring_poll *p;
+	unsigned int mask;
+
+	if (!file->f_op || !file->f_op->poll)
+		return DEFAULT_POLLMASK & events;
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	p->ctx = ctx;
+	p->file = file;
+	p->user_data = sqe->user_data;
+	p->events = events;
+	init_waitqueue_func_entry(&p->wait, io_ring_poll_wake);
+	init_poll_funcptr(&p->pt, io_ring_poll_queue);
+	INIT_WORK(&p->work, io_ring_poll_work);
+	atomic_inc(&ctx->refs);
+
+	/* on the list before a wakeup can come */
+	spin_lock(&ctx->poll_lock);
+	list_add_tail(&p->list, &ctx->poll_list);
+	spin_unlock(&ctx->poll_lock);
+
+	mask = file->f_op->poll(file, &p->pt);
+	if ((mask & events) || !p->head)
+		io_ring_poll_finish(p, mask & events, false);
+	return -EIOCBQUEUED;
+}
+
+/*
+ * Polls whose work already took them off poll_list finish on their own,
+ * the ctx reference each of them holds keeps ctx and the rings around.
+ */
+static void io_ring_poll_cancel(struct io_ring_ctx *ctx)
+{
+	struct io_ring_poll *p;
+
+	spin_lock(&ctx->poll_lock);
+	while (!list_empty(&ctx->poll_list)) {
+		p = list_first_entry(&ctx->poll_list, struct io_ring_poll,
+				     list);
+		spin_unlock(&ctx->poll_lock);
+
+		io_ring_poll_finish(p, -ECANCELED, false);
+
+		spin_lock(&ctx->poll_lock);
+	}
+	spin_unlock(&ctx->poll_lock);
+}
+
+static void io_ring_issue(struct io_ring_ctx *ctx, struct files_struct *files,
+			  const struct io_ring_sqe *sqe)
+{
+	struct file *file = NULL;
+	long res;
+
+	/* not used yet, refused so that they can be later */
+	if (sqe->flags || sqe->ioprio) {
+		res = -EINVAL;
+		goto out;
+	}
+
+	if (sqe->opcode != IORING_OP_NOP) {
+		file = io_ring_fget(files, sqe->fd);
+		if (!file) {
+			res = -EBADF;
+			goto out;
+		}
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+		res = 0;
+		break;
+	case IORING_OP_READV:
+		res = io_ring_rw(file, sqe, READ);
+		break;
+	case IORING_OP_WRITEV:
+		res = io_ring_rw(file, sqe, WRITE);
+		break;
+	case IORING_OP_FSYNC:
+		res = io_ring_fsync(file, sqe);
+		break;
+	case IORING_OP_POLL_ADD:
+		res = io_ring_poll_add(ctx, file, sqe);
+		if (res == -EIOCBQUEUED)
+			return;
+		break;
+	default:
+		res = -EINVAL;
+		break;
+	}
+
+	if (file)
+		fput(file);
+out:
+	io_ring_complete(ctx, sqe->user_data, res);
+}
+
+/*
+ * Consume up to @max SQEs, called with submit_lock held. A garbage tail
+ * from the application can at worst make us run a queue full of stale
+ * entries.
+ */
+static unsigned int io_ring_submit(struct io_ring_ctx *ctx,
+				   struct files_struct *files, unsigned int max)
+{
+	struct io_ring_hdr *hdr = ctx->hdr;
+	struct io_ring_sqe sqe;
+	unsigned int tail, done = 0;
+
+	tail = ACCESS_ONCE(hdr->sq_tail);
+	/* the tail before the entries it publishes */
+	smp_rmb();
+
+	max = min(max, ctx->sq_entries);
+	while (done < max && ctx->sq_head != tail) {
+		sqe = ctx->sqes[ctx->sq_head & ctx->sq_mask];
+		ctx->sq_head++;
+		/* the slot may be reused as soon as it is copied */
+		smp_mb();
+		hdr->sq_head = ctx->sq_head;
+
+		io_ring_issue(ctx, files, &sqe);
+		done++;
+		cond_resched();
+	}
+	return done;
+}
+
+static bool io_ring_sq_pending(struct io_ring_ctx *ctx)
+{
+	return ACCESS_ONCE(ctx->hdr->sq_tail) != ctx->sq_head;
+}
+
+static void io_ring_sq_run(struct io_ring_ctx *ctx)
+{
+	struct files_struct *files;
+	struct mm_struct *mm;
+
+	/*
+	 * With the owner gone there is no mm to copy from and no files, the
+	 * remaining entries complete with -EBADF.
+	 */
+	mm = get_task_mm(ctx->owner);
+	files = mm ? get_files_struct(ctx->owner) : NULL;
+
+	if (mm)
+		use_mm(mm);
+	mutex_lock(&ctx->submit_lock);
+	io_ring_submit(ctx, files, ctx->sq_entries);
+	mutex_unlock(&ctx->submit_lock);
+	if (mm) {
+		unuse_mm(mm);
+		mmput(mm);
+	}
+	if (files)
+		put_files_struct(files);
+}
+
+static int io_ring_sq_thread(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct io_ring_hdr *hdr = ctx->hdr;
+	unsigned long idle_end = jiffies + ctx->sq_idle;
+	const struct cred *old_cred;
+	DEFINE_WAIT(wait);
+
+	old_cred = override_creds(ctx->creds);
+	set_fs(USER_DS);
+
+	while (!kthread_should_stop()) {
+		if (io_ring_sq_pending(ctx)) {
+			io_ring_sq_run(ctx);
+			idle_end = jiffies + ctx->sq_idle;
+			continue;
+		}
+		if (time_before(jiffies, idle_end)) {
+			cpu_relax();
+			cond_resched();
+			continue;
+		}
+
+		/* the application does IORING_IOC_ENTER once it sees this */
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		hdr->flags |= IORING_SQ_NEED_WAKEUP;
+		smp_mb();
+		if (!io_ring_sq_pending(ctx) && !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+		hdr->flags &= ~IORING_SQ_NEED_WAKEUP;
+		idle_end = jiffies + ctx->sq_idle;
+	}
+
+	revert_creds(old_cred);
+	return 0;
+}
+
+static void io_ring_free(struct io_ring_ctx *ctx)
+{
+	if (ctx->sq_thread)
+		kthread_stop(ctx->sq_thread);
+	io_ring_poll_cancel(ctx);
+	if (ctx->owner)
+		put_task_struct(ctx->owner);
+	if (ctx->creds)
+		put_cred(ctx->creds);
+	io_ring_put(ctx);
+}
+
+static void io_ring_free_work(struct work_struct *work)
+{
+	io_ring_free(container_of(work, struct io_ring_ctx, free_work));
+}
+
+static int io_ring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	/*
+	 * The SQ thread holds the owner's files while it submits. If the
+	 * owner exited meanwhile, its put closes the ring, and the thread
+	 * cannot stop itself: leave that to a work item.
+	 */
+	if (current == ctx->sq_thread) {
+		schedule_work(&ctx->free_work);
+		return 0;
+	}
+	io_ring_free(ctx);
+	return 0;
+}
+
+static int io_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > ctx->map_size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ctx->hdr, 0);
+}
+
+static unsigned int io_ring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	poll_wait(file, &ctx->cq_wait, wait);
+	smp_rmb();
+	return io_ring_cq_ready(ctx) ? POLLIN | POLLRDNORM : 0;
+}
+
+static long io_ring_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg);
+
+static const struct file_operations io_ring_fops = {
+	.release	= io_ring_release,
+	.mmap		= io_ring_mmap,
+	.poll		= io_ring_poll,
+	.unlocked_ioctl	= io_ring_ioctl,
+	.compat_ioctl	= io_ring_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct io_ring_ctx *io_ring_alloc(unsigned int entries,
+					 struct io_ring_params *p)
+{
+	struct io_ring_ctx *ctx;
+	struct io_ring_hdr *hdr;
+	size_t sq_off, cq_off;
+	int ret = -ENOMEM;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_init(&ctx->submit_lock);
+	spin_lock_init(&ctx->completion_lock);
+	init_waitqueue_head(&ctx->cq_wait);
+	init_waitqueue_head(&ctx->sq_wait);
+	spin_lock_init(&ctx->poll_lock);
+	INIT_LIST_HEAD(&ctx->poll_list);
+	atomic_set(&ctx->refs, 1);
+	INIT_WORK(&ctx->free_work, io_ring_free_work);
+
+	/* the CQ has room for polls completing while the SQ is refilled */
+	ctx->sq_entries = entries;
+	ctx->sq_mask = entries - 1;
+	ctx->cq_entries = 2 * entries;
+	ctx->cq_mask = 2 * entries - 1;
+
+	sq_off = ALIGN(sizeof(*hdr), L1_CACHE_BYTES);
+	cq_off = ALIGN(sq_off + entries * sizeof(struct io_ring_sqe),
+		       L1_CACHE_BYTES);
+	ctx->map_size = PAGE_ALIGN(cq_off +
+				   ctx->cq_entries * sizeof(struct io_ring_cqe));
+
+	hdr = vmalloc_user(ctx->map_size);
+	if (!hdr)
+		goto err;
+	ctx->hdr = hdr;
+	ctx->sqes = (void *)hdr + sq_off;
+	ctx->cqes = (void *)hdr + cq_off;
+
+	hdr->sq_mask = ctx->sq_mask;
+	hdr->sq_entries = ctx->sq_entries;
+	hdr->cq_mask = ctx->cq_mask;
+	hdr->cq_entries = ctx->cq_entries;
+	hdr->sq_off = sq_off;
+	hdr->cq_off = cq_off;
+
+	if (p->flags & IORING_SETUP_SQPOLL) {
+		/* a thread spinning on the SQ is not for everyone */
+		ret = -EPERM;
+		if (!capable(CAP_SYS_ADMIN))
+			goto err;
+
+		get_task_struct(current);
+		ctx->owner = current;
+		ctx->creds = get_current_cred();
+		ctx->sq_idle = msecs_to_jiffies(p->sq_thread_idle ?:
+						IORING_SQ_IDLE_MS);
+
+		ctx->sq_thread = kthread_run(io_ring_sq_thread, ctx,
+					     "io_ring_sq/%d",
+					     task_pid_nr(current));
+		if (IS_ERR(ctx->sq_thread)) {
+			ret = PTR_ERR(ctx->sq_thread);
+			ctx->sq_thread = NULL;
+			goto err;
+		}
+	}
+
+	p->sq_entries = ctx->sq_entries;
+	p->cq_entries = ctx->cq_entries;
+	p->map_size = ctx->map_size;
+	return ctx;
+
+err:
+	io_ring_free(ctx);
+	return ERR_PTR(ret);
+}
+
+/*
+ *	Create a ring with room for at least sq_entries submissions and
+ *	return a file descriptor for it, to be mmap()ed from offset 0 for
+ *	the map_size bytes returned in @params. IORING_SETUP_SQPOLL in
+ *	the flags of @params starts a kernel thread polling the SQ, which
+ *	sleeps after sq_thread_idle ms without work.
+ */
+static long io_ring_setup(struct io_ring_params __user *params)
+{
+	struct io_ring_params p;
+	struct io_ring_ctx *ctx;
+	int fd, i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (p.resv[i])
+			return -EINVAL;
+	if (p.flags & ~IORING_SETUP_SQPOLL)
+		return -EINVAL;
+	if (!p.sq_entries || p.sq_entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	ctx = io_ring_alloc(roundup_pow_of_two(p.sq_entries), &p);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	if (copy_to_user(params, &p, sizeof(p))) {
+		io_ring_free(ctx);
+		return -EFAULT;
+	}
+
+	fd = anon_inode_getfd("[io_ring]", &io_ring_fops, ctx,
+			      O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		io_ring_free(ctx);
+	return fd;
+}
+
+/*
+ *	Consume up to to_submit entries of the SQ and, with
+ *	IORING_ENTER_GETEVENTS, wait until the CQ holds at least
+ *	min_complete entries. Returns the number of entries consumed.
+ *	With an SQ thread nothing is consumed here, IORING_ENTER_SQ_WAKEUP
+ *	wakes the thread once it set IORING_SQ_NEED_WAKEUP.
+ */
+static long io_ring_enter(struct io_ring_ctx *ctx,
+			  struct io_ring_enter __user *arg)
+{
+	struct io_ring_enter e;
+	long ret = 0;
+	int err;
+
+	if (copy_from_user(&e, arg, sizeof(e)))
+		return -EFAULT;
+	if (e.resv ||
+	    e.flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	if (ctx->sq_thread) {
+		if (e.flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sq_wait);
+	} else if (e.to_submit) {
+		mutex_lock(&ctx->submit_lock);
+		ret = io_ring_submit(ctx, current->files, e.to_submit);
+		mutex_unlock(&ctx->submit_lock);
+	}
+
+	if (e.flags & IORING_ENTER_GETEVENTS) {
+		e.min_complete = min(e.min_complete, ctx->cq_entries);
+		err = wait_event_interruptible(ctx->cq_wait,
+				io_ring_cq_ready(ctx) >= e.min_complete);
+		if (err && !ret)
+			ret = err;
+	}
+	return ret;
+}
+
+static long io_ring_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	if (cmd != IORING_IOC_ENTER)
+		return -ENOTTY;
+	return io_ring_enter(file->private_data, (void __user *)arg);
+}
+
+/* /dev/io_ring only hands out rings */
+static long io_ring_dev_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	if (cmd != IORING_IOC_SETUP)
+		return -ENOTTY;
+	return io_ring_setup((void __user *)arg);
+}
+
+static const struct file_operations io_ring_dev_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= io_ring_dev_ioctl,
+	.compat_ioctl	= io_ring_dev_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice io_ring_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "io_ring",
+	.fops		= &io_ring_dev_fops,
+	.mode		= 0666,
+};
+
+static int __init io_ring_init(void)
+{
+	return misc_register(&io_ring_dev);
+}
+device_initcall(io_ring_init);
@@ -30,6 +30,7 @@
 #include <linux/fs_struct.h>
 #include <linux/ima.h>
 #include <linux/dnotify.h>
+#include <linux/readahead_learn.h>
 
 #include "internal.h"
 
@@ -705,10 +706,11 @@ static struct file *__dentry_open(struct dentry *dentry, struct vfsmount *mnt,
 		    ((!f->f_mapping->a_ops->direct_IO) &&
 		    (!f->f_mapping->a_ops->get_xip_mem))) {
 			fput(f);
-			f = ERR_PTR(-EINVAL);
+			return ERR_PTR(-EINVAL);
 		}
 	}
 
+	ra_learn_open(f);
 	return f;
 
 cleanup_all:
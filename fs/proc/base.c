@@ -1030,6 +1030,7 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	lowmem_adj_tree_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -1159,6 +1160,8 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	/* the kill index is updated outside of task_lock and siglock */
+	lowmem_adj_tree_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
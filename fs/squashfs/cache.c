@@ -52,11 +52,36 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 
+/*
+ * Entries are found through a hash of their block, and the unused ones
+ * are kept on an LRU list from which the least recently used is evicted.
+ * Both matter once the caches are made larger with the metadata_cache=
+ * and fragment_cache= mount options.
+ */
+static struct squashfs_cache_entry *squashfs_cache_lookup(
+	struct squashfs_cache *cache, u64 block)
+{
+	struct squashfs_cache_entry *entry;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(entry, node,
+			&cache->hash[hash_64(block, cache->hash_bits)],
+			hash_node)
+		if (entry->block == block)
+			return entry;
+
+	return NULL;
+}
+
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -64,17 +89,14 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
 
 	while (1) {
-		for (i = 0; i < cache->entries; i++)
-			if (cache->entry[i].block == block)
-				break;
+		entry = squashfs_cache_lookup(cache, block);
 
-		if (i == cache->entries) {
+		if (entry == NULL) {
 			/*
 			 * Block not in cache, if all cache entries are used
 			 * go to sleep waiting for one to become available.
@@ -89,19 +111,14 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  The least
+			 * recently used one is evicted.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			entry = list_first_entry(&cache->lru,
+				struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			hlist_del_init(&entry->hash_node);
+			cache->misses++;
 
 			/*
 			 * Initialise chosen cache entry, and fill it in from
@@ -109,6 +126,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 */
 			cache->unused--;
 			entry->block = block;
+			hlist_add_head(&entry->hash_node,
+				&cache->hash[hash_64(block, cache->hash_bits)]);
 			entry->refcount = 1;
 			entry->pending = 1;
 			entry->num_waiters = 0;
@@ -146,9 +165,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
-		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		cache->hits++;
+		if (entry->refcount == 0) {
 			cache->unused--;
+			list_del_init(&entry->lru);
+		}
 		entry->refcount++;
 
 		/*
@@ -167,7 +188,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 
 out:
 	TRACE("Got %s %d, start block %lld, refcount %d, error %d\n",
-		cache->name, i, entry->block, entry->refcount, entry->error);
+		cache->name, (int) (entry - cache->entry), entry->block,
+		entry->refcount, entry->error);
 
 	if (entry->error)
 		ERROR("Unable to read %s cache entry [%llx]\n", cache->name,
@@ -187,6 +209,7 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	entry->refcount--;
 	if (entry->refcount == 0) {
 		cache->unused++;
+		list_add_tail(&entry->lru, &cache->lru);
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
@@ -200,6 +223,27 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_unlock(&cache->lock);
 }
 
+/*
+ * Print the size and the lookup counters of a cache, one line of the
+ * caches file in /proc/fs/squashfs/<device>.
+ */
+void squashfs_cache_stats(struct seq_file *m, struct squashfs_cache *cache)
+{
+	unsigned long hits, misses;
+
+	if (cache == NULL)
+		return;
+
+	spin_lock(&cache->lock);
+	hits = cache->hits;
+	misses = cache->misses;
+	spin_unlock(&cache->lock);
+
+	seq_printf(m, "%-10s %8d %10d %12lu %12lu\n", cache->name,
+		cache->entries, cache->block_size, hits, misses);
+}
+
+
 /*
  * Delete cache reclaiming all kmalloced buffers.
  */
@@ -219,6 +263,7 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 	}
 
 	kfree(cache->entry);
+	kfree(cache->hash);
 	kfree(cache);
 }
 
@@ -245,7 +290,16 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->next_blk = 0;
+	/* at least two buckets, so that hash_64() gets a shift below 64 */
+	cache->hash_bits = ilog2(roundup_pow_of_two(entries)) + 1;
+	cache->hash = kcalloc(1 << cache->hash_bits, sizeof(*cache->hash),
+		GFP_KERNEL);
+	if (cache->hash == NULL) {
+		ERROR("Failed to allocate %s cache\n", name);
+		goto cleanup;
+	}
+	INIT_LIST_HEAD(&cache->lru);
+
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -262,6 +316,8 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		init_waitqueue_head(&cache->entry[i].wait_queue);
 		entry->cache = cache;
 		entry->block = SQUASHFS_INVALID_BLK;
+		INIT_HLIST_NODE(&entry->hash_node);
+		list_add_tail(&entry->lru, &cache->lru);
 		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
 		if (entry->data == NULL) {
 			ERROR("Failed to allocate %s cache entry\n", name);
@@ -371,6 +371,106 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Read and decompress a datablock straight into the page cache pages it
+ * covers, instead of into the read_page cache and copying from there.
+ * Besides saving the copy, this doesn't serialise readers on the
+ * read_page cache entries.  Pages of the block that can't be grabbed
+ * without waiting, that are already up to date or that lie beyond the
+ * end of the file get their part of the block in a scratch page, which
+ * is thrown away.
+ */
+static int squashfs_readpage_direct(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int pages = mask + 1;
+	int i, n, avail, res = -ENOMEM;
+	struct page **page;
+	void **pageaddr, *scratch = NULL;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	pageaddr = kcalloc(pages, sizeof(*pageaddr), GFP_KERNEL);
+	if (page == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0, n = start_index; i < pages; i++, n++) {
+		if (n == target_page->index)
+			page[i] = target_page;
+		else if (n <= file_end) {
+			page[i] = grab_cache_page_nowait(target_page->mapping,
+				n);
+			if (page[i] && PageUptodate(page[i])) {
+				unlock_page(page[i]);
+				page_cache_release(page[i]);
+				page[i] = NULL;
+			}
+		}
+
+		if (page[i]) {
+			pageaddr[i] = kmap(page[i]);
+			continue;
+		}
+
+		if (scratch == NULL) {
+			scratch = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+			if (scratch == NULL)
+				goto release;
+		}
+		pageaddr[i] = scratch;
+	}
+
+	res = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+		msblk->block_size, pages);
+	if (res < 0)
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+
+release:
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL)
+			continue;
+
+		if (pageaddr[i]) {
+			if (res >= 0) {
+				avail = min_t(int, PAGE_CACHE_SIZE,
+					max_t(int, res - i * PAGE_CACHE_SIZE,
+						0));
+				memset(pageaddr[i] + avail, 0,
+					PAGE_CACHE_SIZE - avail);
+			}
+			kunmap(page[i]);
+		}
+
+		/* the caller deals with the target page on failure */
+		if (page[i] == target_page) {
+			if (res >= 0) {
+				flush_dcache_page(page[i]);
+				SetPageUptodate(page[i]);
+			}
+			continue;
+		}
+
+		if (res >= 0) {
+			flush_dcache_page(page[i]);
+			SetPageUptodate(page[i]);
+		}
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+
+out:
+	kfree(scratch);
+	kfree(pageaddr);
+	kfree(page);
+	return res < 0 ? res : 0;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -408,6 +508,14 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				(i_size_read(inode) & (msblk->block_size - 1)) :
 				 msblk->block_size;
 			sparse = 1;
+		} else if (msblk->direct_read) {
+			/*
+			 * Read and decompress datablock into the page cache.
+			 */
+			if (squashfs_readpage_direct(page, block, bsize))
+				goto error_out;
+			unlock_page(page);
+			return 0;
 		} else {
 			/*
 			 * Read and decompress datablock.
@@ -28,7 +28,6 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			next_blk;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
@@ -36,10 +35,17 @@ struct squashfs_cache {
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
+	struct hlist_head	*hash;		/* entries by block */
+	int			hash_bits;
+	struct list_head	lru;		/* unused entries, oldest first */
+	unsigned long		hits;
+	unsigned long		misses;
 };
 
 struct squashfs_cache_entry {
 	u64			block;
+	struct hlist_node	hash_node;
+	struct list_head	lru;
 	int			length;
 	int			refcount;
 	u64			next_index;
@@ -53,6 +59,12 @@ struct squashfs_cache_entry {
 
 struct squashfs_sb_info {
 	const struct squashfs_decompressor	*decompressor;
+	const struct squashfs_decompressor_thread_ops	*thread_ops;
+	int					max_decompressors;
+	int					direct_read;
+	int					metadata_cache_entries;
+	int					fragment_cache_entries;
+	struct proc_dir_entry			*proc;
 	int					devblksize;
 	int					devblksize_log2;
 	struct squashfs_cache			*block_cache;
@@ -62,7 +74,6 @@ struct squashfs_sb_info {
 	__le64					*id_table;
 	__le64					*fragment_index;
 	__le64					*xattr_id_table;
-	struct mutex				read_data_mutex;
 	struct mutex				meta_index_mutex;
 	struct meta_index			*meta_index;
 	void					*stream;
@@ -36,6 +36,9 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/proc_fs.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -46,6 +49,114 @@
 
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
+static struct proc_dir_entry *squashfs_proc_root;
+
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU)
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_percpu)
+#elif defined(CONFIG_SQUASHFS_DECOMP_MULTI)
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_multi)
+#else
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_single)
+#endif
+
+enum {
+	Opt_threads_single, Opt_threads_multi, Opt_threads_percpu,
+	Opt_threads_num, Opt_readpage_cache, Opt_readpage_direct,
+	Opt_metadata_cache, Opt_fragment_cache, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_threads_single, "threads=single"},
+	{Opt_threads_multi, "threads=multi"},
+	{Opt_threads_percpu, "threads=percpu"},
+	{Opt_threads_num, "threads=%u"},
+	{Opt_readpage_cache, "readpage=cache"},
+	{Opt_readpage_direct, "readpage=direct"},
+	{Opt_metadata_cache, "metadata_cache=%u"},
+	{Opt_fragment_cache, "fragment_cache=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * threads= chooses how decompression is parallelised: single uses one
+ * stream, percpu one per CPU, multi a pool of up to twice the number of
+ * CPUs and a number a pool of at most that many streams. readpage=direct
+ * decompresses datablocks straight into the page cache instead of going
+ * through the read_page cache.  metadata_cache= and fragment_cache= set
+ * the number of blocks the metadata and fragment caches hold.
+ */
+static int squashfs_parse_options(struct squashfs_sb_info *msblk,
+	char *options)
+{
+	substring_t args[MAX_OPT_ARGS];
+	int token, n;
+	char *p;
+
+	msblk->thread_ops = SQUASHFS_DEFAULT_THREAD_OPS;
+	msblk->metadata_cache_entries = SQUASHFS_CACHED_BLKS;
+	msblk->fragment_cache_entries = SQUASHFS_CACHED_FRAGMENTS;
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+	msblk->direct_read = 1;
+#endif
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_threads_single:
+			msblk->thread_ops = &squashfs_decompressor_single;
+			break;
+		case Opt_threads_multi:
+			msblk->thread_ops = &squashfs_decompressor_multi;
+			msblk->max_decompressors = 0;
+			break;
+		case Opt_threads_percpu:
+			msblk->thread_ops = &squashfs_decompressor_percpu;
+			break;
+		case Opt_threads_num:
+			if (match_int(args, &n) || n < 1)
+				return -EINVAL;
+			if (n == 1) {
+				msblk->thread_ops =
+					&squashfs_decompressor_single;
+				break;
+			}
+			msblk->thread_ops = &squashfs_decompressor_multi;
+			msblk->max_decompressors = n;
+			break;
+		case Opt_readpage_cache:
+			msblk->direct_read = 0;
+			break;
+		case Opt_readpage_direct:
+			msblk->direct_read = 1;
+			break;
+		case Opt_metadata_cache:
+			/* read_blocklist() relies on SQUASHFS_CACHED_BLKS */
+			if (match_int(args, &n) || n < SQUASHFS_CACHED_BLKS ||
+					n > SQUASHFS_MAX_CACHED_BLKS)
+				return -EINVAL;
+			msblk->metadata_cache_entries = n;
+			break;
+		case Opt_fragment_cache:
+			if (match_int(args, &n) || n < 1 ||
+					n > SQUASHFS_MAX_CACHED_BLKS)
+				return -EINVAL;
+			msblk->fragment_cache_entries = n;
+			break;
+		default:
+			ERROR("unrecognised mount option \"%s\" or missing "
+				"value\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
 
 static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 	major, short minor, short id)
@@ -74,6 +185,40 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+/*
+ * /proc/fs/squashfs/<device>/caches: the size of each cache and how often
+ * lookups found their block in it or had to read and decompress it.
+ */
+static int squashfs_caches_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	seq_printf(m, "%-10s %8s %10s %12s %12s\n", "cache", "entries",
+		"block_size", "hits", "misses");
+	squashfs_cache_stats(m, msblk->block_cache);
+	squashfs_cache_stats(m, msblk->fragment_cache);
+	squashfs_cache_stats(m, msblk->read_page);
+
+	return 0;
+}
+
+
+static int squashfs_caches_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, squashfs_caches_show, PDE(inode)->data);
+}
+
+
+static const struct file_operations squashfs_caches_fops = {
+	.owner = THIS_MODULE,
+	.open = squashfs_caches_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -98,9 +243,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -196,24 +344,30 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			msblk->metadata_cache_entries, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
-	if (msblk->read_page == NULL) {
-		ERROR("Failed to allocate read_page block\n");
-		goto failed_mount;
-	}
-
-	msblk->stream = squashfs_decompressor_init(sb, flags);
+	msblk->stream = squashfs_decompressor_setup(sb, flags);
 	if (IS_ERR(msblk->stream)) {
 		err = PTR_ERR(msblk->stream);
 		msblk->stream = NULL;
 		goto failed_mount;
 	}
 
+	/*
+	 * Allocate read_page blocks, one per reader that can decompress at
+	 * the same time unless datablocks are read directly into the page
+	 * cache.
+	 */
+	err = -ENOMEM;
+	msblk->read_page = squashfs_cache_init("data", msblk->direct_read ? 1 :
+		squashfs_max_decompressors(msblk), msblk->block_size);
+	if (msblk->read_page == NULL) {
+		ERROR("Failed to allocate read_page block\n");
+		goto failed_mount;
+	}
+
 	/* Handle xattrs */
 	sb->s_xattr = squashfs_xattr_handlers;
 	xattr_id_table_start = le64_to_cpu(sblk->xattr_id_table_start);
@@ -271,7 +425,7 @@ handle_fragments:
 		goto check_directory_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		msblk->fragment_cache_entries, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -324,6 +478,13 @@ check_directory_table:
 		goto failed_mount;
 	}
 
+	if (squashfs_proc_root) {
+		msblk->proc = proc_mkdir(sb->s_id, squashfs_proc_root);
+		if (msblk->proc)
+			proc_create_data("caches", S_IRUGO, msblk->proc,
+				&squashfs_caches_fops, sb);
+	}
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -332,7 +493,7 @@ failed_mount:
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
-	squashfs_decompressor_free(msblk, msblk->stream);
+	squashfs_decompressor_destroy(msblk);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
@@ -365,6 +526,28 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	if (msblk->thread_ops == &squashfs_decompressor_single)
+		seq_puts(seq, ",threads=single");
+	else if (msblk->thread_ops == &squashfs_decompressor_percpu)
+		seq_puts(seq, ",threads=percpu");
+	else if (msblk->max_decompressors)
+		seq_printf(seq, ",threads=%d", msblk->max_decompressors);
+	else
+		seq_puts(seq, ",threads=multi");
+
+	seq_printf(seq, ",readpage=%s", msblk->direct_read ? "direct" :
+		"cache");
+	seq_printf(seq, ",metadata_cache=%d,fragment_cache=%d",
+		msblk->metadata_cache_entries, msblk->fragment_cache_entries);
+
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -376,10 +559,15 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+
+		if (sbi->proc) {
+			remove_proc_entry("caches", sbi->proc);
+			remove_proc_entry(sb->s_id, squashfs_proc_root);
+		}
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
-		squashfs_decompressor_free(sbi, sbi->stream);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
@@ -432,8 +620,12 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	squashfs_proc_root = proc_mkdir("fs/squashfs", NULL);
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		if (squashfs_proc_root)
+			remove_proc_entry("fs/squashfs", NULL);
 		destroy_inodecache();
 		return err;
 	}
@@ -448,6 +640,8 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	if (squashfs_proc_root)
+		remove_proc_entry("fs/squashfs", NULL);
 	destroy_inodecache();
 }
 
@@ -486,6 +680,7 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
 	.remount_fs = squashfs_remount
 };
 
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/wait.h>
 
 #include <linux/atomic.h>
 
@@ -118,6 +119,12 @@ struct kiocb {
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 
+	/*
+	 * Queued on a page's wait queue by an async buffered read that
+	 * found the page locked, to kick the iocb when it is unlocked.
+	 */
+	struct wait_bit_queue	ki_wait;
+
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
 	 * this is the underlying eventfd context to deliver events to.
@@ -0,0 +1,134 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+
+#include <linux/blkdev.h>
+
+/*
+ * Multi-queue block submission.
+ *
+ * Bios are turned into requests on the submitting CPU and staged on that
+ * CPU's software queue (struct blk_mq_ctx), without queue_lock and without
+ * an elevator. Every CPU maps to one hardware dispatch queue (struct
+ * blk_mq_hw_ctx), which hands the staged requests to the driver through
+ * ->queue_rq. Requests and their driver data are preallocated per hardware
+ * queue and identified by a tag; struct blk_mq_tag_set owns them and
+ * describes the device.
+ */
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned long		*bitmap;	/* allocated tags */
+	struct request		**rqs;
+	atomic_t		active;
+	wait_queue_head_t	wait;		/* for a free tag */
+};
+
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;	/* staged requests */
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	unsigned int		tag_hint;
+	struct blk_mq_hw_ctx	*hctx;
+	struct request_queue	*queue;
+} ____cacheline_aligned_in_smp;
+
+struct blk_mq_hw_ctx {
+	spinlock_t		lock;
+	struct list_head	dispatch;	/* the driver was busy */
+	unsigned long		state;		/* BLK_MQ_S_* */
+	struct work_struct	run_work;
+
+	struct blk_mq_ctx	**ctxs;		/* CPUs mapped here */
+	unsigned int		nr_ctx;
+	unsigned long		*ctx_map;	/* ctxs with staged requests */
+
+	struct request_queue	*queue;
+	struct blk_mq_tags	*tags;
+	unsigned int		queue_num;
+	void			*driver_data;
+
+	unsigned long		queued;
+	unsigned long		run;
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
+typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
+typedef int (init_request_fn)(void *, struct request *, unsigned int,
+			      unsigned int);
+
+struct blk_mq_ops {
+	/*
+	 * Start a request. Called without locks held and must not sleep;
+	 * the CPUs sharing a hardware queue may call it concurrently.
+	 */
+	queue_rq_fn		*queue_rq;
+
+	/*
+	 * Finish a request passed to blk_mq_complete_request(), on the
+	 * submitting CPU. Defaults to blk_mq_end_io(rq, rq->errors).
+	 */
+	softirq_done_fn		*complete;
+
+	init_hctx_fn		*init_hctx;
+	exit_hctx_fn		*exit_hctx;
+
+	/* set up the driver data of a preallocated request */
+	init_request_fn		*init_request;
+};
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* queued to hardware */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* requeue, retried on next run */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end the request with -EIO */
+
+	BLK_MQ_S_STOPPED	= 0,
+
+	BLK_MQ_MAX_DEPTH	= 2048,
+};
+
+struct blk_mq_tag_set {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* per hardware queue */
+	unsigned int		cmd_size;	/* driver data per request */
+	int			numa_node;
+	void			*driver_data;
+
+	struct blk_mq_tags	**tags;
+};
+
+int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set);
+void blk_mq_free_tag_set(struct blk_mq_tag_set *set);
+
+struct request_queue *blk_mq_init_queue(struct blk_mq_tag_set *set);
+void blk_mq_free_queue(struct request_queue *q);
+void blk_mq_release(struct request_queue *q);
+void blk_mq_drain_queue(struct request_queue *q);
+
+void blk_mq_end_io(struct request *rq, int error);
+void blk_mq_complete_request(struct request *rq);
+
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
+void blk_mq_run_queues(struct request_queue *q, bool async);
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx);
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx);
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async);
+
+/* the driver data follows the request */
+static inline void *blk_mq_rq_to_pdu(struct request *rq)
+{
+	return rq + 1;
+}
+
+static inline struct request *blk_mq_rq_from_pdu(void *pdu)
+{
+	return pdu - sizeof(struct request);
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif /* BLK_MQ_H */
@@ -0,0 +1,86 @@
+#ifndef _LINUX_BOOT_PREFETCH_H
+#define _LINUX_BOOT_PREFETCH_H
+
+#include <linux/types.h>
+
+/*
+ * Boot prefetch trace, as read from and written to
+ * /sys/kernel/debug/boot_prefetch: a header followed by nr extents of
+ * pages of files, in host byte order. See mm/boot_prefetch.c.
+ */
+#define BOOT_PREFETCH_MAGIC	0x42505431	/* "BPT1" */
+
+struct boot_prefetch_hdr {
+	__u32	magic;
+	__u32	nr;
+};
+
+struct boot_prefetch_rec {
+	__u32	dev;		/* new_encode_dev() of the superblock's s_dev */
+	__u32	ino;
+	__u32	gen;
+	__u32	index;		/* first page */
+	__u32	nr_pages;
+	__u32	flags;
+};
+
+/* rec flags: read on a miss, or a prefetched page that was used */
+#define BOOT_PREFETCH_MISS	0x1
+#define BOOT_PREFETCH_USED	0x2
+
+#ifdef __KERNEL__
+struct address_space;
+struct list_head;
+
+#ifdef CONFIG_BOOT_PREFETCH
+extern bool boot_prefetch_recording;
+
+extern void __boot_prefetch_miss(struct address_space *mapping,
+				 pgoff_t index);
+extern void __boot_prefetch_pages(struct address_space *mapping,
+				  struct list_head *pages);
+extern void __boot_prefetch_access(struct address_space *mapping,
+				   pgoff_t index);
+
+/* page @index of @mapping is being read in on demand */
+static inline void boot_prefetch_miss(struct address_space *mapping,
+				      pgoff_t index)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_miss(mapping, index);
+}
+
+/* the pages on @pages are being read in by readahead */
+static inline void boot_prefetch_pages(struct address_space *mapping,
+				       struct list_head *pages)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_pages(mapping, pages);
+}
+
+/* page @index of @mapping is being read or faulted */
+static inline void boot_prefetch_access(struct address_space *mapping,
+					pgoff_t index)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_access(mapping, index);
+}
+#else
+static inline void boot_prefetch_miss(struct address_space *mapping,
+				      pgoff_t index)
+{
+}
+
+static inline void boot_prefetch_pages(struct address_space *mapping,
+				       struct list_head *pages)
+{
+}
+
+static inline void boot_prefetch_access(struct address_space *mapping,
+					pgoff_t index)
+{
+}
+#endif
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_BOOT_PREFETCH_H */
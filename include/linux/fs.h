@@ -176,6 +176,7 @@ struct inodes_stat_t {
 #define FS_REQUIRES_DEV 1 
 #define FS_BINARY_MOUNTDATA 2
 #define FS_HAS_SUBTYPE 4
+#define FS_GROUP_FSYNC	8	/* ->sync_fs() can commit for many fsyncs */
 #define FS_REVAL_DOT	16384	/* Check the paths ".", ".." for staleness */
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
@@ -984,6 +985,9 @@ struct file {
 	struct fown_struct	f_owner;
 	const struct cred	*f_cred;
 	struct file_ra_state	f_ra;
+#ifdef CONFIG_READAHEAD_LEARN
+	struct ra_learn		*f_ra_learn;
+#endif
 
 	u64			f_version;
 #ifdef CONFIG_SECURITY
@@ -1471,6 +1475,11 @@ struct super_block {
 	int cleancache_poolid;
 
 	struct shrinker s_shrink;	/* per-sb shrinker handle */
+
+#ifdef CONFIG_FSYNC_BATCH
+	struct fsync_batch *s_fsync_batch;	/* batch taking members */
+	atomic_t s_fsync_writing;	/* fsyncs writing back their data */
+#endif
 };
 
 /* superblock cache pruning functions */
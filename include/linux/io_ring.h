@@ -0,0 +1,98 @@
+/*
+ * include/linux/io_ring.h
+ *
+ * Shared memory submission and completion rings for file I/O, see
+ * fs/io_ring.c.
+ *
+ * IORING_IOC_SETUP on /dev/io_ring returns a new file descriptor for a
+ * ring, whose first map_size bytes are mapped with mmap(): a struct
+ * io_ring_hdr, the submission queue of sq_entries struct io_ring_sqe at
+ * sq_off and the completion queue of cq_entries struct io_ring_cqe at
+ * cq_off. The application fills SQEs at
+ * sq_tail and advances it, the kernel consumes them at sq_head; the
+ * kernel posts CQEs at cq_tail, the application reaps them at cq_head.
+ * Both are free running counters, masked with the queue's mask.
+ */
+#ifndef _LINUX_IO_RING_H
+#define _LINUX_IO_RING_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+struct io_ring_sqe {
+	__u8	opcode;		/* IORING_OP_* */
+	__u8	flags;		/* must be 0 */
+	__u16	ioprio;		/* must be 0 */
+	__s32	fd;
+	__u64	off;		/* file offset */
+	__u64	addr;		/* struct iovec array */
+	__u32	len;		/* iovecs, or bytes to fsync, 0 for all */
+	__u32	op_flags;	/* IORING_FSYNC_*, or poll events */
+	__u64	user_data;	/* passed back in the CQE */
+};
+
+enum {
+	IORING_OP_NOP,
+	IORING_OP_READV,
+	IORING_OP_WRITEV,
+	IORING_OP_FSYNC,
+	IORING_OP_POLL_ADD,
+};
+
+#define IORING_FSYNC_DATASYNC	(1U << 0)
+
+struct io_ring_cqe {
+	__u64	user_data;
+	__s32	res;		/* as the syscall would return */
+	__u32	flags;
+};
+
+struct io_ring_hdr {
+	__u32	sq_head;
+	__u32	sq_tail;
+	__u32	sq_mask;
+	__u32	sq_entries;
+	__u32	cq_head;
+	__u32	cq_tail;
+	__u32	cq_mask;
+	__u32	cq_entries;
+	__u32	flags;		/* IORING_SQ_* */
+	__u32	cq_overflow;	/* completions lost to a full CQ */
+	__u32	sq_off;
+	__u32	cq_off;
+};
+
+/* hdr flags: the SQ thread sleeps, wake it with IORING_ENTER_SQ_WAKEUP */
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)
+
+struct io_ring_params {
+	__u32	sq_entries;	/* in: at least this many, out: rounded up */
+	__u32	cq_entries;	/* out */
+	__u32	flags;		/* IORING_SETUP_* */
+	__u32	sq_thread_idle;	/* ms the SQ thread polls before it sleeps */
+	__u32	map_size;	/* out */
+	__u32	resv[3];
+};
+
+/* setup flags: a kernel thread polls the SQ, no IORING_IOC_ENTER needed */
+#define IORING_SETUP_SQPOLL	(1U << 0)
+
+struct io_ring_enter {
+	__u32	to_submit;	/* SQEs to consume */
+	__u32	min_complete;	/* CQEs to wait for with GETEVENTS */
+	__u32	flags;		/* IORING_ENTER_* */
+	__u32	resv;
+};
+
+/* struct io_ring_enter flags */
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+#define IORING_IOC_MAGIC	0xB8
+
+/* on /dev/io_ring: create a ring, returns its file descriptor */
+#define IORING_IOC_SETUP	_IOWR(IORING_IOC_MAGIC, 0, struct io_ring_params)
+/* on a ring: submit and/or wait, returns the number of SQEs consumed */
+#define IORING_IOC_ENTER	_IOW(IORING_IOC_MAGIC, 1, struct io_ring_enter)
+
+#endif /* _LINUX_IO_RING_H */
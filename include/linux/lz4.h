@@ -0,0 +1,69 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * LZ4 is a fast LZ77 type compressor designed by Yann Collet. The block
+ * format implemented here is compatible with the reference implementation,
+ * see http://code.google.com/p/lz4/
+ */
+
+#include <linux/types.h>
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(u32))
+#define LZ4HC_MEM_COMPRESS	(32768 * sizeof(u32) + 65536 * sizeof(u16) + sizeof(u32))
+
+/*
+ * lz4_compressbound()
+ * Provides the maximum size that LZ4 may output in a "worst case" scenario
+ * (input data not compressible)
+ */
+static inline size_t lz4_compressbound(size_t isize)
+{
+	return isize + (isize / 255) + 16;
+}
+
+/*
+ * lz4_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : on input, the size of dst; on output, the size of the
+ *		compressed data. dst is never overrun: if it is smaller than
+ *		lz4_compressbound(src_len), compression may fail
+ *	wrkmem  : address of the working memory.
+ *		This requires 'workmem' of size LZ4_MEM_COMPRESS.
+ *	return  : 0 on success, -E2BIG if the output did not fit
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4hc_compress()
+ *	Same as lz4_compress(), but searches harder for matches. Slower,
+ *	compresses better, and the output is decompressed just as fast.
+ *	This requires 'workmem' of size LZ4HC_MEM_COMPRESS.
+ */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4_decompress_safe()
+ *	src     : source address of the compressed data
+ *	src_len : size of the compressed data
+ *	dest	: output buffer address of the decompressed data
+ *	dest_len: on input, the size of dest; on output, the size of the
+ *		decompressed data
+ *	return  : 0 on success, -EINVAL if the input is malformed or does
+ *		not decompress into dest_len bytes.
+ *	note :  Never reads outside of src, nor writes outside of dest,
+ *		whatever the input.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+
+#endif
@@ -11,6 +11,7 @@
 #define LINUX_MMC_CARD_H
 
 #include <linux/mmc/core.h>
+#include <linux/mmc/mmc.h>
 #include <linux/mod_devicetable.h>
 
 struct mmc_cid {
@@ -87,6 +88,10 @@ struct mmc_ext_csd {
 	bool			refresh;		/* refresh of blocks supported */
 	__kernel_time_t		last_tv_sec;		/* last time a block was refreshed */
 	__kernel_time_t		last_bkops_tv_sec;	/* last time bkops was done */
+	unsigned int		data_sector_size;	/* 512 bytes or 4KB */
+	u8			max_packed_writes;	/* 500 */
+	u8			max_packed_reads;	/* 501 */
+	bool			packed_event_en;	/* packed failure events */
 };
 
 struct sd_scr {
@@ -161,6 +166,30 @@ struct sdio_cis {
 	unsigned int		max_dtr;
 };
 
+/*
+ * Why the block driver stopped adding requests to a packed command
+ */
+enum mmc_packed_stop_reason {
+	MMC_PACKED_STOP_EMPTY_QUEUE = 0,
+	MMC_PACKED_STOP_WRONG_DATA_DIR,
+	MMC_PACKED_STOP_FLUSH_OR_DISCARD,
+	MMC_PACKED_STOP_REL_WRITE,
+	MMC_PACKED_STOP_LARGE_SEC_ALIGN,
+	MMC_PACKED_STOP_EXCEEDS_SEGMENTS,
+	MMC_PACKED_STOP_EXCEEDS_SECTORS,
+	MMC_PACKED_STOP_MAX_ENTRIES,
+	MMC_PACKED_NR_STOP_REASONS,
+};
+
+struct mmc_packed_stats {
+	spinlock_t		lock;
+	unsigned int		packed[MMC_PACKED_MAX_ENTRIES + 1]; /* by entries */
+	unsigned int		stop[MMC_PACKED_NR_STOP_REASONS];
+	unsigned int		unpacked;	/* writes that went alone */
+	unsigned int		retries;	/* after an indexed failure */
+	unsigned int		failures;
+};
+
 struct mmc_host;
 struct sdio_func;
 struct sdio_func_tuple;
@@ -233,6 +262,7 @@ struct mmc_card {
 	unsigned int		sd_bus_speed;	/* Bus Speed Mode set for the card */
 
 	struct dentry		*debugfs_root;
+	struct mmc_packed_stats	packed_stats;	/* packed write statistics */
 
 	struct timer_list	timer;
 	struct work_struct	bkops;
@@ -328,6 +358,8 @@ static inline void __maybe_unused remove_quirk(struct mmc_card *card, int data)
 #define mmc_card_sd(c)		((c)->type == MMC_TYPE_SD)
 #define mmc_card_sdio(c)	((c)->type == MMC_TYPE_SDIO)
 
+#define mmc_large_sector(c)	((c)->ext_csd.data_sector_size == 4096)
+
 #define mmc_card_present(c)	((c)->state & MMC_STATE_PRESENT)
 #define mmc_card_readonly(c)	((c)->state & MMC_STATE_READONLY)
 #define mmc_card_highspeed(c)	((c)->state & MMC_STATE_HIGHSPEED)
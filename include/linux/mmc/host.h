@@ -238,6 +238,7 @@ struct mmc_host {
 #define MMC_CAP2_POWEROFF_NOTIFY	(1 << 2)	/* Notify poweroff supported */
 #define MMC_CAP2_NO_MULTI_READ	(1 << 3)	/* Multiblock reads don't work */
 #define MMC_CAP2_NO_SLEEP_CMD		(1 << 4)	/* Don't allow sleep command */
+#define MMC_CAP2_PACKED_WR		(1 << 5)	/* Allow packed write */
 
 	mmc_pm_flag_t		pm_caps;	/* supported pm features */
 
@@ -43,6 +43,24 @@ enum oom_constraint {
 extern void compare_swap_oom_score_adj(int old_val, int new_val);
 extern int test_set_oom_score_adj(int new_val);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+extern void lowmem_adj_tree_add(struct task_struct *p);
+extern void lowmem_adj_tree_del(struct task_struct *p);
+extern void lowmem_adj_tree_update(struct task_struct *p);
+#else
+static inline void lowmem_adj_tree_add(struct task_struct *p)
+{
+}
+
+static inline void lowmem_adj_tree_del(struct task_struct *p)
+{
+}
+
+static inline void lowmem_adj_tree_update(struct task_struct *p)
+{
+}
+#endif
+
 extern unsigned long oom_badness(struct task_struct *p,
 		struct mem_cgroup *memcg, const nodemask_t *nodemask,
 		unsigned long totalpages);
@@ -0,0 +1,46 @@
+#ifndef _LINUX_READAHEAD_LEARN_H
+#define _LINUX_READAHEAD_LEARN_H
+
+#include <linux/fs.h>
+
+/*
+ * Readahead from access profiles learned on earlier opens of a file, see
+ * mm/readahead_learn.c.
+ */
+
+struct ra_extent {
+	pgoff_t		start;
+	unsigned int	len;
+};
+
+#ifdef CONFIG_READAHEAD_LEARN
+extern void ra_learn_open(struct file *file);
+extern void ra_learn_release(struct file *file);
+extern void __ra_learn_access(struct file *file, pgoff_t index);
+
+extern unsigned long trace_readahead(struct address_space *mapping,
+				     struct file *filp,
+				     const struct ra_extent *ext,
+				     unsigned int nr);
+
+/* page @index of @file is being read or faulted in */
+static inline void ra_learn_access(struct file *file, pgoff_t index)
+{
+	if (unlikely(file->f_ra_learn))
+		__ra_learn_access(file, index);
+}
+#else
+static inline void ra_learn_open(struct file *file)
+{
+}
+
+static inline void ra_learn_release(struct file *file)
+{
+}
+
+static inline void ra_learn_access(struct file *file, pgoff_t index)
+{
+}
+#endif
+
+#endif /* _LINUX_READAHEAD_LEARN_H */
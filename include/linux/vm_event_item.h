@@ -58,6 +58,14 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+#endif
+#ifdef CONFIG_READAHEAD_LEARN
+		RA_LEARN_RECORD,	/* opens recording a profile */
+		RA_LEARN_REPLAY,	/* opens replaying one */
+		RA_LEARN_PAGES,		/* pages read by replay */
+		RA_LEARN_HIT,		/* first touches the profile predicted */
+		RA_LEARN_MISS,		/* and those it didn't */
+		RA_LEARN_WASTE,		/* predicted, never touched */
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -529,6 +529,41 @@ TRACE_EVENT(f2fs_get_victim,
 		__entry->free)
 );
 
+TRACE_EVENT(f2fs_gc_section,
+
+	TP_PROTO(struct super_block *sb, int gc_type, unsigned int secno,
+			unsigned int valid, unsigned int moved, u64 time),
+
+	TP_ARGS(sb, gc_type, secno, valid, moved, time),
+
+	TP_STRUCT__entry(
+		__field(dev_t,	dev)
+		__field(int,	gc_type)
+		__field(unsigned int,	secno)
+		__field(unsigned int,	valid)
+		__field(unsigned int,	moved)
+		__field(u64,	time)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->gc_type	= gc_type;
+		__entry->secno		= secno;
+		__entry->valid		= valid;
+		__entry->moved		= moved;
+		__entry->time		= time;
+	),
+
+	TP_printk("dev = (%d,%d), %s, secno = %u, valid blocks = %u, "
+		"moved blocks = %u, time = %llu us",
+		show_dev(__entry),
+		show_gc_type(__entry->gc_type),
+		__entry->secno,
+		__entry->valid,
+		__entry->moved,
+		(unsigned long long)div_u64(__entry->time, NSEC_PER_USEC))
+);
+
 TRACE_EVENT(f2fs_fallocate,
 
 	TP_PROTO(struct inode *inode, int mode,
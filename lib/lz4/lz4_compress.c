@@ -0,0 +1,124 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * LZ4 is designed by Yann Collet, see http://code.google.com/p/lz4/
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define LZ4_HASH_LOG	12
+#define SKIP_STRENGTH	6
+
+static inline u32 lz4_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/*
+ * Single pass greedy matcher: the hash table remembers the last position
+ * of every 4 byte sequence. Positions that do not find a match are
+ * skipped at an increasing pace, so incompressible data goes fast.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const u8 *ip = src, *anchor = src, *ref;
+	const u8 *const iend = src + src_len;
+	const u8 *const mflimit = iend - MFLIMIT;
+	const u8 *const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	size_t match_len;
+	u32 h, forward_h;
+
+	if (src_len > (u32)-1)
+		return -EINVAL;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+	if (src_len < MIN_LENGTH)
+		goto last_literals;
+
+	/* first byte */
+	hash_table[lz4_hash(ip)] = 0;
+	ip++;
+	forward_h = lz4_hash(ip);
+
+	for (;;) {
+		const u8 *forward_ip = ip;
+		unsigned int step = 1;
+		unsigned int search = 1 << SKIP_STRENGTH;
+
+		/* find a match */
+		do {
+			h = forward_h;
+			ip = forward_ip;
+			forward_ip += step;
+			step = search++ >> SKIP_STRENGTH;
+
+			if (unlikely(forward_ip > mflimit))
+				goto last_literals;
+
+			ref = src + hash_table[h];
+			forward_h = lz4_hash(forward_ip);
+			hash_table[h] = ip - src;
+		} while (ip - ref > MAX_DISTANCE ||
+			 LZ4_READ32(ref) != LZ4_READ32(ip));
+
+		/* catch up */
+		while (ip > anchor && ref > (const u8 *)src &&
+		       ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (;;) {
+			match_len = MINMATCH + lz4_count(ip + MINMATCH,
+						ref + MINMATCH, matchlimit);
+			op = lz4_encode_sequence(op, oend, anchor, ip - anchor,
+						 match_len, ip - ref);
+			if (!op)
+				return -E2BIG;
+
+			ip += match_len;
+			anchor = ip;
+			if (ip > mflimit)
+				goto last_literals;
+
+			/* fill table */
+			hash_table[lz4_hash(ip - 2)] = ip - 2 - src;
+
+			/* test next position, a match there needs no literals */
+			h = lz4_hash(ip);
+			ref = src + hash_table[h];
+			hash_table[h] = ip - src;
+			if (ip - ref > MAX_DISTANCE ||
+			    LZ4_READ32(ref) != LZ4_READ32(ip))
+				break;
+		}
+
+		/* prepare next loop */
+		ip++;
+		forward_h = lz4_hash(ip);
+	}
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend - anchor);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
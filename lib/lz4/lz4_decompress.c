@@ -0,0 +1,123 @@
+/*
+ * LZ4 Decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * LZ4 is designed by Yann Collet, see http://code.google.com/p/lz4/
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+/*
+ * Read the continuation bytes of a length. Every length is bounded by the
+ * input or output size, so stop as soon as it exceeds @max instead of
+ * letting it wrap around.
+ */
+static inline int lz4_read_length(const u8 **ipp, const u8 *iend,
+				  size_t *len, size_t max)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return -EINVAL;
+		s = *ip++;
+		*len += s;
+		if (unlikely(*len > max))
+			return -EINVAL;
+	} while (s == 255);
+
+	*ipp = ip;
+	return 0;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const u8 *ip = src;
+	const u8 *const iend = src + src_len;
+	u8 *op = dest;
+	u8 *const oend = dest + *dest_len;
+	const u8 *ref;
+	size_t length, offset;
+	unsigned int token;
+	u8 *cpy;
+
+	if (unlikely(!src_len))
+		return -EINVAL;
+
+	for (;;) {
+		/* literals */
+		token = *ip++;
+		length = token >> ML_BITS;
+		if (length == RUN_MASK &&
+		    lz4_read_length(&ip, iend, &length, src_len))
+			goto malformed;
+
+		if (unlikely(length > (size_t)(iend - ip) ||
+			     length > (size_t)(oend - op)))
+			goto malformed;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* match offset */
+		if (unlikely(iend - ip < 2))
+			goto malformed;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dest)))
+			goto malformed;
+		ref = op - offset;
+
+		/* match length */
+		length = token & ML_MASK;
+		if (length == ML_MASK &&
+		    lz4_read_length(&ip, iend, &length, *dest_len))
+			goto malformed;
+		length += MINMATCH;
+		if (unlikely(length > (size_t)(oend - op)))
+			goto malformed;
+
+		/* copy the match, which may overlap its own output */
+		cpy = op + length;
+		if (offset >= sizeof(unsigned long)) {
+			while (op + sizeof(unsigned long) <= cpy) {
+				put_unaligned(LZ4_READLONG(ref),
+					      (unsigned long *)op);
+				op += sizeof(unsigned long);
+				ref += sizeof(unsigned long);
+			}
+		}
+		while (op < cpy)
+			*op++ = *ref++;
+
+		if (unlikely(ip >= iend))
+			goto malformed;
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+malformed:
+	return -EINVAL;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
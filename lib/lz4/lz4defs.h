@@ -0,0 +1,141 @@
+/*
+ * lz4defs.h -- architecture specific defines and the sequence encoder
+ * shared by the LZ4 compressors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
+
+/*
+ * A sequence is a token byte (literal run length in the high nibble,
+ * match length - MINMATCH in the low nibble), extra literal length bytes,
+ * the literals, a little endian 16 bit match offset and extra match
+ * length bytes. A length nibble of 15 is continued by bytes that are
+ * added to it, up to and including the first byte that is not 255.
+ *
+ * The last sequence of a block has literals only. The last LASTLITERALS
+ * bytes of the input are always literals and no match starts in the last
+ * MFLIMIT bytes, which lets decoders copy in words near the end.
+ */
+#define MINMATCH	4
+#define COPYLENGTH	8
+#define LASTLITERALS	5
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+#define MIN_LENGTH	(MFLIMIT + 1)
+
+#define MAXD_LOG	16
+#define MAX_DISTANCE	((1 << MAXD_LOG) - 1)
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
+#define LZ4_READLONG(p)	get_unaligned((const unsigned long *)(p))
+
+/* Number of leading bytes two words have in common, given their xor */
+static inline unsigned int lz4_nb_common_bytes(unsigned long diff)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(diff) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+}
+
+/* Length of the common run at @ip and @match, not reading past @limit */
+static inline size_t lz4_count(const u8 *ip, const u8 *match,
+			       const u8 *limit)
+{
+	const u8 *start = ip;
+	unsigned long diff;
+
+	while (ip + sizeof(unsigned long) <= limit) {
+		diff = LZ4_READLONG(match) ^ LZ4_READLONG(ip);
+		if (diff)
+			return ip - start + lz4_nb_common_bytes(diff);
+		ip += sizeof(unsigned long);
+		match += sizeof(unsigned long);
+	}
+
+	while (ip < limit && *ip == *match) {
+		ip++;
+		match++;
+	}
+
+	return ip - start;
+}
+
+/* Append the continuation bytes of a length that did not fit a nibble */
+static inline u8 *lz4_write_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (u8)len;
+
+	return op;
+}
+
+/*
+ * Emit one sequence: @lit_len literals from @anchor followed by a match
+ * of @match_len (>= MINMATCH) bytes, @offset bytes back. Returns the new
+ * output position, or NULL if the sequence does not fit before @oend.
+ */
+static inline u8 *lz4_encode_sequence(u8 *op, u8 *oend, const u8 *anchor,
+				      size_t lit_len, size_t match_len,
+				      size_t offset)
+{
+	u8 *token;
+
+	match_len -= MINMATCH;
+	if (op + 1 + lit_len / 255 + 1 + lit_len + 2 +
+	    match_len / 255 + 1 > oend)
+		return NULL;
+
+	token = op++;
+	if (lit_len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit_len - RUN_MASK);
+	} else {
+		*token = lit_len << ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	put_unaligned_le16(offset, op);
+	op += 2;
+
+	if (match_len >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_write_length(op, match_len - ML_MASK);
+	} else {
+		*token |= match_len;
+	}
+
+	return op;
+}
+
+/* Emit the final, literals only, sequence */
+static inline u8 *lz4_encode_last_literals(u8 *op, u8 *oend,
+					   const u8 *anchor, size_t lit_len)
+{
+	if (op + 1 + lit_len / 255 + 1 + lit_len > oend)
+		return NULL;
+
+	if (lit_len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit_len - RUN_MASK);
+	} else {
+		*op++ = lit_len << ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+
+	return op + lit_len;
+}
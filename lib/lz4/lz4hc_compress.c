@@ -0,0 +1,158 @@
+/*
+ * LZ4 HC - High Compression Mode of LZ4
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * LZ4 is designed by Yann Collet, see http://code.google.com/p/lz4/
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define LZ4HC_HASH_LOG		15
+#define LZ4HC_HASHTABLESIZE	(1 << LZ4HC_HASH_LOG)
+#define LZ4HC_MAXD		(1 << MAXD_LOG)
+#define LZ4HC_MAXD_MASK		(LZ4HC_MAXD - 1)
+#define LZ4HC_MAX_ATTEMPTS	256
+
+/*
+ * Every position of the input is linked into a chain of earlier positions
+ * with the same hash, so that all candidates within MAX_DISTANCE can be
+ * tried instead of only the most recent one.
+ */
+struct lz4hc_data {
+	/* last position + 1 with a given hash, 0 if none */
+	u32 hash_table[LZ4HC_HASHTABLESIZE];
+	/* distance from a position to the previous one in its chain */
+	u16 chain_table[LZ4HC_MAXD];
+	/* first position not yet inserted */
+	u32 next;
+};
+
+static inline u32 lz4hc_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - LZ4HC_HASH_LOG);
+}
+
+/* Link all positions before @pos into their hash chains */
+static inline void lz4hc_insert(struct lz4hc_data *hc, const u8 *src, u32 pos)
+{
+	u32 h, prev, delta;
+
+	for (; hc->next < pos; hc->next++) {
+		h = lz4hc_hash(src + hc->next);
+		prev = hc->hash_table[h];
+		delta = prev ? hc->next + 1 - prev : 0;
+		if (delta > MAX_DISTANCE)
+			delta = 0;
+		hc->chain_table[hc->next & LZ4HC_MAXD_MASK] = delta;
+		hc->hash_table[h] = hc->next + 1;
+	}
+}
+
+/* Longest match for @ip, 0 if there is none of at least MINMATCH bytes */
+static size_t lz4hc_find_match(struct lz4hc_data *hc, const u8 *src,
+			       const u8 *ip, const u8 *matchlimit,
+			       const u8 **matchpos)
+{
+	int attempts = LZ4HC_MAX_ATTEMPTS;
+	size_t len, best = 0;
+	const u8 *ref;
+	u32 cand;
+	u16 delta;
+
+	lz4hc_insert(hc, src, ip - src);
+
+	cand = hc->hash_table[lz4hc_hash(ip)];
+	while (cand && attempts--) {
+		ref = src + cand - 1;
+		if (ip - ref > MAX_DISTANCE)
+			break;
+
+		/* a longer match must at least differ at its last byte */
+		if (ref[best] == ip[best] && LZ4_READ32(ref) == LZ4_READ32(ip)) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			if (len > best) {
+				best = len;
+				*matchpos = ref;
+			}
+		}
+
+		delta = hc->chain_table[(cand - 1) & LZ4HC_MAXD_MASK];
+		if (!delta)
+			break;
+		cand -= delta;
+	}
+
+	return best;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_data *hc = wrkmem;
+	const u8 *ip = src, *anchor = src, *ref, *ref2;
+	const u8 *const iend = src + src_len;
+	const u8 *const mflimit = iend - MFLIMIT;
+	const u8 *const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	size_t len, len2;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_data) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len > (u32)-1)
+		return -EINVAL;
+
+	memset(hc->hash_table, 0, sizeof(hc->hash_table));
+	hc->next = 0;
+	if (src_len < MIN_LENGTH)
+		goto last_literals;
+
+	/* there is nothing to match the first byte against */
+	ip++;
+	while (ip <= mflimit) {
+		len = lz4hc_find_match(hc, src, ip, matchlimit, &ref);
+		if (!len) {
+			ip++;
+			continue;
+		}
+
+		/* lazy matching: prefer a longer match starting one byte later */
+		while (ip + 1 <= mflimit) {
+			len2 = lz4hc_find_match(hc, src, ip + 1, matchlimit,
+						&ref2);
+			if (len2 <= len)
+				break;
+			ip++;
+			len = len2;
+			ref = ref2;
+		}
+
+		op = lz4_encode_sequence(op, oend, anchor, ip - anchor, len,
+					 ip - ref);
+		if (!op)
+			return -E2BIG;
+
+		ip += len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend - anchor);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4HC compressor");
@@ -0,0 +1,674 @@
+/*
+ * mm/boot_prefetch.c - record the page cache misses of a boot and prefetch
+ * them on the next one
+ *
+ * Boot spends most of its time waiting for small reads of thousands of
+ * files, each issued only when init or a service gets to it. From early
+ * boot on, the pages of files on block devices that are read in on a
+ * miss, by readpage or readahead, are recorded here as extents of
+ * (device, inode, generation, page range) until recording is stopped or
+ * times out. The trace is read from /sys/kernel/debug/boot_prefetch/trace
+ * and saved by userspace.
+ *
+ * On the next boot early init writes the saved trace to
+ * /sys/kernel/debug/boot_prefetch/prefetch, once the filesystems it names
+ * are mounted. The extents are sorted by file and page and merged, and the
+ * pages are read in one plugged batch of readahead, finding the files
+ * through their filesystem's export operations. Misses on pages that were
+ * prefetched are counted as late, and the first access to a prefetched
+ * page is recorded as a used extent, so the new trace again has the whole
+ * of the boot's working set and the ratio of used pages to misses is the
+ * hit rate the prefetch achieved.
+ *
+ * Booting with boot_prefetch=off doesn't record, boot_prefetch=<seconds>
+ * sets the timeout, 0 for none.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/blkdev.h>
+#include <linux/debugfs.h>
+#include <linux/exportfs.h>
+#include <linux/kdev_t.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/boot_prefetch.h>
+
+#define BP_MAX_RECS		65536
+/* records looked at for one to extend */
+#define BP_MERGE_WINDOW		8
+
+/* prefetched extents, sorted, with a bit per page for first use */
+struct bp_extent {
+	struct boot_prefetch_rec rec;
+	unsigned long		base;
+};
+
+struct bp_set {
+	unsigned int		nr;
+	unsigned long		pages;
+	unsigned long		*used;
+	struct bp_extent	ext[];
+};
+
+bool boot_prefetch_recording __read_mostly;
+static bool bp_record_at_boot __initdata = true;
+static unsigned int bp_timeout = 120;
+
+/* protects the records */
+static DEFINE_SPINLOCK(bp_lock);
+static struct boot_prefetch_rec *bp_recs;
+static unsigned int bp_nr_recs;
+
+/* serializes start, stop and prefetch */
+static DEFINE_MUTEX(bp_mutex);
+static struct bp_set __rcu *bp_set;
+static struct task_struct *bp_prefetch_task;
+
+static void bp_timeout_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(bp_timeout_work, bp_timeout_fn);
+
+static struct {
+	atomic_long_t	misses;		/* pages read on demand */
+	atomic_long_t	used;		/* prefetched pages accessed */
+	atomic_long_t	late;		/* prefetched pages read on demand */
+	atomic_long_t	dropped;	/* records lost to a full buffer */
+	unsigned long	files;
+	unsigned long	skipped;	/* files that couldn't be found */
+	unsigned long	pages;		/* pages prefetched */
+} bp_stats;
+
+static int __init boot_prefetch_setup(char *str)
+{
+	if (!strcmp(str, "off"))
+		bp_record_at_boot = false;
+	else if (kstrtouint(str, 10, &bp_timeout))
+		return 0;
+	return 1;
+}
+__setup("boot_prefetch=", boot_prefetch_setup);
+
+static int bp_rec_cmp(const void *a, const void *b)
+{
+	const struct boot_prefetch_rec *x = a, *y = b;
+
+	if (x->dev != y->dev)
+		return x->dev < y->dev ? -1 : 1;
+	if (x->ino != y->ino)
+		return x->ino < y->ino ? -1 : 1;
+	if (x->gen != y->gen)
+		return x->gen < y->gen ? -1 : 1;
+	if (x->index != y->index)
+		return x->index < y->index ? -1 : 1;
+	return 0;
+}
+
+static inline bool bp_same_file(const struct boot_prefetch_rec *x,
+				const struct boot_prefetch_rec *y)
+{
+	return x->dev == y->dev && x->ino == y->ino && x->gen == y->gen;
+}
+
+/* fill in @key for a page of @mapping, if it is one to record */
+static bool bp_key(struct address_space *mapping, pgoff_t index,
+		   struct boot_prefetch_rec *key)
+{
+	struct inode *inode = mapping->host;
+
+	if (!inode || !S_ISREG(inode->i_mode) || !inode->i_sb->s_bdev ||
+	    inode->i_ino > (u32)~0 || index > (u32)~0)
+		return false;
+
+	key->dev = new_encode_dev(inode->i_sb->s_dev);
+	key->ino = inode->i_ino;
+	key->gen = inode->i_generation;
+	key->index = index;
+	key->nr_pages = 1;
+	return true;
+}
+
+static void bp_record(const struct boot_prefetch_rec *key, u32 flags)
+{
+	struct boot_prefetch_rec *r;
+	unsigned int i;
+
+	spin_lock(&bp_lock);
+	if (!boot_prefetch_recording)
+		goto out;
+
+	for (i = bp_nr_recs; i > 0 && i + BP_MERGE_WINDOW > bp_nr_recs; i--) {
+		r = &bp_recs[i - 1];
+		if (!bp_same_file(r, key) || r->flags != flags)
+			continue;
+		if (key->index >= r->index &&
+		    key->index < r->index + r->nr_pages)
+			goto out;
+		if (key->index == r->index + r->nr_pages) {
+			r->nr_pages++;
+			goto out;
+		}
+	}
+
+	if (bp_nr_recs == BP_MAX_RECS) {
+		atomic_long_inc(&bp_stats.dropped);
+		goto out;
+	}
+	r = &bp_recs[bp_nr_recs++];
+	*r = *key;
+	r->flags = flags;
+out:
+	spin_unlock(&bp_lock);
+}
+
+/* the prefetched extent holding @key's page, under rcu_read_lock() */
+static struct bp_extent *bp_set_find(struct bp_set *s,
+				     const struct boot_prefetch_rec *key)
+{
+	unsigned int lo = 0, hi = s->nr, mid;
+	struct bp_extent *e;
+
+	/* last extent starting at or before the page */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (bp_rec_cmp(&s->ext[mid].rec, key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return NULL;
+	e = &s->ext[lo - 1];
+	if (!bp_same_file(&e->rec, key) ||
+	    key->index >= e->rec.index + e->rec.nr_pages)
+		return NULL;
+	return e;
+}
+
+void __boot_prefetch_miss(struct address_space *mapping, pgoff_t index)
+{
+	struct boot_prefetch_rec key;
+	struct bp_set *s;
+
+	if (current == bp_prefetch_task || !bp_key(mapping, index, &key))
+		return;
+
+	atomic_long_inc(&bp_stats.misses);
+	rcu_read_lock();
+	s = rcu_dereference(bp_set);
+	if (s && bp_set_find(s, &key))
+		atomic_long_inc(&bp_stats.late);
+	rcu_read_unlock();
+
+	bp_record(&key, BOOT_PREFETCH_MISS);
+}
+
+void __boot_prefetch_pages(struct address_space *mapping,
+			   struct list_head *pages)
+{
+	struct page *page;
+
+	/* readahead lists its pages last to first */
+	list_for_each_entry_reverse(page, pages, lru)
+		__boot_prefetch_miss(mapping, page->index);
+}
+
+void __boot_prefetch_access(struct address_space *mapping, pgoff_t index)
+{
+	struct boot_prefetch_rec key;
+	struct bp_extent *e;
+	struct bp_set *s;
+	void *page;
+
+	rcu_read_lock();
+	s = rcu_dereference(bp_set);
+	if (!s || !bp_key(mapping, index, &key))
+		goto out;
+	e = bp_set_find(s, &key);
+	if (!e)
+		goto out;
+
+	/* not there any more, the miss will be counted as late */
+	page = radix_tree_lookup(&mapping->page_tree, index);
+	if (!page || radix_tree_exceptional_entry(page))
+		goto out;
+
+	if (test_and_set_bit(e->base + index - e->rec.index, s->used))
+		goto out;
+	atomic_long_inc(&bp_stats.used);
+	bp_record(&key, BOOT_PREFETCH_USED);
+out:
+	rcu_read_unlock();
+}
+
+/* bp_mutex held */
+static int bp_start(void)
+{
+	struct boot_prefetch_rec *recs, *old;
+
+	if (boot_prefetch_recording)
+		return -EBUSY;
+
+	recs = vmalloc(BP_MAX_RECS * sizeof(*recs));
+	if (!recs)
+		return -ENOMEM;
+
+	atomic_long_set(&bp_stats.misses, 0);
+	atomic_long_set(&bp_stats.used, 0);
+	atomic_long_set(&bp_stats.late, 0);
+	atomic_long_set(&bp_stats.dropped, 0);
+
+	spin_lock(&bp_lock);
+	old = bp_recs;
+	bp_recs = recs;
+	bp_nr_recs = 0;
+	boot_prefetch_recording = true;
+	spin_unlock(&bp_lock);
+	vfree(old);
+
+	if (bp_timeout)
+		schedule_delayed_work(&bp_timeout_work, bp_timeout * HZ);
+	return 0;
+}
+
+static void bp_set_free(struct bp_set *s)
+{
+	if (s) {
+		vfree(s->used);
+		vfree(s);
+	}
+}
+
+/* bp_mutex held */
+static void bp_stop(void)
+{
+	struct bp_set *s;
+
+	spin_lock(&bp_lock);
+	boot_prefetch_recording = false;
+	spin_unlock(&bp_lock);
+
+	s = rcu_dereference_protected(bp_set, lockdep_is_held(&bp_mutex));
+	rcu_assign_pointer(bp_set, NULL);
+	synchronize_rcu();
+	bp_set_free(s);
+}
+
+static void bp_timeout_fn(struct work_struct *work)
+{
+	mutex_lock(&bp_mutex);
+	if (boot_prefetch_recording)
+		bp_stop();
+	mutex_unlock(&bp_mutex);
+}
+
+/*
+ * Sort and merge the extents of the trace in @buf into a prefetch set.
+ */
+static struct bp_set *bp_set_build(const void *buf, size_t len)
+{
+	const struct boot_prefetch_hdr *hdr = buf;
+	const struct boot_prefetch_rec *recs = buf + sizeof(*hdr);
+	struct bp_extent *e, *last;
+	struct bp_set *s;
+	unsigned int i, n;
+	u32 end;
+
+	if (len < sizeof(*hdr) || hdr->magic != BOOT_PREFETCH_MAGIC ||
+	    hdr->nr > BP_MAX_RECS ||
+	    len != sizeof(*hdr) + hdr->nr * sizeof(*recs))
+		return ERR_PTR(-EINVAL);
+
+	s = vmalloc(sizeof(*s) + hdr->nr * sizeof(s->ext[0]));
+	if (!s)
+		return ERR_PTR(-ENOMEM);
+
+	for (i = 0; i < hdr->nr; i++)
+		s->ext[i].rec = recs[i];
+	sort(s->ext, hdr->nr, sizeof(s->ext[0]), bp_rec_cmp, NULL);
+
+	s->pages = 0;
+	for (i = 0, n = 0; i < hdr->nr; i++) {
+		e = &s->ext[i];
+		if (!e->rec.nr_pages)
+			continue;
+		last = n ? &s->ext[n - 1] : NULL;
+		if (last && bp_same_file(&last->rec, &e->rec) &&
+		    e->rec.index <= last->rec.index + last->rec.nr_pages) {
+			end = max(last->rec.index + last->rec.nr_pages,
+				  e->rec.index + e->rec.nr_pages);
+			s->pages += end - last->rec.index - last->rec.nr_pages;
+			last->rec.nr_pages = end - last->rec.index;
+			continue;
+		}
+		s->ext[n] = *e;
+		s->ext[n].rec.flags = 0;
+		s->ext[n].base = s->pages;
+		s->pages += e->rec.nr_pages;
+		n++;
+	}
+	s->nr = n;
+
+	s->used = vzalloc(BITS_TO_LONGS(s->pages) * sizeof(long));
+	if (!s->used) {
+		vfree(s);
+		return ERR_PTR(-ENOMEM);
+	}
+	return s;
+}
+
+static struct dentry *bp_get_file(struct super_block *sb,
+				  const struct boot_prefetch_rec *rec)
+{
+	struct fid fid;
+
+	if (!sb || !sb->s_export_op || !sb->s_export_op->fh_to_dentry)
+		return NULL;
+
+	fid.i32.ino = rec->ino;
+	fid.i32.gen = rec->gen;
+	return sb->s_export_op->fh_to_dentry(sb, &fid, 2, FILEID_INO32_GEN);
+}
+
+/* read the pages of @s, file by file, as one batch */
+static void bp_issue(struct bp_set *s)
+{
+	unsigned long budget = totalram_pages / 4;
+	struct super_block *sb = NULL;
+	struct boot_prefetch_rec *rec;
+	struct dentry *dentry;
+	struct inode *inode;
+	struct blk_plug plug;
+	unsigned long nr;
+	unsigned int i, j;
+	dev_t dev;
+	int ret;
+
+	bp_prefetch_task = current;
+	blk_start_plug(&plug);
+
+	for (i = 0; i < s->nr && budget; i = j) {
+		rec = &s->ext[i].rec;
+		for (j = i + 1; j < s->nr && bp_same_file(&s->ext[j].rec, rec);
+		     j++)
+			;
+
+		dev = new_decode_dev(rec->dev);
+		if (!sb || sb->s_dev != dev) {
+			if (sb)
+				drop_super(sb);
+			sb = user_get_super(dev);
+		}
+
+		dentry = bp_get_file(sb, rec);
+		if (IS_ERR_OR_NULL(dentry)) {
+			bp_stats.skipped++;
+			continue;
+		}
+		inode = dentry->d_inode;
+		if (!inode || !S_ISREG(inode->i_mode)) {
+			bp_stats.skipped++;
+			dput(dentry);
+			continue;
+		}
+
+		bp_stats.files++;
+		for (; i < j && budget; i++) {
+			rec = &s->ext[i].rec;
+			nr = min_t(unsigned long, rec->nr_pages, budget);
+			budget -= nr;
+			ret = force_page_cache_readahead(inode->i_mapping, NULL,
+							 rec->index, nr);
+			if (ret > 0)
+				bp_stats.pages += ret;
+		}
+		dput(dentry);
+	}
+
+	blk_finish_plug(&plug);
+	if (sb)
+		drop_super(sb);
+	bp_prefetch_task = NULL;
+}
+
+/* bp_mutex held */
+static int bp_prefetch(const void *buf, size_t len)
+{
+	struct bp_set *s;
+
+	if (rcu_dereference_protected(bp_set, lockdep_is_held(&bp_mutex)))
+		return -EBUSY;
+
+	s = bp_set_build(buf, len);
+	if (IS_ERR(s))
+		return PTR_ERR(s);
+
+	/* only watched for hits while recording */
+	if (boot_prefetch_recording)
+		rcu_assign_pointer(bp_set, s);
+	bp_issue(s);
+	if (!boot_prefetch_recording)
+		bp_set_free(s);
+	return 0;
+}
+
+/*
+ * debugfs: control takes "start" and "stop", trace reads the recorded
+ * trace once recording has stopped, prefetch takes a saved trace in one
+ * open and prefetches it on close, stats shows the counters.
+ */
+struct bp_buf {
+	size_t	len;
+	char	*data;
+};
+
+static int bp_control_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "%s %u\n", boot_prefetch_recording ? "recording" :
+		   "stopped", bp_nr_recs);
+	return 0;
+}
+
+static int bp_control_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bp_control_show, NULL);
+}
+
+static ssize_t bp_control_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char buf[16];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	mutex_lock(&bp_mutex);
+	if (sysfs_streq(buf, "start")) {
+		ret = bp_start();
+	} else if (sysfs_streq(buf, "stop")) {
+		cancel_delayed_work(&bp_timeout_work);
+		bp_stop();
+		ret = 0;
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&bp_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations bp_control_fops = {
+	.open		= bp_control_open,
+	.read		= seq_read,
+	.write		= bp_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int bp_trace_open(struct inode *inode, struct file *file)
+{
+	struct boot_prefetch_hdr *hdr;
+	struct bp_buf *b;
+	int ret = 0;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	mutex_lock(&bp_mutex);
+	if (boot_prefetch_recording) {
+		ret = -EBUSY;
+		goto out;
+	}
+	b->len = sizeof(*hdr) + bp_nr_recs * sizeof(*bp_recs);
+	b->data = vmalloc(b->len);
+	if (!b->data) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	hdr = (struct boot_prefetch_hdr *)b->data;
+	hdr->magic = BOOT_PREFETCH_MAGIC;
+	hdr->nr = bp_nr_recs;
+	if (bp_nr_recs)
+		memcpy(hdr + 1, bp_recs, bp_nr_recs * sizeof(*bp_recs));
+	file->private_data = b;
+out:
+	mutex_unlock(&bp_mutex);
+	if (ret)
+		kfree(b);
+	return ret;
+}
+
+static ssize_t bp_trace_read(struct file *file, char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct bp_buf *b = file->private_data;
+
+	return simple_read_from_buffer(ubuf, count, ppos, b->data, b->len);
+}
+
+static int bp_buf_release(struct inode *inode, struct file *file)
+{
+	struct bp_buf *b = file->private_data;
+
+	vfree(b->data);
+	kfree(b);
+	return 0;
+}
+
+static const struct file_operations bp_trace_fops = {
+	.open		= bp_trace_open,
+	.read		= bp_trace_read,
+	.llseek		= default_llseek,
+	.release	= bp_buf_release,
+};
+
+static int bp_prefetch_open(struct inode *inode, struct file *file)
+{
+	struct bp_buf *b;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+	file->private_data = b;
+	return 0;
+}
+
+static ssize_t bp_prefetch_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct bp_buf *b = file->private_data;
+	size_t max = sizeof(struct boot_prefetch_hdr) +
+		BP_MAX_RECS * sizeof(struct boot_prefetch_rec);
+
+	if (!b->data) {
+		b->data = vmalloc(max);
+		if (!b->data)
+			return -ENOMEM;
+	}
+	return simple_write_to_buffer(b->data, max, ppos, ubuf, count);
+}
+
+static int bp_prefetch_release(struct inode *inode, struct file *file)
+{
+	struct bp_buf *b = file->private_data;
+	int ret = 0;
+
+	if (b->data && file->f_pos) {
+		mutex_lock(&bp_mutex);
+		ret = bp_prefetch(b->data, file->f_pos);
+		mutex_unlock(&bp_mutex);
+		if (ret)
+			pr_warn("boot_prefetch: trace not prefetched: %d\n",
+				ret);
+	}
+	bp_buf_release(inode, file);
+	return ret;
+}
+
+static const struct file_operations bp_prefetch_fops = {
+	.open		= bp_prefetch_open,
+	.write		= bp_prefetch_write,
+	.llseek		= default_llseek,
+	.release	= bp_prefetch_release,
+};
+
+static int bp_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long used = atomic_long_read(&bp_stats.used);
+	unsigned long misses = atomic_long_read(&bp_stats.misses);
+
+	seq_printf(m, "records %u\ndropped %lu\nmisses %lu\n"
+		   "prefetch_files %lu\nprefetch_skipped %lu\n"
+		   "prefetch_pages %lu\nused %lu\nlate %lu\nhit_pct %lu\n",
+		   bp_nr_recs, atomic_long_read(&bp_stats.dropped), misses,
+		   bp_stats.files, bp_stats.skipped, bp_stats.pages, used,
+		   atomic_long_read(&bp_stats.late),
+		   used + misses ? used * 100 / (used + misses) : 0);
+	return 0;
+}
+
+static int bp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bp_stats_show, NULL);
+}
+
+static const struct file_operations bp_stats_fops = {
+	.open		= bp_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init boot_prefetch_init(void)
+{
+	struct dentry *root;
+
+	root = debugfs_create_dir("boot_prefetch", NULL);
+	if (!root)
+		return -ENOMEM;
+	debugfs_create_file("control", 0600, root, NULL, &bp_control_fops);
+	debugfs_create_file("trace", 0400, root, NULL, &bp_trace_fops);
+	debugfs_create_file("prefetch", 0200, root, NULL, &bp_prefetch_fops);
+	debugfs_create_file("stats", 0444, root, NULL, &bp_stats_fops);
+
+	if (bp_record_at_boot) {
+		mutex_lock(&bp_mutex);
+		bp_start();
+		mutex_unlock(&bp_mutex);
+	}
+	return 0;
+}
+fs_initcall(boot_prefetch_init);
@@ -33,6 +33,8 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
+#include <linux/readahead_learn.h>
+#include <linux/boot_prefetch.h>
 #include "internal.h"
 
 /*
@@ -574,6 +576,48 @@ void add_page_wait_queue(struct page *page, wait_queue_t *waiter)
 }
 EXPORT_SYMBOL_GPL(add_page_wait_queue);
 
+/*
+ * An async read doesn't sleep for a locked page: lock @page if it can be
+ * locked right away, otherwise queue @iocb on the page's wait queue, to be
+ * kicked and retried when the page is unlocked. Returns 0 with the page
+ * locked, or -EIOCBRETRY. With @written bytes read already nothing is
+ * queued, the caller returns the short read and is called again.
+ */
+static int lock_page_async(struct page *page, struct kiocb *iocb,
+			   size_t written)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	struct wait_bit_queue *wait = &iocb->ki_wait;
+	unsigned long flags;
+
+	if (trylock_page(page))
+		return 0;
+	if (written)
+		return -EIOCBRETRY;
+
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+	spin_lock_irqsave(&q->lock, flags);
+	__add_wait_queue(q, &wait->wait);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	/* pairs with the barrier in unlock_page() */
+	smp_mb();
+	if (!trylock_page(page))
+		return -EIOCBRETRY;
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (list_empty(&wait->wait.task_list)) {
+		/* kicked already, the retry will do the rest */
+		spin_unlock_irqrestore(&q->lock, flags);
+		unlock_page(page);
+		return -EIOCBRETRY;
+	}
+	list_del_init(&wait->wait.task_list);
+	spin_unlock_irqrestore(&q->lock, flags);
+	return 0;
+}
+
 /**
  * unlock_page - unlock a locked page
  * @page: the page
@@ -1082,6 +1126,7 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @iocb:	async iocb to queue instead of sleeping on I/O, or NULL
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
@@ -1090,7 +1135,8 @@ static void shrink_readahead_size_eio(struct file *filp,
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct kiocb *iocb)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1115,6 +1161,8 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 		unsigned long nr, ret;
 
 		cond_resched();
+		ra_learn_access(filp, index);
+		boot_prefetch_access(mapping, index);
 find_page:
 		page = find_get_page(mapping, index);
 		if (!page) {
@@ -1210,7 +1258,10 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		if (iocb)
+			error = lock_page_async(page, iocb, desc->written);
+		else
+			error = lock_page_killable(page);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1247,7 +1298,11 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			if (iocb)
+				error = lock_page_async(page, iocb,
+							desc->written);
+			else
+				error = lock_page_killable(page);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1294,6 +1349,7 @@ no_cached_page:
 			desc->error = error;
 			goto out;
 		}
+		boot_prefetch_miss(mapping, index);
 		goto readpage;
 	}
 
@@ -1398,6 +1454,7 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		unsigned long nr_segs, loff_t pos)
 {
 	struct file *filp = iocb->ki_filp;
+	struct kiocb *async = is_sync_kiocb(iocb) ? NULL : iocb;
 	ssize_t retval;
 	unsigned long seg = 0;
 	size_t count;
@@ -1446,6 +1503,13 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 				file_accessed(filp);
 				goto out;
 			}
+			/*
+			 * lock_page_async() only sees the buffered bytes and
+			 * would queue the iocb although the DIO part was read:
+			 * read the tail of a short DIO read the blocking way.
+			 */
+			if (retval > 0)
+				async = NULL;
 		}
 	}
 
@@ -1473,7 +1537,7 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor, async);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -1481,6 +1545,12 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		}
 		if (desc.count > 0)
 			break;
+		/*
+		 * An async read queues its iocb only when it made no progress
+		 * in this call: return what was read, the retry continues.
+		 */
+		if (async && retval)
+			break;
 	}
 out:
 	blk_finish_plug(&plug);
@@ -1509,10 +1579,12 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 			return -ENOMEM;
 
 		ret = add_to_page_cache_lru(page, mapping, offset, GFP_KERNEL);
-		if (ret == 0)
+		if (ret == 0) {
+			boot_prefetch_miss(mapping, offset);
 			ret = mapping->a_ops->readpage(file, page);
-		else if (ret == -EEXIST)
+		} else if (ret == -EEXIST) {
 			ret = 0; /* losing race to add is OK */
+		}
 
 		page_cache_release(page);
 
@@ -1618,6 +1690,9 @@ int filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	if (offset >= size)
 		return VM_FAULT_SIGBUS;
 
+	ra_learn_access(file, offset);
+	boot_prefetch_access(mapping, offset);
+
 	/*
 	 * Do we have something in the page cache already?
 	 */
@@ -19,6 +19,8 @@
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
 #include <linux/file.h>
+#include <linux/readahead_learn.h>
+#include <linux/boot_prefetch.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -115,6 +117,7 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	unsigned page_idx;
 	int ret;
 
+	boot_prefetch_pages(mapping, pages);
 	blk_start_plug(&plug);
 
 	if (mapping->a_ops->readpages) {
@@ -240,6 +243,44 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
+#ifdef CONFIG_READAHEAD_LEARN
+/*
+ * Readahead from a saved access trace: start reading the @nr extents at
+ * @ext, in trace order and under one plug, so that a scattered trace goes
+ * out as one batch. Nothing is waited for. Returns the number of pages
+ * read, which is at most max_sane_readahead() allows.
+ */
+unsigned long trace_readahead(struct address_space *mapping, struct file *filp,
+			      const struct ra_extent *ext, unsigned int nr)
+{
+	unsigned long budget = max_sane_readahead(ULONG_MAX);
+	unsigned long this_chunk, ret = 0;
+	struct blk_plug plug;
+	unsigned int i;
+
+	if (unlikely(!mapping->a_ops->readpage && !mapping->a_ops->readpages))
+		return 0;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr && budget; i++) {
+		pgoff_t offset = ext[i].start;
+		unsigned long len = min_t(unsigned long, ext[i].len, budget);
+
+		budget -= len;
+		while (len) {
+			this_chunk = min_t(unsigned long, len,
+					   (2 * 1024 * 1024) / PAGE_CACHE_SIZE);
+			ret += __do_page_cache_readahead(mapping, filp, offset,
+							 this_chunk, 0);
+			offset += this_chunk;
+			len -= this_chunk;
+		}
+	}
+	blk_finish_plug(&plug);
+	return ret;
+}
+#endif
+
 /*
  * Given a desired number of PAGE_CACHE_SIZE readahead pages, return a
  * sensible upper limit.
@@ -0,0 +1,491 @@
+/*
+ * mm/readahead_learn.c - readahead from learned per-file access profiles
+ *
+ * An app launch reads its APK, dex files and libraries in a scattered
+ * pattern that the sequential window in readahead.c can't predict, so a
+ * cold start is a long string of small synchronous reads. Here the pages
+ * the first learn_opens opens of a file touch are recorded, in the order
+ * they were first touched, into a profile of the file kept by device,
+ * inode number and generation, mtime and size. Later opens of the same,
+ * unmodified, file read the whole profile at once with trace_readahead(),
+ * before the app asks for any of it.
+ *
+ * Only read-only opens of regular files with readahead and of at most
+ * RA_LEARN_MAX_PAGES are profiled. Profiles live in memory, at most
+ * max_profiles of them, the least recently opened going first.
+ *
+ * /proc/vmstat counts the opens that recorded and replayed a profile and
+ * the pages replay read. For replaying opens, the first touch of a page
+ * is a hit if the profile had it and a miss if not, and the pages the
+ * profile had that weren't touched before the file was closed are waste.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/hash.h>
+#include <linux/kobject.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/vmstat.h>
+#include <linux/readahead_learn.h>
+
+#define RA_LEARN_MAX_PAGES	((128 << 20) >> PAGE_CACHE_SHIFT)
+#define RA_LEARN_MAX_EXTENTS	256
+#define RA_LEARN_HASH_BITS	8
+
+/* an access trace, in the order the pages were first touched */
+struct ra_trace {
+	struct kref		ref;
+	unsigned int		nr;
+	struct ra_extent	ext[];
+};
+
+struct ra_profile {
+	struct hlist_node	hash;
+	struct list_head	lru;
+	struct kref		ref;
+
+	dev_t			dev;
+	unsigned long		ino;
+	u32			generation;
+	struct timespec		mtime;
+	loff_t			size;
+
+	unsigned int		opens;		/* opens learned from */
+	struct ra_trace		*trace;
+};
+
+/* per open file */
+struct ra_learn {
+	struct ra_profile	*profile;
+	struct ra_trace		*base;		/* profile's trace at open */
+	struct ra_trace		*rec;		/* recording, NULL if replaying */
+	spinlock_t		lock;		/* protects rec */
+	unsigned long		nr_pages;
+	unsigned long		*predicted;	/* replaying */
+	unsigned long		seen[];
+};
+
+static bool ra_learn_enabled __read_mostly = true;
+static unsigned int ra_learn_opens __read_mostly = 2;
+static unsigned int ra_learn_max_profiles __read_mostly = 1024;
+
+/* protects the hash, the LRU and every profile's opens and trace */
+static DEFINE_SPINLOCK(ra_learn_lock);
+static struct hlist_head ra_profile_hash[1 << RA_LEARN_HASH_BITS];
+static LIST_HEAD(ra_profile_lru);
+static unsigned int ra_nr_profiles;
+
+static struct ra_trace *ra_trace_alloc(unsigned int nr, gfp_t gfp)
+{
+	struct ra_trace *t;
+
+	t = kmalloc(sizeof(*t) + nr * sizeof(t->ext[0]), gfp);
+	if (!t)
+		return NULL;
+	kref_init(&t->ref);
+	t->nr = 0;
+	return t;
+}
+
+static void ra_trace_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct ra_trace, ref));
+}
+
+static void ra_trace_put(struct ra_trace *t)
+{
+	if (t)
+		kref_put(&t->ref, ra_trace_free);
+}
+
+static void ra_profile_free(struct kref *ref)
+{
+	struct ra_profile *p = container_of(ref, struct ra_profile, ref);
+
+	ra_trace_put(p->trace);
+	kfree(p);
+}
+
+static inline struct hlist_head *ra_profile_bucket(dev_t dev,
+						   unsigned long ino)
+{
+	return &ra_profile_hash[hash_long(ino ^ dev, RA_LEARN_HASH_BITS)];
+}
+
+/* ra_learn_lock held */
+static void ra_profile_unhash(struct ra_profile *p)
+{
+	hlist_del_init(&p->hash);
+	list_del_init(&p->lru);
+	ra_nr_profiles--;
+	kref_put(&p->ref, ra_profile_free);
+}
+
+static void ra_profile_trim(unsigned int max)
+{
+	while (ra_nr_profiles > max)
+		ra_profile_unhash(list_first_entry(&ra_profile_lru,
+						   struct ra_profile, lru));
+}
+
+static bool ra_profile_matches(struct ra_profile *p, struct inode *inode)
+{
+	return p->generation == inode->i_generation &&
+		timespec_equal(&p->mtime, &inode->i_mtime) &&
+		p->size == i_size_read(inode);
+}
+
+/*
+ * Find @inode's profile, dropping one of an earlier version of the file,
+ * and move it to the tail of the LRU. ra_learn_lock held.
+ */
+static struct ra_profile *ra_profile_lookup(struct inode *inode)
+{
+	dev_t dev = inode->i_sb->s_dev;
+	struct hlist_node *node;
+	struct ra_profile *p;
+
+	hlist_for_each_entry(p, node, ra_profile_bucket(dev, inode->i_ino),
+			     hash) {
+		if (p->dev != dev || p->ino != inode->i_ino)
+			continue;
+		if (!ra_profile_matches(p, inode)) {
+			ra_profile_unhash(p);
+			return NULL;
+		}
+		list_move_tail(&p->lru, &ra_profile_lru);
+		return p;
+	}
+	return NULL;
+}
+
+/*
+ * Return @inode's profile, creating an empty one if it has none, with a
+ * reference held, or NULL without memory.
+ */
+static struct ra_profile *ra_profile_get(struct inode *inode)
+{
+	struct ra_profile *p, *new;
+
+	spin_lock(&ra_learn_lock);
+	p = ra_profile_lookup(inode);
+	if (p)
+		goto found;
+	spin_unlock(&ra_learn_lock);
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+	/* the initial reference is the hash's */
+	kref_init(&new->ref);
+	INIT_LIST_HEAD(&new->lru);
+	new->dev = inode->i_sb->s_dev;
+	new->ino = inode->i_ino;
+	new->generation = inode->i_generation;
+	new->mtime = inode->i_mtime;
+	new->size = i_size_read(inode);
+
+	spin_lock(&ra_learn_lock);
+	p = ra_profile_lookup(inode);
+	if (p) {
+		kfree(new);
+		goto found;
+	}
+	p = new;
+	hlist_add_head(&p->hash, ra_profile_bucket(p->dev, p->ino));
+	list_add_tail(&p->lru, &ra_profile_lru);
+	ra_nr_profiles++;
+found:
+	kref_get(&p->ref);
+	ra_profile_trim(ra_learn_max_profiles);
+	spin_unlock(&ra_learn_lock);
+	return p;
+}
+
+static void ra_trace_mark(const struct ra_trace *t, unsigned long *map,
+			  unsigned long nr_pages)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->nr; i++) {
+		if (t->ext[i].start >= nr_pages)
+			continue;
+		bitmap_set(map, t->ext[i].start,
+			   min_t(unsigned long, t->ext[i].len,
+				 nr_pages - t->ext[i].start));
+	}
+}
+
+/**
+ * ra_learn_open - start recording or replay the profile for a new open
+ * @file: the file just opened
+ *
+ * Called at the end of a successful open.
+ */
+void ra_learn_open(struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct ra_profile *p;
+	struct ra_trace *trace;
+	struct ra_learn *l;
+	unsigned long nr_pages, longs;
+	bool replay;
+
+	if (!ra_learn_enabled || !S_ISREG(inode->i_mode) ||
+	    (file->f_mode & (FMODE_READ | FMODE_WRITE)) != FMODE_READ ||
+	    (file->f_flags & O_DIRECT) || !file->f_ra.ra_pages ||
+	    !mapping->a_ops->readpage)
+		return;
+
+	nr_pages = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	if (!nr_pages || nr_pages > RA_LEARN_MAX_PAGES)
+		return;
+
+	p = ra_profile_get(inode);
+	if (!p)
+		return;
+
+	spin_lock(&ra_learn_lock);
+	trace = p->trace;
+	if (trace)
+		kref_get(&trace->ref);
+	replay = p->opens >= ra_learn_opens && trace && trace->nr;
+	spin_unlock(&ra_learn_lock);
+
+	longs = BITS_TO_LONGS(nr_pages);
+	l = kzalloc(sizeof(*l) + (replay ? 2 : 1) * longs * sizeof(long),
+		    GFP_KERNEL);
+	if (!l)
+		goto out;
+	l->profile = p;
+	l->nr_pages = nr_pages;
+	spin_lock_init(&l->lock);
+
+	if (replay) {
+		l->predicted = l->seen + longs;
+		ra_trace_mark(trace, l->predicted, nr_pages);
+		count_vm_event(RA_LEARN_REPLAY);
+		count_vm_events(RA_LEARN_PAGES,
+				trace_readahead(mapping, file, trace->ext,
+						trace->nr));
+		ra_trace_put(trace);
+	} else {
+		/* start from what is known, record only what is new */
+		l->rec = ra_trace_alloc(RA_LEARN_MAX_EXTENTS, GFP_KERNEL);
+		if (!l->rec) {
+			kfree(l);
+			goto out;
+		}
+		if (trace) {
+			memcpy(l->rec->ext, trace->ext,
+			       trace->nr * sizeof(trace->ext[0]));
+			l->rec->nr = trace->nr;
+			ra_trace_mark(trace, l->seen, nr_pages);
+		}
+		l->base = trace;
+		count_vm_event(RA_LEARN_RECORD);
+	}
+
+	file->f_ra_learn = l;
+	return;
+out:
+	ra_trace_put(trace);
+	kref_put(&p->ref, ra_profile_free);
+}
+
+/**
+ * __ra_learn_access - note an access to a page
+ * @file: the file being read
+ * @index: the page read or faulted
+ */
+void __ra_learn_access(struct file *file, pgoff_t index)
+{
+	struct ra_learn *l = file->f_ra_learn;
+	struct ra_trace *rec = l->rec;
+	struct ra_extent *last;
+
+	if (index >= l->nr_pages || test_and_set_bit(index, l->seen))
+		return;
+
+	if (!rec) {
+		if (test_bit(index, l->predicted))
+			count_vm_event(RA_LEARN_HIT);
+		else
+			count_vm_event(RA_LEARN_MISS);
+		return;
+	}
+
+	spin_lock(&l->lock);
+	last = rec->nr ? &rec->ext[rec->nr - 1] : NULL;
+	if (last && index == last->start + last->len) {
+		last->len++;
+	} else if (rec->nr < RA_LEARN_MAX_EXTENTS) {
+		rec->ext[rec->nr].start = index;
+		rec->ext[rec->nr].len = 1;
+		rec->nr++;
+	}
+	spin_unlock(&l->lock);
+}
+
+/*
+ * Make what this open recorded the profile's trace, unless another open
+ * of the file got there first.
+ */
+static void ra_learn_commit(struct ra_learn *l)
+{
+	struct ra_profile *p = l->profile;
+	struct ra_trace *rec = l->rec, *old = NULL, *t;
+
+	t = krealloc(rec, sizeof(*rec) + rec->nr * sizeof(rec->ext[0]),
+		     GFP_KERNEL);
+	if (t)
+		rec = t;
+
+	spin_lock(&ra_learn_lock);
+	if (p->trace == l->base && !hlist_unhashed(&p->hash) &&
+	    p->opens < ra_learn_opens) {
+		old = p->trace;
+		p->trace = rec;
+		p->opens++;
+		rec = NULL;
+	}
+	spin_unlock(&ra_learn_lock);
+
+	ra_trace_put(old);
+	ra_trace_put(rec);
+}
+
+/**
+ * ra_learn_release - finish recording or account the replay for an open
+ * @file: the file being closed
+ */
+void ra_learn_release(struct file *file)
+{
+	struct ra_learn *l = file->f_ra_learn;
+
+	if (!l)
+		return;
+	file->f_ra_learn = NULL;
+
+	if (l->rec) {
+		ra_learn_commit(l);
+		ra_trace_put(l->base);
+	} else {
+		bitmap_andnot(l->predicted, l->predicted, l->seen, l->nr_pages);
+		count_vm_events(RA_LEARN_WASTE,
+				bitmap_weight(l->predicted, l->nr_pages));
+	}
+
+	kref_put(&l->profile->ref, ra_profile_free);
+	kfree(l);
+}
+
+/*
+ * sysfs: enabled, learn_opens (how many opens of a file are recorded
+ * before it is replayed), max_profiles and the number of profiles kept.
+ */
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ra_learn_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	ra_learn_enabled = !!val;
+	return count;
+}
+
+static ssize_t learn_opens_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ra_learn_opens);
+}
+
+static ssize_t learn_opens_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+	if (val < 1 || val > 64)
+		return -EINVAL;
+	ra_learn_opens = val;
+	return count;
+}
+
+static ssize_t max_profiles_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ra_learn_max_profiles);
+}
+
+static ssize_t max_profiles_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+
+	spin_lock(&ra_learn_lock);
+	ra_learn_max_profiles = val;
+	ra_profile_trim(val);
+	spin_unlock(&ra_learn_lock);
+	return count;
+}
+
+static ssize_t profiles_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ra_nr_profiles);
+}
+
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+static struct kobj_attribute learn_opens_attr =
+	__ATTR(learn_opens, 0644, learn_opens_show, learn_opens_store);
+static struct kobj_attribute max_profiles_attr =
+	__ATTR(max_profiles, 0644, max_profiles_show, max_profiles_store);
+static struct kobj_attribute profiles_attr = __ATTR_RO(profiles);
+
+static struct attribute *ra_learn_attrs[] = {
+	&enabled_attr.attr,
+	&learn_opens_attr.attr,
+	&max_profiles_attr.attr,
+	&profiles_attr.attr,
+	NULL,
+};
+
+static struct attribute_group ra_learn_attr_group = {
+	.attrs = ra_learn_attrs,
+	.name = "readahead_learn",
+};
+
+static int __init ra_learn_init(void)
+{
+	return sysfs_create_group(mm_kobj, &ra_learn_attr_group);
+}
+module_init(ra_learn_init);
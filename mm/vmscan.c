@@ -42,6 +42,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/vmpressure.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -2147,6 +2148,8 @@ static void shrink_zone(int priority, struct zone *zone,
 		.zone = zone,
 		.priority = priority,
 	};
+	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	unsigned long nr_scanned = sc->nr_scanned;
 	struct mem_cgroup *memcg;
 
 	memcg = mem_cgroup_iter(root, NULL, &reclaim);
@@ -2155,8 +2158,15 @@ static void shrink_zone(int priority, struct zone *zone,
 			.mem_cgroup = memcg,
 			.zone = zone,
 		};
+		unsigned long memcg_reclaimed = sc->nr_reclaimed;
+		unsigned long memcg_scanned = sc->nr_scanned;
 
 		shrink_mem_cgroup_zone(priority, &mz, sc);
+
+		if (memcg)
+			vmpressure(sc->gfp_mask, memcg,
+				   sc->nr_scanned - memcg_scanned,
+				   sc->nr_reclaimed - memcg_reclaimed);
 		/*
 		 * Limit reclaim has historically picked one memcg and
 		 * scanned it with decreasing priority levels until
@@ -2173,6 +2183,10 @@ static void shrink_zone(int priority, struct zone *zone,
 		}
 		memcg = mem_cgroup_iter(root, memcg, &reclaim);
 	} while (memcg);
+
+	if (global_reclaim(sc))
+		vmpressure(sc->gfp_mask, NULL, sc->nr_scanned - nr_scanned,
+			   sc->nr_reclaimed - nr_reclaimed);
 }
 
 /*
@@ -2335,6 +2349,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		count_vm_event(ALLOCSTALL);
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
+		vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup, priority);
 		sc->nr_scanned = 0;
 		if (shrink_zones(priority, zonelist, sc))
 			break;
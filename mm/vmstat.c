@@ -786,6 +786,14 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc_failed",
 	"thp_split",
 #endif
+#ifdef CONFIG_READAHEAD_LEARN
+	"ra_learn_record",
+	"ra_learn_replay",
+	"ra_learn_pages",
+	"ra_learn_hit",
+	"ra_learn_miss",
+	"ra_learn_waste",
+#endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
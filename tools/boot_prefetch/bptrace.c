@@ -0,0 +1,337 @@
+/*
+ * bptrace: convert boot prefetch traces and report on them
+ *
+ * A trace is what /sys/kernel/debug/boot_prefetch/trace gives after a
+ * boot, and what is written to .../prefetch on the next one: extents of
+ * pages of files, as device, inode, generation, first page and number of
+ * pages. Extents are flagged M if they were read on a miss, U if they were
+ * prefetched and used; the prefetch input has no flags.
+ *
+ *   bptrace text trace		print a trace as text, sorted and merged
+ *   bptrace pack text		turn such text back into a trace, on stdout
+ *   bptrace merge trace...	sorted and merged union of traces, on stdout
+ *   bptrace report predicted actual
+ *
+ * report compares the trace that was prefetched with the one recorded on
+ * the same boot. The predicted hit rate is the part of the boot's working
+ * set, everything missed or used, that the prefetch covered, and the
+ * accuracy the part of what it read that was needed. The actual hit rate
+ * is the part of the working set that was found prefetched when asked for,
+ * which is lower when prefetched pages were evicted or read too late.
+ *
+ * Compile with:
+ *
+ * gcc -O2 -Wall -o bptrace bptrace.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* as in include/linux/boot_prefetch.h */
+#define BOOT_PREFETCH_MAGIC	0x42505431
+#define BOOT_PREFETCH_MISS	0x1
+#define BOOT_PREFETCH_USED	0x2
+
+struct boot_prefetch_hdr {
+	uint32_t magic;
+	uint32_t nr;
+};
+
+struct boot_prefetch_rec {
+	uint32_t dev;
+	uint32_t ino;
+	uint32_t gen;
+	uint32_t index;
+	uint32_t nr_pages;
+	uint32_t flags;
+};
+
+struct trace {
+	struct boot_prefetch_rec *recs;
+	size_t nr;
+	size_t max;
+};
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		perror("realloc");
+		exit(1);
+	}
+	return p;
+}
+
+static void trace_add(struct trace *t, const struct boot_prefetch_rec *r)
+{
+	if (t->nr == t->max) {
+		t->max = t->max ? t->max * 2 : 1024;
+		t->recs = xrealloc(t->recs, t->max * sizeof(*t->recs));
+	}
+	t->recs[t->nr++] = *r;
+}
+
+static void trace_read(struct trace *t, const char *path)
+{
+	struct boot_prefetch_hdr hdr;
+	struct boot_prefetch_rec r;
+	FILE *f;
+	uint32_t i;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    hdr.magic != BOOT_PREFETCH_MAGIC) {
+		fprintf(stderr, "%s: not a boot prefetch trace\n", path);
+		exit(1);
+	}
+	for (i = 0; i < hdr.nr; i++) {
+		if (fread(&r, sizeof(r), 1, f) != 1) {
+			fprintf(stderr, "%s: truncated\n", path);
+			exit(1);
+		}
+		trace_add(t, &r);
+	}
+	fclose(f);
+}
+
+static void trace_write(const struct trace *t)
+{
+	struct boot_prefetch_hdr hdr = {
+		.magic = BOOT_PREFETCH_MAGIC,
+		.nr = t->nr,
+	};
+
+	if (fwrite(&hdr, sizeof(hdr), 1, stdout) != 1 ||
+	    fwrite(t->recs, sizeof(*t->recs), t->nr, stdout) != t->nr) {
+		perror("write");
+		exit(1);
+	}
+}
+
+static int same_file(const struct boot_prefetch_rec *x,
+		     const struct boot_prefetch_rec *y)
+{
+	return x->dev == y->dev && x->ino == y->ino && x->gen == y->gen;
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const struct boot_prefetch_rec *x = a, *y = b;
+
+	if (x->dev != y->dev)
+		return x->dev < y->dev ? -1 : 1;
+	if (x->ino != y->ino)
+		return x->ino < y->ino ? -1 : 1;
+	if (x->gen != y->gen)
+		return x->gen < y->gen ? -1 : 1;
+	if (x->index != y->index)
+		return x->index < y->index ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort and merge overlapping and adjacent extents of a file. With
+ * @keep_flags only extents with the same flags are merged, and overlaps
+ * between differently flagged ones are left alone.
+ */
+static void trace_normalize(struct trace *t, int keep_flags)
+{
+	struct boot_prefetch_rec *last, *r;
+	size_t i, n = 0;
+	uint64_t end;
+
+	qsort(t->recs, t->nr, sizeof(*t->recs), rec_cmp);
+	for (i = 0; i < t->nr; i++) {
+		r = &t->recs[i];
+		if (!r->nr_pages)
+			continue;
+		if (!keep_flags)
+			r->flags = 0;
+		last = n ? &t->recs[n - 1] : NULL;
+		if (last && same_file(last, r) && last->flags == r->flags &&
+		    r->index <= (uint64_t)last->index + last->nr_pages) {
+			end = (uint64_t)r->index + r->nr_pages;
+			if (end > (uint64_t)last->index + last->nr_pages)
+				last->nr_pages = end - last->index;
+			continue;
+		}
+		t->recs[n++] = *r;
+	}
+	t->nr = n;
+}
+
+static unsigned long long trace_pages(const struct trace *t, uint32_t flags)
+{
+	unsigned long long pages = 0;
+	size_t i;
+
+	for (i = 0; i < t->nr; i++)
+		if (!flags || (t->recs[i].flags & flags))
+			pages += t->recs[i].nr_pages;
+	return pages;
+}
+
+/* pages in both of two normalized, flagless traces */
+static unsigned long long trace_overlap(const struct trace *a,
+					const struct trace *b)
+{
+	unsigned long long pages = 0;
+	uint64_t lo, hi, ea, eb;
+	size_t i = 0, j = 0;
+	int c;
+
+	while (i < a->nr && j < b->nr) {
+		const struct boot_prefetch_rec *x = &a->recs[i], *y = &b->recs[j];
+
+		if (!same_file(x, y)) {
+			c = rec_cmp(x, y);
+			if (c < 0)
+				i++;
+			else
+				j++;
+			continue;
+		}
+		ea = (uint64_t)x->index + x->nr_pages;
+		eb = (uint64_t)y->index + y->nr_pages;
+		lo = x->index > y->index ? x->index : y->index;
+		hi = ea < eb ? ea : eb;
+		if (hi > lo)
+			pages += hi - lo;
+		if (ea < eb)
+			i++;
+		else
+			j++;
+	}
+	return pages;
+}
+
+static void cmd_text(const char *path)
+{
+	struct trace t = { 0 };
+	size_t i;
+
+	trace_read(&t, path);
+	trace_normalize(&t, 1);
+	for (i = 0; i < t.nr; i++) {
+		struct boot_prefetch_rec *r = &t.recs[i];
+
+		printf("%u:%u %u %u %u+%u %s\n",
+		       (r->dev & 0xfff00) >> 8,
+		       (r->dev & 0xff) | ((r->dev >> 12) & 0xfff00),
+		       r->ino, r->gen, r->index, r->nr_pages,
+		       r->flags & BOOT_PREFETCH_USED ? "U" :
+		       r->flags & BOOT_PREFETCH_MISS ? "M" : "-");
+	}
+}
+
+static void cmd_pack(const char *path)
+{
+	struct boot_prefetch_rec r;
+	struct trace t = { 0 };
+	unsigned int major, minor;
+	char line[256], flag;
+	FILE *f;
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		flag = '-';
+		if (sscanf(line, "%u:%u %u %u %u+%u %c", &major, &minor,
+			   &r.ino, &r.gen, &r.index, &r.nr_pages, &flag) < 6) {
+			fprintf(stderr, "bad line: %s", line);
+			exit(1);
+		}
+		/* new_encode_dev() */
+		r.dev = (minor & 0xff) | (major << 8) | ((minor & ~0xff) << 12);
+		r.flags = flag == 'U' ? BOOT_PREFETCH_USED :
+			flag == 'M' ? BOOT_PREFETCH_MISS : 0;
+		trace_add(&t, &r);
+	}
+	trace_normalize(&t, 1);
+	trace_write(&t);
+}
+
+static void cmd_merge(int argc, char **argv)
+{
+	struct trace t = { 0 };
+	int i;
+
+	for (i = 0; i < argc; i++)
+		trace_read(&t, argv[i]);
+	trace_normalize(&t, 0);
+	trace_write(&t);
+}
+
+static void cmd_report(const char *predicted, const char *actual)
+{
+	struct trace p = { 0 }, a = { 0 }, ws = { 0 };
+	unsigned long long pred, used, missed, work, covered;
+
+	trace_read(&p, predicted);
+	trace_read(&a, actual);
+
+	used = trace_pages(&a, BOOT_PREFETCH_USED);
+	missed = trace_pages(&a, BOOT_PREFETCH_MISS);
+
+	/* the working set is everything used or missed */
+	trace_read(&ws, actual);
+	trace_normalize(&ws, 0);
+	trace_normalize(&p, 0);
+
+	pred = trace_pages(&p, 0);
+	work = trace_pages(&ws, 0);
+	covered = trace_overlap(&p, &ws);
+
+	printf("predicted pages     %llu\n", pred);
+	printf("working set pages   %llu\n", work);
+	printf("  used prefetched   %llu\n", used);
+	printf("  missed            %llu\n", missed);
+	printf("predicted hit rate  %.1f%%\n",
+	       work ? 100.0 * covered / work : 0.0);
+	printf("accuracy            %.1f%%\n",
+	       pred ? 100.0 * covered / pred : 0.0);
+	printf("actual hit rate     %.1f%%\n",
+	       used + missed ? 100.0 * used / (used + missed) : 0.0);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: bptrace text trace\n"
+		"       bptrace pack text|- > trace\n"
+		"       bptrace merge trace... > trace\n"
+		"       bptrace report predicted actual\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage();
+
+	if (!strcmp(argv[1], "text") && argc == 3)
+		cmd_text(argv[2]);
+	else if (!strcmp(argv[1], "pack") && argc == 3)
+		cmd_pack(argv[2]);
+	else if (!strcmp(argv[1], "merge"))
+		cmd_merge(argc - 2, argv + 2);
+	else if (!strcmp(argv[1], "report") && argc == 4)
+		cmd_report(argv[2], argv[3]);
+	else
+		usage();
+	return 0;
+}
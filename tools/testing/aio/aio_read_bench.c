@@ -0,0 +1,261 @@
+/*
+ * aio_read_bench.c - Buffered AIO read throughput by queue depth
+ *
+ * One thread keeps 1, 2, 4 ... up to the given number of reads of a file
+ * in flight with io_submit() and reaps them with io_getevents(), reading
+ * random blocks of a cold page cache: the file's pages are dropped before
+ * every step. For every depth the reads and MB per second are printed,
+ * and how long io_submit() took: with buffered AIO that blocks on a cache
+ * miss the submitter gets no further than depth 1 and the submit time is
+ * the read latency, with async buffered reads it stays in microseconds.
+ *
+ * Build: gcc -O2 -Wall -pthread -o aio_read_bench aio_read_bench.c
+ *
+ * Usage: aio_read_bench [-c file MB] [-q max depth] [-b block size]
+ *			 [-t seconds per step] [-d] file
+ *
+ * -c creates the file first, -d opens it O_DIRECT for comparison.
+ * Uses the raw system calls, libaio isn't needed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/aio_abi.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define MAX_DEPTH	256
+
+static unsigned int block_size = 4096;
+static int odirect;
+
+static long io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static long io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static long io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static long io_getevents(aio_context_t ctx, long min_nr, long nr,
+			 struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int create_file(const char *path, unsigned long long size)
+{
+	char *buf;
+	unsigned long long off;
+	int fd, i;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	buf = malloc(1 << 20);
+	if (!buf)
+		return -1;
+	for (off = 0; off < size; off += 1 << 20) {
+		for (i = 0; i < (1 << 20) / (int)sizeof(int); i++)
+			((int *)buf)[i] = rand();
+		if (write(fd, buf, 1 << 20) != 1 << 20) {
+			perror(path);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+static void prep_read(struct iocb *cb, int fd, void *buf,
+		      unsigned long long blocks)
+{
+	memset(cb, 0, sizeof(*cb));
+	cb->aio_fildes = fd;
+	cb->aio_lio_opcode = IOCB_CMD_PREAD;
+	cb->aio_buf = (unsigned long)buf;
+	cb->aio_nbytes = block_size;
+	cb->aio_offset = (unsigned long long)(random() % blocks) * block_size;
+	cb->aio_data = (unsigned long)cb;
+}
+
+static int run_step(const char *path, int depth, int seconds)
+{
+	static struct iocb cbs[MAX_DEPTH], *list[1];
+	static struct io_event events[MAX_DEPTH];
+	unsigned long long blocks, reads = 0, sub_ns = 0, sub_max = 0;
+	unsigned long long t, start, end, errors = 0;
+	aio_context_t ctx = 0;
+	struct stat st;
+	char *bufs;
+	int fd, i, n, inflight = 0;
+
+	fd = open(path, O_RDONLY | (odirect ? O_DIRECT : 0));
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+	blocks = st.st_size / block_size;
+	if (!blocks) {
+		fprintf(stderr, "%s: smaller than a block\n", path);
+		return -1;
+	}
+
+	/* cold cache */
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	if (posix_memalign((void **)&bufs, 4096,
+			   (size_t)depth * block_size)) {
+		close(fd);
+		return -1;
+	}
+	if (io_setup(depth, &ctx) < 0) {
+		perror("io_setup");
+		return -1;
+	}
+
+	start = now_ns();
+	end = start + seconds * 1000000000ULL;
+	for (i = 0; i < depth; i++) {
+		prep_read(&cbs[i], fd, bufs + (size_t)i * block_size, blocks);
+		list[0] = &cbs[i];
+		t = now_ns();
+		if (io_submit(ctx, 1, list) != 1) {
+			perror("io_submit");
+			return -1;
+		}
+		t = now_ns() - t;
+		sub_ns += t;
+		if (t > sub_max)
+			sub_max = t;
+		inflight++;
+	}
+
+	while (inflight) {
+		n = io_getevents(ctx, 1, depth, events, NULL);
+		if (n < 0) {
+			perror("io_getevents");
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			struct iocb *cb = (struct iocb *)(unsigned long)
+				events[i].data;
+
+			inflight--;
+			if (events[i].res != block_size)
+				errors++;
+			reads++;
+			if (now_ns() >= end)
+				continue;
+
+			prep_read(cb, fd, (void *)(unsigned long)cb->aio_buf,
+				  blocks);
+			list[0] = cb;
+			t = now_ns();
+			if (io_submit(ctx, 1, list) != 1) {
+				perror("io_submit");
+				return -1;
+			}
+			t = now_ns() - t;
+			sub_ns += t;
+			if (t > sub_max)
+				sub_max = t;
+			inflight++;
+		}
+	}
+	t = now_ns() - start;
+
+	printf("%6d %10llu %8.1f %12llu %12llu %8llu\n", depth,
+	       reads * 1000000000ULL / t,
+	       (double)reads * block_size / (1 << 20) * 1e9 / t,
+	       sub_ns / reads / 1000, sub_max / 1000, errors);
+
+	io_destroy(ctx);
+	free(bufs);
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c file MB] [-q max depth] [-b block size] [-t seconds] [-d] file\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long create = 0;
+	int max_depth = 64, seconds = 5, depth, opt;
+
+	while ((opt = getopt(argc, argv, "c:q:b:t:d")) != -1) {
+		switch (opt) {
+		case 'c':
+			create = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'q':
+			max_depth = atoi(optarg);
+			break;
+		case 'b':
+			block_size = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'd':
+			odirect = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || max_depth < 1 || max_depth > MAX_DEPTH ||
+	    seconds < 1 || block_size < 512 || block_size % 512)
+		usage(argv[0]);
+
+	if (create && create_file(argv[optind], create))
+		return 1;
+
+	printf("%s: random %u byte %s reads, %d s per step\n", argv[optind],
+	       block_size, odirect ? "O_DIRECT" : "buffered", seconds);
+	printf("\n%6s %10s %8s %12s %12s %8s\n", "depth", "reads/s", "MB/s",
+	       "submit_us", "submit_max", "errors");
+
+	/* 1, 2, 4 ... and max_depth */
+	for (depth = 1; ; depth = depth * 2 < max_depth ? depth * 2 : max_depth) {
+		if (run_step(argv[optind], depth, seconds))
+			return 1;
+		if (depth == max_depth)
+			break;
+	}
+	return 0;
+}
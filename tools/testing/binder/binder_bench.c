@@ -0,0 +1,438 @@
+/*
+ * binder_bench.c - Transaction throughput benchmark for the binder driver
+ *
+ * Starts a server process that becomes the context manager and serves
+ * transactions from a pool of looper threads, then forks a number of
+ * client processes that each run synchronous transactions against handle
+ * 0 as fast as they can. Every transaction carries a payload of the given
+ * size and is answered with a reply of the same size.
+ *
+ * At the end the benchmark reports the transactions per second for each
+ * client and in total, along with the average and worst round trip time.
+ * Running it with a growing number of clients and servers shows how well
+ * the driver scales across CPUs.
+ *
+ * With -g the payload is sent as a BINDER_TYPE_PTR buffer with
+ * BC_TRANSACTION_SG instead of inline, and with -r it lives in a shared
+ * file mapping and is flagged for remapping rather than copying (use a
+ * multiple of the page size for -b).
+ *
+ * There can only be one context manager, so this has to run where nothing
+ * else (such as servicemanager) has claimed it.
+ *
+ * Build: gcc -O2 -Wall -pthread -o binder_bench binder_bench.c
+ *
+ * Usage: binder_bench [-c clients] [-s server threads] [-t seconds]
+ *		       [-b payload bytes] [-g] [-r]
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define __user
+#include "../../../drivers/staging/android/binder.h"
+
+#define MAP_SIZE	(1024 * 1024)
+#define MAX_CLIENTS	64
+#define MAX_SERVERS	64
+#define MAX_PAYLOAD	(64 * 1024)
+
+/* Shared with the clients */
+struct client_stats {
+	unsigned long transactions;
+	unsigned long errors;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+};
+
+static struct client_stats *stats;
+static size_t payload_size = 128;
+static int sg, remap;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int binder_open_dev(void)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open("/dev/binder", O_RDWR);
+	if (fd < 0) {
+		perror("/dev/binder");
+		return -1;
+	}
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol version mismatch\n");
+		close(fd);
+		return -1;
+	}
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) ==
+	    MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int binder_write(int fd, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+/* Free the buffer of @txn and, for servers, send a reply in the same call */
+static int binder_done(int fd, struct binder_transaction_data *txn,
+		       const void *reply)
+{
+	struct {
+		uint32_t cmd_free;
+		void *buffer;
+		uint32_t cmd_reply;
+		struct binder_transaction_data txn;
+	} __attribute__((packed)) data;
+
+	data.cmd_free = BC_FREE_BUFFER;
+	data.buffer = (void *)txn->data.ptr.buffer;
+	if (!reply)
+		return binder_write(fd, &data, sizeof(uint32_t) + sizeof(void *));
+
+	data.cmd_reply = BC_REPLY;
+	memset(&data.txn, 0, sizeof(data.txn));
+	data.txn.data_size = payload_size;
+	data.txn.data.ptr.buffer = (void *)reply;
+	return binder_write(fd, &data, sizeof(data));
+}
+
+/*
+ * Read until a transaction or reply arrives and copy it to @txn. Returns
+ * the BR_ command that ended the wait.
+ */
+static uint32_t binder_wait(int fd, struct binder_transaction_data *txn)
+{
+	struct binder_write_read bwr;
+	uint32_t buf[256];
+	char *ptr, *end;
+	uint32_t cmd;
+
+	for (;;) {
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = sizeof(buf);
+		bwr.read_buffer = (unsigned long)buf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			return BR_FAILED_REPLY;
+		}
+
+		ptr = (char *)buf;
+		end = ptr + bwr.read_consumed;
+		while (ptr < end) {
+			cmd = *(uint32_t *)ptr;
+			ptr += sizeof(uint32_t);
+			switch (cmd) {
+			case BR_TRANSACTION:
+			case BR_REPLY:
+				memcpy(txn, ptr, sizeof(*txn));
+				return cmd;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				return cmd;
+			default:
+				/* BR_NOOP, BR_TRANSACTION_COMPLETE, ... */
+				ptr += _IOC_SIZE(cmd);
+				break;
+			}
+		}
+	}
+}
+
+static void *server_thread(void *arg)
+{
+	int fd = (long)arg;
+	struct binder_transaction_data txn;
+	uint32_t cmd = BC_ENTER_LOOPER;
+	char *reply;
+
+	reply = calloc(1, payload_size ? payload_size : 1);
+	if (binder_write(fd, &cmd, sizeof(cmd)) < 0) {
+		perror("BC_ENTER_LOOPER");
+		return NULL;
+	}
+
+	for (;;) {
+		cmd = binder_wait(fd, &txn);
+		if (cmd != BR_TRANSACTION)
+			continue;
+		if (binder_done(fd, &txn, reply) < 0)
+			perror("BC_REPLY");
+	}
+	return NULL;
+}
+
+/* Become the context manager, tell the parent through @ready, and serve */
+static void server(int nr_threads, int ready)
+{
+	size_t max_threads = nr_threads;
+	pthread_t tid;
+	char ok = 0;
+	int i, fd;
+
+	fd = binder_open_dev();
+	if (fd >= 0) {
+		ioctl(fd, BINDER_SET_MAX_THREADS, &max_threads);
+		if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+			perror("BINDER_SET_CONTEXT_MGR");
+		else
+			ok = 1;
+	}
+	if (write(ready, &ok, 1) != 1 || !ok)
+		return;
+	close(ready);
+
+	for (i = 1; i < nr_threads; i++)
+		pthread_create(&tid, NULL, server_thread, (void *)(long)fd);
+	server_thread((void *)(long)fd);
+}
+
+/* A payload the driver can remap: whole pages of a shared file mapping */
+static char *shared_payload(void)
+{
+	char path[] = "/tmp/binder_bench.XXXXXX";
+	char *payload;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return NULL;
+	unlink(path);
+	if (ftruncate(fd, payload_size) < 0) {
+		close(fd);
+		return NULL;
+	}
+	payload = mmap(NULL, payload_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED, fd, 0);
+	close(fd);
+	if (payload == MAP_FAILED)
+		return NULL;
+	memset(payload, 1, payload_size);
+	return payload;
+}
+
+static void client(struct client_stats *st, unsigned long long end)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data_sg txn;
+	} __attribute__((packed)) data;
+	struct binder_buffer_object obj;
+	size_t offset = 0, len;
+	struct binder_transaction_data reply;
+	unsigned long long t, d;
+	char *payload;
+	uint32_t cmd;
+	int fd;
+
+	fd = binder_open_dev();
+	if (fd < 0)
+		return;
+	if (remap)
+		payload = shared_payload();
+	else
+		payload = calloc(1, payload_size ? payload_size : 1);
+	if (payload == NULL) {
+		perror("payload");
+		return;
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.txn.transaction_data.target.handle = 0;
+	if (sg) {
+		memset(&obj, 0, sizeof(obj));
+		obj.type = BINDER_TYPE_PTR;
+		obj.flags = remap ? BINDER_BUFFER_FLAG_REMAP : 0;
+		obj.buffer = payload;
+		obj.length = payload_size;
+
+		data.cmd = BC_TRANSACTION_SG;
+		data.txn.transaction_data.data_size = sizeof(obj);
+		data.txn.transaction_data.data.ptr.buffer = &obj;
+		data.txn.transaction_data.offsets_size = sizeof(offset);
+		data.txn.transaction_data.data.ptr.offsets = &offset;
+		/* a page of slack lets the driver align remapped buffers */
+		data.txn.buffers_size = (payload_size + 7) & ~7UL;
+		if (remap)
+			data.txn.buffers_size += sysconf(_SC_PAGESIZE);
+		len = sizeof(data);
+	} else {
+		data.cmd = BC_TRANSACTION;
+		data.txn.transaction_data.data_size = payload_size;
+		data.txn.transaction_data.data.ptr.buffer = payload;
+		len = sizeof(uint32_t) + sizeof(struct binder_transaction_data);
+	}
+
+	while ((t = now_ns()) < end) {
+		if (binder_write(fd, &data, len) < 0) {
+			st->errors++;
+			continue;
+		}
+		cmd = binder_wait(fd, &reply);
+		if (cmd != BR_REPLY) {
+			st->errors++;
+			continue;
+		}
+		binder_done(fd, &reply, NULL);
+		d = now_ns() - t;
+
+		st->transactions++;
+		st->total_ns += d;
+		if (d > st->max_ns)
+			st->max_ns = d;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c clients] [-s server threads] [-t seconds] [-b payload bytes] [-g] [-r]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pid_t server_pid, pid;
+	unsigned long long end, total_ns = 0, max_ns = 0;
+	unsigned long transactions = 0, errors = 0;
+	int nr_clients = 1, nr_servers = 1, seconds = 10;
+	int i, opt, pipefd[2];
+	char ok = 0;
+
+	while ((opt = getopt(argc, argv, "c:s:t:b:gr")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_clients = atoi(optarg);
+			break;
+		case 's':
+			nr_servers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			payload_size = atoi(optarg);
+			break;
+		case 'r':
+			remap = 1;
+			/* fall through */
+		case 'g':
+			sg = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_clients < 1 || nr_clients > MAX_CLIENTS ||
+	    nr_servers < 1 || nr_servers > MAX_SERVERS ||
+	    seconds < 1 || payload_size > MAX_PAYLOAD)
+		usage(argv[0]);
+
+	stats = mmap(NULL, sizeof(*stats) * nr_clients, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(stats, 0, sizeof(*stats) * nr_clients);
+
+	/* the server has to be the context manager before any client starts */
+	if (pipe(pipefd) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	server_pid = fork();
+	if (server_pid == 0) {
+		close(pipefd[0]);
+		server(nr_servers, pipefd[1]);
+		_exit(1);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &ok, 1) != 1 || !ok) {
+		waitpid(server_pid, NULL, 0);
+		return 1;
+	}
+	close(pipefd[0]);
+
+	printf("%d clients, %d server threads, %zu byte %s payload, %d seconds\n",
+	       nr_clients, nr_servers, payload_size,
+	       remap ? "remapped" : sg ? "scatter-gather" : "inline", seconds);
+
+	end = now_ns() + seconds * 1000000000ULL;
+	for (i = 0; i < nr_clients; i++) {
+		pid = fork();
+		if (pid == 0) {
+			client(&stats[i], end);
+			_exit(0);
+		}
+	}
+	for (i = 0; i < nr_clients; i++)
+		wait(NULL);
+
+	kill(server_pid, SIGTERM);
+	waitpid(server_pid, NULL, 0);
+
+	printf("\n%6s %12s %10s %10s %10s %8s\n", "client", "transactions",
+	       "per_sec", "avg_us", "max_us", "errors");
+	for (i = 0; i < nr_clients; i++) {
+		struct client_stats *st = &stats[i];
+
+		printf("%6d %12lu %10lu %10llu %10llu %8lu\n", i,
+		       st->transactions, st->transactions / seconds,
+		       st->transactions ? st->total_ns / st->transactions / 1000 : 0,
+		       st->max_ns / 1000, st->errors);
+		transactions += st->transactions;
+		errors += st->errors;
+		total_ns += st->total_ns;
+		if (st->max_ns > max_ns)
+			max_ns = st->max_ns;
+	}
+
+	printf("\ntransactions: %lu, %lu per second\n", transactions,
+	       transactions / seconds);
+	printf("round trip: average %llu us, max %llu us\n",
+	       transactions ? total_ns / transactions / 1000 : 0,
+	       max_ns / 1000);
+	printf("errors: %lu\n", errors);
+
+	return 0;
+}
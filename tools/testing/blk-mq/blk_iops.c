@@ -0,0 +1,188 @@
+/*
+ * blk_iops.c - Random read IOPS scaling test for block devices
+ *
+ * Runs random O_DIRECT reads against a block device from 1 up to the given
+ * number of threads, each pinned to its own CPU, and prints the IOPS and
+ * average latency for every thread count. With null_blk loaded this is the
+ * per-I/O cost of the block layer: compare queue_mode=0 (bio) against
+ * queue_mode=1 (multi-queue), or a zram or MMC device against it.
+ *
+ * Build: gcc -O2 -Wall -pthread -o blk_iops blk_iops.c
+ *
+ * Usage: blk_iops [-j max threads] [-t seconds per step] [-b block size]
+ *		   [-w] device
+ *
+ * -w issues writes instead of reads and destroys the contents of the
+ * device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define MAX_THREADS	64
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	unsigned long ios;
+	unsigned long long total_ns;
+	unsigned long errors;
+};
+
+static const char *device;
+static unsigned long long dev_blocks;
+static unsigned int block_size = 4096;
+static int do_write;
+static volatile int stop;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->cpu * 7919 + 1;
+	unsigned long long t;
+	cpu_set_t set;
+	void *buf;
+	off_t off;
+	ssize_t ret;
+	int fd;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	fd = open(device, (do_write ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0) {
+		perror(device);
+		return NULL;
+	}
+	if (posix_memalign(&buf, 4096, block_size)) {
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0x5a, block_size);
+
+	while (!stop) {
+		off = (off_t)(((unsigned long long)rand_r(&seed) << 31 |
+			       rand_r(&seed)) % dev_blocks) * block_size;
+		t = now_ns();
+		if (do_write)
+			ret = pwrite(fd, buf, block_size, off);
+		else
+			ret = pread(fd, buf, block_size, off);
+		w->total_ns += now_ns() - t;
+		if (ret != (ssize_t)block_size)
+			w->errors++;
+		w->ios++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j max threads] [-t seconds] [-b block size] [-w] device\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker workers[MAX_THREADS];
+	unsigned long long size, ios, total_ns;
+	unsigned long errors;
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max_threads = 4, seconds = 5;
+	int i, n, opt, fd;
+
+	while ((opt = getopt(argc, argv, "j:t:b:w")) != -1) {
+		switch (opt) {
+		case 'j':
+			max_threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block_size = atoi(optarg);
+			break;
+		case 'w':
+			do_write = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || max_threads < 1 ||
+	    max_threads > MAX_THREADS || seconds < 1 ||
+	    block_size < 512 || block_size & (block_size - 1))
+		usage(argv[0]);
+	device = argv[optind];
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size) < 0) {
+		perror(device);
+		return 1;
+	}
+	close(fd);
+	dev_blocks = size / block_size;
+	if (!dev_blocks) {
+		fprintf(stderr, "%s: device too small\n", device);
+		return 1;
+	}
+
+	printf("%s: %llu MB, %u byte random %s, %d s per step\n", device,
+	       size >> 20, block_size, do_write ? "writes" : "reads", seconds);
+	printf("\n%8s %12s %10s %8s\n", "threads", "iops", "avg_us", "errors");
+
+	for (n = 1; n <= max_threads; n++) {
+		memset(workers, 0, sizeof(workers));
+		stop = 0;
+		for (i = 0; i < n; i++) {
+			workers[i].cpu = i % nr_cpus;
+			if (pthread_create(&workers[i].thread, NULL, worker_fn,
+					   &workers[i])) {
+				perror("pthread_create");
+				return 1;
+			}
+		}
+		sleep(seconds);
+		stop = 1;
+
+		ios = total_ns = errors = 0;
+		for (i = 0; i < n; i++) {
+			pthread_join(workers[i].thread, NULL);
+			ios += workers[i].ios;
+			total_ns += workers[i].total_ns;
+			errors += workers[i].errors;
+		}
+		printf("%8d %12llu %10.2f %8lu\n", n, ios / seconds,
+		       ios ? total_ns / 1000.0 / ios : 0.0, errors);
+	}
+
+	return 0;
+}
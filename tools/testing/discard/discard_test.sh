@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# discard_test.sh - compare synchronous and background discard
+#
+# Usage: discard_test.sh [-n files] [-s file MB] [-m image MB] [dir]
+#
+# Sets up a loop device on an image file in dir (default /data/local/tmp),
+# which passes discards on to the file as punched holes, makes an ext4 file
+# system on it and mounts it with -o discard. Then twice, with the loop
+# queue's discard_async at 0 and at 1, it writes files, deletes them and
+# times the rm and the sync that commits the deletion, which is where the
+# discards are issued. Afterwards it waits for the queued discards to go
+# out, checking that the space used by the image shrinks back, and prints
+# the queue's discard_stats:
+#
+#	queued merged cancelled issued pending issued_MB pending_MB
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+FILES=64
+FILE_MB=4
+MB=1024
+
+usage() {
+	echo "usage: $0 [-n files] [-s file MB] [-m image MB] [dir]"
+	exit 1
+}
+
+while getopts n:s:m: opt; do
+	case $opt in
+	n) FILES=$OPTARG ;;
+	s) FILE_MB=$OPTARG ;;
+	m) MB=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+IMG=$DIR/discard_test.img
+MNT=$DIR/discard_test.mnt
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+used_kb() {
+	du -k $IMG | awk '{ print $1 }'
+}
+
+rm -f $IMG
+dd if=/dev/zero of=$IMG bs=1M count=0 seek=$MB 2>/dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $IMG || { rm -f $IMG; exit 1; }
+Q=/sys/block/$(basename $LOOP)/queue
+if [ ! -f $Q/discard_async ] || [ $(cat $Q/discard_max_bytes) = 0 ]; then
+	echo "$LOOP: no discard support or no background discard"
+	losetup -d $LOOP
+	rm -f $IMG
+	exit 1
+fi
+
+mkfs.ext4 -q -E nodiscard $LOOP || exit 1
+mkdir -p $MNT
+mount -o discard $LOOP $MNT || exit 1
+echo "$FILES files of $FILE_MB MB on $LOOP"
+
+for async in 0 1; do
+	echo "== discard_async $async"
+	echo $async > $Q/discard_async
+	i=0
+	while [ $i -lt $FILES ]; do
+		dd if=/dev/zero of=$MNT/f$i bs=1M count=$FILE_MB 2>/dev/null
+		i=$((i + 1))
+	done
+	sync
+	echo "image uses $(used_kb) KB"
+
+	t=$(now_ms)
+	rm -f $MNT/f*
+	t1=$(now_ms)
+	sync
+	t2=$(now_ms)
+	echo "rm $((t1 - t)) ms, sync $((t2 - t1)) ms"
+
+	# wait for the background discards
+	i=0
+	while [ $i -lt 30 ]; do
+		set -- $(cat $Q/discard_stats)
+		[ $5 = 0 ] && break
+		sleep 1
+		i=$((i + 1))
+	done
+	echo "image uses $(used_kb) KB after discard"
+	echo "stats $(cat $Q/discard_stats)"
+done
+
+umount $MNT
+rmdir $MNT
+losetup -d $LOOP
+rm -f $IMG
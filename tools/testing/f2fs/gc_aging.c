@@ -0,0 +1,215 @@
+/*
+ * gc_aging.c - Age a file system with random overwrites, report write
+ *		amplification
+ *
+ * Fills a directory with files up to the given share of the file system,
+ * then overwrites random 4KB blocks of them in rounds, 80% of the writes
+ * going to 20% of the files so that hot and cold data mix in segments.
+ * After every round it syncs and prints how much the workload wrote, how
+ * much the block device was asked to write (from /sys/block/<dev>/stat)
+ * and the write amplification so far: device writes over workload writes.
+ * On f2fs the difference is mostly the blocks GC had to move, so a better
+ * victim choice shows up as a lower amplification and a higher rate.
+ * gc_aging.sh runs it on a loop device.
+ *
+ * Build: gcc -O2 -Wall -o gc_aging gc_aging.c
+ *
+ * Usage: gc_aging [-f fill %] [-s file KB] [-r rounds] [-w writes per round]
+ *		   -D dev dir
+ *
+ * dev is the block device name under /sys/block, such as loop0.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+
+#define BLOCK		4096
+#define MAX_FILES	65536
+
+static const char *dir;
+static const char *dev;
+static int fds[MAX_FILES];
+static int nr_files;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* sectors written to the device, the 7th field of its stat file */
+static unsigned long long dev_written(void)
+{
+	unsigned long long f[7];
+	char path[256];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/stat", dev);
+	fp = fopen(path, "r");
+	if (!fp || fscanf(fp, "%llu %llu %llu %llu %llu %llu %llu", &f[0],
+			  &f[1], &f[2], &f[3], &f[4], &f[5], &f[6]) != 7) {
+		perror(path);
+		exit(1);
+	}
+	fclose(fp);
+	return f[6] * 512;
+}
+
+static int used_percent(void)
+{
+	struct statvfs st;
+
+	if (statvfs(dir, &st)) {
+		perror(dir);
+		exit(1);
+	}
+	return 100 - st.f_bavail * 100 / st.f_blocks;
+}
+
+static void fill_block(char *buf)
+{
+	int i;
+
+	for (i = 0; i < BLOCK / (int)sizeof(int); i++)
+		((int *)buf)[i] = rand();
+}
+
+static int fill(int fill_pct, unsigned long file_size)
+{
+	char path[4096], buf[BLOCK];
+	unsigned long off;
+	int fd;
+
+	while (used_percent() < fill_pct && nr_files < MAX_FILES) {
+		snprintf(path, sizeof(path), "%s/age%05d", dir, nr_files);
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		for (off = 0; off < file_size; off += BLOCK) {
+			fill_block(buf);
+			if (write(fd, buf, BLOCK) != BLOCK) {
+				perror(path);
+				return -1;
+			}
+		}
+		fds[nr_files++] = fd;
+	}
+	sync();
+	return nr_files ? 0 : -1;
+}
+
+/* 80% of the writes go to the first 20% of the files */
+static int pick_file(void)
+{
+	int hot = nr_files / 5 ? nr_files / 5 : 1;
+
+	if (rand() % 10 < 8)
+		return rand() % hot;
+	return rand() % nr_files;
+}
+
+static int age(int rounds, int writes, unsigned long file_size)
+{
+	unsigned long long host = 0, dev_start, dev_bytes, t, start;
+	unsigned long blocks = file_size / BLOCK;
+	char buf[BLOCK];
+	int r, i, f;
+
+	printf("%6s %10s %10s %8s %10s\n", "round", "host_MB", "dev_MB",
+	       "WA", "MB/s");
+
+	dev_start = dev_written();
+	start = now_ns();
+	for (r = 1; r <= rounds; r++) {
+		t = now_ns();
+		for (i = 0; i < writes; i++) {
+			f = pick_file();
+			fill_block(buf);
+			if (pwrite(fds[f], buf, BLOCK,
+				   (off_t)(rand() % blocks) * BLOCK) != BLOCK) {
+				perror("pwrite");
+				return -1;
+			}
+		}
+		sync();
+		t = now_ns() - t;
+		host += (unsigned long long)writes * BLOCK;
+		dev_bytes = dev_written() - dev_start;
+
+		printf("%6d %10llu %10llu %8.2f %10.1f\n", r, host >> 20,
+		       dev_bytes >> 20, (double)dev_bytes / host,
+		       (double)writes * BLOCK / (1 << 20) * 1e9 / t);
+		fflush(stdout);
+	}
+	printf("\n%d rounds in %llu s\n", rounds,
+	       (now_ns() - start) / 1000000000ULL);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-f fill %%] [-s file KB] [-r rounds] [-w writes per round] -D dev dir\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int fill_pct = 80, rounds = 20, writes = 65536, opt, i;
+	unsigned long file_size = 1024 * 1024;
+
+	while ((opt = getopt(argc, argv, "f:s:r:w:D:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fill_pct = atoi(optarg);
+			break;
+		case 's':
+			file_size = strtoul(optarg, NULL, 10) * 1024;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'w':
+			writes = atoi(optarg);
+			break;
+		case 'D':
+			dev = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !dev || fill_pct < 1 || fill_pct > 99 ||
+	    file_size < BLOCK || rounds < 1 || writes < 1)
+		usage(argv[0]);
+	dir = argv[optind];
+	srand(1);
+
+	if (fill(fill_pct, file_size)) {
+		fprintf(stderr, "%s: could not create files\n", dir);
+		return 1;
+	}
+	printf("%s: %d files of %lu KB, %d%% used\n\n", dir, nr_files,
+	       file_size >> 10, used_percent());
+
+	if (age(rounds, writes, file_size))
+		return 1;
+
+	for (i = 0; i < nr_files; i++)
+		close(fds[i]);
+	return 0;
+}
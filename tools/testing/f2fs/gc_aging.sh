@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# gc_aging.sh - age an f2fs loop device and report GC write amplification
+#
+# Usage: gc_aging.sh [-m image MB] [-f fill %] [-r rounds] [-w writes per round]
+#		     [dir]
+#
+# Makes an f2fs image of the given size in dir (default /data/local/tmp),
+# loop mounts it and runs gc_aging on it, which fills it and overwrites
+# random blocks in rounds, printing the write amplification after every
+# round. The GC lines of /sys/kernel/debug/f2fs/status are printed at the
+# end when debugfs is mounted. The f2fs_gc_section trace event shows the
+# valid blocks of every victim and the time taken to clean it.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+SIZE_MB=1024
+FILL=80
+ROUNDS=20
+WRITES=65536
+
+usage() {
+	echo "usage: $0 [-m image MB] [-f fill %] [-r rounds] [-w writes per round] [dir]"
+	exit 1
+}
+
+while getopts m:f:r:w: opt; do
+	case $opt in
+	m) SIZE_MB=$OPTARG ;;
+	f) FILL=$OPTARG ;;
+	r) ROUNDS=$OPTARG ;;
+	w) WRITES=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+HERE=$(cd $(dirname $0) && pwd)
+BENCH=$HERE/gc_aging
+IMG=$DIR/gc_aging.img
+MNT=$DIR/gc_aging.mnt
+
+which mkfs.f2fs > /dev/null || { echo "mkfs.f2fs not found"; exit 1; }
+[ -x $BENCH ] || gcc -O2 -Wall -o $BENCH $HERE/gc_aging.c || exit 1
+
+mkdir -p $MNT
+dd if=/dev/zero of=$IMG bs=1M count=0 seek=$SIZE_MB 2> /dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $IMG || exit 1
+mkfs.f2fs $LOOP > /dev/null || exit 1
+mount -t f2fs $LOOP $MNT || exit 1
+
+ulimit -n 65536
+$BENCH -f $FILL -r $ROUNDS -w $WRITES -D $(basename $LOOP) $MNT
+
+STATUS=/sys/kernel/debug/f2fs/status
+if [ -r $STATUS ]; then
+	echo
+	grep -A 5 "GC calls" $STATUS
+fi
+
+umount $MNT
+losetup -d $LOOP
+rmdir $MNT
+rm -f $IMG
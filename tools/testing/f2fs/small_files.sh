@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# small_files.sh - small file space and cold reads with and without inline
+#
+# Usage: small_files.sh [-m image MB] [-n files] [-s max file bytes]
+#			[-d files per dir] [dir]
+#
+# Makes an f2fs image of the given size in dir (default /data/local/tmp)
+# and runs small_files on it twice: mounted as is, and mounted with
+# inline_data,inline_dentry, on a fresh image each time. With the inline
+# options the space and the device reads per file should be about halved.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+SIZE_MB=1024
+FILES=20000
+MAX_SIZE=3072
+PER_DIR=32
+
+usage() {
+	echo "usage: $0 [-m image MB] [-n files] [-s max file bytes] [-d files per dir] [dir]"
+	exit 1
+}
+
+while getopts m:n:s:d: opt; do
+	case $opt in
+	m) SIZE_MB=$OPTARG ;;
+	n) FILES=$OPTARG ;;
+	s) MAX_SIZE=$OPTARG ;;
+	d) PER_DIR=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+HERE=$(cd $(dirname $0) && pwd)
+BENCH=$HERE/small_files
+IMG=$DIR/small_files.img
+MNT=$DIR/small_files.mnt
+
+which mkfs.f2fs > /dev/null || { echo "mkfs.f2fs not found"; exit 1; }
+[ -x $BENCH ] || gcc -O2 -Wall -o $BENCH $HERE/small_files.c || exit 1
+
+mkdir -p $MNT
+dd if=/dev/zero of=$IMG bs=1M count=0 seek=$SIZE_MB 2> /dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $IMG || exit 1
+
+for opts in defaults inline_data,inline_dentry; do
+	echo
+	echo "== $opts"
+	mkfs.f2fs $LOOP > /dev/null || break
+	mount -t f2fs -o $opts $LOOP $MNT || continue
+	$BENCH -n $FILES -s $MAX_SIZE -d $PER_DIR -D $(basename $LOOP) $MNT
+	umount $MNT
+done
+
+losetup -d $LOOP
+rmdir $MNT
+rm -f $IMG
@@ -0,0 +1,222 @@
+/*
+ * fsync_bench.c - Concurrent write+fsync throughput and latency
+ *
+ * Every thread appends blocks to its own file in a directory and fsyncs
+ * after each one, the way SQLite commits with its journal, for 1, 2, 4 ...
+ * up to the given number of threads. For every thread count the total
+ * commits per second and the fsync latency percentiles are printed. Run it
+ * with /sys/kernel/fsync_batch/window_us at 0 and at some window to see
+ * what group commit does; fsync_test.sh does that on ext4, and on f2fs,
+ * which doesn't batch, for reference.
+ *
+ * Build: gcc -O2 -Wall -pthread -o fsync_bench fsync_bench.c
+ *
+ * Usage: fsync_bench [-j max threads] [-t seconds per step]
+ *		      [-b block size] [-s file MB] [-d] dir
+ *
+ * -d uses fdatasync instead of fsync. Files are truncated when they reach
+ * the given size and removed at the end.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS	64
+#define MAX_SAMPLES	(1 << 16)	/* per thread */
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned long ops;
+	unsigned long errors;
+	unsigned long long *lat;
+};
+
+static const char *dir;
+static unsigned int block_size = 4096;
+static unsigned long long file_size = 16ULL << 20;
+static int datasync;
+static volatile int stop;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long off = 0, t;
+	char path[4096], *buf;
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/fsync_bench.%d", dir, w->id);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+	buf = malloc(block_size);
+	if (!buf) {
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0x5a + w->id, block_size);
+
+	while (!stop) {
+		if (off + block_size > file_size) {
+			if (ftruncate(fd, 0) < 0)
+				break;
+			off = 0;
+		}
+		if (pwrite(fd, buf, block_size, off) != (ssize_t)block_size) {
+			w->errors++;
+			continue;
+		}
+		off += block_size;
+
+		t = now_ns();
+		ret = datasync ? fdatasync(fd) : fsync(fd);
+		t = now_ns() - t;
+		if (ret) {
+			w->errors++;
+			continue;
+		}
+		if (w->ops < MAX_SAMPLES)
+			w->lat[w->ops] = t;
+		w->ops++;
+	}
+
+	free(buf);
+	close(fd);
+	unlink(path);
+	return NULL;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_step(int threads, unsigned long ops, unsigned long errors,
+		       unsigned long long *lat, unsigned long n, int seconds)
+{
+	unsigned long long sum = 0;
+	unsigned long i;
+
+	if (!n) {
+		printf("%8d %10s %10s %10s %10s %10s %8lu\n", threads, "-", "-",
+		       "-", "-", "-", errors);
+		return;
+	}
+	qsort(lat, n, sizeof(*lat), cmp_ull);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%8d %10lu %10llu %10llu %10llu %10llu %8lu\n", threads,
+	       ops / seconds, sum / n / 1000, lat[n / 2] / 1000,
+	       lat[n * 99 / 100] / 1000, lat[n - 1] / 1000, errors);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j max threads] [-t seconds] [-b block size] [-s file MB] [-d] dir\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker workers[MAX_THREADS];
+	unsigned long long *lat;
+	unsigned long ops, errors, n_lat, samples;
+	int max_threads = 8, seconds = 10;
+	int i, n, opt;
+
+	while ((opt = getopt(argc, argv, "j:t:b:s:d")) != -1) {
+		switch (opt) {
+		case 'j':
+			max_threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block_size = atoi(optarg);
+			break;
+		case 's':
+			file_size = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'd':
+			datasync = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || max_threads < 1 ||
+	    max_threads > MAX_THREADS || seconds < 1 || block_size < 1 ||
+	    file_size < block_size)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	lat = malloc((size_t)max_threads * MAX_SAMPLES * sizeof(*lat));
+	if (!lat) {
+		perror("malloc");
+		return 1;
+	}
+
+	printf("%s: %u byte appends + %s, %d s per step\n", dir, block_size,
+	       datasync ? "fdatasync" : "fsync", seconds);
+	printf("\n%8s %10s %10s %10s %10s %10s %8s\n", "threads", "fsyncs/s",
+	       "avg_us", "p50_us", "p99_us", "max_us", "errors");
+
+	/* 1, 2, 4 ... and max_threads */
+	for (n = 1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+		memset(workers, 0, sizeof(workers));
+		stop = 0;
+		for (i = 0; i < n; i++) {
+			workers[i].id = i;
+			workers[i].lat = lat + (size_t)i * MAX_SAMPLES;
+			if (pthread_create(&workers[i].thread, NULL, worker_fn,
+					   &workers[i])) {
+				perror("pthread_create");
+				return 1;
+			}
+		}
+		sleep(seconds);
+		stop = 1;
+
+		ops = errors = n_lat = 0;
+		for (i = 0; i < n; i++) {
+			pthread_join(workers[i].thread, NULL);
+			ops += workers[i].ops;
+			errors += workers[i].errors;
+			samples = workers[i].ops < MAX_SAMPLES ?
+				workers[i].ops : MAX_SAMPLES;
+			memmove(lat + n_lat, workers[i].lat,
+				samples * sizeof(*lat));
+			n_lat += samples;
+		}
+		print_step(n, ops, errors, lat, n_lat, seconds);
+		if (n == max_threads)
+			break;
+	}
+
+	return 0;
+}
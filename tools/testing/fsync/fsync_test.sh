@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# fsync_test.sh - compare group commit against plain fsync on ext4 and f2fs
+#
+# Usage: fsync_test.sh [-j max threads] [-t seconds] [-w window_us]
+#		       [-m MB] [dir]
+#
+# Makes an ext4 and an f2fs file system on an MB sized loop file in dir
+# (default /data/local/tmp) and runs fsync_bench on each, once with
+# /sys/kernel/fsync_batch/window_us at 0, which is plain fsync, and once
+# at window_us. After every run the kernel's counters are printed: how many
+# fsyncs were coalesced into how many commits, and their latencies. f2fs
+# does not batch, its checkpoint can't report write errors, so its runs
+# are a baseline for plain fsync.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+THREADS=8
+SECS=10
+WINDOW=1000
+MB=512
+
+usage() {
+	echo "usage: $0 [-j threads] [-t seconds] [-w window_us] [-m MB] [dir]"
+	exit 1
+}
+
+while getopts j:t:w:m: opt; do
+	case $opt in
+	j) THREADS=$OPTARG ;;
+	t) SECS=$OPTARG ;;
+	w) WINDOW=$OPTARG ;;
+	m) MB=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+HERE=$(cd $(dirname $0) && pwd)
+BENCH=$HERE/fsync_bench
+SYS=/sys/kernel/fsync_batch
+FILE=$DIR/fsync_test.img
+MNT=$DIR/fsync_test.mnt
+
+[ -d $SYS ] || { echo "kernel without CONFIG_FSYNC_BATCH"; exit 1; }
+[ -x $BENCH ] || gcc -O2 -Wall -pthread -o $BENCH $HERE/fsync_bench.c || exit 1
+OLD_WINDOW=$(cat $SYS/window_us)
+
+dd if=/dev/zero of=$FILE bs=1M count=$MB 2>/dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $FILE || { rm -f $FILE; exit 1; }
+mkdir -p $MNT
+
+for fs in ext4 f2fs; do
+	case $fs in
+	ext4) mkfs.ext4 -q -F $LOOP ;;
+	f2fs) mkfs.f2fs $LOOP >/dev/null ;;
+	esac || { echo "$fs: mkfs failed"; continue; }
+	mount -t $fs $LOOP $MNT || continue
+
+	for w in 0 $WINDOW; do
+		echo "== $fs, window_us $w"
+		echo $w > $SYS/window_us
+		echo 0 > $SYS/stats
+		$BENCH -j $THREADS -t $SECS $MNT
+		echo
+		cat $SYS/stats $SYS/latency_hist
+		echo
+	done
+
+	umount $MNT
+done
+
+echo $OLD_WINDOW > $SYS/window_us
+rmdir $MNT
+losetup -d $LOOP
+rm -f $FILE
@@ -0,0 +1,532 @@
+/*
+ * io_ring_bench.c - Small I/O through pread/pwrite, io_submit and io_ring
+ *
+ * Reads (or with -w writes) random blocks of a file, keeping the given
+ * number of them in flight, in each of four ways: one pread()/pwrite()
+ * per block, batches of io_submit() and io_getevents(), batches of SQEs
+ * per IORING_IOC_ENTER that also waits for the completions, and SQEs
+ * consumed by an io_ring SQ thread without any system call. The file
+ * is read once beforehand so that the page cache holds it and what is
+ * measured is the cost of getting the I/O to the kernel and back, which
+ * is what the rings save. Printed are operations and MB per second and
+ * the system calls made per operation.
+ *
+ * Build: gcc -O2 -Wall -pthread -o io_ring_bench io_ring_bench.c
+ *
+ * Usage: io_ring_bench [-c file MB] [-q depth] [-b block size]
+ *			[-t seconds per mode] [-w] file
+ *
+ * -c creates the file first. The SQ thread mode needs CAP_SYS_ADMIN and
+ * is skipped without it.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/aio_abi.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* as in include/linux/io_ring.h */
+struct io_ring_sqe {
+	__u8	opcode;
+	__u8	flags;
+	__u16	ioprio;
+	__s32	fd;
+	__u64	off;
+	__u64	addr;
+	__u32	len;
+	__u32	op_flags;
+	__u64	user_data;
+};
+
+#define IORING_OP_READV		1
+#define IORING_OP_WRITEV	2
+
+struct io_ring_cqe {
+	__u64	user_data;
+	__s32	res;
+	__u32	flags;
+};
+
+struct io_ring_hdr {
+	__u32	sq_head;
+	__u32	sq_tail;
+	__u32	sq_mask;
+	__u32	sq_entries;
+	__u32	cq_head;
+	__u32	cq_tail;
+	__u32	cq_mask;
+	__u32	cq_entries;
+	__u32	flags;
+	__u32	cq_overflow;
+	__u32	sq_off;
+	__u32	cq_off;
+};
+
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)
+
+struct io_ring_params {
+	__u32	sq_entries;
+	__u32	cq_entries;
+	__u32	flags;
+	__u32	sq_thread_idle;
+	__u32	map_size;
+	__u32	resv[3];
+};
+
+#define IORING_SETUP_SQPOLL	(1U << 0)
+
+struct io_ring_enter {
+	__u32	to_submit;
+	__u32	min_complete;
+	__u32	flags;
+	__u32	resv;
+};
+
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+#define IORING_IOC_SETUP	_IOWR(0xB8, 0, struct io_ring_params)
+#define IORING_IOC_ENTER	_IOW(0xB8, 1, struct io_ring_enter)
+
+#define MAX_DEPTH	1024
+
+#define barrier()	__sync_synchronize()
+
+static unsigned int block_size = 4096;
+static unsigned long long blocks;
+static int depth = 32, seconds = 5, writes;
+static char *bufs;
+static struct iovec iovs[MAX_DEPTH];
+static unsigned long long syscalls;
+
+struct ring {
+	int fd;
+	struct io_ring_hdr *hdr;
+	struct io_ring_sqe *sqes;
+	struct io_ring_cqe *cqes;
+	size_t size;
+};
+
+static long io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static long io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static long io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	syscalls++;
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static long io_getevents(aio_context_t ctx, long min_nr, long nr,
+			 struct io_event *events, struct timespec *timeout)
+{
+	syscalls++;
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static int io_ring_setup(unsigned entries, struct io_ring_params *p)
+{
+	int dev, fd, err;
+
+	dev = open("/dev/io_ring", O_RDWR);
+	if (dev < 0)
+		return -1;
+	p->sq_entries = entries;
+	fd = ioctl(dev, IORING_IOC_SETUP, p);
+	err = errno;
+	close(dev);
+	errno = err;
+	return fd;
+}
+
+static int io_ring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			 unsigned flags)
+{
+	struct io_ring_enter e = {
+		.to_submit	= to_submit,
+		.min_complete	= min_complete,
+		.flags		= flags,
+	};
+
+	syscalls++;
+	return ioctl(fd, IORING_IOC_ENTER, &e);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long random_off(void)
+{
+	return (unsigned long long)(random() % blocks) * block_size;
+}
+
+static int create_file(const char *path, unsigned long long size)
+{
+	char *buf;
+	unsigned long long off;
+	int fd, i;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	buf = malloc(1 << 20);
+	if (!buf)
+		return -1;
+	for (off = 0; off < size; off += 1 << 20) {
+		for (i = 0; i < (1 << 20) / (int)sizeof(int); i++)
+			((int *)buf)[i] = rand();
+		if (write(fd, buf, 1 << 20) != 1 << 20) {
+			perror(path);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+/* read the whole file once so that it is cached */
+static void warm_cache(int fd)
+{
+	char *buf = malloc(1 << 20);
+	off_t off = 0;
+	ssize_t n;
+
+	if (!buf)
+		return;
+	while ((n = pread(fd, buf, 1 << 20, off)) > 0)
+		off += n;
+	free(buf);
+}
+
+static int run_sync(int fd, unsigned long long *ops)
+{
+	unsigned long long end = now_ns() + seconds * 1000000000ULL;
+	ssize_t ret;
+	int i;
+
+	while (now_ns() < end) {
+		/* a depth's worth between clock reads, as the others */
+		for (i = 0; i < depth; i++) {
+			if (writes)
+				ret = pwrite(fd, iovs[i].iov_base, block_size,
+					     random_off());
+			else
+				ret = pread(fd, iovs[i].iov_base, block_size,
+					    random_off());
+			syscalls++;
+			if (ret != block_size) {
+				perror(writes ? "pwrite" : "pread");
+				return -1;
+			}
+		}
+		*ops += depth;
+	}
+	return 0;
+}
+
+static int run_aio(int fd, unsigned long long *ops)
+{
+	static struct iocb cbs[MAX_DEPTH], *list[MAX_DEPTH];
+	static struct io_event events[MAX_DEPTH];
+	unsigned long long end = now_ns() + seconds * 1000000000ULL;
+	aio_context_t ctx = 0;
+	int i, n, nr;
+
+	if (io_setup(depth, &ctx) < 0) {
+		perror("io_setup");
+		return -1;
+	}
+	for (i = 0; i < depth; i++) {
+		cbs[i].aio_fildes = fd;
+		cbs[i].aio_lio_opcode = writes ? IOCB_CMD_PWRITE :
+						 IOCB_CMD_PREAD;
+		cbs[i].aio_buf = (unsigned long)iovs[i].iov_base;
+		cbs[i].aio_nbytes = block_size;
+		cbs[i].aio_data = i;
+		list[i] = &cbs[i];
+	}
+
+	nr = depth;
+	while (now_ns() < end) {
+		for (i = 0; i < nr; i++)
+			list[i]->aio_offset = random_off();
+		if (io_submit(ctx, nr, list) != nr) {
+			perror("io_submit");
+			return -1;
+		}
+		n = io_getevents(ctx, 1, depth, events, NULL);
+		if (n < 0) {
+			perror("io_getevents");
+			return -1;
+		}
+		for (i = 0; i < n; i++)
+			if (events[i].res != block_size) {
+				fprintf(stderr, "aio: %lld\n",
+					(long long)events[i].res);
+				return -1;
+			}
+		for (i = 0; i < n; i++)
+			list[i] = &cbs[events[i].data];
+		*ops += n;
+		nr = n;
+	}
+	io_destroy(ctx);
+	return 0;
+}
+
+static int ring_open(struct ring *r, unsigned flags)
+{
+	struct io_ring_params p;
+	void *map;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	p.sq_thread_idle = 100;
+	r->fd = io_ring_setup(depth, &p);
+	if (r->fd < 0) {
+		/* no SQ thread without CAP_SYS_ADMIN, not an error here */
+		if (errno == EPERM && (flags & IORING_SETUP_SQPOLL))
+			return -EPERM;
+		perror("io_ring_setup");
+		return -1;
+	}
+	map = mmap(NULL, p.map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   r->fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		close(r->fd);
+		return -1;
+	}
+	r->size = p.map_size;
+	r->hdr = map;
+	r->sqes = map + r->hdr->sq_off;
+	r->cqes = map + r->hdr->cq_off;
+	return 0;
+}
+
+static void ring_close(struct ring *r)
+{
+	munmap(r->hdr, r->size);
+	close(r->fd);
+}
+
+static void ring_queue(struct ring *r, int fd, int slot)
+{
+	struct io_ring_hdr *hdr = r->hdr;
+	struct io_ring_sqe *sqe = &r->sqes[hdr->sq_tail & hdr->sq_mask];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = writes ? IORING_OP_WRITEV : IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->off = random_off();
+	sqe->addr = (unsigned long)&iovs[slot];
+	sqe->len = 1;
+	sqe->user_data = slot;
+	/* the SQE before the tail */
+	barrier();
+	hdr->sq_tail++;
+}
+
+/* reap what has completed and requeue it, returns the number reaped */
+static int ring_reap(struct ring *r, int fd)
+{
+	struct io_ring_hdr *hdr = r->hdr;
+	struct io_ring_cqe *cqe;
+	int n = 0;
+
+	while (hdr->cq_head != *(volatile __u32 *)&hdr->cq_tail) {
+		barrier();
+		cqe = &r->cqes[hdr->cq_head & hdr->cq_mask];
+		if (cqe->res != (int)block_size) {
+			fprintf(stderr, "io_ring: %s\n", strerror(-cqe->res));
+			return -1;
+		}
+		ring_queue(r, fd, cqe->user_data);
+		barrier();
+		hdr->cq_head++;
+		n++;
+	}
+	return n;
+}
+
+static int run_ring(int fd, unsigned long long *ops)
+{
+	unsigned long long end = now_ns() + seconds * 1000000000ULL;
+	struct ring r;
+	int i, n, nr;
+
+	if (ring_open(&r, 0))
+		return -1;
+	for (i = 0; i < depth; i++)
+		ring_queue(&r, fd, i);
+
+	nr = depth;
+	while (now_ns() < end) {
+		/* submit what was queued and wait for some of it */
+		if (io_ring_enter(r.fd, nr, 1, IORING_ENTER_GETEVENTS) < 0) {
+			perror("io_ring_enter");
+			return -1;
+		}
+		n = ring_reap(&r, fd);
+		if (n < 0)
+			return -1;
+		*ops += n;
+		nr = n;
+	}
+	ring_close(&r);
+	return 0;
+}
+
+static int run_sqpoll(int fd, unsigned long long *ops)
+{
+	unsigned long long end = now_ns() + seconds * 1000000000ULL;
+	struct ring r;
+	int i, n, ret;
+
+	ret = ring_open(&r, IORING_SETUP_SQPOLL);
+	if (ret == -EPERM)
+		return 1;
+	if (ret)
+		return -1;
+	for (i = 0; i < depth; i++)
+		ring_queue(&r, fd, i);
+
+	while (now_ns() < end) {
+		barrier();
+		if (r.hdr->flags & IORING_SQ_NEED_WAKEUP)
+			io_ring_enter(r.fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+		n = ring_reap(&r, fd);
+		if (n < 0)
+			return -1;
+		*ops += n;
+	}
+	ring_close(&r);
+	return 0;
+}
+
+static const struct mode {
+	const char *name;
+	int (*run)(int fd, unsigned long long *ops);
+} modes[] = {
+	{ "sync",	run_sync },
+	{ "io_submit",	run_aio },
+	{ "io_ring",	run_ring },
+	{ "sqpoll",	run_sqpoll },
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c file MB] [-q depth] [-b block size] [-t seconds] [-w] file\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long create = 0, ops, t;
+	struct stat st;
+	unsigned int i;
+	int fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "c:q:b:t:w")) != -1) {
+		switch (opt) {
+		case 'c':
+			create = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			block_size = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'w':
+			writes = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || depth < 1 || depth > MAX_DEPTH ||
+	    seconds < 1 || block_size < 512)
+		usage(argv[0]);
+
+	if (create && create_file(argv[optind], create))
+		return 1;
+
+	fd = open(argv[optind], writes ? O_RDWR : O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	blocks = st.st_size / block_size;
+	if (!blocks) {
+		fprintf(stderr, "%s: smaller than a block\n", argv[optind]);
+		return 1;
+	}
+	if (posix_memalign((void **)&bufs, 4096, (size_t)depth * block_size))
+		return 1;
+	memset(bufs, 0x5a, (size_t)depth * block_size);
+	for (i = 0; i < (unsigned int)depth; i++) {
+		iovs[i].iov_base = bufs + (size_t)i * block_size;
+		iovs[i].iov_len = block_size;
+	}
+	warm_cache(fd);
+
+	printf("%s: random %u byte %s, depth %d, %d s per mode\n",
+	       argv[optind], block_size, writes ? "writes" : "reads", depth,
+	       seconds);
+	printf("\n%10s %10s %8s %12s\n", "mode", "ops/s", "MB/s",
+	       "syscalls/op");
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		ops = syscalls = 0;
+		t = now_ns();
+		ret = modes[i].run(fd, &ops);
+		t = now_ns() - t;
+		if (ret < 0)
+			return 1;
+		if (ret > 0 || !ops) {
+			printf("%10s %10s\n", modes[i].name, "skipped");
+			continue;
+		}
+		printf("%10s %10llu %8.1f %12.3f\n", modes[i].name,
+		       ops * 1000000000ULL / t,
+		       (double)ops * block_size / (1 << 20) * 1e9 / t,
+		       (double)syscalls / ops);
+	}
+
+	close(fd);
+	return 0;
+}
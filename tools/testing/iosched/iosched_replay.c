@@ -0,0 +1,325 @@
+/*
+ * iosched_replay.c - Replay a block trace and report read latency
+ *
+ * Reads a trace of "seconds R|W sector sectors" lines, as produced from a
+ * blktrace capture by replay.sh, and issues the same O_DIRECT reads and
+ * writes against a device at the recorded times. Meanwhile a writeback
+ * thread dirties the page cache of the device at a fixed rate with
+ * buffered writes, so that the replayed I/O competes with async writeback
+ * the way it does on a phone installing an app. At the end the latency
+ * percentiles of the replayed reads are printed on one line:
+ *
+ *	reads p50_us p99_us p999_us max_us writes wb_MB
+ *
+ * Offsets are wrapped into the first half of the device; the writeback
+ * thread uses the second half.
+ *
+ * Build: gcc -O2 -Wall -pthread -o iosched_replay iosched_replay.c
+ *
+ * Usage: iosched_replay [-j threads] [-s speedup] [-W writeback MB/s]
+ *			 [-t max seconds] trace device
+ *
+ * The device is written to.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#define MAX_THREADS	64
+#define MAX_IO		(1 << 20)
+
+struct event {
+	unsigned long long when_ns;
+	unsigned long long off;
+	unsigned int len;
+	int write;
+	unsigned long long lat_ns;
+};
+
+static struct event *events;
+static unsigned long nr_events;
+static unsigned long next_event;
+static unsigned long long start_ns;
+static unsigned long long half_size;
+static double speedup = 1.0;
+static unsigned long long deadline_ns;
+static const char *device;
+static int wb_rate;
+static volatile int stop;
+static unsigned long long wb_bytes;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(unsigned long long t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void *replay_fn(void *arg __attribute__((unused)))
+{
+	struct event *ev;
+	unsigned long i;
+	unsigned long long t;
+	void *buf;
+	ssize_t ret;
+	int fd;
+
+	fd = open(device, O_RDWR | O_DIRECT);
+	if (fd < 0) {
+		perror(device);
+		return NULL;
+	}
+	if (posix_memalign(&buf, 4096, MAX_IO)) {
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0x5a, MAX_IO);
+
+	for (;;) {
+		i = __sync_fetch_and_add(&next_event, 1);
+		if (i >= nr_events)
+			break;
+		ev = &events[i];
+		t = start_ns + ev->when_ns / speedup;
+		if (deadline_ns && t > deadline_ns)
+			break;
+		sleep_until(t);
+
+		t = now_ns();
+		if (ev->write)
+			ret = pwrite(fd, buf, ev->len, ev->off);
+		else
+			ret = pread(fd, buf, ev->len, ev->off);
+		ev->lat_ns = now_ns() - t;
+		if (ret != (ssize_t)ev->len)
+			ev->lat_ns = 0;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+/*
+ * Dirty wb_rate MB of page cache every second; the flusher threads turn
+ * it into async writes to the device.
+ */
+static void *writeback_fn(void *arg __attribute__((unused)))
+{
+	unsigned long long off = 0, t = now_ns();
+	char *buf;
+	int fd, i;
+
+	fd = open(device, O_WRONLY);
+	if (fd < 0) {
+		perror(device);
+		return NULL;
+	}
+	buf = malloc(1 << 20);
+	if (!buf) {
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0xa5, 1 << 20);
+
+	while (!stop) {
+		for (i = 0; i < wb_rate && !stop; i++) {
+			if (pwrite(fd, buf, 1 << 20, half_size + off) < 0)
+				break;
+			wb_bytes += 1 << 20;
+			off = (off + (1 << 20)) % half_size;
+		}
+		t += 1000000000ULL;
+		sleep_until(t);
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static int load_trace(const char *path)
+{
+	unsigned long long sector, sectors, first = 0;
+	unsigned long alloc = 0;
+	char rwbs[16];
+	double when;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fscanf(f, "%lf %15s %llu %llu", &when, rwbs, &sector,
+		      &sectors) == 4) {
+		if (!sectors || (!strchr(rwbs, 'R') && !strchr(rwbs, 'W')))
+			continue;
+		if (nr_events == alloc) {
+			alloc = alloc ? alloc * 2 : 4096;
+			events = realloc(events, alloc * sizeof(*events));
+			if (!events) {
+				fclose(f);
+				return -1;
+			}
+		}
+		if (!nr_events)
+			first = when * 1e9;
+		events[nr_events].when_ns = when * 1e9 - first;
+		events[nr_events].off = (sector * 512) % half_size & ~4095ULL;
+		events[nr_events].len = sectors * 512 > MAX_IO ?
+			MAX_IO : (sectors * 512 + 4095) & ~4095U;
+		if (events[nr_events].off + events[nr_events].len > half_size)
+			events[nr_events].off = 0;
+		events[nr_events].write = strchr(rwbs, 'W') != NULL;
+		events[nr_events].lat_ns = 0;
+		nr_events++;
+	}
+	fclose(f);
+	return 0;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-s speedup] [-W writeback MB/s] [-t max seconds] trace device\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t threads[MAX_THREADS], wb_thread;
+	unsigned long long size, *lat;
+	struct stat st;
+	unsigned long i, reads = 0, writes = 0;
+	int nr_threads = 8, seconds = 0;
+	int opt, fd, j;
+
+	while ((opt = getopt(argc, argv, "j:s:W:t:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			speedup = atof(optarg);
+			break;
+		case 'W':
+			wb_rate = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2 || nr_threads < 1 || nr_threads > MAX_THREADS ||
+	    speedup <= 0 || wb_rate < 0 || seconds < 0)
+		usage(argv[0]);
+	device = argv[optind + 1];
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(device);
+		return 1;
+	}
+	/* a regular file will do for a dry run */
+	if (S_ISREG(st.st_mode)) {
+		size = st.st_size;
+	} else if (ioctl(fd, BLKGETSIZE64, &size) < 0) {
+		perror(device);
+		return 1;
+	}
+	close(fd);
+	half_size = size / 2 & ~((1ULL << 20) - 1);
+	if (half_size < MAX_IO) {
+		fprintf(stderr, "%s: device too small\n", device);
+		return 1;
+	}
+
+	if (load_trace(argv[optind]) || !nr_events) {
+		fprintf(stderr, "%s: no events\n", argv[optind]);
+		return 1;
+	}
+
+	if (wb_rate && pthread_create(&wb_thread, NULL, writeback_fn, NULL)) {
+		perror("pthread_create");
+		return 1;
+	}
+	/* let writeback get going before the first replayed request */
+	if (wb_rate)
+		sleep(1);
+
+	start_ns = now_ns();
+	if (seconds)
+		deadline_ns = start_ns + seconds * 1000000000ULL;
+	for (j = 0; j < nr_threads; j++) {
+		if (pthread_create(&threads[j], NULL, replay_fn, NULL)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (j = 0; j < nr_threads; j++)
+		pthread_join(threads[j], NULL);
+	stop = 1;
+	if (wb_rate)
+		pthread_join(wb_thread, NULL);
+
+	lat = malloc(nr_events * sizeof(*lat));
+	if (!lat)
+		return 1;
+	for (i = 0; i < nr_events; i++) {
+		if (!events[i].lat_ns)
+			continue;
+		if (events[i].write)
+			writes++;
+		else
+			lat[reads++] = events[i].lat_ns;
+	}
+	if (!reads) {
+		fprintf(stderr, "no reads completed\n");
+		return 1;
+	}
+	qsort(lat, reads, sizeof(*lat), cmp_ull);
+
+	printf("%lu %llu %llu %llu %llu %lu %llu\n", reads,
+	       lat[reads / 2] / 1000, lat[reads * 99 / 100] / 1000,
+	       lat[reads * 999 / 1000] / 1000, lat[reads - 1] / 1000,
+	       writes, wb_bytes >> 20);
+	return 0;
+}
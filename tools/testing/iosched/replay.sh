@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# replay.sh - compare I/O schedulers by replaying a blktrace capture
+#
+# Usage: replay.sh [-W writeback MB/s] [-s speedup] [-d delay jiffies]
+#		   [-m disk MB] [-t max seconds] capture
+#
+# capture is the base name of a blktrace capture (capture.blktrace.N), for
+# example one taken on a phone with "blktrace -d /dev/block/mmcblk0 -o boot"
+# while it boots or starts an app. The queued (Q) events are extracted with
+# blkparse and replayed by iosched_replay on a RAM backed scsi_debug disk,
+# once for every scheduler the kernel offers, with buffered writeback
+# running in the background. brd can't be used: it takes bios directly and
+# never reaches an I/O scheduler. delay is the scsi_debug completion delay,
+# which stands in for the device's service time.
+#
+# For every scheduler the read latency percentiles are printed in usecs,
+# with the number of replayed writes and of MB written back.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+WB=16
+SPEEDUP=1
+DELAY=1
+MB=512
+SECONDS_MAX=60
+
+while getopts W:s:d:m:t: opt; do
+	case $opt in
+	W) WB=$OPTARG ;;
+	s) SPEEDUP=$OPTARG ;;
+	d) DELAY=$OPTARG ;;
+	m) MB=$OPTARG ;;
+	t) SECONDS_MAX=$OPTARG ;;
+	*) echo "usage: $0 [-W MB/s] [-s speedup] [-d delay] [-m MB] [-t s] capture"
+	   exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || { echo "usage: $0 [-W MB/s] [-s speedup] [-d delay] [-m MB] [-t s] capture"; exit 1; }
+
+HERE=$(cd $(dirname $0) && pwd)
+REPLAY=$HERE/iosched_replay
+TRACE=/tmp/iosched_replay.$$
+
+[ -x $REPLAY ] || gcc -O2 -Wall -pthread -o $REPLAY $HERE/iosched_replay.c || exit 1
+
+blkparse -i $1 -f "%a %T.%9t %d %S %n\n" 2>/dev/null | \
+	awk '$1 == "Q" { print $2, $3, $4, $5 }' > $TRACE
+[ -s $TRACE ] || { echo "$1: no queued events"; rm -f $TRACE; exit 1; }
+
+modprobe scsi_debug dev_size_mb=$MB delay=$DELAY max_queue=32 || exit 1
+sleep 1
+DEV=
+for d in /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*:*/block/*; do
+	[ -d $d ] && DEV=$(basename $d)
+done
+[ -n "$DEV" ] || { echo "no scsi_debug disk"; modprobe -r scsi_debug; exit 1; }
+SYS=/sys/block/$DEV/queue
+
+echo "$(wc -l < $TRACE) events, $DEV, ${WB} MB/s writeback, speedup $SPEEDUP"
+printf "%-10s %8s %8s %8s %8s %8s %8s %6s\n" sched reads p50_us p99_us \
+	p999_us max_us writes wb_MB
+
+for sched in $(sed 's/[][]//g' $SYS/scheduler); do
+	echo $sched > $SYS/scheduler
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	set -- $($REPLAY -s $SPEEDUP -W $WB -t $SECONDS_MAX $TRACE /dev/$DEV)
+	printf "%-10s %8s %8s %8s %8s %8s %8s %6s\n" $sched "$1" "$2" "$3" \
+		"$4" "$5" "$6" "$7"
+done
+
+rm -f $TRACE
+modprobe -r scsi_debug
@@ -0,0 +1,301 @@
+/*
+ * lmk_stress.c - Allocation stress test for the low memory killer
+ *
+ * Forks a number of workers with increasing oom_score_adj that keep
+ * allocating and touching anonymous memory until together they want about
+ * twice the RAM of the machine, then churn through it. Workers that get
+ * killed are restarted, so the pressure persists for the whole run.
+ *
+ * At the end the test reports how many workers were killed (and at which
+ * oom_score_adj), how long page faults on freshly allocated memory
+ * stalled, and how many memory.pressure_level events each level got, if
+ * a memory cgroup was given.
+ *
+ * Build: gcc -O2 -Wall -o lmk_stress lmk_stress.c
+ *
+ * Usage: lmk_stress [-n workers] [-t seconds] [-m MB per worker]
+ *		     [-c /sys/fs/cgroup/memory[/group]]
+ *
+ * Enabling the lowmemorykiller:lowmem_scan and lowmem_kill trace events
+ * during the run gives the cost of each scan and kill.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define CHUNK		(1UL << 20)
+#define MAX_WORKERS	64
+#define STALL_MS	10
+
+static const char * const levels[] = { "low", "medium", "critical" };
+#define NR_LEVELS	(sizeof(levels) / sizeof(levels[0]))
+
+/* Shared with the workers, so that killed workers' numbers survive */
+struct worker_stats {
+	unsigned long chunks;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	unsigned long stalls;
+	unsigned long kills;
+	int oom_score_adj;
+};
+
+static struct worker_stats *stats;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void set_oom_score_adj(int adj)
+{
+	char buf[16];
+	int fd, len;
+
+	fd = open("/proc/self/oom_score_adj", O_WRONLY);
+	if (fd < 0)
+		return;
+	len = snprintf(buf, sizeof(buf), "%d", adj);
+	if (write(fd, buf, len) != len)
+		perror("oom_score_adj");
+	close(fd);
+}
+
+static void worker(struct worker_stats *st, unsigned long max_chunks)
+{
+	char **chunks = calloc(max_chunks, sizeof(*chunks));
+	unsigned long i = 0, n;
+	unsigned long long t, d;
+
+	if (!chunks) {
+		perror("calloc");
+		return;
+	}
+	set_oom_score_adj(st->oom_score_adj);
+
+	for (;;) {
+		/* once full, recycle the oldest chunk */
+		if (chunks[i])
+			munmap(chunks[i], CHUNK);
+
+		t = now_ns();
+		chunks[i] = mmap(NULL, CHUNK, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (chunks[i] == MAP_FAILED) {
+			chunks[i] = NULL;
+			usleep(1000);
+			continue;
+		}
+		/* half compressible, like typical anonymous memory */
+		for (n = 0; n < CHUNK; n += 4096)
+			memset(chunks[i] + n, (int)(n >> 12), 2048);
+		d = now_ns() - t;
+
+		st->chunks++;
+		st->total_ns += d;
+		if (d > st->max_ns)
+			st->max_ns = d;
+		if (d > STALL_MS * 1000000ULL)
+			st->stalls++;
+
+		i = (i + 1) % max_chunks;
+	}
+}
+
+/* returns -1 if fork failed, main() tries again later */
+static pid_t start_worker(int i, unsigned long max_chunks)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		perror("fork");
+	if (pid == 0) {
+		worker(&stats[i], max_chunks);
+		_exit(0);
+	}
+	return pid;
+}
+
+/* Register an eventfd for @level on the memory cgroup at @path */
+static int pressure_event(const char *path, const char *level)
+{
+	char file[4096], cmd[64];
+	int efd, cfd, pfd, len;
+
+	efd = eventfd(0, EFD_NONBLOCK);
+	if (efd < 0)
+		return -1;
+
+	snprintf(file, sizeof(file), "%s/memory.pressure_level", path);
+	pfd = open(file, O_RDONLY);
+	snprintf(file, sizeof(file), "%s/cgroup.event_control", path);
+	cfd = open(file, O_WRONLY);
+	if (pfd < 0 || cfd < 0) {
+		perror(file);
+		return -1;
+	}
+
+	len = snprintf(cmd, sizeof(cmd), "%d %d %s", efd, pfd, level);
+	if (write(cfd, cmd, len) != len) {
+		perror("cgroup.event_control");
+		return -1;
+	}
+	close(cfd);
+
+	return efd;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n workers] [-t seconds] [-m MB per worker] [-c memcg path]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pid_t pids[MAX_WORKERS];
+	struct pollfd pfds[NR_LEVELS];
+	unsigned long events[NR_LEVELS] = { 0 };
+	unsigned long long end, total_ns = 0, max_ns = 0;
+	unsigned long chunks = 0, stalls = 0, kills = 0, max_chunks;
+	unsigned long ram_mb;
+	const char *memcg = NULL;
+	int nr_workers = 8, seconds = 60, mb = 0;
+	int i, opt, status, nfds = 0;
+	uint64_t val;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "n:t:m:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_workers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			mb = atoi(optarg);
+			break;
+		case 'c':
+			memcg = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_workers < 1 || nr_workers > MAX_WORKERS || seconds < 1)
+		usage(argv[0]);
+
+	ram_mb = sysconf(_SC_PHYS_PAGES) / (CHUNK / sysconf(_SC_PAGESIZE));
+	if (!mb)
+		mb = 2 * ram_mb / nr_workers;
+	max_chunks = mb;
+
+	stats = mmap(NULL, sizeof(*stats) * nr_workers, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(stats, 0, sizeof(*stats) * nr_workers);
+
+	if (memcg) {
+		for (i = 0; i < (int)NR_LEVELS; i++) {
+			pfds[i].fd = pressure_event(memcg, levels[i]);
+			pfds[i].events = POLLIN;
+			if (pfds[i].fd < 0)
+				return 1;
+		}
+		nfds = NR_LEVELS;
+	}
+
+	printf("%d workers, %d MB each, %lu MB RAM, %d seconds\n",
+	       nr_workers, mb, ram_mb, seconds);
+
+	/* the first worker is the most important one */
+	for (i = 0; i < nr_workers; i++) {
+		stats[i].oom_score_adj = i * 1000 / nr_workers;
+		pids[i] = start_worker(i, max_chunks);
+	}
+
+	end = now_ns() + seconds * 1000000000ULL;
+	while (now_ns() < end) {
+		if (poll(pfds, nfds, 100) > 0) {
+			for (i = 0; i < nfds; i++) {
+				if (!(pfds[i].revents & POLLIN))
+					continue;
+				if (read(pfds[i].fd, &val, sizeof(val)) ==
+				    sizeof(val))
+					events[i] += val;
+			}
+		}
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (i = 0; i < nr_workers; i++)
+				if (pids[i] == pid)
+					break;
+			if (i == nr_workers)
+				continue;
+			if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL)
+				stats[i].kills++;
+			pids[i] = start_worker(i, max_chunks);
+		}
+		/* fork can fail under the pressure we create */
+		for (i = 0; i < nr_workers; i++)
+			if (pids[i] < 0)
+				pids[i] = start_worker(i, max_chunks);
+	}
+
+	/* never kill(-1), that signals every process we may signal */
+	for (i = 0; i < nr_workers; i++)
+		if (pids[i] > 0)
+			kill(pids[i], SIGTERM);
+	while (wait(NULL) > 0)
+		;
+
+	printf("\n%6s %8s %8s %10s %10s %8s\n", "adj", "kills", "chunks",
+	       "avg_us", "max_us", "stalls");
+	for (i = 0; i < nr_workers; i++) {
+		struct worker_stats *st = &stats[i];
+
+		printf("%6d %8lu %8lu %10llu %10llu %8lu\n", st->oom_score_adj,
+		       st->kills, st->chunks,
+		       st->chunks ? st->total_ns / st->chunks / 1000 : 0,
+		       st->max_ns / 1000, st->stalls);
+		kills += st->kills;
+		chunks += st->chunks;
+		stalls += st->stalls;
+		total_ns += st->total_ns;
+		if (st->max_ns > max_ns)
+			max_ns = st->max_ns;
+	}
+
+	printf("\nkills: %lu\n", kills);
+	printf("allocated: %lu MB, average %llu us/MB, max %llu us/MB\n",
+	       chunks, chunks ? total_ns / chunks / 1000 : 0, max_ns / 1000);
+	printf("stalls over %d ms: %lu\n", STALL_MS, stalls);
+	for (i = 0; i < nfds; i++)
+		printf("%s pressure events: %lu\n", levels[i], events[i]);
+
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * launch_replay.c - Cold app launch read pattern
+ *
+ * Reads a set of files the way an app start reads its APK, dex file and
+ * libraries: scattered preads of the APK and dex file and page faults on
+ * scattered pages of mmapped libraries, all at offsets drawn from a fixed
+ * seed so that every launch reads the same pages in the same order. The
+ * page cache is dropped before every launch, and the time each launch
+ * took and its major faults are printed. Run it with
+ * /sys/kernel/mm/readahead_learn/enabled at 0 and at 1 to see what the
+ * learned readahead does; launch_test.sh does that on a loop mounted
+ * ext4 image.
+ *
+ * Build: gcc -O2 -Wall -pthread -o launch_replay launch_replay.c
+ *
+ * Usage: launch_replay -c [-m app MB] dir
+ *	  launch_replay [-l launches] [-n reads per MB] [-s seed] dir
+ *
+ * -c creates the files in dir, about app MB of them in all. Launching
+ * needs root to drop the page cache.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#define PAGE		4096
+
+/* name and share of the app's size, in percent */
+static const struct app_file {
+	const char *name;
+	int share;
+	int mapped;
+} app_files[] = {
+	{ "base.apk",		50, 0 },
+	{ "classes.dex",	20, 0 },
+	{ "libapp.so",		15, 1 },
+	{ "libui.so",		10, 1 },
+	{ "libutil.so",		5, 1 },
+};
+#define NR_FILES	(sizeof(app_files) / sizeof(app_files[0]))
+
+static const char *dir;
+static unsigned long long app_size = 64ULL << 20;
+static int reads_per_mb = 16;
+static unsigned int seed = 1;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long file_size(const struct app_file *f)
+{
+	return (app_size * f->share / 100) & ~(PAGE - 1ULL);
+}
+
+static int create_files(void)
+{
+	char path[4096], *buf;
+	unsigned long long off, size;
+	unsigned int i, j;
+	int fd;
+
+	buf = malloc(1 << 20);
+	if (!buf)
+		return 1;
+	srand(seed);
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, app_files[i].name);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			return 1;
+		}
+		size = file_size(&app_files[i]);
+		for (off = 0; off < size; off += 1 << 20) {
+			for (j = 0; j < (1 << 20) / sizeof(int); j++)
+				((int *)buf)[j] = rand();
+			if (write(fd, buf, size - off < (1 << 20) ?
+				  size - off : (1 << 20)) < 0) {
+				perror(path);
+				return 1;
+			}
+		}
+		fsync(fd);
+		close(fd);
+	}
+	free(buf);
+	return 0;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* read or fault in the file's scattered pages, same ones every launch */
+static int launch_file(const struct app_file *f, unsigned int *rnd)
+{
+	unsigned long long size = file_size(f), off;
+	unsigned long pages = size / PAGE;
+	int nr = reads_per_mb * (size >> 20) + 1;
+	volatile char *map = NULL;
+	char path[4096], buf[64 * 1024];
+	size_t len;
+	int fd, i;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, f->name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (f->mapped) {
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			close(fd);
+			return -1;
+		}
+	}
+
+	/* the header and the central directory or symbol tables first */
+	if (pread(fd, buf, PAGE, 0) < 0 ||
+	    pread(fd, buf, PAGE, size - PAGE) < 0)
+		perror(path);
+
+	for (i = 0; i < nr; i++) {
+		off = (unsigned long long)(rand_r(rnd) % pages) * PAGE;
+		len = (1 + rand_r(rnd) % 16) * PAGE;
+		if (off + len > size)
+			len = size - off;
+		if (map) {
+			unsigned long long o;
+
+			for (o = off; o < off + len; o += PAGE)
+				(void)map[o];
+		} else if (pread(fd, buf, len, off) < 0) {
+			perror(path);
+			break;
+		}
+	}
+
+	if (map)
+		munmap((void *)map, size);
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -c [-m app MB] dir\n"
+		"       %s [-l launches] [-n reads per MB] [-s seed] dir\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long t, total = 0;
+	struct rusage ru0, ru1;
+	unsigned int rnd, i;
+	int launches = 5, create = 0, l, opt;
+
+	while ((opt = getopt(argc, argv, "cm:l:n:s:")) != -1) {
+		switch (opt) {
+		case 'c':
+			create = 1;
+			break;
+		case 'm':
+			app_size = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'l':
+			launches = atoi(optarg);
+			break;
+		case 'n':
+			reads_per_mb = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || launches < 1 || reads_per_mb < 0 ||
+	    app_size < (1ULL << 20) * 10)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create)
+		return create_files();
+
+	printf("%8s %10s %10s\n", "launch", "ms", "majflt");
+	for (l = 1; l <= launches; l++) {
+		drop_caches();
+		getrusage(RUSAGE_SELF, &ru0);
+		rnd = seed;
+		t = now_ns();
+		for (i = 0; i < NR_FILES; i++)
+			if (launch_file(&app_files[i], &rnd))
+				return 1;
+		t = now_ns() - t;
+		getrusage(RUSAGE_SELF, &ru1);
+		total += t;
+		printf("%8d %10llu %10ld\n", l, t / 1000000,
+		       ru1.ru_majflt - ru0.ru_majflt);
+	}
+	printf("%8s %10llu\n", "avg", total / launches / 1000000);
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# launch_test.sh - compare cold launches with and without learned readahead
+#
+# Usage: launch_test.sh [-l launches] [-m app MB] [-n reads per MB] [dir]
+#
+# Makes an ext4 file system on a loop file in dir (default /data/local/tmp),
+# creates launch_replay's app files on it and runs launch_replay, which
+# drops the page cache before every launch, first with
+# /sys/kernel/mm/readahead_learn/enabled at 0 and then at 1 with no
+# profiles kept. With learning on, the first learn_opens launches record
+# and the rest replay. After every run the ra_learn counters of
+# /proc/vmstat that the run moved are printed.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+LAUNCHES=6
+APP_MB=64
+READS=16
+
+usage() {
+	echo "usage: $0 [-l launches] [-m app MB] [-n reads per MB] [dir]"
+	exit 1
+}
+
+while getopts l:m:n: opt; do
+	case $opt in
+	l) LAUNCHES=$OPTARG ;;
+	m) APP_MB=$OPTARG ;;
+	n) READS=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+HERE=$(cd $(dirname $0) && pwd)
+BENCH=$HERE/launch_replay
+SYS=/sys/kernel/mm/readahead_learn
+FILE=$DIR/launch_test.img
+MNT=$DIR/launch_test.mnt
+
+[ -d $SYS ] || { echo "kernel without CONFIG_READAHEAD_LEARN"; exit 1; }
+[ -x $BENCH ] || gcc -O2 -Wall -pthread -o $BENCH $HERE/launch_replay.c || exit 1
+OLD_ENABLED=$(cat $SYS/enabled)
+OLD_MAX=$(cat $SYS/max_profiles)
+
+ra_counters() {
+	grep '^ra_learn_' /proc/vmstat
+}
+
+dd if=/dev/zero of=$FILE bs=1M count=$((APP_MB * 2)) 2>/dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $FILE || { rm -f $FILE; exit 1; }
+mkdir -p $MNT
+mkfs.ext4 -q -F $LOOP && mount -t ext4 $LOOP $MNT || {
+	rmdir $MNT; losetup -d $LOOP; rm -f $FILE; exit 1;
+}
+$BENCH -c -m $APP_MB $MNT || exit 1
+
+for on in 0 1; do
+	echo "== learned readahead enabled $on"
+	echo 0 > $SYS/max_profiles
+	echo $OLD_MAX > $SYS/max_profiles
+	echo $on > $SYS/enabled
+	ra_counters > /tmp/launch_test.$$
+	$BENCH -l $LAUNCHES -m $APP_MB -n $READS $MNT
+	echo
+	ra_counters | paste /tmp/launch_test.$$ - | \
+		awk '{ printf "%-16s %10d\n", $1, $4 - $2 }'
+	echo
+done
+
+rm -f /tmp/launch_test.$$
+echo $OLD_ENABLED > $SYS/enabled
+umount $MNT
+rmdir $MNT
+losetup -d $LOOP
+rm -f $FILE
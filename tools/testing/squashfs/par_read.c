@@ -0,0 +1,250 @@
+/*
+ * par_read.c - Parallel cold reads of a directory of files
+ *
+ * Reads every regular file in a directory from start to end with 1, 2,
+ * 4 ... up to the given number of threads, the files shared out between
+ * the threads, dropping the page cache before every step. On squashfs
+ * the reads are bound by decompression, so how the time scales with the
+ * threads shows how much of it runs in parallel. For every step the time
+ * taken and MB per second of file data are printed. squashfs_test.sh runs
+ * it on a loop mounted image with the different threads= and readpage=
+ * mount options.
+ *
+ * Build: gcc -O2 -Wall -pthread -o par_read par_read.c
+ *
+ * Usage: par_read -c [-n files] [-s file KB] dir
+ *	  par_read [-t max threads] [-b read size] dir
+ *
+ * -c creates the files, with data that gzip compresses to about a quarter.
+ * Reading needs root to drop the page cache.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_THREADS	64
+#define MAX_FILES	65536
+
+static const char *dir;
+static char *files[MAX_FILES];
+static int nr_files;
+static int next_file;
+static unsigned int read_size = 64 * 1024;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int create_files(int nr, unsigned long size)
+{
+	static const char *words[] = {
+		"squashfs ", "block ", "fragment ", "inode ", "page ",
+		"cache ", "stream ", "zlib ", "dex ", "apk ", "launch ",
+	};
+	char path[4096], *buf;
+	unsigned long off, len;
+	int fd, i;
+
+	buf = malloc(size);
+	if (!buf)
+		return 1;
+	srand(1);
+	for (i = 0; i < nr; i++) {
+		/* words for text, random bytes for the rest */
+		for (off = 0; off < size; off += len) {
+			if (rand() % 3) {
+				const char *w = words[rand() % 11];
+
+				len = strlen(w);
+				if (len > size - off)
+					len = size - off;
+				memcpy(buf + off, w, len);
+			} else {
+				buf[off] = rand();
+				len = 1;
+			}
+		}
+		snprintf(path, sizeof(path), "%s/file%05d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || write(fd, buf, size) != (ssize_t)size) {
+			perror(path);
+			return 1;
+		}
+		close(fd);
+	}
+	free(buf);
+	return 0;
+}
+
+static int list_files(void)
+{
+	char path[4096];
+	struct dirent *d;
+	struct stat st;
+	DIR *dp;
+
+	dp = opendir(dir);
+	if (!dp) {
+		perror(dir);
+		return -1;
+	}
+	while ((d = readdir(dp)) && nr_files < MAX_FILES) {
+		snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+		if (stat(path, &st) || !S_ISREG(st.st_mode))
+			continue;
+		files[nr_files++] = strdup(path);
+	}
+	closedir(dp);
+	return nr_files ? 0 : -1;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* take files off the shared list until there are none left */
+static void *reader(void *arg)
+{
+	unsigned long long *bytes = arg;
+	char *buf = malloc(read_size);
+	ssize_t n;
+	int fd, f;
+
+	if (!buf)
+		return NULL;
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		f = next_file < nr_files ? next_file++ : -1;
+		pthread_mutex_unlock(&lock);
+		if (f < 0)
+			break;
+
+		fd = open(files[f], O_RDONLY);
+		if (fd < 0) {
+			perror(files[f]);
+			continue;
+		}
+		while ((n = read(fd, buf, read_size)) > 0)
+			*bytes += n;
+		if (n < 0)
+			perror(files[f]);
+		close(fd);
+	}
+	free(buf);
+	return NULL;
+}
+
+static int run_step(int threads)
+{
+	static unsigned long long bytes[MAX_THREADS];
+	pthread_t tid[MAX_THREADS];
+	unsigned long long t, total = 0;
+	int i;
+
+	drop_caches();
+	next_file = 0;
+	memset(bytes, 0, sizeof(bytes));
+
+	t = now_ns();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tid[i], NULL, reader, &bytes[i])) {
+			perror("pthread_create");
+			return -1;
+		}
+	for (i = 0; i < threads; i++) {
+		pthread_join(tid[i], NULL);
+		total += bytes[i];
+	}
+	t = now_ns() - t;
+
+	printf("%8d %10llu %10.1f\n", threads, t / 1000000,
+	       (double)total / (1 << 20) * 1e9 / t);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -c [-n files] [-s file KB] dir\n"
+		"       %s [-t max threads] [-b read size] dir\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int create = 0, nr = 256, max_threads = 8, threads, opt;
+	unsigned long size = 512 * 1024;
+
+	while ((opt = getopt(argc, argv, "cn:s:t:b:")) != -1) {
+		switch (opt) {
+		case 'c':
+			create = 1;
+			break;
+		case 'n':
+			nr = atoi(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 10) * 1024;
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'b':
+			read_size = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr < 1 || nr > MAX_FILES || !size ||
+	    max_threads < 1 || max_threads > MAX_THREADS || !read_size)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create)
+		return create_files(nr, size);
+
+	if (list_files()) {
+		fprintf(stderr, "%s: no files\n", dir);
+		return 1;
+	}
+
+	printf("%s: %d files\n\n", dir, nr_files);
+	printf("%8s %10s %10s\n", "threads", "ms", "MB/s");
+
+	/* 1, 2, 4 ... and max_threads */
+	for (threads = 1; ;
+	     threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+		if (run_step(threads))
+			return 1;
+		if (threads == max_threads)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# squashfs_test.sh - parallel cold reads of squashfs with each decompressor mode
+#
+# Usage: squashfs_test.sh [-c compressor] [-n files] [-s file KB]
+#			  [-t max threads] [dir]
+#
+# Creates par_read's files in dir (default /data/local/tmp), packs them
+# into a squashfs image with mksquashfs and loop mounts the image once
+# for every combination of the threads= and readpage= mount options,
+# running par_read on it each time. With threads=single the read rate
+# should not grow with the threads; with the other modes it should, up
+# to the number of CPUs.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+COMP=gzip
+FILES=256
+SIZE_KB=512
+THREADS=$(grep -c ^processor /proc/cpuinfo)
+
+usage() {
+	echo "usage: $0 [-c compressor] [-n files] [-s file KB] [-t max threads] [dir]"
+	exit 1
+}
+
+while getopts c:n:s:t: opt; do
+	case $opt in
+	c) COMP=$OPTARG ;;
+	n) FILES=$OPTARG ;;
+	s) SIZE_KB=$OPTARG ;;
+	t) THREADS=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -le 1 ] || usage
+
+DIR=${1:-/data/local/tmp}
+HERE=$(cd $(dirname $0) && pwd)
+BENCH=$HERE/par_read
+SRC=$DIR/squashfs_test.src
+IMG=$DIR/squashfs_test.img
+MNT=$DIR/squashfs_test.mnt
+
+which mksquashfs > /dev/null || { echo "mksquashfs not found"; exit 1; }
+[ -x $BENCH ] || gcc -O2 -Wall -pthread -o $BENCH $HERE/par_read.c || exit 1
+
+mkdir -p $SRC $MNT
+$BENCH -c -n $FILES -s $SIZE_KB $SRC || exit 1
+mksquashfs $SRC $IMG -comp $COMP -noappend -no-progress > /dev/null || exit 1
+echo "image $(du -k $IMG | cut -f1) KB of $((FILES * SIZE_KB)) KB, $COMP"
+
+LOOP=$(losetup -f)
+losetup $LOOP $IMG || exit 1
+
+for readpage in cache direct; do
+	for threads in single multi percpu; do
+		echo
+		echo "== threads=$threads readpage=$readpage"
+		mount -t squashfs -o ro,threads=$threads,readpage=$readpage \
+			$LOOP $MNT || continue
+		$BENCH -t $THREADS $MNT
+		umount $MNT
+	done
+done
+
+losetup -d $LOOP
+rmdir $MNT
+rm -rf $SRC $IMG
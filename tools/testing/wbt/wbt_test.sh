@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# wbt_test.sh - show the effect of writeback throttling on read latency
+#
+# Usage: wbt_test.sh [dir] [mb] [lat_usec] [seconds]
+#
+# Sets up a loop device on an mb sized file in dir and runs the fio jobs
+# in wbt.fio on it three times: reads alone, reads with buffered writeback
+# and wbt_lat_usec=0, and reads with writeback and wbt_lat_usec=lat_usec.
+# The loop device takes bios directly and passes them on as file I/O, so
+# the throttling happens on the disk holding dir; that is the queue whose
+# wbt_lat_usec is changed. For each run the reader's completion latency
+# percentiles are printed, and for the throttled run also the window and
+# observed read latency once a second.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+DIR=${1:-/data/local/tmp}
+MB=${2:-1024}
+LAT=${3:-20000}
+export RUNTIME=${4:-30}
+HERE=$(cd $(dirname $0) && pwd)
+FILE=$DIR/wbt_test.img
+
+which fio >/dev/null 2>&1 || { echo "fio not found"; exit 1; }
+
+# the whole disk under dir
+part=$(basename $(df -P $DIR | tail -1 | awk '{ print $1 }'))
+if [ -f /sys/class/block/$part/partition ]; then
+	disk=$(basename $(readlink -f /sys/class/block/$part/..))
+else
+	disk=$part
+fi
+Q=/sys/block/$disk/queue
+[ -f $Q/wbt_lat_usec ] || { echo "$disk: no writeback throttling"; exit 1; }
+OLD_LAT=$(cat $Q/wbt_lat_usec)
+
+dd if=/dev/zero of=$FILE bs=1M count=$MB 2>/dev/null || exit 1
+LOOP=$(losetup -f)
+losetup $LOOP $FILE || { rm -f $FILE; exit 1; }
+export DEV=$LOOP
+export HALF=$((MB / 2))m
+
+run() {
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	fio $HERE/wbt.fio "$@" | grep -A 8 "clat percentiles"
+}
+
+echo "== reads alone"
+echo 0 > $Q/wbt_lat_usec
+run --section=reader
+
+echo "== reads + writeback, throttling off"
+run --section=reader --section=writeback
+
+echo "== reads + writeback, wbt_lat_usec=$LAT"
+echo $LAT > $Q/wbt_lat_usec
+(
+	i=0
+	while [ $i -lt $RUNTIME ]; do
+		sleep 1
+		echo "window $(cat $Q/wbt_window)" \
+			"observed $(cat $Q/wbt_lat_observed_usec)us"
+		i=$((i + 1))
+	done
+) &
+run --section=reader --section=writeback
+wait
+
+echo $OLD_LAT > $Q/wbt_lat_usec
+losetup -d $LOOP
+rm -f $FILE
@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# zram_bench.sh - measure zram write/read throughput with parallel writers
+#
+# Usage: zram_bench.sh [dev] [max_jobs] [mb_per_job] [data_file]
+#
+# For every max_comp_streams value in 1 and max_jobs, the device is reset,
+# re-initialised and filled by 1..max_jobs concurrent dd writers, each one
+# working on its own region of the disk. The same regions are then read
+# back in parallel. Throughput is the aggregate over all jobs.
+#
+# data_file is used as the page source so that the data compresses like
+# real swap traffic would; it defaults to a concatenation of whatever is
+# found in /system/lib (or /usr/lib). If fio is installed, a randrw fio job
+# with the same number of jobs is run as well.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+DEV=${1:-zram0}
+MAX_JOBS=${2:-$(grep -c ^processor /proc/cpuinfo)}
+MB=${3:-32}
+DATA=${4:-/tmp/zram_bench.data}
+SYS=/sys/block/$DEV
+
+[ -d $SYS ] || { echo "no such device: $DEV"; exit 1; }
+
+if [ ! -f $DATA ]; then
+	for d in /system/lib /usr/lib; do
+		[ -d $d ] && find $d -type f -name '*.so*' 2>/dev/null | \
+			xargs cat 2>/dev/null | head -c $((MB * 1024 * 1024)) > $DATA
+		[ -s $DATA ] && break
+	done
+fi
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+setup() {
+	echo 1 > $SYS/reset
+	echo $1 > $SYS/max_comp_streams
+	echo $((MAX_JOBS * MB + 1))M > $SYS/disksize
+}
+
+# run_jobs <jobs> <write|read>
+run_jobs() {
+	j=0
+	start=$(now_ms)
+	while [ $j -lt $1 ]; do
+		if [ $2 = write ]; then
+			dd if=$DATA of=/dev/$DEV bs=4096 count=$((MB * 256)) \
+				seek=$((j * MB * 256)) conv=notrunc \
+				oflag=direct 2>/dev/null &
+		else
+			dd if=/dev/$DEV of=/dev/null bs=4096 \
+				count=$((MB * 256)) skip=$((j * MB * 256)) \
+				iflag=direct 2>/dev/null &
+		fi
+		j=$((j + 1))
+	done
+	wait
+	end=$(now_ms)
+	echo $(($1 * MB * 1000 / (end - start + 1)))
+}
+
+printf "%8s %5s %12s %12s\n" streams jobs "write MB/s" "read MB/s"
+for streams in 1 $MAX_JOBS; do
+	jobs=1
+	while [ $jobs -le $MAX_JOBS ]; do
+		setup $streams
+		w=$(run_jobs $jobs write)
+		r=$(run_jobs $jobs read)
+		printf "%8d %5d %12d %12d\n" $streams $jobs $w $r
+		jobs=$((jobs + 1))
+	done
+done
+
+if which fio >/dev/null 2>&1; then
+	setup $MAX_JOBS
+	fio --name=zram --filename=/dev/$DEV --direct=1 --rw=randrw \
+		--bs=4k --size=${MB}M --numjobs=$MAX_JOBS --offset_increment=${MB}M \
+		--buffer_compress_percentage=50 --refill_buffers \
+		--group_reporting --runtime=30 --time_based
+fi
+
+echo 1 > $SYS/reset
@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# zram_wb_test.sh - exercise zram writeback on a loop backed device
+#
+# Usage: zram_wb_test.sh [dev] [mb]
+#
+# Sets up a loop device on a scratch file as backing_dev of the given zram
+# device, fills half of the disk with incompressible data and half with
+# compressible data, then writes back huge pages and idle pages in turn.
+# After every step the data is read back and compared with what was
+# written, and the writeback counters are printed. Needs CONFIG_ZRAM
+# with CONFIG_ZRAM_WRITEBACK and losetup; works fine inside QEMU.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2.
+
+DEV=${1:-zram0}
+MB=${2:-16}
+SYS=/sys/block/$DEV
+TMP=${TMPDIR:-/tmp}/zram_wb.$$
+LOOP=
+
+[ -d $SYS ] || { echo "no such device: $DEV"; exit 1; }
+[ -f $SYS/backing_dev ] || { echo "$DEV: no writeback support"; exit 1; }
+
+cleanup() {
+	echo 1 > $SYS/reset
+	[ -n "$LOOP" ] && losetup -d $LOOP
+	rm -rf $TMP
+}
+trap cleanup EXIT
+
+fail() {
+	echo "FAIL: $*"
+	exit 1
+}
+
+stats() {
+	echo "$1: huge_pages $(cat $SYS/huge_pages) bd_count $(cat $SYS/bd_count)" \
+		"bd_reads $(cat $SYS/bd_reads) bd_writes $(cat $SYS/bd_writes)"
+}
+
+verify() {
+	dd if=/dev/$DEV of=$TMP/out bs=1M count=$MB iflag=direct 2>/dev/null
+	cmp -s $TMP/data $TMP/out || fail "data mismatch after $1"
+}
+
+mkdir -p $TMP
+dd if=/dev/zero of=$TMP/backing bs=1M count=$MB 2>/dev/null
+LOOP=$(losetup -f) || fail "no free loop device"
+losetup $LOOP $TMP/backing || fail "losetup $LOOP"
+
+echo 1 > $SYS/reset
+echo $LOOP > $SYS/backing_dev || fail "set backing_dev"
+echo ${MB}M > $SYS/disksize || fail "set disksize"
+
+# first half random (incompressible), second half text (compressible)
+dd if=/dev/urandom of=$TMP/data bs=1M count=$((MB / 2)) 2>/dev/null
+yes "zram writeback test" | head -c $((MB / 2 * 1024 * 1024)) >> $TMP/data
+dd if=$TMP/data of=/dev/$DEV bs=1M oflag=direct 2>/dev/null
+stats written
+verify write
+
+echo huge > $SYS/writeback || fail "huge writeback"
+stats huge
+[ $(cat $SYS/huge_pages) -eq 0 ] || fail "huge pages left in memory"
+verify "huge writeback"
+
+echo all > $SYS/idle
+echo idle > $SYS/writeback || fail "idle writeback"
+stats idle
+verify "idle writeback"
+
+# overwriting pages on the backing device must release their blocks
+dd if=/dev/zero of=/dev/$DEV bs=1M oflag=direct 2>/dev/null
+stats overwritten
+[ $(cat $SYS/bd_count) -eq 0 ] || fail "blocks leaked on backing device"
+
+echo PASS